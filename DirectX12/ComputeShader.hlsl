@@ -12,8 +12,18 @@ cbuffer ConstantBuffer : register(b0) {
 	float time;
 };
 
-StructuredBuffer<Particle> oldPos      : register(t0);    // SRV
-RWStructuredBuffer<Particle> newPos    : register(u0);    // UAV
+// Bindless indices of the buffers of the shard being simulated
+cbuffer ParticleConstants : register(b1) {
+	uint oldPosIndex;
+	uint newPosIndex;
+};
+
+// Bindless: every view of the descriptor heap
+StructuredBuffer<Particle> srvBuffers[]   : register(t0, space1);
+RWStructuredBuffer<Particle> uavBuffers[] : register(u0, space1);
+
+#define oldPos srvBuffers[oldPosIndex]    // SRV
+#define newPos uavBuffers[newPosIndex]    // UAV
 
 [numthreads(blocksize, 1, 1)]
 void main(uint3 Gid : SV_GroupID, uint3 DTid : SV_DispatchThreadID, uint3 GTid : SV_GroupThreadID, uint GI : SV_GroupIndex) {
@@ -5,8 +5,18 @@ struct vs_out {
     float4 locPos : POSITION;
 };
 
+// Shader permutation feature, off unless the variant turns it on
+#ifndef SOFT_PARTICLES
+#define SOFT_PARTICLES 0
+#endif
+
 float4 main(vs_out input) : SV_TARGET {
+#if SOFT_PARTICLES
+    // Additive blending, alpha fades the particle out from its center
     float intensity = 0.5f - length(float2(0.5f, 0.5f) - input.locPos.xy);
     intensity = clamp(intensity, 0.0f, 0.5f) * 2.0f;
+	return float4(1, 1, 1, intensity);
+#else
 	return float4(1, 1, 1, 1);
+#endif
 }
\ No newline at end of file
@@ -20,13 +20,19 @@ cbuffer ConstantBuffer : register(b0) {
     float4x4 projection;
 };
 
-StructuredBuffer<Particle> g_bufPos;
+// Bindless index of the particle buffer of the shard being drawn
+cbuffer ParticleConstants : register(b1) {
+    uint particleBuffer;
+};
+
+// Bindless: every SRV of the descriptor heap
+StructuredBuffer<Particle> particleBuffers[] : register(t0, space1);
 
 vs_out main(vs_in input) {
     vs_out output;
 
     output.locPos = input.pos;
-    output.position = mul(mul(projection, view), mul(model, input.pos) + g_bufPos[input.id].pos);
+    output.position = mul(mul(projection, view), mul(model, input.pos) + particleBuffers[particleBuffer][input.id].pos);
     output.color = input.color * 0.1;
 
 	return output;
@@ -1,23 +1,22 @@
 #include "stdafx.h"
 
 void RestartComputeBuffer() {
-    if (prevSpaceKey || !spaceKey) { return; }
-
     //std::wstringstream ss;
     //ss << "Restart" << "\n";
     //OutputDebugString(ss.str().c_str());
 
-    if (fence[0]->GetCompletedValue() < fenceValue[0]) {
-        fence[0]->SetEventOnCompletion(fenceValue[0], fenceEvent);
-        WaitForSingleObject(fenceEvent, INFINITE);
-    }
+    timeline->WaitIdle(directQueue);
 
-    for (int i = 0; i < threadCount; i++) {
-        SuspendThread(threadHandles[i]);
-    }
+    // The compute threads park between steps, where they hold no locks, and report the
+    // last step they submitted. The buffers are recreated, none of those may still be writing them.
+    ResetEvent(computeResume);
+    InterlockedExchange(&computePauseRequested, 1);
+    WaitForMultipleObjects(threadCount, computePaused, TRUE, INFINITE);
+    std::vector<TimelinePoint> computeSteps(computePausedStep, computePausedStep + threadCount);
+    timeline->WaitAll(computeSteps);
 
     commandAllocator[0]->Reset();
-    commandList->Reset(commandAllocator[0], pipelineStateObject);
+    commandList->Reset(commandAllocator[0], GetPipelineStateObject(inputSnapshot.shaderFeatures));
 
     CreateComputeBuffer();
 
@@ -26,62 +25,78 @@ void RestartComputeBuffer() {
 
     commandQueue->ExecuteCommandLists(_countof(ppCommandLists), ppCommandLists);
 
-    fenceValue[0]++;
-    commandQueue->Signal(fence[0], fenceValue[0]);
+    timeline->Wait(timeline->Signal(directQueue));
 
-    if (fence[0]->GetCompletedValue() < fenceValue[0]) {
-        fence[0]->SetEventOnCompletion(fenceValue[0], fenceEvent);
-        WaitForSingleObject(fenceEvent, INFINITE);
-    }
-    
-    for (int i = 0; i < threadCount; i++) {
-        ResumeThread(threadHandles[i]);
-    }
+    InterlockedExchange(&computePauseRequested, 0);
+    SetEvent(computeResume);
 
     return;
 }
 
-void Update() {
-    if (GetKeyState(KEY_SPACE) & 0x8000) {
-        prevSpaceKey = spaceKey;
-        spaceKey = true;
-        RestartComputeBuffer();
-    } else {
-        prevSpaceKey = spaceKey;
-        spaceKey = false;
-    }
+// Window thread: input only changes the camera and publishes it
+void MoveCamera(POINT newCursor) {
+    float distance = 0.0f;
+    XMStoreFloat(&distance, XMVector3Length(camPosition));
 
-    if (GetKeyState(VK_LBUTTON) & 0x8000) {
-        POINT newCursor;
-        GetCursorPos(&newCursor);
+    camPosition += camRight * float(newCursor.x - cursor.x) * 0.2f;
+    camPosition += camUp    * float(newCursor.y - cursor.y) * 0.2f;
 
-        float distance = 0.0f;
-        XMStoreFloat(&distance, XMVector3Length(camPosition));
+    float newDistance = 0.0f;
+    XMStoreFloat(&newDistance, XMVector3Length(camPosition));
+    camPosition = camPosition * distance / newDistance;
 
-        camPosition += camFront * mouseZ * 0.02f;
-        camPosition += camRight * float(newCursor.x - cursor.x) * 0.2f;
-        camPosition += camUp    * float(newCursor.y - cursor.y) * 0.2f;
+    camFront = XMVector3Normalize(camTarget - camPosition);
+    camRight = XMVector3Normalize(XMVector3Cross(camFront, XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f)));
+    camUp    = XMVector3Normalize(XMVector3Cross(camRight, camFront));
 
-        float newDistance = 0.0f;
-        XMStoreFloat(&newDistance, XMVector3Length(camPosition));
-        camPosition = camPosition * distance / newDistance;
+    camTarget = XMVectorSet(0.0f, 0.0f, 0.0f, 0.0f);
+    camView = XMMatrixLookAtLH(camPosition, camTarget, camUp);
+}
 
-        camFront = XMVector3Normalize(camTarget - camPosition);
-        camRight = XMVector3Normalize(XMVector3Cross(camFront, XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f)));
-        camUp    = XMVector3Normalize(XMVector3Cross(camRight, camFront));
+void ZoomCamera(float delta) {
+    camPosition += camFront * delta * 0.002f;
+    camView = XMMatrixLookAtLH(camPosition, camTarget, camUp);
+}
 
-        camTarget = XMVectorSet(0.0f, 0.0f, 0.0f, 0.0f);
-        camView = XMMatrixLookAtLH(camPosition, camTarget, camUp);
-    }
+void PublishSnapshot() {
+    inputSnapshot.view = camView;
+    inputSnapshot.projection = camProjection;
+
+    // Only fails when the render thread is stalled, the next event retries
+    snapshotPending = !snapshots.Push(inputSnapshot);
+}
+
+// Render thread: applies the newest snapshot and records frames back to back
+DWORD WINAPI RenderThread(LPVOID) {
+    UINT restartCount = frameSnapshot.restartRequests;
+    while (!renderTerminating) {
+        snapshots.PopLatest(frameSnapshot);
+        if (frameSnapshot.restartRequests != restartCount) {
+            restartCount = frameSnapshot.restartRequests;
+            RestartComputeBuffer();
+        }
 
-    if (mouseZ != 0) {
-        camPosition += camFront * mouseZ * 0.002f;
-        camView = XMMatrixLookAtLH(camPosition, camTarget, camUp);
-        mouseZ = 0;
+        Update();
+        Render();
     }
+    return 0;
+}
 
-    GetCursorPos(&cursor);
-    
+void StartRenderThread() {
+    InterlockedExchange(&renderTerminating, 0);
+    renderThreadHandle = CreateThread(nullptr, 0, RenderThread, nullptr, 0, nullptr);
+}
+
+void StopRenderThread() {
+    if (!renderThreadHandle) return;
+    InterlockedExchange(&renderTerminating, 1);
+    WaitForSingleObject(renderThreadHandle, INFINITE);
+    CloseHandle(renderThreadHandle);
+    renderThreadHandle = NULL;
+}
+
+void Update() {
+    memoryTracker.NextFrame();
 
     XMMATRIX model = XMMatrixIdentity();
     XMVECTOR rotAxis = XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f);
@@ -91,8 +106,8 @@ void Update() {
 
     end = std::chrono::steady_clock::now();
     cbData.model = model * rotation * translation * scale;
-    cbData.view = camView;
-    cbData.projection = camProjection;
+    cbData.view = frameSnapshot.view;
+    cbData.projection = frameSnapshot.projection;
     cbData.time = std::chrono::duration_cast<std::chrono::microseconds>(end - begin).count() / 1000.0f;
     begin = std::chrono::steady_clock::now();
 
@@ -113,12 +128,17 @@ void InitCamera() {
     XMStoreFloat3(&tempFront, camFront);
     yaw = XMConvertToDegrees(atan2(tempFront.z, tempFront.x));
     pitch = XMConvertToDegrees(atan2(tempFront.y, -tempFront.z));
+
+    // The render thread starts from the initial camera
+    PublishSnapshot();
+    frameSnapshot = inputSnapshot;
 }
 
 void UpdatePipeline() {
     HRESULT hr;
 
     commandAllocator[frameIndex]->Reset();
+    ID3D12PipelineState* pipelineStateObject = GetPipelineStateObject(frameSnapshot.shaderFeatures);
     commandList->Reset(commandAllocator[frameIndex], pipelineStateObject);
     
     commandList->SetPipelineState(pipelineStateObject);
@@ -157,19 +177,36 @@ void UpdatePipeline() {
     commandList->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
     commandList->IASetVertexBuffers(0, 1, &vertexBufferView);
     commandList->IASetIndexBuffer(&indexBufferView);
+    memoryTracker.Use(constantBuffer);
+    memoryTracker.Use(vertexBuffer);
+    memoryTracker.Use(indexBuffer);
 
 
-    ID3D12DescriptorHeap* ppHeaps[] = { srvUavDescriptorHeap };
+    ID3D12DescriptorHeap* ppHeaps[] = { descriptorHeap.GetHeap() };
     commandList->SetDescriptorHeaps(_countof(ppHeaps), ppHeaps);
 
-    for (UINT i = 0; i < threadCount; i++) {
-        const UINT srvIdx = i + (srvIndex[i] == 0 ? UINT(SrvParticle0) : UINT(SrvParticle1));
+    commandList->SetGraphicsRootDescriptorTable(GraphicsRootBindless, descriptorHeap.GetBindlessTable());
 
-        D3D12_GPU_DESCRIPTOR_HANDLE srvHandle = srvUavDescriptorHeap->GetGPUDescriptorHandleForHeapStart();
-        srvHandle.ptr += size_t(srvIdx) * size_t(srvUavDescriptorSize);
-        commandList->SetGraphicsRootDescriptorTable(GraphicsRootSRVTable, srvHandle);
+    // Render signals the next value of the direct queue right after this list. The drawn
+    // buffer is marked with it before it is confirmed still published: a step that
+    // overwrites it once the other buffer is published then sees the mark and waits for
+    // this frame on the GPU.
+    UINT64 frameValue = timeline->GetLastSignaled(directQueue).value + 1;
+    for (UINT i = 0; i < threadCount; i++) {
+        // The simulation alternates between both, the tracker is only used from this thread
+        memoryTracker.Use(particleBuffer0[i]);
+        memoryTracker.Use(particleBuffer1[i]);
+
+        LONG buffer = InterlockedCompareExchange(&drawSrvIndex[i], 0, 0);
+        for (;;) {
+            InterlockedExchange64(&drawnFenceValue[i][buffer], static_cast<LONG64>(frameValue));
+            LONG published = InterlockedCompareExchange(&drawSrvIndex[i], 0, 0);
+            if (published == buffer) break;
+            buffer = published;
+        }
+        commandList->SetGraphicsRoot32BitConstant(GraphicsRootParticles, particleViews[i].index + ParticleSrv0 + buffer, 0);
 
-        commandList->DrawIndexedInstanced(36, particleCount, 0, 0, 0);
+        commandList->DrawIndexedInstanced(indexCount, particleCount, 0, 0, 0);
     }
 
     D3D12_RESOURCE_BARRIER resourceBarrierToPresent = {};
@@ -187,18 +224,10 @@ void UpdatePipeline() {
 
 void UpdateComputePipeline(UINT threadIndex) {
 
-    UINT srvIdx;
-    UINT uavIdx;
-    ID3D12Resource* pUavResource;
-    if (srvIndex[threadIndex] == 0) {
-        srvIdx = SrvParticle0;
-        uavIdx = UavParticle1;
-        pUavResource = particleBuffer1[threadIndex];
-    } else {
-        srvIdx = SrvParticle1;
-        uavIdx = UavParticle0;
-        pUavResource = particleBuffer0[threadIndex];
-    }
+    // Reads the current buffer, writes the other one
+    UINT srvIdx = ParticleSrv0 + srvIndex[threadIndex];
+    UINT uavIdx = ParticleUav0 + 1 - srvIndex[threadIndex];
+    ID3D12Resource* pUavResource = srvIndex[threadIndex] == 0 ? particleBuffer1[threadIndex] : particleBuffer0[threadIndex];
 
     computeCommandList[threadIndex]->SetPipelineState(computeStateObject);
     computeCommandList[threadIndex]->SetComputeRootSignature(computeRootSignature);
@@ -212,18 +241,14 @@ void UpdateComputePipeline(UINT threadIndex) {
     resourceBarrierToUAV.Transition.Subresource = D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES;
     computeCommandList[threadIndex]->ResourceBarrier(1, &resourceBarrierToUAV);
 
-    ID3D12DescriptorHeap* ppHeaps[] = { srvUavDescriptorHeap };
+    ID3D12DescriptorHeap* ppHeaps[] = { descriptorHeap.GetHeap() };
     computeCommandList[threadIndex]->SetDescriptorHeaps(_countof(ppHeaps), ppHeaps);
 
-    D3D12_GPU_DESCRIPTOR_HANDLE srvHandle = srvUavDescriptorHeap->GetGPUDescriptorHandleForHeapStart();
-    srvHandle.ptr += (size_t(srvIdx) + threadIndex) * size_t(srvUavDescriptorSize);
-
-    D3D12_GPU_DESCRIPTOR_HANDLE uavHandle = srvUavDescriptorHeap->GetGPUDescriptorHandleForHeapStart();
-    uavHandle.ptr += (size_t(uavIdx) + threadIndex) * size_t(srvUavDescriptorSize);
+    UINT particleIndices[] = { particleViews[threadIndex].index + srvIdx, particleViews[threadIndex].index + uavIdx };
 
     computeCommandList[threadIndex]->SetComputeRootConstantBufferView(ComputeRootCBV, constantBuffer->GetGPUVirtualAddress());
-    computeCommandList[threadIndex]->SetComputeRootDescriptorTable(ComputeRootSRVTable, srvHandle);
-    computeCommandList[threadIndex]->SetComputeRootDescriptorTable(ComputeRootUAVTable, uavHandle);
+    computeCommandList[threadIndex]->SetComputeRootDescriptorTable(ComputeRootBindless, descriptorHeap.GetBindlessTable());
+    computeCommandList[threadIndex]->SetComputeRoot32BitConstants(ComputeRootParticles, _countof(particleIndices), particleIndices, 0);
 
     computeCommandList[threadIndex]->Dispatch(static_cast<int>(ceil(particleCount / 128.0f)), 1, 1);
 
@@ -249,7 +274,7 @@ void Render() {
      
     commandQueue->ExecuteCommandLists(_countof(ppCommandLists), ppCommandLists);
 
-    commandQueue->Signal(fence[frameIndex], fenceValue[frameIndex]);
+    frameFenceValue[frameIndex] = timeline->Signal(directQueue).value;
 
     swapChain->Present(0, 0);
 }
@@ -258,42 +283,48 @@ void WaitForPreviousFrame() {
 
     frameIndex = swapChain->GetCurrentBackBufferIndex();
 
-    if (fence[frameIndex]->GetCompletedValue() < fenceValue[frameIndex]) {
-        fence[frameIndex]->SetEventOnCompletion(fenceValue[frameIndex], fenceEvent);
-
-        WaitForSingleObject(fenceEvent, INFINITE);
-    }
-
-    fenceValue[frameIndex]++;
+    // Only the last frame rendered into this back buffer has to be finished
+    timeline->Wait({ directQueue, frameFenceValue[frameIndex] });
 }
 
 void mainloop() {
     MSG msg;
     ZeroMemory(&msg, sizeof(MSG));
 
-    while (true) {
-        if (PeekMessage(&msg, NULL, 0, 0, PM_REMOVE)) {
-            if (msg.message == WM_QUIT) break;
-
-            TranslateMessage(&msg);
-            DispatchMessage(&msg);
-        }
-        else {
-            Update();
-            Render();
-        }
+    // Frames are recorded on the render thread, this thread sleeps until the next event
+    StartRenderThread();
+    while (GetMessage(&msg, NULL, 0, 0) > 0) {
+        TranslateMessage(&msg);
+        DispatchMessage(&msg);
     }
+    StopRenderThread();
 }
 
 void Cleanup() {
     InterlockedExchange(&terminating, 1);
     WaitForMultipleObjects(threadCount, threadHandles, TRUE, INFINITE);
 
+    // The compute queues are released below, let their last steps and callbacks finish
+    if (timeline) {
+        std::vector<TimelinePoint> computeSteps;
+        for (int i = 0; i < threadCount; i++) computeSteps.push_back(timeline->GetLastSignaled(computeQueue[i]));
+        timeline->WaitAll(computeSteps);
+        timeline->Flush();
+    }
+
+    OutputDebugString(memoryTracker.Report().c_str());
+
 
     for (int n = 0; n < threadCount; n++) {
         CloseHandle(threadHandles[n]);
-        CloseHandle(computeFenceEvent[n]);
+        if (computePaused[n]) CloseHandle(computePaused[n]);
     }
+    if (computeResume) CloseHandle(computeResume);
+
+    delete timeline;
+    timeline = nullptr;
+    delete fenceBackend;
+    fenceBackend = nullptr;
 
     for (int i = 0; i < threadCount; ++i) {
         SAFE_RELEASE(particleBuffer0[i]);
@@ -304,7 +335,7 @@ void Cleanup() {
     SAFE_RELEASE(dsDescriptorHeap);
 
     for (int i = 0; i < threadCount; ++i) {
-        SAFE_RELEASE(computeCommandAllocator[i]);
+        for (int n = 0; n < computeFrameCount; ++n) SAFE_RELEASE(computeCommandAllocator[i][n]);
         SAFE_RELEASE(computeCommandQueue[i]);
         SAFE_RELEASE(computeCommandList[i]);
     };
@@ -312,7 +343,6 @@ void Cleanup() {
     for (int i = 0; i < frameBufferCount; ++i) {
         SAFE_RELEASE(renderTargets[i]);
         SAFE_RELEASE(commandAllocator[i]);
-        SAFE_RELEASE(fence[i]);
     };
 
     SAFE_RELEASE(constantBuffer);
@@ -322,11 +352,13 @@ void Cleanup() {
     SAFE_RELEASE(computeStateObject);
     SAFE_RELEASE(computeRootSignature);
 
-    SAFE_RELEASE(pipelineStateObject);
+    for (ID3D12PipelineState*& pipelineStateObject : pipelineStateObjects) {
+        SAFE_RELEASE(pipelineStateObject);
+    }
     SAFE_RELEASE(rootSignature);
 
     SAFE_RELEASE(commandList);
-    SAFE_RELEASE(srvUavDescriptorHeap);
+    descriptorHeap = D3D12DescriptorHeap();
     SAFE_RELEASE(rtvDescriptorHeap);
     SAFE_RELEASE(swapChain);
     SAFE_RELEASE(commandQueue);
@@ -334,30 +366,55 @@ void Cleanup() {
 }
 
 bool InitD3D() {
-    HRESULT hr;
     IDXGIFactory4* dxgiFactory;
     CreateDXGIFactory1(IID_PPV_ARGS(&dxgiFactory));
     CreateDevice(dxgiFactory);
+    residencyDevice = D3D12ResidencyDevice(device);
+    memoryTracker.Init(&residencyDevice);
+    memoryTracker.SetBudgets(memoryBudgets);
     CreateCommandQueue();
     CreateSwapChain(dxgiFactory);
     CreateRTV();
     CreateCommandList();
     CreateFence();
+    if (!shaderArchive.Open(GetExecutableRelativePath(L"Shaders.bin").c_str())) {
+        shaderCache.Init(L"ShaderCache");
+    }
+    pipelineCache.Init(device, L"PipelineCache.bin");
     CreateGraphicsPipelineStateObj();
 
     CreateComputeDescriptorHeap();
     CreateComputeRootSignature();
     CreateComputePipelineStateObj();
+    if (!pipelineCache.Save()) OutputDebugStringW(L"Cannot write the pipeline library\n");
+
+    // create input buffer, the cube mesh file is written from the built-in arrays on first run
+    if (GetFileAttributesW(L"Cube.mesh") == INVALID_FILE_ATTRIBUTES) {
+        WriteMeshFile(L"Cube.mesh", vList, sizeof(Vertex), _countof(vList),
+            reinterpret_cast<const UINT32*>(iList), _countof(iList));
+    }
 
-    // create input buffer
+    const BYTE* vertexData = reinterpret_cast<const BYTE*>(vList);
+    const BYTE* indexData = reinterpret_cast<const BYTE*>(iList);
     int vBufferSize = sizeof(vList);
-    CreateBufferTransition(vBufferSize, &vertexBuffer, reinterpret_cast<BYTE*>(vList));
+    int iBufferSize = sizeof(iList);
+    indexCount = _countof(iList);
+
+    MappedMesh cube;
+    if (cube.Open(L"Cube.mesh") && cube.Header().vertexStride == sizeof(Vertex) && cube.Header().indexCount) {
+        vertexData = static_cast<const BYTE*>(cube.Vertices());
+        indexData = static_cast<const BYTE*>(cube.Indices());
+        vBufferSize = static_cast<int>(cube.Header().vertexSize);
+        iBufferSize = static_cast<int>(cube.Header().indexSize);
+        indexCount = static_cast<UINT>(cube.Header().indexCount);
+    }
+
+    CreateBufferTransition(vBufferSize, &vertexBuffer, vertexData, L"Vertex Buffer");
     vertexBufferView.BufferLocation = vertexBuffer->GetGPUVirtualAddress();
     vertexBufferView.StrideInBytes = sizeof(Vertex);
     vertexBufferView.SizeInBytes = vBufferSize;
 
-    int iBufferSize = sizeof(iList);
-    CreateBufferTransition(iBufferSize, &indexBuffer, reinterpret_cast<BYTE*>(iList));
+    CreateBufferTransition(iBufferSize, &indexBuffer, indexData, L"Index Buffer");
     indexBufferView.BufferLocation = indexBuffer->GetGPUVirtualAddress();
     indexBufferView.Format = DXGI_FORMAT_R32_UINT;
     indexBufferView.SizeInBytes = iBufferSize;
@@ -373,9 +430,7 @@ bool InitD3D() {
     ID3D12CommandList* ppCommandLists[] = { commandList };
     commandQueue->ExecuteCommandLists(_countof(ppCommandLists), ppCommandLists);
 
-    fenceValue[frameIndex]++;
-    hr = commandQueue->Signal(fence[frameIndex], fenceValue[frameIndex]);
-    if (FAILED(hr)) Running = false; 
+    frameFenceValue[frameIndex] = timeline->Signal(directQueue).value;
 
     
     CreateComputeCommandList();
@@ -393,13 +448,24 @@ void CreateComputeCommandList() {
         cqDesc.Type = D3D12_COMMAND_LIST_TYPE_COMPUTE;
 
         device->CreateCommandQueue(&cqDesc, IID_PPV_ARGS(&computeCommandQueue[i]));
-        device->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_COMPUTE, IID_PPV_ARGS(&computeCommandAllocator[i]));
-        device->CreateCommandList(0, D3D12_COMMAND_LIST_TYPE_COMPUTE, computeCommandAllocator[i], nullptr, IID_PPV_ARGS(&computeCommandList[i]));
-        device->CreateFence(0, D3D12_FENCE_FLAG_SHARED, IID_PPV_ARGS(&computeFence[i]));
+        for (int n = 0; n < computeFrameCount; n++) {
+            device->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_COMPUTE, IID_PPV_ARGS(&computeCommandAllocator[i][n]));
+        }
+        device->CreateCommandList(0, D3D12_COMMAND_LIST_TYPE_COMPUTE, computeCommandAllocator[i][0], nullptr, IID_PPV_ARGS(&computeCommandList[i]));
+        // Closed, the compute thread resets it before every step
+        computeCommandList[i]->Close();
+
+        // Compute queues share the timeline, fences are created by the backend
+        computeQueue[i] = fenceBackend->AddQueue(computeCommandQueue[i], L"Compute Queue Fence");
+    }
 
+    // Start the threads once every queue is registered, the backend is not
+    // safe to grow while other threads wait on it
+    computeResume = CreateEvent(nullptr, TRUE, FALSE, nullptr);
+    for (int i = 0; i < threadCount; i++) {
         threadData[i].idx = i;
+        computePaused[i] = CreateEvent(nullptr, FALSE, FALSE, nullptr);
 
-        computeFenceEvent[i] = CreateEvent(nullptr, FALSE, FALSE, nullptr);
         threadHandles[i] = CreateThread(
             nullptr, 0,
             reinterpret_cast<LPTHREAD_START_ROUTINE>(ComputeThread),
@@ -416,28 +482,49 @@ void CreateComputeCommandList() {
 
 DWORD ComputeThread(ThreadData* pThreadData) {
     int threadIndex = pThreadData->idx;
+    int frame = 0;
+    TimelinePoint lastStep = { computeQueue[threadIndex], 0 };
+    // The initial data stands in for the output of a step before the first one
+    LONG lastWritten = static_cast<LONG>(1 - srvIndex[threadIndex]);
 
     while (0 == InterlockedCompareExchange(&terminating, 0, 0)) {
+        if (InterlockedCompareExchange(&computePauseRequested, 0, 0)) {
+            computePausedStep[threadIndex] = lastStep;
+            SetEvent(computePaused[threadIndex]);
+            WaitForSingleObject(computeResume, INFINITE);
+            continue;
+        }
+
+        // Only the step that last used this allocator has to be finished, the one
+        // submitted after it keeps the queue busy meanwhile
+        timeline->Wait({ computeQueue[threadIndex], computeFenceValue[threadIndex][frame] });
+        computeCommandAllocator[threadIndex][frame]->Reset();
+        computeCommandList[threadIndex]->Reset(computeCommandAllocator[threadIndex][frame], computeStateObject);
+
         // Swap the indices to the SRV and UAV.
         srvIndex[threadIndex] = 1 - srvIndex[threadIndex];
 
         UpdateComputePipeline(threadIndex);
 
+        // The step overwrites the buffer the render thread draws until the output of the
+        // previous step is published. Once it is, every frame drawing this buffer has
+        // marked it, and the compute queue waits for the last of them.
+        timeline->Wait(lastStep);
+        InterlockedExchange(&drawSrvIndex[threadIndex], lastWritten);
+        LONG written = static_cast<LONG>(1 - srvIndex[threadIndex]);
+        UINT64 drawn = static_cast<UINT64>(InterlockedCompareExchange64(&drawnFenceValue[threadIndex][written], 0, 0));
+        computeCommandQueue[threadIndex]->Wait(fenceBackend->GetFence(directQueue), drawn);
+
         ID3D12CommandList* ppCommandLists[] = { computeCommandList[threadIndex] };
 
         computeCommandQueue[threadIndex]->ExecuteCommandLists(1, ppCommandLists);
 
-        // Wait for the compute shader to complete the simulation.
-        computeFenceValue[threadIndex]++;
-        computeCommandQueue[threadIndex]->Signal(computeFence[threadIndex], computeFenceValue[threadIndex]);
-        if (computeFence[threadIndex]->GetCompletedValue() < computeFenceValue[threadIndex]) {
-            computeFence[threadIndex]->SetEventOnCompletion(computeFenceValue[threadIndex], computeFenceEvent[threadIndex]);
-            WaitForSingleObject(computeFenceEvent[threadIndex], INFINITE);
-        }
-
-        computeCommandAllocator[threadIndex]->Reset();
-        computeCommandList[threadIndex]->Reset(computeCommandAllocator[threadIndex], computeStateObject);
+        TimelinePoint step = timeline->Signal(computeQueue[threadIndex]);
+        computeFenceValue[threadIndex][frame] = step.value;
+        lastStep = step;
+        lastWritten = written;
 
+        frame = (frame + 1) % computeFrameCount;
     }
 
     return 0;
@@ -457,8 +544,10 @@ void CreateComputeBuffer() {
 
     for (UINT i = 0; i < threadCount; i++) {
         CreateBufferTransition(dataSize, &particleBuffer0[i], reinterpret_cast<BYTE*>(data.data()),
+            L"Particle Buffer 0", MemoryCategory::Instance,
             D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
         CreateBufferTransition(dataSize, &particleBuffer1[i], reinterpret_cast<BYTE*>(data.data()),
+            L"Particle Buffer 1", MemoryCategory::Instance,
             D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
 
         D3D12_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
@@ -470,12 +559,9 @@ void CreateComputeBuffer() {
         srvDesc.Buffer.StructureByteStride = sizeof(Particle);
         srvDesc.Buffer.Flags = D3D12_BUFFER_SRV_FLAG_NONE;
 
-        D3D12_CPU_DESCRIPTOR_HANDLE srvHandle0 = srvUavDescriptorHeap->GetCPUDescriptorHandleForHeapStart();
-        D3D12_CPU_DESCRIPTOR_HANDLE srvHandle1 = srvUavDescriptorHeap->GetCPUDescriptorHandleForHeapStart();
-        srvHandle0.ptr += (size_t(SrvParticle0) + i) * size_t(srvUavDescriptorSize);
-        srvHandle1.ptr += (size_t(SrvParticle1) + i) * size_t(srvUavDescriptorSize);
-        device->CreateShaderResourceView(particleBuffer0[i], &srvDesc, srvHandle0);
-        device->CreateShaderResourceView(particleBuffer1[i], &srvDesc, srvHandle1);
+        // Views are written to the staging heap, then copied in a single batch
+        device->CreateShaderResourceView(particleBuffer0[i], &srvDesc, particleStaging[i].Cpu(ParticleSrv0));
+        device->CreateShaderResourceView(particleBuffer1[i], &srvDesc, particleStaging[i].Cpu(ParticleSrv1));
 
         D3D12_UNORDERED_ACCESS_VIEW_DESC uavDesc = {};
         uavDesc.Format = DXGI_FORMAT_UNKNOWN;
@@ -486,104 +572,42 @@ void CreateComputeBuffer() {
         uavDesc.Buffer.CounterOffsetInBytes = 0;
         uavDesc.Buffer.Flags = D3D12_BUFFER_UAV_FLAG_NONE;
 
-        D3D12_CPU_DESCRIPTOR_HANDLE uavHandle0 = srvUavDescriptorHeap->GetCPUDescriptorHandleForHeapStart();
-        D3D12_CPU_DESCRIPTOR_HANDLE uavHandle1 = srvUavDescriptorHeap->GetCPUDescriptorHandleForHeapStart();
-        uavHandle0.ptr += (size_t(UavParticle0) + i) * size_t(srvUavDescriptorSize);
-        uavHandle1.ptr += (size_t(UavParticle1) + i) * size_t(srvUavDescriptorSize);
-        device->CreateUnorderedAccessView(particleBuffer0[i], nullptr, &uavDesc, uavHandle0);
-        device->CreateUnorderedAccessView(particleBuffer1[i], nullptr, &uavDesc, uavHandle1);
+        device->CreateUnorderedAccessView(particleBuffer0[i], nullptr, &uavDesc, particleStaging[i].Cpu(ParticleUav0));
+        device->CreateUnorderedAccessView(particleBuffer1[i], nullptr, &uavDesc, particleStaging[i].Cpu(ParticleUav1));
+
+        descriptorHeap.StageCopy(particleViews[i], 0, particleStaging[i].Cpu(), ParticleViewCount);
     }
+    descriptorHeap.FlushCopies();
     return;
 }
 
 void CreateComputeDescriptorHeap() {
-    D3D12_DESCRIPTOR_HEAP_DESC srvHeapDesc = {};
-    srvHeapDesc.NumDescriptors = DescriptorCount;
-    srvHeapDesc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV;
-    srvHeapDesc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_SHADER_VISIBLE;
-    device->CreateDescriptorHeap(&srvHeapDesc, IID_PPV_ARGS(&srvUavDescriptorHeap));
-    srvUavDescriptorSize = device->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
+    descriptorHeap.Init(device, D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV,
+        ParticleViewCount * threadCount, 0, ParticleViewCount * threadCount);
+
+    // Views are rewritten in place whenever the simulation restarts
+    for (int i = 0; i < threadCount; i++) {
+        particleViews[i] = descriptorHeap.AllocatePersistent(ParticleViewCount);
+        particleStaging[i] = descriptorHeap.AllocateStaging(ParticleViewCount);
+    }
 }
 
 void CreateComputeRootSignature() {
-    D3D12_DESCRIPTOR_RANGE1  descriptorTableRanges[2];
-    descriptorTableRanges[0].RangeType = D3D12_DESCRIPTOR_RANGE_TYPE_SRV;
-    descriptorTableRanges[0].NumDescriptors = 1;
-    descriptorTableRanges[0].BaseShaderRegister = 0;
-    descriptorTableRanges[0].RegisterSpace = 0;
-    descriptorTableRanges[0].OffsetInDescriptorsFromTableStart = D3D12_DESCRIPTOR_RANGE_OFFSET_APPEND;
-    descriptorTableRanges[0].Flags = D3D12_DESCRIPTOR_RANGE_FLAG_DESCRIPTORS_VOLATILE;
-
-    descriptorTableRanges[1].RangeType = D3D12_DESCRIPTOR_RANGE_TYPE_UAV;
-    descriptorTableRanges[1].NumDescriptors = 1;
-    descriptorTableRanges[1].BaseShaderRegister = 0;
-    descriptorTableRanges[1].RegisterSpace = 0;
-    descriptorTableRanges[1].OffsetInDescriptorsFromTableStart = D3D12_DESCRIPTOR_RANGE_OFFSET_APPEND;
-    descriptorTableRanges[1].Flags = D3D12_DESCRIPTOR_RANGE_FLAG_DATA_VOLATILE;
-
-
-    D3D12_ROOT_DESCRIPTOR_TABLE1 descriptorTables[2];
-    descriptorTables[0].NumDescriptorRanges = 1;
-    descriptorTables[0].pDescriptorRanges = &descriptorTableRanges[0];
-    descriptorTables[1].NumDescriptorRanges = 1;
-    descriptorTables[1].pDescriptorRanges = &descriptorTableRanges[1];
-
-    D3D12_ROOT_PARAMETER1 rootParameters[ComputeRootParametersCount];
-    D3D12_ROOT_DESCRIPTOR1 rootDesc;
-    rootDesc.ShaderRegister = 0;
-    rootDesc.RegisterSpace = 0;
-    rootDesc.Flags = D3D12_ROOT_DESCRIPTOR_FLAG_DATA_STATIC;
-
-    rootParameters[ComputeRootCBV].ParameterType = D3D12_ROOT_PARAMETER_TYPE_CBV;
-    rootParameters[ComputeRootCBV].Descriptor = rootDesc;
-    rootParameters[ComputeRootCBV].ShaderVisibility = D3D12_SHADER_VISIBILITY_ALL;
-
-    rootParameters[ComputeRootSRVTable].ParameterType = D3D12_ROOT_PARAMETER_TYPE_DESCRIPTOR_TABLE;
-    rootParameters[ComputeRootSRVTable].DescriptorTable = descriptorTables[0];
-    rootParameters[ComputeRootSRVTable].ShaderVisibility = D3D12_SHADER_VISIBILITY_ALL;
-
-    rootParameters[ComputeRootUAVTable].ParameterType = D3D12_ROOT_PARAMETER_TYPE_DESCRIPTOR_TABLE;
-    rootParameters[ComputeRootUAVTable].DescriptorTable = descriptorTables[1];
-    rootParameters[ComputeRootUAVTable].ShaderVisibility = D3D12_SHADER_VISIBILITY_ALL;
-
-    D3D12_VERSIONED_ROOT_SIGNATURE_DESC rootSignatureDesc;
-    rootSignatureDesc.Version = D3D_ROOT_SIGNATURE_VERSION_1_1;
-    rootSignatureDesc.Desc_1_1.NumParameters = _countof(rootParameters);
-    rootSignatureDesc.Desc_1_1.pParameters = rootParameters;
-    rootSignatureDesc.Desc_1_1.NumStaticSamplers = 0;
-    rootSignatureDesc.Desc_1_1.pStaticSamplers = nullptr;
-    rootSignatureDesc.Desc_1_1.Flags = D3D12_ROOT_SIGNATURE_FLAG_NONE;
-
-    ID3DBlob* signature;
-    D3D12SerializeVersionedRootSignature(&rootSignatureDesc, &signature, nullptr);
-
-    device->CreateRootSignature(0, signature->GetBufferPointer(), signature->GetBufferSize(), IID_PPV_ARGS(&computeRootSignature));
+    ID3DBlob* signature = ComputeRootLayout::Serialize();
+    computeRootSignature = pipelineCache.GetRootSignature(signature->GetBufferPointer(), signature->GetBufferSize()).Detach();
 }
 
 HRESULT CreateComputePipelineStateObj() {
-    ID3DBlob* computeShader;
-    ID3DBlob* errorBuff;
-
-    HRESULT hr = D3DCompileFromFile(L"ComputeShader.hlsl",
-        nullptr, nullptr,
-        "main", "cs_5_0",
-        D3DCOMPILE_DEBUG | D3DCOMPILE_SKIP_OPTIMIZATION, 0,
-        &computeShader, &errorBuff);
-
-    if (FAILED(hr)) {
-        OutputDebugStringA((char*)errorBuff->GetBufferPointer());
-        return hr;
-    }
-
     D3D12_SHADER_BYTECODE computeShaderBytecode = {};
-    computeShaderBytecode.BytecodeLength = computeShader->GetBufferSize();
-    computeShaderBytecode.pShaderBytecode = computeShader->GetBufferPointer();
+    HRESULT hr = CompileShader(L"ComputeShader.hlsl", "cs_5_1", &computeShaderBytecode);
+    if (FAILED(hr)) return hr;
 
     D3D12_COMPUTE_PIPELINE_STATE_DESC computePsoDesc = {};
     computePsoDesc.pRootSignature = computeRootSignature;
     computePsoDesc.CS = computeShaderBytecode;
 
-    return device->CreateComputePipelineState(&computePsoDesc, IID_PPV_ARGS(&computeStateObject));
+    computeStateObject = pipelineCache.GetComputePipeline(computePsoDesc).Detach();
+    return computeStateObject ? S_OK : E_FAIL;
 }
 
 void CreateDevice(IDXGIFactory4* dxgiFactory) {
@@ -659,6 +683,7 @@ void CreateRTV() {
 
     for (int i = 0; i < frameBufferCount; i++) {
         swapChain->GetBuffer(i, IID_PPV_ARGS(&renderTargets[i]));
+        memoryTracker.Track(renderTargets[i], L"Back Buffer", MemoryCategory::RenderTarget, ResidencyPriority::Pinned);
         device->CreateRenderTargetView(renderTargets[i], nullptr, rtvHandle);
         rtvHandle.ptr += rtvDescriptorSize;
     }
@@ -673,15 +698,15 @@ void CreateCommandList() {
 }
 
 void CreateFence() {
+    fenceBackend = new D3D12FenceBackend(device);
+    directQueue = fenceBackend->AddQueue(commandQueue, L"Direct Queue Fence");
+    timeline = new Timeline(fenceBackend);
     for (int i = 0; i < frameBufferCount; i++) {
-        device->CreateFence(0, D3D12_FENCE_FLAG_NONE, IID_PPV_ARGS(&fence[i]));
-        fenceValue[i] = 0;
+        frameFenceValue[i] = 0;
     }
-
-    fenceEvent = CreateEvent(nullptr, FALSE, FALSE, nullptr);
 }
 
-void CreateBufferTransition(int bufferSize, ID3D12Resource** dstBuffer, BYTE* data, D3D12_RESOURCE_FLAGS dstFlags, D3D12_RESOURCE_STATES dstStates) {
+void CreateBufferTransition(int bufferSize, ID3D12Resource** dstBuffer, const BYTE* data, LPCWSTR name, MemoryCategory category, D3D12_RESOURCE_FLAGS dstFlags, D3D12_RESOURCE_STATES dstStates) {
 
     // create upload universal buffer
     D3D12_RESOURCE_DESC resourceDescUpload = {};
@@ -712,7 +737,8 @@ void CreateBufferTransition(int bufferSize, ID3D12Resource** dstBuffer, BYTE* da
         D3D12_RESOURCE_STATE_GENERIC_READ,
         nullptr,
         IID_PPV_ARGS(&srcBuffer));
-    srcBuffer->SetName(L"Buffer Upload Resource Heap");
+    std::wstring uploadName = std::wstring(name) + L" Upload Resource Heap";
+    memoryTracker.Track(srcBuffer, uploadName.c_str(), MemoryCategory::Upload);
 
     // create default GPU buffer
     D3D12_RESOURCE_DESC resourceDescDefault = resourceDescUpload;
@@ -732,7 +758,7 @@ void CreateBufferTransition(int bufferSize, ID3D12Resource** dstBuffer, BYTE* da
         D3D12_RESOURCE_STATE_COPY_DEST,
         nullptr,
         IID_PPV_ARGS(dstBuffer));
-    (*dstBuffer)->SetName(L"Buffer Default Resource Heap");
+    memoryTracker.Track(*dstBuffer, name, category);
 
     // copy the data from the upload heap to the default heap
     BYTE* pData;
@@ -804,87 +830,98 @@ void CreateDepthStencilBuffer() {
     );
 
     dsDescriptorHeap->SetName(L"Depth/Stencil Resource Heap");
+    memoryTracker.Track(depthStencilBuffer, L"Depth/Stencil Buffer", MemoryCategory::RenderTarget, ResidencyPriority::Pinned);
 
     device->CreateDepthStencilView(depthStencilBuffer, &depthStencilDesc, dsDescriptorHeap->GetCPUDescriptorHandleForHeapStart());
 
 
 }
 
-HRESULT CreateGraphicsPipelineStateObj() {
-    ID3DBlob* vertexShader;
-    ID3DBlob* errorBuff;
-
-    HRESULT hr = D3DCompileFromFile(L"VertexShader.hlsl",
-        nullptr, nullptr,
-        "main", "vs_5_0",
-        D3DCOMPILE_DEBUG | D3DCOMPILE_SKIP_OPTIMIZATION, 0,
-        &vertexShader, &errorBuff);
-
-    if (FAILED(hr)) {
-        OutputDebugStringA((char*)errorBuff->GetBufferPointer());
-        return hr;
-    }
+HRESULT CompileShader(LPCWSTR fileName, LPCSTR target, D3D12_SHADER_BYTECODE* bytecode, const ShaderDefines& defines, UINT32 flags) {
+    ShaderRequest request;
+    request.fileName = fileName;
+    request.entryPoint = "main";
+    request.target = target;
+    request.defines = defines;
+    request.flags = flags;
+    request.compiler = "d3dcompiler_" + std::to_string(D3D_COMPILER_VERSION);
+
+    // Points into the mapping, which stays open until exit
+    if (shaderArchive.Find(request, bytecode)) return S_OK;
+
+    HRESULT hr = E_FAIL;
+    const ShaderBytecode* cached = shaderCache.GetOrCompile(request, [&](ShaderBytecode* output) {
+        std::vector<D3D_SHADER_MACRO> macros;
+        for (const auto& define : request.defines) {
+            macros.push_back({ define.first.c_str(), define.second.c_str() });
+        }
+        macros.push_back({ nullptr, nullptr });
+
+        ID3DBlob* shader;
+        ID3DBlob* errorBuff;
+        hr = D3DCompileFromFile(fileName,
+            macros.data(), nullptr,
+            "main", target,
+            request.flags, 0,
+            &shader, &errorBuff);
+
+        if (FAILED(hr)) {
+            OutputDebugStringA((char*)errorBuff->GetBufferPointer());
+            return false;
+        }
 
-    D3D12_SHADER_BYTECODE vertexShaderBytecode = {};
-    vertexShaderBytecode.BytecodeLength = vertexShader->GetBufferSize();
-    vertexShaderBytecode.pShaderBytecode = vertexShader->GetBufferPointer();
-
-    ID3DBlob* pixelShader;
-    hr = D3DCompileFromFile(L"PixelShader.hlsl",
-        nullptr, nullptr,
-        "main", "ps_5_0",
-        D3DCOMPILE_DEBUG | D3DCOMPILE_SKIP_OPTIMIZATION, 0,
-        &pixelShader, &errorBuff);
-
-    if (FAILED(hr)) {
-        OutputDebugStringA((char*)errorBuff->GetBufferPointer());
-        return hr;
+        const BYTE* data = static_cast<const BYTE*>(shader->GetBufferPointer());
+        output->assign(data, data + shader->GetBufferSize());
+        SAFE_RELEASE(shader);
+        return true;
+    });
+    if (!cached) return hr;
+
+    bytecode->BytecodeLength = cached->size();
+    bytecode->pShaderBytecode = cached->data();
+    return S_OK;
+}
+
+bool BuildShaderArchive(LPCWSTR fileName) {
+    struct Shader { LPCWSTR fileName; LPCSTR target; ShaderDefines defines; };
+    std::vector<Shader> shaders = {
+        { L"ComputeShader.hlsl", "cs_5_1" },
+        { L"VertexShader.hlsl", "vs_5_1" },
+    };
+    // Every pixel shader variant, as CreateGraphicsPipelineStateObj asks for them
+    for (UINT32 features : { 0u, UINT32(ShaderFeatureSoftParticles) }) {
+        shaders.push_back({ L"PixelShader.hlsl", "ps_5_1", GetShaderFeatureDefines(features, ParticleFeatures) });
     }
 
-    D3D12_SHADER_BYTECODE pixelShaderBytecode = {};
-    pixelShaderBytecode.BytecodeLength = pixelShader->GetBufferSize();
-    pixelShaderBytecode.pShaderBytecode = pixelShader->GetBufferPointer();
+    ShaderArchiveWriter writer;
+    for (const auto& shader : shaders) {
+        D3D12_SHADER_BYTECODE bytecode = {};
+        if (FAILED(CompileShader(shader.fileName, shader.target, &bytecode, shader.defines, D3DCOMPILE_OPTIMIZATION_LEVEL3))) return false;
+
+        // The archive key leaves out flags and compiler
+        ShaderRequest request;
+        request.fileName = shader.fileName;
+        request.entryPoint = "main";
+        request.target = shader.target;
+        request.defines = shader.defines;
+        writer.Add(request, bytecode.pShaderBytecode, bytecode.BytecodeLength);
+    }
+    return writer.Write(fileName);
+}
 
+ID3D12PipelineState* GetPipelineStateObject(UINT32 features) {
+    return pipelineStateObjects[(features & ShaderFeatureSoftParticles) ? 1 : 0];
+}
 
-    // create root signature
+template <typename Features>
+HRESULT CreateGraphicsPipelineVariant(Features) {
+    D3D12_SHADER_BYTECODE vertexShaderBytecode = {};
+    HRESULT hr = CompileShader(L"VertexShader.hlsl", "vs_5_1", &vertexShaderBytecode);
+    if (FAILED(hr)) return hr;
 
-    D3D12_DESCRIPTOR_RANGE1 descriptorTableRanges[1];
-    descriptorTableRanges[0].RangeType = D3D12_DESCRIPTOR_RANGE_TYPE_SRV;
-    descriptorTableRanges[0].NumDescriptors = 1;
-    descriptorTableRanges[0].BaseShaderRegister = 0;
-    descriptorTableRanges[0].RegisterSpace = 0;
-    descriptorTableRanges[0].OffsetInDescriptorsFromTableStart = D3D12_DESCRIPTOR_RANGE_OFFSET_APPEND;
-    descriptorTableRanges[0].Flags = D3D12_DESCRIPTOR_RANGE_FLAG_DATA_STATIC;
-
-    D3D12_ROOT_DESCRIPTOR_TABLE1 descriptorTable;
-    descriptorTable.NumDescriptorRanges = _countof(descriptorTableRanges);
-    descriptorTable.pDescriptorRanges = &descriptorTableRanges[0];
-
-    D3D12_ROOT_DESCRIPTOR1 rootDesc;
-    rootDesc.ShaderRegister = 0;
-    rootDesc.RegisterSpace = 0;
-    rootDesc.Flags = D3D12_ROOT_DESCRIPTOR_FLAG_DATA_STATIC;
-
-    D3D12_ROOT_PARAMETER1 rootParameters[GraphicsRootParametersCount];
-    rootParameters[GraphicsRootCBV].ParameterType = D3D12_ROOT_PARAMETER_TYPE_CBV;
-    rootParameters[GraphicsRootCBV].Descriptor = rootDesc;
-    rootParameters[GraphicsRootCBV].ShaderVisibility = D3D12_SHADER_VISIBILITY_ALL;
-    rootParameters[GraphicsRootSRVTable].ParameterType = D3D12_ROOT_PARAMETER_TYPE_DESCRIPTOR_TABLE;
-    rootParameters[GraphicsRootSRVTable].DescriptorTable = descriptorTable;
-    rootParameters[GraphicsRootSRVTable].ShaderVisibility = D3D12_SHADER_VISIBILITY_VERTEX;
-
-    D3D12_VERSIONED_ROOT_SIGNATURE_DESC rootSignatureDesc;
-    rootSignatureDesc.Version = D3D_ROOT_SIGNATURE_VERSION_1_1;
-    rootSignatureDesc.Desc_1_1.NumParameters = _countof(rootParameters);
-    rootSignatureDesc.Desc_1_1.pParameters = rootParameters;
-    rootSignatureDesc.Desc_1_1.NumStaticSamplers = 0;
-    rootSignatureDesc.Desc_1_1.pStaticSamplers = nullptr;
-    rootSignatureDesc.Desc_1_1.Flags = D3D12_ROOT_SIGNATURE_FLAG_ALLOW_INPUT_ASSEMBLER_INPUT_LAYOUT;
-
-    ID3DBlob* signature;
-    D3D12SerializeVersionedRootSignature(&rootSignatureDesc, &signature, nullptr);
-
-    device->CreateRootSignature(0, signature->GetBufferPointer(), signature->GetBufferSize(), IID_PPV_ARGS(&rootSignature));
+    D3D12_SHADER_BYTECODE pixelShaderBytecode = {};
+    hr = CompileShader(L"PixelShader.hlsl", "ps_5_1", &pixelShaderBytecode, GetShaderFeatureDefines(Features::Bits, ParticleFeatures));
+    if (FAILED(hr)) return hr;
 
     // create pso
     D3D12_INPUT_ELEMENT_DESC inputLayout[] = {
@@ -935,7 +972,8 @@ HRESULT CreateGraphicsPipelineStateObj() {
 
     D3D12_DEPTH_STENCIL_DESC depthStencilDesc = {};
     depthStencilDesc.DepthEnable = TRUE;
-    depthStencilDesc.DepthWriteMask = D3D12_DEPTH_WRITE_MASK_ALL; 
+    // Faded particle edges must not hide the particles behind them
+    depthStencilDesc.DepthWriteMask = Features::SoftParticles ? D3D12_DEPTH_WRITE_MASK_ZERO : D3D12_DEPTH_WRITE_MASK_ALL;
     depthStencilDesc.DepthFunc = D3D12_COMPARISON_FUNC_LESS;
     depthStencilDesc.StencilEnable = FALSE;
     depthStencilDesc.StencilReadMask = D3D12_DEFAULT_STENCIL_READ_MASK;
@@ -958,8 +996,26 @@ HRESULT CreateGraphicsPipelineStateObj() {
     psoDesc.DSVFormat = DXGI_FORMAT_D32_FLOAT;
     psoDesc.NumRenderTargets = 1;
 
-    return device->CreateGraphicsPipelineState(&psoDesc, IID_PPV_ARGS(&pipelineStateObject));
+    ID3D12PipelineState*& pipelineStateObject = pipelineStateObjects[Features::SoftParticles ? 1 : 0];
+    pipelineStateObject = pipelineCache.GetGraphicsPipeline(psoDesc).Detach();
+    return pipelineStateObject ? S_OK : E_FAIL;
+
+}
 
+HRESULT CreateGraphicsPipelineStateObj() {
+    // create root signature
+    ID3DBlob* signature = GraphicsRootLayout::Serialize();
+    rootSignature = pipelineCache.GetRootSignature(signature->GetBufferPointer(), signature->GetBufferSize()).Detach();
+    if (!rootSignature) return E_FAIL;
+
+    // Every variant up front, switching features at runtime only picks another pipeline
+    HRESULT hr = S_OK;
+    for (UINT32 features : { 0u, UINT32(ShaderFeatureSoftParticles) }) {
+        WithShaderFeatures<ParticleFeatures>(features, [&](auto variant) {
+            if (SUCCEEDED(hr)) hr = CreateGraphicsPipelineVariant(variant);
+        });
+    }
+    return hr;
 }
 
 void InitViewport() {
@@ -1008,7 +1064,7 @@ void CreateConstantBuffer() {
         nullptr,
         IID_PPV_ARGS(&constantBuffer));
 
-    constantBuffer->SetName(L"Constant Buffer Upload Resource Heap");
+    memoryTracker.Track(constantBuffer, L"Constant Buffer Upload Resource Heap", MemoryCategory::Constant);
 
     D3D12_RANGE readRange = { 0, 0 };
     constantBuffer->Map(0, &readRange, reinterpret_cast<void**>(&constantBufferData));
@@ -1016,7 +1072,20 @@ void CreateConstantBuffer() {
 }
 
 int WINAPI WinMain(_In_ HINSTANCE hInstance, _In_opt_ HINSTANCE hPrevInstance, _In_ LPSTR lpCmdLine, _In_ int nShowCmd) {
-
+    // -buildshaders FILE writes the optimized shader archive and exits, see the post-build step
+    int argc = 0;
+    LPWSTR* argv = CommandLineToArgvW(GetCommandLineW(), &argc);
+    for (int i = 1; argv && i + 1 < argc; i++) {
+        if (wcscmp(argv[i], L"-buildshaders") == 0) {
+            bool built = BuildShaderArchive(argv[i + 1]);
+            LocalFree(argv);
+            return built ? 0 : 1;
+        }
+    }
+    // -budget NAME MB caps a memory category as named in the memory report, or Total,
+    // idle resources are paged out past it
+    memoryBudgets = MemoryTracker::ParseBudgets(argc, argv);
+    LocalFree(argv);
 
     if (!InitWindow(hInstance, nShowCmd, Width, Height, FullScreen)) {
         MessageBox(0, L"Window Initialization - Failed", L"Error", MB_OK);
@@ -1031,8 +1100,7 @@ int WINAPI WinMain(_In_ HINSTANCE hInstance, _In_opt_ HINSTANCE hPrevInstance, _
 
     InitCamera();
     mainloop();
-    WaitForPreviousFrame();
-    CloseHandle(fenceEvent);
+    timeline->WaitIdle(directQueue);
     Cleanup();
     return 0;
 }
@@ -1083,17 +1151,44 @@ bool InitWindow(HINSTANCE hInstance, int ShowWnd, int width, int height, bool fu
 LRESULT CALLBACK WndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam) {
     switch (msg) {
 
+    case WM_KEYDOWN:
+        // Only the initial press restarts the simulation, not the auto-repeats
+        if (wParam == KEY_SPACE && !(lParam & (1 << 30))) {
+            inputSnapshot.restartRequests++;
+            PublishSnapshot();
+        }
+        return 0;
+
     case WM_KEYUP:
         if (wParam == VK_ESCAPE) {
             DestroyWindow(hwnd);
         }
+        if (wParam == 'P') {
+            inputSnapshot.shaderFeatures ^= ShaderFeatureSoftParticles;
+            PublishSnapshot();
+        }
+        return 0;
+
+    case WM_MOUSEMOVE: {
+        POINT newCursor = { GET_X_LPARAM(lParam), GET_Y_LPARAM(lParam) };
+        if (wParam & MK_LBUTTON) {
+            MoveCamera(newCursor);
+            PublishSnapshot();
+        } else if (snapshotPending) {
+            PublishSnapshot();
+        }
+        cursor = newCursor;
         return 0;
+    }
 
     case WM_MOUSEWHEEL:
-        mouseZ += GET_WHEEL_DELTA_WPARAM(wParam);
+        ZoomCamera(GET_WHEEL_DELTA_WPARAM(wParam));
+        PublishSnapshot();
         return 0;
 
     case WM_DESTROY:
+        // Stop presenting before the window goes away
+        StopRenderThread();
         PostQuitMessage(0);
         return 0;
     }
@@ -5,6 +5,8 @@
 #endif
 
 #include <windows.h>
+#include <Windowsx.h>
+#include <shellapi.h>
 #include <d3d12.h>
 #include <dxgi1_6.h>
 #include <D3Dcompiler.h>
@@ -17,6 +19,17 @@
 #include <chrono>
 
 //#include "d3dx12.h"
+#include "../Raytracing/MemoryTracker.h"
+#include "../Raytracing/MeshFile.h"
+#include "../Raytracing/Timeline.h"
+#include "../Raytracing/D3D12FenceBackend.h"
+#include "../Raytracing/SnapshotQueue.h"
+#include "../Raytracing/D3D12DescriptorHeap.h"
+#include "../Raytracing/ShaderCache.h"
+#include "../Raytracing/ShaderArchive.h"
+#include "../Raytracing/ShaderFeatures.h"
+#include "../Raytracing/PipelineCache.h"
+#include "../Raytracing/RootSignatureLayout.h"
 
 #define SAFE_RELEASE(p) { if ( (p) ) { (p)->Release(); (p) = 0; } }
 #define KEY_W 0x57
@@ -52,8 +65,6 @@ struct ThreadData {
 HWND hwnd = NULL;
 LPCTSTR WindowName = L"DirectX12";
 LPCTSTR WindowTitle = L"DirectX12";
-bool spaceKey = false;
-bool prevSpaceKey = false;
 
 int Width = 900;
 int Height = 600;
@@ -71,7 +82,6 @@ float pitch = 0.f;
 float roll = 0.f;
 
 POINT cursor;
-float mouseZ = 0.f;
 
 XMMATRIX camView;
 XMMATRIX camProjection;
@@ -84,10 +94,25 @@ XMVECTOR camRight;
 
 ConstantBuffer cbData;
 
+// Camera and requests produced by the window thread, consumed by the render thread
+struct FrameSnapshot {
+    XMMATRIX view;
+    XMMATRIX projection;
+    UINT restartRequests;
+    UINT32 shaderFeatures;
+};
+
+SnapshotQueue<FrameSnapshot, 64> snapshots;
+FrameSnapshot inputSnapshot = {}; // window thread
+FrameSnapshot frameSnapshot = {}; // render thread
+bool snapshotPending = false;
+
+HANDLE renderThreadHandle = NULL;
+LONG volatile renderTerminating;
+
 // Direct3D
 const int frameBufferCount = 2;
 const int threadCount = 1;
-const int fenceCount = frameBufferCount;
 
 UINT frameIndex;
 UINT rtvDescriptorSize;
@@ -99,11 +124,16 @@ ID3D12Resource* renderTargets[frameBufferCount];
 ID3D12CommandQueue* commandQueue;
 ID3D12CommandAllocator* commandAllocator[frameBufferCount];
 ID3D12GraphicsCommandList* commandList;
-ID3D12Fence* fence[fenceCount];
-HANDLE fenceEvent;
-UINT64 fenceValue[fenceCount];
-
-ID3D12PipelineState* pipelineStateObject;
+// Fences of the direct and compute queues, all waits go through the timeline
+D3D12FenceBackend* fenceBackend;
+Timeline* timeline;
+uint32_t directQueue;
+UINT64 frameFenceValue[frameBufferCount];
+
+// One graphics pipeline per combination of the particle features
+static const UINT32 ParticleFeatures = ShaderFeatureSoftParticles;
+ID3D12PipelineState* pipelineStateObjects[2];
+ID3D12PipelineState* GetPipelineStateObject(UINT32 features);
 ID3D12RootSignature* rootSignature;
 D3D12_VIEWPORT viewport;
 D3D12_RECT scissorRect;
@@ -111,14 +141,25 @@ ID3D12Resource* vertexBuffer;
 D3D12_VERTEX_BUFFER_VIEW vertexBufferView;
 ID3D12Resource* indexBuffer;
 D3D12_INDEX_BUFFER_VIEW indexBufferView;
+UINT indexCount;
 ID3D12Resource* depthStencilBuffer; 
 ID3D12DescriptorHeap* dsDescriptorHeap;
 
 ID3D12Resource* constantBuffer;
 UINT8* constantBufferData;
 
+D3D12ResidencyDevice residencyDevice;
+MemoryTracker memoryTracker;
+MemoryBudgets memoryBudgets; // -budget NAME MB, per memory category or Total
+
 
 void mainloop();
+void MoveCamera(POINT newCursor);
+void ZoomCamera(float delta);
+void PublishSnapshot();
+DWORD WINAPI RenderThread(LPVOID);
+void StartRenderThread();
+void StopRenderThread();
 bool InitWindow(HINSTANCE hInstance, int ShowWnd, int width, int height, bool fullscreen);
 LRESULT CALLBACK WndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam);
 void RestartComputeBuffer();
@@ -139,36 +180,65 @@ void CreateSwapChain(IDXGIFactory4* dxgiFactory);
 void CreateRTV();
 void CreateCommandList();
 void CreateFence();
-void CreateBufferTransition(int bufferSize, ID3D12Resource** dstBuffer, BYTE* data, 
+void CreateBufferTransition(int bufferSize, ID3D12Resource** dstBuffer, const BYTE* data, 
+    LPCWSTR name, MemoryCategory category = MemoryCategory::Geometry,
     D3D12_RESOURCE_FLAGS dstFlag = D3D12_RESOURCE_FLAG_NONE,
     D3D12_RESOURCE_STATES dstStates = D3D12_RESOURCE_STATE_VERTEX_AND_CONSTANT_BUFFER);
 void CreateDepthStencilBuffer();
 void CreateConstantBuffer();
 HRESULT CreateGraphicsPipelineStateObj();
 
+// Shaders come from the optimized archive next to the executable when there is
+// one, otherwise compiled shaders are kept in the on-disk cache, keyed by source and options
+MappedShaderArchive shaderArchive;
+ShaderCache shaderCache;
+HRESULT CompileShader(LPCWSTR fileName, LPCSTR target, D3D12_SHADER_BYTECODE* bytecode,
+    const ShaderDefines& defines = ShaderDefines(), UINT32 flags = D3DCOMPILE_DEBUG | D3DCOMPILE_SKIP_OPTIMIZATION);
+// Post-build step: every shader with full optimization, written to the archive
+bool BuildShaderArchive(LPCWSTR fileName);
+
+// Root signatures and pipelines, deduplicated by description and kept in a pipeline
+// library across launches. Globals below hold their own reference.
+PipelineCache pipelineCache;
+
 // Compute pipeline
 ID3D12PipelineState* computeStateObject;
 ID3D12RootSignature* computeRootSignature;
 
-ID3D12DescriptorHeap* srvUavDescriptorHeap;
 ID3D12Resource* particleBuffer0[threadCount];
 ID3D12Resource* particleBuffer1[threadCount];
 std::vector<Particle> particles;
 
 UINT srvIndex[threadCount]; // Denotes which of the particle buffer resource views is the SRV (0 or 1). The UAV is 1 - srvIndex.
-UINT srvUavDescriptorSize;
+LONG volatile drawSrvIndex[threadCount]; // Buffer written by the last finished simulation step, published by its compute thread.
+LONG64 volatile drawnFenceValue[threadCount][2]; // Direct queue value of the last frame drawing each buffer, a step overwriting it waits for it.
+
+// Particle views of each compute thread, written in the staging heap and copied to the shader visible one.
+// Shaders address them by their index in the heap, through the bindless table.
+D3D12DescriptorHeap descriptorHeap;
+DescriptorHandle particleViews[threadCount];
+DescriptorHandle particleStaging[threadCount];
 
 ID3D12CommandQueue* computeCommandQueue[threadCount];
-ID3D12CommandAllocator* computeCommandAllocator[threadCount];
+// Each thread records a step while the previous one runs, an allocator is reset
+// once the step that last used it has finished. The step is submitted once the
+// previous one finished and its output is published for drawing.
+const int computeFrameCount = 2;
+ID3D12CommandAllocator* computeCommandAllocator[threadCount][computeFrameCount];
 ID3D12GraphicsCommandList* computeCommandList[threadCount];
 
-ID3D12Fence* computeFence[threadCount];
-HANDLE computeFenceEvent[threadCount];
-UINT64 computeFenceValue[threadCount];
+uint32_t computeQueue[threadCount];
+uint64_t computeFenceValue[threadCount][computeFrameCount];
 
 ThreadData threadData[threadCount];
 HANDLE threadHandles[threadCount];
 LONG volatile terminating;
+// RestartComputeBuffer pauses the compute threads at the top of their loop: each one
+// reports its last step, sets its paused event and waits for the resume event
+LONG volatile computePauseRequested;
+HANDLE computePaused[threadCount];
+HANDLE computeResume;
+TimelinePoint computePausedStep[threadCount];
 
 void CreateComputeDescriptorHeap();
 void CreateComputeRootSignature();
@@ -180,27 +250,40 @@ void UpdateComputePipeline(UINT threadIndex);
 DWORD ComputeThread(ThreadData* pThData);
 
 
-// Indices of the root signature parameters.
-enum GraphicsRootParameters : UINT32 {
-    GraphicsRootCBV = 0,
-    GraphicsRootSRVTable,
-    GraphicsRootParametersCount
-};
-
-enum ComputeRootParameters : UINT32 {
-    ComputeRootCBV = 0,
-    ComputeRootSRVTable,
-    ComputeRootUAVTable,
-    ComputeRootParametersCount
-};
-
-// Indices of shader resources in the descriptor heap.
-enum DescriptorHeapIndex : UINT32 {
-    UavParticle0 = 0,
-    UavParticle1 = UavParticle0 + threadCount,
-    SrvParticle0 = UavParticle1 + threadCount,
-    SrvParticle1 = SrvParticle0 + threadCount,
-    DescriptorCount = SrvParticle1 + threadCount
+// Root signature layouts.
+// Every shard shares them: the bindless table covers the whole heap and the
+// shard's buffers are selected by their descriptor indices in root constants.
+typedef RootLayout::RootCbv<0, 0, D3D12_ROOT_DESCRIPTOR_FLAG_DATA_STATIC> SceneCbv;
+
+// One root constant selects the shard's buffer
+typedef RootLayout::Table<D3D12_SHADER_VISIBILITY_VERTEX, RootLayout::Bindless<D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 1>> GraphicsBindless;
+typedef RootLayout::RootConstants<1, 1, 0, D3D12_SHADER_VISIBILITY_VERTEX> GraphicsParticles;
+typedef RootSignatureLayout<D3D12_ROOT_SIGNATURE_FLAG_ALLOW_INPUT_ASSEMBLER_INPUT_LAYOUT,
+    SceneCbv, GraphicsBindless, GraphicsParticles> GraphicsRootLayout;
+
+// Unbounded SRV and UAV arrays both start at the heap start, the root constants
+// hold the indices of the buffer read and the buffer written
+typedef RootLayout::Table<D3D12_SHADER_VISIBILITY_ALL,
+    RootLayout::Bindless<D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 1>,
+    RootLayout::Bindless<D3D12_DESCRIPTOR_RANGE_TYPE_UAV, 1, RootLayout::VolatileDescriptors>> ComputeBindless;
+typedef RootLayout::RootConstants<2, 1> ComputeParticles;
+typedef RootSignatureLayout<D3D12_ROOT_SIGNATURE_FLAG_NONE, SceneCbv, ComputeBindless, ComputeParticles> ComputeRootLayout;
+
+static constexpr UINT GraphicsRootCBV = GraphicsRootLayout::Index<SceneCbv>();
+static constexpr UINT GraphicsRootBindless = GraphicsRootLayout::Index<GraphicsBindless>();
+static constexpr UINT GraphicsRootParticles = GraphicsRootLayout::Index<GraphicsParticles>();
+
+static constexpr UINT ComputeRootCBV = ComputeRootLayout::Index<SceneCbv>();
+static constexpr UINT ComputeRootBindless = ComputeRootLayout::Index<ComputeBindless>();
+static constexpr UINT ComputeRootParticles = ComputeRootLayout::Index<ComputeParticles>();
+
+// Offsets of the views inside the particle descriptor range of a thread.
+enum ParticleViewIndex : UINT32 {
+    ParticleSrv0 = 0,
+    ParticleSrv1,
+    ParticleUav0,
+    ParticleUav1,
+    ParticleViewCount
 };
 
 
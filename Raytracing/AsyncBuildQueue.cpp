@@ -0,0 +1,112 @@
+#include "AsyncBuildQueue.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+
+void AsyncBuildQueue::Init(ID3D12Device5* device, MemoryTracker* memory, Timeline* timeline, D3D12FenceBackend* fences,
+    ID3D12CommandQueue* queue, uint32_t computeQueue, UINT contextCount) {
+    m_timeline = timeline;
+    m_fences = fences;
+    m_queue = queue;
+    m_computeQueue = computeQueue;
+
+    m_allocators.resize(contextCount);
+    for (auto& allocator : m_allocators) {
+        if (FAILED(device->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_COMPUTE, IID_PPV_ARGS(&allocator)))) {
+            throw std::runtime_error("Cannot create the build queue command allocator");
+        }
+    }
+    if (FAILED(device->CreateCommandList(0, D3D12_COMMAND_LIST_TYPE_COMPUTE, m_allocators[0].Get(), nullptr, IID_PPV_ARGS(&m_commandList)))) {
+        throw std::runtime_error("Cannot create the build queue command list");
+    }
+    m_commandList->Close();
+    m_allocatorPoints.assign(contextCount, TimelinePoint{ computeQueue, 0 });
+    m_built.assign(contextCount, false);
+
+    m_scratch.Init(device, memory);
+    m_timestamps.Init(device, queue, memory, contextCount);
+}
+
+ID3D12GraphicsCommandList4* AsyncBuildQueue::Begin(UINT context) {
+    // Done long ago in the steady state, the direct queue waited for it before the
+    // frame that last used the context could finish
+    if (m_allocatorPoints[context].value != 0) m_timeline->Wait(m_allocatorPoints[context]);
+    m_context = context;
+    m_allocators[context]->Reset();
+    m_commandList->Reset(m_allocators[context].Get(), nullptr);
+    m_timestamps.Begin(m_commandList.Get(), context);
+    return m_commandList.Get();
+}
+
+TimelinePoint AsyncBuildQueue::Submit(TimelinePoint after, ID3D12CommandQueue* waiter) {
+    m_timestamps.End(m_commandList.Get(), m_context);
+    m_commandList->Close();
+
+    if (after.value != 0) m_queue->Wait(m_fences->GetFence(after.queue), after.value);
+    ID3D12CommandList* commandLists[] = { m_commandList.Get() };
+    m_queue->ExecuteCommandLists(_countof(commandLists), commandLists);
+    TimelinePoint submitted = m_timeline->Signal(m_computeQueue);
+    m_scratch.Submit(submitted.value);
+
+    waiter->Wait(m_fences->GetFence(m_computeQueue), submitted.value);
+    m_allocatorPoints[m_context] = submitted;
+    m_built[m_context] = true;
+    m_submits++;
+    return submitted;
+}
+
+void AsyncBuildQueue::Retire() {
+    m_scratch.Retire(m_timeline->GetCompletedValue(m_computeQueue));
+}
+
+void AsyncBuildQueue::AddFrame(UINT context, double renderBeginMs, double renderEndMs) {
+    Frame frame = {};
+    frame.number = m_frameCount++;
+    frame.renderBegin = renderBeginMs;
+    frame.renderEnd = renderEndMs;
+    frame.built = m_built[context] && m_timestamps.ReadSpan(context, &frame.buildBegin, &frame.buildEnd);
+    m_built[context] = false;
+
+    // The builds of a frame are meant to run under the rendering of the frame before.
+    // What runs past its end holds the direct queue back.
+    if (frame.built && !m_frames.empty()) {
+        const Frame& previous = m_frames.back();
+        double overlap = (std::min)(frame.buildEnd, previous.renderEnd) - (std::max)(frame.buildBegin, previous.renderBegin);
+        double exposed = frame.buildEnd - (std::max)(frame.buildBegin, previous.renderEnd);
+        m_buildMs += frame.buildEnd - frame.buildBegin;
+        m_overlapMs += (std::max)(overlap, 0.0);
+        m_stallMs += (std::max)(exposed, 0.0);
+        m_measured++;
+    }
+
+    m_frames.push_back(frame);
+    if (m_frames.size() > TimelineFrames) m_frames.pop_front();
+}
+
+std::wstring AsyncBuildQueue::Report() const {
+    std::wstringstream ss;
+    ss << std::fixed << std::setprecision(3);
+    ss << L"Async AS builds: " << m_submits << L" submissions";
+    if (m_measured) {
+        ss << L", " << m_buildMs / m_measured << L" ms per frame on the compute queue, "
+           << m_overlapMs / m_measured << L" ms under the previous frame ("
+           << std::setprecision(1) << 100.0 * m_overlapMs / (std::max)(m_buildMs, 1e-9) << L"%), "
+           << std::setprecision(3) << m_stallMs / m_measured << L" ms past its end";
+    }
+    ss << L"\n";
+    if (m_frames.empty()) return ss.str();
+
+    // Last frames relative to the start of the oldest, direct queue then compute queue
+    double origin = m_frames.front().renderBegin;
+    for (const Frame& frame : m_frames) {
+        if (frame.built) origin = (std::min)(origin, frame.buildBegin);
+    }
+    for (const Frame& frame : m_frames) {
+        ss << L"  frame " << frame.number << L": render " << frame.renderBegin - origin << L" - " << frame.renderEnd - origin;
+        if (frame.built) ss << L", builds " << frame.buildBegin - origin << L" - " << frame.buildEnd - origin;
+        ss << L" ms\n";
+    }
+    return ss.str();
+}
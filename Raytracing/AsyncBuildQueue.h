@@ -0,0 +1,87 @@
+#pragma once
+#include <d3d12.h>
+#include <wrl.h>
+
+#include <deque>
+#include <string>
+#include <vector>
+
+#include "D3D12FenceBackend.h"
+#include "D3D12TimestampSource.h"
+#include "MemoryTracker.h"
+#include "ScratchArena.h"
+#include "Timeline.h"
+
+using Microsoft::WRL::ComPtr;
+
+// Records the acceleration structure builds of a frame on the compute queue, so they
+// run while the direct queue is still rendering the previous frame. The direct queue
+// waits on the compute fence before the work that reads the results. Every frame
+// context has its own allocator, which is free again once the frame context is.
+//
+// The builds are bracketed by timestamps. Paired with the frame spans of the direct
+// queue they make a timeline of how much the builds overlap rendering.
+class AsyncBuildQueue {
+
+public:
+	static const UINT TimelineFrames = 8; // frames listed in the report
+
+	AsyncBuildQueue() {}
+
+	AsyncBuildQueue(const AsyncBuildQueue&) = delete;
+	AsyncBuildQueue& operator=(const AsyncBuildQueue&) = delete;
+
+	// `computeQueue` is the timeline index of `queue`
+	void Init(ID3D12Device5* device, MemoryTracker* memory, Timeline* timeline, D3D12FenceBackend* fences,
+		ID3D12CommandQueue* queue, uint32_t computeQueue, UINT contextCount);
+
+	// Resets the command list on the allocator of `context`
+	ID3D12GraphicsCommandList4* Begin(UINT context);
+	// Scratch for the builds of the command list, on the compute queue only
+	ScratchArena* GetScratch() { return &m_scratch; }
+	// Runs the recorded builds once the compute queue passed `after`, the direct queue
+	// work producing their inputs (no wait when its value is 0). `waiter` waits for them
+	// on the GPU before anything submitted to it later.
+	TimelinePoint Submit(TimelinePoint after, ID3D12CommandQueue* waiter);
+
+	// Non-blocking, releases scratch the GPU is done with
+	void Retire();
+
+	// Called once the frame of `context` completed, with its span on the direct queue.
+	// Its builds are laid against the span of the frame before.
+	void AddFrame(UINT context, double renderBeginMs, double renderEndMs);
+	std::wstring Report() const;
+
+	UINT64 GetSubmitCount() const { return m_submits; }
+
+private:
+	struct Frame {
+		UINT64 number;
+		double renderBegin;
+		double renderEnd;
+		bool built;
+		double buildBegin;
+		double buildEnd;
+	};
+
+	Timeline* m_timeline = nullptr;
+	D3D12FenceBackend* m_fences = nullptr;
+	ComPtr<ID3D12CommandQueue> m_queue;
+	uint32_t m_computeQueue = 0;
+
+	std::vector<ComPtr<ID3D12CommandAllocator>> m_allocators;
+	std::vector<TimelinePoint> m_allocatorPoints; // last submission per allocator
+	std::vector<bool> m_built;                    // per context, builds not yet added to the timeline
+	ComPtr<ID3D12GraphicsCommandList4> m_commandList;
+	UINT m_context = 0;
+	ScratchArena m_scratch;
+	D3D12TimestampSource m_timestamps;
+
+	std::deque<Frame> m_frames; // the last TimelineFrames, oldest first
+	UINT64 m_frameCount = 0;
+	UINT64 m_submits = 0;
+	UINT64 m_measured = 0;      // builds with a frame to lay them against
+	double m_buildMs = 0.0;
+	double m_overlapMs = 0.0;   // of the builds with the previous frame
+	double m_stallMs = 0.0;     // direct queue idle past the previous frame, until the builds finished
+};
@@ -0,0 +1,207 @@
+#include "BlasCompactor.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+static const UINT64 CompactedSizeStride = sizeof(D3D12_RAYTRACING_ACCELERATION_STRUCTURE_POSTBUILD_INFO_COMPACTED_SIZE_DESC);
+
+void BlasCompactor::Init(ID3D12Device* device, MemoryTracker* memory, Timeline* timeline, UINT slotCount, UINT64 pageSize) {
+    m_device = device;
+    m_memory = memory;
+    m_timeline = timeline;
+    m_pageSize = (pageSize + 0xFFFF) & ~0xFFFFull;
+
+    m_postbuild = CreateBuffer(CompactedSizeStride * slotCount, D3D12_HEAP_TYPE_DEFAULT,
+        D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
+    if (m_memory) m_memory->Track(m_postbuild.Get(), L"BLAS Compacted Sizes", MemoryCategory::AccelerationStructure, ResidencyPriority::Pinned);
+
+    m_readback = CreateBuffer(CompactedSizeStride * slotCount, D3D12_HEAP_TYPE_READBACK,
+        D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_FLAG_NONE);
+    if (m_memory) m_memory->Track(m_readback.Get(), L"BLAS Compacted Size Readback", MemoryCategory::Readback, ResidencyPriority::Pinned);
+
+    // A slot is only read once the queue of its size copy has passed it
+    void* data = nullptr;
+    m_readback->Map(0, nullptr, &data);
+    m_sizes = static_cast<const UINT64*>(data);
+
+    m_freeSlots.clear();
+    for (UINT i = slotCount; i > 0; i--) m_freeSlots.push_back(i - 1);
+}
+
+bool BlasCompactor::Request(UINT id, ID3D12Resource* source, D3D12_RAYTRACING_ACCELERATION_STRUCTURE_POSTBUILD_INFO_DESC* postbuildInfo) {
+    if (m_freeSlots.empty()) return false;
+
+    Pending request = {};
+    request.id = id;
+    request.slot = m_freeSlots.back();
+    request.source = source;
+    m_freeSlots.pop_back();
+    m_pending.push_back(request);
+
+    postbuildInfo->DestBuffer = m_postbuild->GetGPUVirtualAddress() + request.slot * CompactedSizeStride;
+    postbuildInfo->InfoType = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_POSTBUILD_INFO_COMPACTED_SIZE;
+    return true;
+}
+
+void BlasCompactor::ResolveSizes(ID3D12GraphicsCommandList* commandList, uint32_t queue) {
+    auto unresolved = [](const Pending& request) { return !request.resolved; };
+    if (std::none_of(m_pending.begin(), m_pending.end(), unresolved)) return;
+
+    // The transition also waits for the builds that write the sizes
+    D3D12_RESOURCE_BARRIER barrier = {};
+    barrier.Type = D3D12_RESOURCE_BARRIER_TYPE_TRANSITION;
+    barrier.Flags = D3D12_RESOURCE_BARRIER_FLAG_NONE;
+    barrier.Transition.pResource = m_postbuild.Get();
+    barrier.Transition.StateBefore = D3D12_RESOURCE_STATE_UNORDERED_ACCESS;
+    barrier.Transition.StateAfter = D3D12_RESOURCE_STATE_COPY_SOURCE;
+    barrier.Transition.Subresource = D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES;
+    commandList->ResourceBarrier(1, &barrier);
+
+    for (auto& request : m_pending) {
+        if (request.resolved) continue;
+        UINT64 offset = request.slot * CompactedSizeStride;
+        commandList->CopyBufferRegion(m_readback.Get(), offset, m_postbuild.Get(), offset, CompactedSizeStride);
+        request.resolved = true;
+        request.queue = queue;
+    }
+
+    std::swap(barrier.Transition.StateBefore, barrier.Transition.StateAfter);
+    commandList->ResourceBarrier(1, &barrier);
+}
+
+std::vector<BlasCompactor::Compacted> BlasCompactor::Compact(ID3D12GraphicsCommandList4* commandList, uint32_t queue) {
+    std::vector<Compacted> compacted;
+    std::vector<ID3D12Resource*> pages;
+
+    for (size_t i = 0; i < m_pending.size();) {
+        Pending& request = m_pending[i];
+        if (!request.readable) {
+            i++;
+            continue;
+        }
+
+        UINT64 size = m_sizes[request.slot];
+        UINT64 sourceSize = request.source->GetDesc().Width;
+        size = (size + D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BYTE_ALIGNMENT - 1) & ~UINT64(D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BYTE_ALIGNMENT - 1);
+        if (size == 0 || size > sourceSize) { throw std::runtime_error("Invalid compacted acceleration structure size"); }
+
+        UINT64 offset = 0;
+        Page& page = Allocate(size, &offset);
+        D3D12_GPU_VIRTUAL_ADDRESS address = page.buffer->GetGPUVirtualAddress() + offset;
+        commandList->CopyRaytracingAccelerationStructure(address, request.source->GetGPUVirtualAddress(),
+            D3D12_RAYTRACING_ACCELERATION_STRUCTURE_COPY_MODE_COMPACT);
+
+        compacted.push_back({ request.id, page.buffer.Get(), address });
+        if (std::find(pages.begin(), pages.end(), page.buffer.Get()) == pages.end()) pages.push_back(page.buffer.Get());
+
+        m_compactedCount++;
+        m_sourceTotal += sourceSize;
+        m_compactedTotal += size;
+
+        m_copied.push_back({ queue, request.source });
+        m_freeSlots.push_back(request.slot);
+        std::swap(request, m_pending.back());
+        m_pending.pop_back();
+    }
+
+    // The TLAS build reads the copies
+    std::vector<D3D12_RESOURCE_BARRIER> uavBarriers;
+    for (ID3D12Resource* page : pages) {
+        D3D12_RESOURCE_BARRIER uavBarrier = {};
+        uavBarrier.Type = D3D12_RESOURCE_BARRIER_TYPE_UAV;
+        uavBarrier.UAV.pResource = page;
+        uavBarrier.Flags = D3D12_RESOURCE_BARRIER_FLAG_NONE;
+        uavBarriers.push_back(uavBarrier);
+    }
+    if (!uavBarriers.empty()) commandList->ResourceBarrier(static_cast<UINT>(uavBarriers.size()), uavBarriers.data());
+
+    return compacted;
+}
+
+void BlasCompactor::Submit(TimelinePoint submitted) {
+    // Work recorded for another queue is tagged by that queue's submission, a value of
+    // this one would not cover it
+    for (auto& request : m_pending) {
+        if (request.resolved && request.submitted.value == 0 && request.queue == submitted.queue) request.submitted = submitted;
+    }
+
+    for (size_t i = 0; i < m_copied.size();) {
+        if (m_copied[i].first != submitted.queue) {
+            i++;
+            continue;
+        }
+        m_retired.push_back({ submitted, m_copied[i].second });
+        m_copied.erase(m_copied.begin() + i);
+    }
+}
+
+void BlasCompactor::Retire() {
+    for (auto& request : m_pending) {
+        if (request.submitted.value != 0 && m_timeline->IsComplete(request.submitted)) request.readable = true;
+    }
+
+    while (!m_retired.empty() && m_timeline->IsComplete(m_retired.front().first)) {
+        m_retired.pop_front();
+    }
+}
+
+UINT64 BlasCompactor::GetPoolSize() const {
+    UINT64 total = 0;
+    for (const auto& page : m_pages) total += page.size;
+    return total;
+}
+
+BlasCompactor::Page& BlasCompactor::Allocate(UINT64 size, UINT64* offset) {
+    // Bump allocation, compacted structures live as long as the scene
+    for (auto& page : m_pages) {
+        if (page.size - page.used >= size) {
+            *offset = page.used;
+            page.used += size;
+            return page;
+        }
+    }
+
+    Page page = {};
+    page.size = (std::max)(m_pageSize, (size + 0xFFFF) & ~0xFFFFull);
+    page.used = size;
+    page.buffer = CreateBuffer(page.size, D3D12_HEAP_TYPE_DEFAULT,
+        D3D12_RESOURCE_STATE_RAYTRACING_ACCELERATION_STRUCTURE, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
+    if (m_memory) m_memory->Track(page.buffer.Get(), L"Compacted BLAS Pool", MemoryCategory::AccelerationStructure, ResidencyPriority::Pinned);
+    m_pages.push_back(page);
+
+    *offset = 0;
+    return m_pages.back();
+}
+
+ComPtr<ID3D12Resource> BlasCompactor::CreateBuffer(UINT64 size, D3D12_HEAP_TYPE heapType, D3D12_RESOURCE_STATES state, D3D12_RESOURCE_FLAGS flags) {
+    D3D12_RESOURCE_DESC resourceDesc = {};
+    resourceDesc.Dimension = D3D12_RESOURCE_DIMENSION_BUFFER;
+    resourceDesc.Alignment = 0;
+    resourceDesc.Width = size;
+    resourceDesc.Height = 1;
+    resourceDesc.DepthOrArraySize = 1;
+    resourceDesc.MipLevels = 1;
+    resourceDesc.Format = DXGI_FORMAT_UNKNOWN;
+    resourceDesc.SampleDesc.Count = 1;
+    resourceDesc.SampleDesc.Quality = 0;
+    resourceDesc.Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR;
+    resourceDesc.Flags = flags;
+
+    D3D12_HEAP_PROPERTIES heapProperties = {};
+    heapProperties.Type = heapType;
+    heapProperties.CPUPageProperty = D3D12_CPU_PAGE_PROPERTY_UNKNOWN;
+    heapProperties.MemoryPoolPreference = D3D12_MEMORY_POOL_UNKNOWN;
+    heapProperties.CreationNodeMask = 1;
+    heapProperties.VisibleNodeMask = 1;
+
+    ComPtr<ID3D12Resource> buffer;
+    HRESULT hr = m_device->CreateCommittedResource(
+        &heapProperties,
+        D3D12_HEAP_FLAG_NONE,
+        &resourceDesc,
+        state,
+        nullptr,
+        IID_PPV_ARGS(&buffer));
+    if (FAILED(hr)) { throw std::runtime_error("Cannot create the BLAS compaction buffers"); }
+    return buffer;
+}
@@ -0,0 +1,100 @@
+#pragma once
+#include <d3d12.h>
+#include <wrl.h>
+
+#include <deque>
+#include <utility>
+#include <vector>
+
+#include "MemoryTracker.h"
+#include "Timeline.h"
+
+using Microsoft::WRL::ComPtr;
+
+// Shrinks bottom level acceleration structures built with ALLOW_COMPACTION. Each build
+// emits its compacted size into a slot of a small UAV buffer that is copied to a
+// persistently mapped readback buffer, nothing waits on the GPU for it. Once the queue
+// that ran the copy has passed its submission, Compact() copies the structure with
+// COPY_MODE_COMPACT into a sub-allocation of a pooled buffer. The original is kept
+// until the copy has completed, then released.
+class BlasCompactor {
+
+public:
+	struct Compacted {
+		UINT id;                           // as passed to Request
+		ID3D12Resource* page;              // pool buffer holding the copy
+		D3D12_GPU_VIRTUAL_ADDRESS address;
+	};
+
+	BlasCompactor() {}
+
+	BlasCompactor(const BlasCompactor&) = delete;
+	BlasCompactor& operator=(const BlasCompactor&) = delete;
+
+	// `slotCount` bounds how many sizes can be waited on at once, structures larger
+	// than `pageSize` get a page of their own
+	void Init(ID3D12Device* device, MemoryTracker* memory, Timeline* timeline, UINT slotCount = 256, UINT64 pageSize = 4 * 1024 * 1024);
+
+	// Fills the postbuild info to pass to the build of `source`. Returns false when every
+	// slot is taken, the structure then stays as built.
+	bool Request(UINT id, ID3D12Resource* source, D3D12_RAYTRACING_ACCELERATION_STRUCTURE_POSTBUILD_INFO_DESC* postbuildInfo);
+
+	// Recorded after the builds, copies the sizes they emitted to the readback buffer.
+	// `queue` is the timeline index of the queue `commandList` is submitted to.
+	void ResolveSizes(ID3D12GraphicsCommandList* commandList, uint32_t queue);
+
+	// Copies every structure whose size has been read back. The caller repoints its
+	// instances to the returned addresses and rebuilds the TLAS.
+	std::vector<Compacted> Compact(ID3D12GraphicsCommandList4* commandList, uint32_t queue);
+
+	// Called after each submission to `submitted.queue`, tags the work recorded for it
+	void Submit(TimelinePoint submitted);
+	// Non-blocking, marks the sizes read back and releases the copied originals
+	void Retire();
+
+	bool IsIdle() const { return m_pending.empty(); }
+	UINT GetCompactedCount() const { return m_compactedCount; }
+	UINT64 GetSourceTotal() const { return m_sourceTotal; }       // built sizes of the compacted structures
+	UINT64 GetCompactedTotal() const { return m_compactedTotal; } // what they use in the pool
+	UINT64 GetPoolSize() const;
+
+private:
+	struct Pending {
+		UINT id;
+		UINT slot;
+		ComPtr<ID3D12Resource> source;
+		bool resolved;           // size copy recorded
+		uint32_t queue;          // that runs the size copy
+		TimelinePoint submitted; // value 0 until the size copy is submitted
+		bool readable;
+	};
+
+	struct Page {
+		ComPtr<ID3D12Resource> buffer;
+		UINT64 size;
+		UINT64 used;
+	};
+
+	ComPtr<ID3D12Resource> CreateBuffer(UINT64 size, D3D12_HEAP_TYPE heapType, D3D12_RESOURCE_STATES state, D3D12_RESOURCE_FLAGS flags);
+	Page& Allocate(UINT64 size, UINT64* offset);
+
+	ID3D12Device* m_device = nullptr;
+	MemoryTracker* m_memory = nullptr;
+	Timeline* m_timeline = nullptr;
+	UINT64 m_pageSize = 0;
+
+	ComPtr<ID3D12Resource> m_postbuild; // UAV, written by the builds
+	ComPtr<ID3D12Resource> m_readback;
+	const UINT64* m_sizes = nullptr;    // mapped readback, one UINT64 per slot
+	std::vector<UINT> m_freeSlots;
+	std::vector<Pending> m_pending;
+
+	std::vector<Page> m_pages;
+
+	std::vector<std::pair<uint32_t, ComPtr<ID3D12Resource>>> m_copied;      // queue, original not submitted yet
+	std::deque<std::pair<TimelinePoint, ComPtr<ID3D12Resource>>> m_retired; // submission, original
+
+	UINT m_compactedCount = 0;
+	UINT64 m_sourceTotal = 0;
+	UINT64 m_compactedTotal = 0;
+};
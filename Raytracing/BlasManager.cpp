@@ -0,0 +1,235 @@
+#include "BlasManager.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+static UINT64 AlignAccelerationStructure(UINT64 size) {
+    return (size + D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BYTE_ALIGNMENT - 1) & ~UINT64(D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BYTE_ALIGNMENT - 1);
+}
+
+void BlasManager::Init(ID3D12Device5* device, MemoryTracker* memory, Timeline* timeline, D3D12FenceBackend* fences,
+    ID3D12CommandQueue* queue, uint32_t computeQueue, BlasCompactor* compactor) {
+    m_device = device;
+    m_memory = memory;
+    m_timeline = timeline;
+    m_fences = fences;
+    m_queue = queue;
+    m_computeQueue = computeQueue;
+    m_compactor = compactor;
+
+    m_computeScratch.Init(device, memory);
+    if (FAILED(m_device->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_COMPUTE, IID_PPV_ARGS(&m_allocator))) ||
+        FAILED(m_device->CreateCommandList(0, D3D12_COMMAND_LIST_TYPE_COMPUTE, m_allocator.Get(), nullptr, IID_PPV_ARGS(&m_commandList)))) {
+        throw std::runtime_error("Cannot create the BLAS build command list");
+    }
+    m_commandList->Close();
+}
+
+D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAGS BlasManager::GetBuildFlags(GeometryHint hint, bool compact) {
+    // Static geometry is traced every frame for its whole life, the build cost is paid once
+    if (hint == GeometryHint::Static) {
+        D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAGS flags = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_PREFER_FAST_TRACE;
+        if (compact) flags |= D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_ALLOW_COMPACTION;
+        return flags;
+    }
+    // Compacting a structure that is rebuilt soon after does not pay off
+    return D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_PREFER_FAST_BUILD |
+        D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_ALLOW_UPDATE;
+}
+
+UINT BlasManager::Request(const D3D12_RAYTRACING_GEOMETRY_DESC& geometry, GeometryHint hint) {
+    BottomLevelAS blas = {};
+    blas.hint = hint;
+    blas.flags = GetBuildFlags(hint, m_compactor != nullptr);
+
+    D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_INPUTS inputs = {};
+    inputs.Type = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL;
+    inputs.DescsLayout = D3D12_ELEMENTS_LAYOUT_ARRAY;
+    inputs.NumDescs = 1;
+    inputs.pGeometryDescs = &geometry;
+    inputs.Flags = blas.flags;
+
+    D3D12_RAYTRACING_ACCELERATION_STRUCTURE_PREBUILD_INFO info = {};
+    m_device->GetRaytracingAccelerationStructurePrebuildInfo(&inputs, &info);
+
+    D3D12_RESOURCE_DESC resourceDesc = {};
+    resourceDesc.Dimension = D3D12_RESOURCE_DIMENSION_BUFFER;
+    resourceDesc.Alignment = 0;
+    resourceDesc.Width = AlignAccelerationStructure(info.ResultDataMaxSizeInBytes);
+    resourceDesc.Height = 1;
+    resourceDesc.DepthOrArraySize = 1;
+    resourceDesc.MipLevels = 1;
+    resourceDesc.Format = DXGI_FORMAT_UNKNOWN;
+    resourceDesc.SampleDesc.Count = 1;
+    resourceDesc.SampleDesc.Quality = 0;
+    resourceDesc.Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR;
+    resourceDesc.Flags = D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS;
+
+    D3D12_HEAP_PROPERTIES heapProperties = {};
+    heapProperties.Type = D3D12_HEAP_TYPE_DEFAULT;
+    heapProperties.CPUPageProperty = D3D12_CPU_PAGE_PROPERTY_UNKNOWN;
+    heapProperties.MemoryPoolPreference = D3D12_MEMORY_POOL_UNKNOWN;
+    heapProperties.CreationNodeMask = 1;
+    heapProperties.VisibleNodeMask = 1;
+
+    HRESULT hr = m_device->CreateCommittedResource(
+        &heapProperties,
+        D3D12_HEAP_FLAG_NONE,
+        &resourceDesc,
+        D3D12_RESOURCE_STATE_RAYTRACING_ACCELERATION_STRUCTURE,
+        nullptr,
+        IID_PPV_ARGS(&blas.resource));
+    if (FAILED(hr)) { throw std::runtime_error("Cannot create the bottom level acceleration structure"); }
+    if (m_memory) m_memory->Track(blas.resource.Get(), L"Bottom Level AS", MemoryCategory::AccelerationStructure, ResidencyPriority::Pinned);
+    blas.address = blas.resource->GetGPUVirtualAddress();
+    blas.scratchSize = AlignAccelerationStructure(info.ScratchDataSizeInBytes);
+    if (blas.flags & D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_ALLOW_UPDATE) {
+        blas.updateScratchSize = AlignAccelerationStructure(info.UpdateScratchDataSizeInBytes);
+    }
+
+    UINT index = static_cast<UINT>(m_structures.size());
+    m_structures.push_back(blas);
+    Queue(index, geometry, false);
+    return index;
+}
+
+void BlasManager::Refit(UINT index, const D3D12_RAYTRACING_GEOMETRY_DESC& geometry) {
+    if (m_structures[index].updateScratchSize == 0) { throw std::logic_error("Only dynamic BLAS can be refit"); }
+    Queue(index, geometry, true);
+}
+
+void BlasManager::Rebuild(UINT index, const D3D12_RAYTRACING_GEOMETRY_DESC& geometry) {
+    // A compacted structure has no room for a full build
+    if (m_structures[index].updateScratchSize == 0) { throw std::logic_error("Only dynamic BLAS can be rebuilt in place"); }
+    Queue(index, geometry, false);
+}
+
+void BlasManager::Queue(UINT index, const D3D12_RAYTRACING_GEOMETRY_DESC& geometry, bool update) {
+    // Builds of one batch are not separated by barriers, a structure is queued once.
+    // A full build stays full, the update would have nothing to start from.
+    for (PendingBuild& build : m_pending) {
+        if (build.index != index) continue;
+        build.geometry = geometry;
+        if (!update) {
+            build.update = false;
+            build.scratchSize = m_structures[index].scratchSize;
+        }
+        return;
+    }
+
+    PendingBuild build = {};
+    build.index = index;
+    build.geometry = geometry;
+    build.update = update;
+    build.scratchSize = update ? m_structures[index].updateScratchSize : m_structures[index].scratchSize;
+    m_pending.push_back(build);
+}
+
+void BlasManager::Record(ID3D12GraphicsCommandList4* commandList, ScratchArena* scratch, uint32_t queue) {
+    if (m_pending.empty()) return;
+    RecordBatches(commandList, scratch, queue);
+}
+
+TimelinePoint BlasManager::SubmitAsync(TimelinePoint after, ID3D12CommandQueue* waiter) {
+    if (m_pending.empty()) return m_lastAsync;
+
+    // One allocator, the previous batch has to be off the GPU before it is reset
+    if (m_lastAsync.value != 0) m_timeline->Wait(m_lastAsync);
+    Retire();
+    m_allocator->Reset();
+    m_commandList->Reset(m_allocator.Get(), nullptr);
+
+    RecordBatches(m_commandList.Get(), &m_computeScratch, m_computeQueue);
+    m_commandList->Close();
+
+    m_queue->Wait(m_fences->GetFence(after.queue), after.value);
+    ID3D12CommandList* commandLists[] = { m_commandList.Get() };
+    m_queue->ExecuteCommandLists(_countof(commandLists), commandLists);
+    m_lastAsync = m_timeline->Signal(m_computeQueue);
+    m_computeScratch.Submit(m_lastAsync.value);
+    if (m_compactor) m_compactor->Submit(m_lastAsync);
+
+    waiter->Wait(m_fences->GetFence(m_computeQueue), m_lastAsync.value);
+    m_asyncBatches++;
+    return m_lastAsync;
+}
+
+void BlasManager::Retire() {
+    m_computeScratch.Retire(m_timeline->GetCompletedValue(m_computeQueue));
+}
+
+void BlasManager::Relocate(UINT index, ID3D12Resource* resource, D3D12_GPU_VIRTUAL_ADDRESS address) {
+    m_structures[index].resource = resource;
+    m_structures[index].address = address;
+}
+
+void BlasManager::RecordBatches(ID3D12GraphicsCommandList4* commandList, ScratchArena* scratch, uint32_t queue) {
+    // Split into batches whose scratch regions fit the budget side by side. A build
+    // larger than the budget makes a batch of its own.
+    std::vector<size_t> batchEnds;
+    std::vector<UINT64> batchSizes;
+    UINT64 batchSize = 0;
+    for (size_t i = 0; i < m_pending.size(); i++) {
+        UINT64 size = m_pending[i].scratchSize;
+        if (batchSize > 0 && batchSize + size > BatchScratchSize) {
+            batchEnds.push_back(i);
+            batchSizes.push_back(batchSize);
+            batchSize = 0;
+        }
+        batchSize += size;
+    }
+    batchEnds.push_back(m_pending.size());
+    batchSizes.push_back(batchSize);
+    scratch->Reserve(*std::max_element(batchSizes.begin(), batchSizes.end()));
+
+    std::vector<D3D12_RESOURCE_BARRIER> uavBarriers;
+    size_t first = 0;
+    for (size_t batch = 0; batch < batchEnds.size(); batch++) {
+        // Barriers on the scratch only separate batches, the builds inside one write disjoint regions
+        D3D12_GPU_VIRTUAL_ADDRESS scratchAddress = scratch->Acquire(commandList, batchSizes[batch]);
+
+        for (size_t i = first; i < batchEnds[batch]; i++) {
+            const PendingBuild& build = m_pending[i];
+            const BottomLevelAS& blas = m_structures[build.index];
+
+            D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_DESC buildDesc = {};
+            buildDesc.Inputs.Type = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL;
+            buildDesc.Inputs.DescsLayout = D3D12_ELEMENTS_LAYOUT_ARRAY;
+            buildDesc.Inputs.NumDescs = 1;
+            buildDesc.Inputs.pGeometryDescs = &build.geometry;
+            buildDesc.Inputs.Flags = blas.flags;
+            buildDesc.DestAccelerationStructureData = blas.address;
+            buildDesc.ScratchAccelerationStructureData = scratchAddress;
+            buildDesc.SourceAccelerationStructureData = 0;
+            if (build.update) {
+                // Refit in place, the structure is its own source
+                buildDesc.Inputs.Flags |= D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_PERFORM_UPDATE;
+                buildDesc.SourceAccelerationStructureData = blas.address;
+                m_updates++;
+            } else {
+                m_builds++;
+            }
+            scratchAddress += build.scratchSize;
+
+            // The compacted size is emitted next to the structure
+            D3D12_RAYTRACING_ACCELERATION_STRUCTURE_POSTBUILD_INFO_DESC postbuildInfo = {};
+            bool compact = m_compactor && (blas.flags & D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_ALLOW_COMPACTION) &&
+                m_compactor->Request(build.index, blas.resource.Get(), &postbuildInfo);
+            commandList->BuildRaytracingAccelerationStructure(&buildDesc, compact ? 1 : 0, compact ? &postbuildInfo : nullptr);
+
+            D3D12_RESOURCE_BARRIER uavBarrier = {};
+            uavBarrier.Type = D3D12_RESOURCE_BARRIER_TYPE_UAV;
+            uavBarrier.UAV.pResource = blas.resource.Get();
+            uavBarrier.Flags = D3D12_RESOURCE_BARRIER_FLAG_NONE;
+            uavBarriers.push_back(uavBarrier);
+        }
+        first = batchEnds[batch];
+        m_batches++;
+    }
+
+    // The results are only read by the TLAS build, so they can be waited on together
+    commandList->ResourceBarrier(static_cast<UINT>(uavBarriers.size()), uavBarriers.data());
+    if (m_compactor) m_compactor->ResolveSizes(commandList, queue);
+
+    m_pending.clear();
+}
@@ -0,0 +1,121 @@
+#pragma once
+#include <d3d12.h>
+#include <wrl.h>
+
+#include <vector>
+
+#include "BlasCompactor.h"
+#include "D3D12FenceBackend.h"
+#include "MemoryTracker.h"
+#include "ScratchArena.h"
+#include "Timeline.h"
+
+using Microsoft::WRL::ComPtr;
+
+// How often the geometry under a BLAS changes, picks its build quality
+enum class GeometryHint : UINT {
+	Static = 0, // built once: PREFER_FAST_TRACE, compacted when a compactor is set
+	Dynamic,    // rebuilt or refit often: PREFER_FAST_BUILD, ALLOW_UPDATE
+};
+
+// Queues bottom level builds and records them in batches. Every build of a batch has
+// its own region of one scratch allocation, so the builds of a batch are not separated
+// by barriers and a single set of UAV barriers closes it. Batches of at least
+// AsyncBuildCount builds are recorded on the compute queue instead, the direct queue
+// then waits for them on the GPU. Dynamic structures can be queued again later, as a
+// refit or as a full build over the same buffer.
+class BlasManager {
+
+public:
+	struct BottomLevelAS {
+		ComPtr<ID3D12Resource> resource; // the build result, or the pool page of its compacted copy
+		D3D12_GPU_VIRTUAL_ADDRESS address;
+		GeometryHint hint;
+		D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAGS flags;
+		UINT64 scratchSize;
+		UINT64 updateScratchSize;        // 0 without ALLOW_UPDATE
+	};
+
+	static const UINT AsyncBuildCount = 32;
+	static const UINT64 BatchScratchSize = 32 * 1024 * 1024; // larger batches are split
+
+	BlasManager() {}
+
+	BlasManager(const BlasManager&) = delete;
+	BlasManager& operator=(const BlasManager&) = delete;
+
+	// `computeQueue` is the timeline index of `queue`. Without a compactor every
+	// structure keeps its built size.
+	void Init(ID3D12Device5* device, MemoryTracker* memory, Timeline* timeline, D3D12FenceBackend* fences,
+		ID3D12CommandQueue* queue, uint32_t computeQueue, BlasCompactor* compactor = nullptr);
+
+	static D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAGS GetBuildFlags(GeometryHint hint, bool compact);
+
+	// Creates the result buffer and queues the build. Returns the index of the BLAS,
+	// its address is valid right away. The geometry buffers must stay alive until the
+	// build has run.
+	UINT Request(const D3D12_RAYTRACING_GEOMETRY_DESC& geometry, GeometryHint hint);
+	// Queues an in-place update of a dynamic BLAS whose vertices moved, same topology.
+	// Cheap, but the tree keeps the splits of its last full build.
+	void Refit(UINT index, const D3D12_RAYTRACING_GEOMETRY_DESC& geometry);
+	// Queues a full build of a dynamic BLAS into its own buffer, the address stays valid
+	void Rebuild(UINT index, const D3D12_RAYTRACING_GEOMETRY_DESC& geometry);
+
+	bool HasPending() const { return !m_pending.empty(); }
+	bool IsAsyncBatch() const { return m_pending.size() >= AsyncBuildCount; }
+
+	// Records the queued builds in `commandList`, using `scratch` on the same queue.
+	// `queue` is the timeline index of that queue.
+	void Record(ID3D12GraphicsCommandList4* commandList, ScratchArena* scratch, uint32_t queue);
+
+	// Records the queued builds on the compute queue, which first waits for `after`
+	// (the work producing the geometry). `waiter` waits for the builds on the GPU.
+	TimelinePoint SubmitAsync(TimelinePoint after, ID3D12CommandQueue* waiter);
+
+	// Non-blocking, releases compute scratch the GPU is done with
+	void Retire();
+
+	const BottomLevelAS& Get(UINT index) const { return m_structures[index]; }
+	UINT GetCount() const { return static_cast<UINT>(m_structures.size()); }
+	// Moves a BLAS, e.g. to its compacted copy. Instances must be rebuilt into the TLAS.
+	void Relocate(UINT index, ID3D12Resource* resource, D3D12_GPU_VIRTUAL_ADDRESS address);
+
+	UINT GetBuildCount() const { return m_builds; }
+	UINT GetUpdateCount() const { return m_updates; }
+	UINT GetBatchCount() const { return m_batches; }
+	UINT GetAsyncBatchCount() const { return m_asyncBatches; }
+
+private:
+	struct PendingBuild {
+		UINT index;
+		D3D12_RAYTRACING_GEOMETRY_DESC geometry;
+		UINT64 scratchSize;
+		bool update;
+	};
+
+	void Queue(UINT index, const D3D12_RAYTRACING_GEOMETRY_DESC& geometry, bool update);
+	void RecordBatches(ID3D12GraphicsCommandList4* commandList, ScratchArena* scratch, uint32_t queue);
+
+	ComPtr<ID3D12Device5> m_device;
+	MemoryTracker* m_memory = nullptr;
+	BlasCompactor* m_compactor = nullptr;
+
+	std::vector<BottomLevelAS> m_structures;
+	std::vector<PendingBuild> m_pending;
+
+	// Compute queue path, with a scratch arena of its own so it never aliases the
+	// direct queue builds
+	Timeline* m_timeline = nullptr;
+	D3D12FenceBackend* m_fences = nullptr;
+	ComPtr<ID3D12CommandQueue> m_queue;
+	uint32_t m_computeQueue = 0;
+	ComPtr<ID3D12CommandAllocator> m_allocator;
+	ComPtr<ID3D12GraphicsCommandList4> m_commandList;
+	TimelinePoint m_lastAsync = {};
+	ScratchArena m_computeScratch;
+
+	UINT m_builds = 0;
+	UINT m_updates = 0;
+	UINT m_batches = 0;
+	UINT m_asyncBatches = 0;
+};
@@ -0,0 +1,201 @@
+#include "BlasRefitScheduler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+
+void BlasRefitScheduler::Init(BlasManager* blas, WorkerPool* pool) {
+    m_blas = blas;
+    m_pool = pool;
+    m_tracked.clear();
+    m_refits = 0;
+    m_rebuilds = 0;
+    m_worstDegradation = 1.0;
+}
+
+void BlasRefitScheduler::Add(UINT blas, const D3D12_RAYTRACING_GEOMETRY_DESC& geometry, const void* vertices, UINT32 vertexStride,
+    UINT64 vertexCount, const UINT32* indices, UINT64 indexCount) {
+    Tracked tracked = {};
+    tracked.blas = blas;
+    tracked.geometry = geometry;
+    tracked.vertexStride = vertexStride;
+    tracked.vertexCount = vertexCount;
+    tracked.vertices.assign(static_cast<const UINT8*>(vertices), static_cast<const UINT8*>(vertices) + vertexCount * vertexStride);
+    tracked.indices.assign(indices, indices + indexCount);
+    tracked.bvh.Build(m_pool, vertices, vertexStride, vertexCount, indices, indexCount);
+    tracked.referenceCost = tracked.bvh.GetStats().sahCost;
+    tracked.degradation = 1.0;
+    m_tracked.push_back(std::move(tracked));
+}
+
+void BlasRefitScheduler::Deformed(UINT blas, const void* vertices) {
+    Tracked& tracked = Find(blas);
+    memcpy(tracked.vertices.data(), vertices, tracked.vertices.size());
+    tracked.bvh.Refit(tracked.vertices.data(), tracked.vertexStride, tracked.vertexCount,
+        tracked.indices.data(), tracked.indices.size());
+    tracked.deformed = true;
+
+    // A new reference starts as soon as the previous one is in, it trails by its build time
+    if (m_pool) {
+        if (!tracked.reference.valid()) {
+            StartReference(tracked);
+        } else if (tracked.reference.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+            tracked.referenceCost = tracked.reference.get();
+            StartReference(tracked);
+        }
+    } else if (++tracked.framesSinceReference >= ReferenceInterval) {
+        CpuBvh reference;
+        reference.Build(nullptr, tracked.vertices.data(), tracked.vertexStride, tracked.vertexCount,
+            tracked.indices.data(), tracked.indices.size());
+        tracked.referenceCost = reference.GetStats().sahCost;
+        tracked.framesSinceReference = 0;
+    }
+    tracked.degradation = tracked.bvh.GetStats().sahCost / (std::max)(tracked.referenceCost, 1e-9);
+}
+
+bool BlasRefitScheduler::Schedule() {
+    // The most degraded past the threshold get this frame's rebuilds
+    std::vector<Tracked*> degraded;
+    bool queued = false;
+    for (Tracked& tracked : m_tracked) {
+        if (!tracked.deformed) continue;
+        if (tracked.degradation > RebuildDegradation) degraded.push_back(&tracked);
+        queued = true;
+    }
+    std::sort(degraded.begin(), degraded.end(), [](const Tracked* a, const Tracked* b) { return a->degradation > b->degradation; });
+    if (degraded.size() > RebuildsPerFrame) degraded.resize(RebuildsPerFrame);
+
+    for (Tracked* tracked : degraded) {
+        m_worstDegradation = (std::max)(m_worstDegradation, tracked->degradation);
+        tracked->bvh.Build(m_pool, tracked->vertices.data(), tracked->vertexStride, tracked->vertexCount,
+            tracked->indices.data(), tracked->indices.size());
+        tracked->referenceCost = tracked->bvh.GetStats().sahCost;
+        tracked->degradation = 1.0;
+        tracked->deformed = false;
+        m_blas->Rebuild(tracked->blas, tracked->geometry);
+        m_rebuilds++;
+    }
+    for (Tracked& tracked : m_tracked) {
+        if (!tracked.deformed) continue;
+        tracked.deformed = false;
+        m_blas->Refit(tracked.blas, tracked.geometry);
+        m_refits++;
+    }
+    return queued;
+}
+
+double BlasRefitScheduler::GetDegradation(UINT blas) const {
+    return Find(blas).degradation;
+}
+
+void BlasRefitScheduler::StartReference(Tracked& tracked) {
+    // The task owns its copy of the mesh, later frames overwrite the tracked vertices
+    auto vertices = std::make_shared<std::vector<UINT8>>(tracked.vertices);
+    auto indices = std::make_shared<std::vector<UINT32>>(tracked.indices);
+    UINT32 vertexStride = tracked.vertexStride;
+    UINT64 vertexCount = tracked.vertexCount;
+    tracked.reference = m_pool->Submit([vertices, indices, vertexStride, vertexCount]() {
+        CpuBvh reference;
+        reference.Build(nullptr, vertices->data(), vertexStride, vertexCount, indices->data(), indices->size());
+        return reference.GetStats().sahCost;
+    });
+}
+
+BlasRefitScheduler::Tracked& BlasRefitScheduler::Find(UINT blas) {
+    for (Tracked& tracked : m_tracked) {
+        if (tracked.blas == blas) return tracked;
+    }
+    throw std::logic_error("The BLAS is not tracked by the refit scheduler");
+}
+
+const BlasRefitScheduler::Tracked& BlasRefitScheduler::Find(UINT blas) const {
+    return const_cast<BlasRefitScheduler*>(this)->Find(blas);
+}
+
+namespace {
+
+// A square ribbon of `side` cells, two triangles each, with a standing wave across it.
+// `amount` twists it about its length by up to a full turn and moves the wave.
+void DeformRibbon(UINT32 side, float amount, std::vector<float>* positions) {
+    const float pi = 3.14159265f;
+    positions->resize(size_t(side + 1) * (side + 1) * 3);
+    for (UINT32 v = 0; v <= side; v++) {
+        for (UINT32 u = 0; u <= side; u++) {
+            float fu = static_cast<float>(u) / side, fv = static_cast<float>(v) / side - 0.5f;
+            float angle = amount * 2.0f * pi * fu;
+            float* position = positions->data() + (size_t(v) * (side + 1) + u) * 3;
+            position[0] = fu;
+            position[1] = fv * std::sin(angle) + 0.1f * std::sin(8.0f * fu + 8.0f * amount) * std::cos(2.0f * pi * fv);
+            position[2] = fv * std::cos(angle);
+        }
+    }
+}
+
+}
+
+std::wstring BenchmarkRefit(WorkerPool* pool, UINT64 triangles, UINT frames) {
+    UINT32 side = static_cast<UINT32>(std::ceil(std::sqrt(static_cast<double>(triangles) / 2.0)));
+    std::vector<UINT32> indices;
+    indices.reserve(size_t(side) * side * 6);
+    for (UINT32 z = 0; z < side; z++) {
+        for (UINT32 x = 0; x < side; x++) {
+            UINT32 corner = z * (side + 1) + x;
+            UINT32 quad[6] = { corner, corner + side + 1, corner + 1, corner + 1, corner + side + 1, corner + side + 2 };
+            indices.insert(indices.end(), quad, quad + 6);
+        }
+    }
+    const UINT32 stride = 3 * sizeof(float);
+
+    std::vector<float> positions;
+    DeformRibbon(side, 0.0f, &positions);
+    UINT64 vertexCount = positions.size() / 3;
+    CpuBvh refit, rebuilt;
+    refit.Build(pool, positions.data(), stride, vertexCount, indices.data(), indices.size());
+    double builtCost = refit.GetStats().sahCost;
+
+    std::wstringstream ss;
+    ss.setf(std::ios::fixed);
+    ss.precision(2);
+    ss << L"Refit, " << indices.size() / 3000 << L"K triangles over " << frames << L" frames, SAH "
+       << builtCost << L" at the build\n";
+
+    // Refit only, against a rebuild of every frame
+    std::vector<double> rebuiltCosts(frames + 1, builtCost);
+    double refitMs = 0.0, buildMs = 0.0;
+    UINT step = (std::max)(1u, frames / 10);
+    for (UINT frame = 1; frame <= frames; frame++) {
+        DeformRibbon(side, static_cast<float>(frame) / frames, &positions);
+        refit.Refit(positions.data(), stride, vertexCount, indices.data(), indices.size());
+        rebuilt.Build(pool, positions.data(), stride, vertexCount, indices.data(), indices.size());
+        rebuiltCosts[frame] = rebuilt.GetStats().sahCost;
+        refitMs += refit.GetStats().refitMs;
+        buildMs += rebuilt.GetStats().buildMs;
+        if (frame % step != 0 && frame != frames) continue;
+        ss << L"  frame " << frame << L": refit SAH " << refit.GetStats().sahCost << L", rebuilt "
+           << rebuiltCosts[frame] << L"; refit tree " << refit.GetStats().sahCost / builtCost << L"x its build, "
+           << refit.GetStats().sahCost / rebuiltCosts[frame] << L"x the rebuild\n";
+    }
+    ss << L"  " << refitMs / frames << L" ms per refit, " << buildMs / frames << L" ms per build\n";
+
+    // The same frames, rebuilt whenever the refit tree passes the threshold
+    DeformRibbon(side, 0.0f, &positions);
+    refit.Build(pool, positions.data(), stride, vertexCount, indices.data(), indices.size());
+    UINT rebuilds = 0;
+    double excess = 0.0;
+    for (UINT frame = 1; frame <= frames; frame++) {
+        DeformRibbon(side, static_cast<float>(frame) / frames, &positions);
+        refit.Refit(positions.data(), stride, vertexCount, indices.data(), indices.size());
+        if (refit.GetStats().sahCost / rebuiltCosts[frame] > BlasRefitScheduler::RebuildDegradation) {
+            refit.Build(pool, positions.data(), stride, vertexCount, indices.data(), indices.size());
+            rebuilds++;
+        }
+        excess += refit.GetStats().sahCost / rebuiltCosts[frame];
+    }
+    ss << L"  rebuilding past " << BlasRefitScheduler::RebuildDegradation << L"x: " << rebuilds
+       << L" rebuilds, the tree averages " << excess / frames << L"x the rebuild\n";
+    return ss.str();
+}
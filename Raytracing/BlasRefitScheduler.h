@@ -0,0 +1,91 @@
+#pragma once
+#include <d3d12.h>
+
+#include <future>
+#include <string>
+#include <vector>
+
+#include "BlasManager.h"
+#include "CpuBvh.h"
+#include "WorkerPool.h"
+
+// Keeps the BLAS of deforming meshes current every frame. A dynamic BLAS is refit in
+// place after its vertices moved, which is cheap but leaves the tree split for the
+// positions of its last full build, so traversal slows down as the mesh deforms.
+//
+// The BLAS itself cannot be inspected, so a CPU BVH over the same triangles mirrors it:
+// built when the BLAS is built, refit when it is refit. The growth of its SAH cost is
+// compared with a reference BVH built from scratch over recent positions, in the
+// background on the pool. Growth against the last build alone misleads: a mesh that
+// folds up shrinks its root box, and the normalized cost of the refit tree drops while
+// it gets worse than a fresh tree.
+//
+// Past RebuildDegradation the BLAS is rebuilt instead of refit, the most degraded first
+// and at most RebuildsPerFrame a frame, so the rebuilds of many deforming meshes are
+// spread over frames. The others keep being refit while they wait.
+class BlasRefitScheduler {
+
+public:
+	static constexpr double RebuildDegradation = 1.3; // refit SAH cost over the cost of the reference
+	static const UINT RebuildsPerFrame = 1;
+	static const UINT ReferenceInterval = 8;          // frames between references built without a pool
+
+	BlasRefitScheduler() {}
+
+	BlasRefitScheduler(const BlasRefitScheduler&) = delete;
+	BlasRefitScheduler& operator=(const BlasRefitScheduler&) = delete;
+
+	// References are built in the background on `pool`, or every ReferenceInterval
+	// frames on the calling thread without one
+	void Init(BlasManager* blas, WorkerPool* pool = nullptr);
+
+	// Starts tracking the dynamic BLAS `blas`, built from these vertices. Positions are
+	// the first three floats of each `vertexStride` byte vertex.
+	void Add(UINT blas, const D3D12_RAYTRACING_GEOMETRY_DESC& geometry, const void* vertices, UINT32 vertexStride,
+		UINT64 vertexCount, const UINT32* indices, UINT64 indexCount);
+	// The vertices of `blas` moved, as many as it was added with
+	void Deformed(UINT blas, const void* vertices);
+	// Queues a refit or a rebuild for every BLAS deformed since the last call. Returns
+	// false when nothing was queued.
+	bool Schedule();
+
+	// Cost of the refit tree over what a rebuild would give, as of the newest reference
+	double GetDegradation(UINT blas) const;
+	UINT64 GetRefitCount() const { return m_refits; }
+	UINT64 GetRebuildCount() const { return m_rebuilds; }
+	double GetWorstDegradation() const { return m_worstDegradation; } // seen before a rebuild
+
+private:
+	struct Tracked {
+		UINT blas;
+		D3D12_RAYTRACING_GEOMETRY_DESC geometry;
+		UINT32 vertexStride;
+		UINT64 vertexCount;
+		std::vector<UINT8> vertices;   // the latest ones
+		std::vector<UINT32> indices;
+		CpuBvh bvh;                    // mirrors the BLAS
+		std::future<double> reference; // SAH cost of a fresh build, in the background
+		double referenceCost;
+		UINT framesSinceReference;
+		double degradation;
+		bool deformed;
+	};
+
+	void StartReference(Tracked& tracked);
+	Tracked& Find(UINT blas);
+	const Tracked& Find(UINT blas) const;
+
+	BlasManager* m_blas = nullptr;
+	WorkerPool* m_pool = nullptr;
+	std::vector<Tracked> m_tracked;
+
+	UINT64 m_refits = 0;
+	UINT64 m_rebuilds = 0;
+	double m_worstDegradation = 1.0;
+};
+
+// Refits a CPU BVH over a ribbon of about `triangles` triangles through `frames` frames
+// of a growing twist, and reports the degradation curve: the SAH cost of the refit tree
+// against its last build and against a rebuild of the same frame. Then replays the
+// frames with a rebuild whenever the refit tree passes RebuildDegradation.
+std::wstring BenchmarkRefit(WorkerPool* pool, UINT64 triangles, UINT frames);
@@ -0,0 +1,572 @@
+#include "CpuBvh.h"
+
+#include <emmintrin.h>
+
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+#include "MeshFile.h"
+
+namespace {
+
+// Boxes and points live in SSE registers, x, y, z in the low lanes. The w lane is not used.
+struct Bounds {
+    __m128 min;
+    __m128 max;
+
+    static Bounds Empty() {
+        return { _mm_set1_ps(FLT_MAX), _mm_set1_ps(-FLT_MAX) };
+    }
+
+    void Grow(__m128 point) {
+        min = _mm_min_ps(min, point);
+        max = _mm_max_ps(max, point);
+    }
+
+    void Grow(const Bounds& other) {
+        min = _mm_min_ps(min, other.min);
+        max = _mm_max_ps(max, other.max);
+    }
+
+    float Area() const {
+        float extent[4];
+        _mm_storeu_ps(extent, _mm_sub_ps(max, min));
+        if (extent[0] < 0.0f) return 0.0f;
+        return 2.0f * (extent[0] * extent[1] + extent[1] * extent[2] + extent[2] * extent[0]);
+    }
+};
+
+// Twice the centroid, the halving does not change which bin a triangle falls in
+__m128 Centroid(const Bounds& bounds) {
+    return _mm_add_ps(bounds.min, bounds.max);
+}
+
+// Triangles are partitioned together with their bounds, so every pass over a node
+// reads memory in order
+struct Primitive {
+    Bounds bounds;
+    UINT32 triangle;
+};
+
+struct Bin {
+    Bounds bounds;
+    UINT32 count;
+};
+
+// Primitives [first, first + count), to become `node`
+struct Range {
+    UINT32 node;
+    UINT32 first;
+    UINT32 count;
+    Bounds bounds;
+    Bounds centroids;
+};
+
+// Maps centroids to bins of the centroid bounds of a node, per axis
+struct BinMapping {
+    __m128 minimum;
+    __m128 scale;
+    UINT last;
+
+    BinMapping(const Bounds& centroids, UINT binCount) : minimum(centroids.min), last(binCount - 1) {
+        // A flat axis maps everything to bin 0 instead of dividing by zero
+        __m128 extent = _mm_sub_ps(centroids.max, centroids.min);
+        __m128 inverse = _mm_div_ps(_mm_set1_ps(static_cast<float>(binCount)), extent);
+        scale = _mm_and_ps(inverse, _mm_cmpgt_ps(extent, _mm_setzero_ps()));
+    }
+
+    void Map(__m128 centroid, UINT (&bins)[4]) const {
+        __m128i k = _mm_cvttps_epi32(_mm_mul_ps(_mm_sub_ps(centroid, minimum), scale));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(bins), k);
+        for (int a = 0; a < 3; a++) bins[a] = (std::min)(bins[a], last);
+    }
+};
+
+class BvhBuilder {
+
+public:
+    BvhBuilder(WorkerPool* pool, std::vector<Primitive>& primitives) : m_pool(pool), m_primitives(primitives) {}
+
+    Range GetRange(UINT32 node, UINT32 first, UINT32 count, bool parallel) const;
+
+    // Stores the bounds of `range.node` and either makes it a leaf or appends its two
+    // children to `nodes`. Returns whether it was split.
+    bool Split(std::vector<BvhNode>& nodes, const Range& range, Range* left, Range* right, bool parallel) const;
+
+    // Builds the whole subtree under `root` into `nodes`, whose first node is the root
+    void BuildSubtree(std::vector<BvhNode>& nodes, const Range& root) const;
+
+private:
+    void FillBins(const Range& range, const BinMapping& mapping, bool parallel, Bin (&bins)[3][CpuBvh::BinCount]) const;
+
+    // Chunks of the parallel passes over a node
+    static const size_t ChunkSize = 16 * 1024;
+
+    WorkerPool* m_pool;
+    std::vector<Primitive>& m_primitives;
+};
+
+Range BvhBuilder::GetRange(UINT32 node, UINT32 first, UINT32 count, bool parallel) const {
+    auto gather = [this](size_t begin, size_t end, Range& range) {
+        range.bounds = Bounds::Empty();
+        range.centroids = Bounds::Empty();
+        for (size_t i = begin; i < end; i++) {
+            const Bounds& bounds = m_primitives[i].bounds;
+            range.bounds.Grow(bounds);
+            range.centroids.Grow(Centroid(bounds));
+        }
+    };
+
+    Range range = { node, first, count, Bounds::Empty(), Bounds::Empty() };
+    if (!parallel) {
+        gather(first, first + count, range);
+        return range;
+    }
+
+    std::vector<Range> chunks((count + ChunkSize - 1) / ChunkSize);
+    m_pool->ParallelFor(count, ChunkSize, [&](size_t begin, size_t end) {
+        gather(first + begin, first + end, chunks[begin / ChunkSize]);
+    });
+    range.bounds = chunks[0].bounds;
+    range.centroids = chunks[0].centroids;
+    for (size_t c = 1; c < chunks.size(); c++) {
+        range.bounds.Grow(chunks[c].bounds);
+        range.centroids.Grow(chunks[c].centroids);
+    }
+    return range;
+}
+
+void BvhBuilder::FillBins(const Range& range, const BinMapping& mapping, bool parallel, Bin (&bins)[3][CpuBvh::BinCount]) const {
+    struct Bins { Bin bins[3][CpuBvh::BinCount]; };
+    auto bin = [&](size_t begin, size_t end, Bins& result) {
+        for (auto& axis : result.bins) {
+            for (UINT k = 0; k <= mapping.last; k++) axis[k] = { Bounds::Empty(), 0 };
+        }
+        for (size_t i = begin; i < end; i++) {
+            const Bounds& bounds = m_primitives[i].bounds;
+            UINT k[4];
+            mapping.Map(Centroid(bounds), k);
+            for (int a = 0; a < 3; a++) {
+                result.bins[a][k[a]].bounds.Grow(bounds);
+                result.bins[a][k[a]].count++;
+            }
+        }
+    };
+
+    if (!parallel) {
+        Bins result;
+        bin(range.first, range.first + range.count, result);
+        memcpy(bins, result.bins, sizeof(bins));
+        return;
+    }
+
+    std::vector<Bins> chunks((range.count + ChunkSize - 1) / ChunkSize);
+    m_pool->ParallelFor(range.count, ChunkSize, [&](size_t begin, size_t end) {
+        bin(range.first + begin, range.first + end, chunks[begin / ChunkSize]);
+    });
+    memcpy(bins, chunks[0].bins, sizeof(bins));
+    for (size_t c = 1; c < chunks.size(); c++) {
+        for (int a = 0; a < 3; a++) {
+            for (UINT k = 0; k <= mapping.last; k++) {
+                bins[a][k].bounds.Grow(chunks[c].bins[a][k].bounds);
+                bins[a][k].count += chunks[c].bins[a][k].count;
+            }
+        }
+    }
+}
+
+bool BvhBuilder::Split(std::vector<BvhNode>& nodes, const Range& range, Range* left, Range* right, bool parallel) const {
+    float boundsMin[4], boundsMax[4];
+    _mm_storeu_ps(boundsMin, range.bounds.min);
+    _mm_storeu_ps(boundsMax, range.bounds.max);
+    BvhNode& node = nodes[range.node];
+    memcpy(node.boundsMin, boundsMin, sizeof(node.boundsMin));
+    memcpy(node.boundsMax, boundsMax, sizeof(node.boundsMax));
+    node.leftOrFirst = range.first;
+    node.triangleCount = range.count;
+    if (range.count <= 1) return false;
+
+    // Cheapest plane between two bins on any axis, against intersecting every triangle.
+    // Small nodes get fewer bins, past a few triangles each bin would be mostly empty.
+    UINT binCount = (std::min)(UINT(CpuBvh::BinCount), (std::max)(4u, range.count));
+    BinMapping mapping(range.centroids, binCount);
+    Bin bins[3][CpuBvh::BinCount];
+    FillBins(range, mapping, parallel, bins);
+
+    float centroidsMin[4], centroidsMax[4];
+    _mm_storeu_ps(centroidsMin, range.centroids.min);
+    _mm_storeu_ps(centroidsMax, range.centroids.max);
+    float bestCost = FLT_MAX;
+    int bestAxis = -1;
+    UINT bestSplit = 0;
+    for (int a = 0; a < 3; a++) {
+        if (centroidsMax[a] <= centroidsMin[a]) continue;
+
+        float leftCosts[CpuBvh::BinCount];
+        Bounds sweep = Bounds::Empty();
+        UINT32 count = 0;
+        for (UINT k = 0; k < binCount - 1; k++) {
+            sweep.Grow(bins[a][k].bounds);
+            count += bins[a][k].count;
+            leftCosts[k] = sweep.Area() * count;
+        }
+        sweep = Bounds::Empty();
+        count = 0;
+        for (UINT k = binCount - 1; k > 0; k--) {
+            sweep.Grow(bins[a][k].bounds);
+            count += bins[a][k].count;
+            float cost = leftCosts[k - 1] + sweep.Area() * count;
+            if (cost < bestCost) {
+                bestCost = cost;
+                bestAxis = a;
+                bestSplit = k;
+            }
+        }
+    }
+
+    UINT32 child = static_cast<UINT32>(nodes.size());
+    bool split = false;
+    if (bestAxis >= 0) {
+        bestCost = CpuBvh::TraversalCost + CpuBvh::IntersectionCost * bestCost / (std::max)(range.bounds.Area(), FLT_MIN);
+        if (bestCost >= CpuBvh::IntersectionCost * range.count && range.count <= CpuBvh::MaxLeafSize) return false;
+
+        // The children bounds come from the bins, their centroid bounds from the partition
+        *left = { child, range.first, 0, Bounds::Empty(), Bounds::Empty() };
+        *right = { child + 1, 0, 0, Bounds::Empty(), Bounds::Empty() };
+        for (UINT k = 0; k < binCount; k++) {
+            Range& side = k < bestSplit ? *left : *right;
+            side.bounds.Grow(bins[bestAxis][k].bounds);
+            side.count += bins[bestAxis][k].count;
+        }
+        right->first = range.first + left->count;
+
+        Primitive* lower = m_primitives.data() + range.first;
+        Primitive* upper = lower + range.count;
+        while (lower < upper) {
+            __m128 centroid = Centroid(lower->bounds);
+            UINT k[4];
+            mapping.Map(centroid, k);
+            if (k[bestAxis] < bestSplit) {
+                left->centroids.Grow(centroid);
+                lower++;
+            } else {
+                right->centroids.Grow(centroid);
+                std::swap(*lower, *--upper);
+            }
+        }
+        split = left->count > 0 && right->count > 0;
+    }
+    if (!split) {
+        // Every centroid in one spot: only the count tells the halves apart
+        if (range.count <= CpuBvh::MaxLeafSize) return false;
+        UINT32 middle = range.count / 2;
+        *left = GetRange(child, range.first, middle, parallel);
+        *right = GetRange(child + 1, range.first + middle, range.count - middle, parallel);
+    }
+
+    nodes.resize(nodes.size() + 2);
+    nodes[range.node].leftOrFirst = child;
+    nodes[range.node].triangleCount = 0;
+    return true;
+}
+
+void BvhBuilder::BuildSubtree(std::vector<BvhNode>& nodes, const Range& root) const {
+    nodes.assign(1, BvhNode());
+    std::vector<Range> stack = { root };
+    stack[0].node = 0;
+    while (!stack.empty()) {
+        Range range = stack.back();
+        stack.pop_back();
+        Range left, right;
+        if (Split(nodes, range, &left, &right, false)) {
+            stack.push_back(right);
+            stack.push_back(left);
+        }
+    }
+}
+
+}
+
+void CpuBvh::Build(WorkerPool* pool, const void* vertices, UINT32 vertexStride, UINT64 vertexCount,
+    const UINT32* indices, UINT64 indexCount) {
+    if (indexCount % 3 != 0) { throw std::logic_error("The index count is not a multiple of 3"); }
+    if (indexCount / 3 > UINT32_MAX) { throw std::logic_error("Too many triangles for a CPU BVH"); }
+    auto start = std::chrono::high_resolution_clock::now();
+
+    UINT32 triangleCount = static_cast<UINT32>(indexCount / 3);
+    const UINT8* positions = static_cast<const UINT8*>(vertices);
+    std::vector<Primitive> primitives(triangleCount);
+    auto computeBounds = [&](size_t begin, size_t end) {
+        for (size_t t = begin; t < end; t++) {
+            Bounds bounds = Bounds::Empty();
+            for (int v = 0; v < 3; v++) {
+                UINT32 index = indices[3 * t + v];
+                if (index >= vertexCount) { throw std::runtime_error("Triangle index out of range"); }
+                const float* position = reinterpret_cast<const float*>(positions + UINT64(index) * vertexStride);
+                bounds.Grow(_mm_setr_ps(position[0], position[1], position[2], 0.0f));
+            }
+            primitives[t] = { bounds, static_cast<UINT32>(t) };
+        }
+    };
+    if (pool) pool->ParallelFor(triangleCount, 64 * 1024, computeBounds);
+    else computeBounds(0, triangleCount);
+
+    m_nodes.clear();
+    m_triangles.clear();
+    if (triangleCount == 0) {
+        ComputeStats(0.0);
+        return;
+    }
+
+    // Top levels on this thread until the subtrees are small enough to balance over the pool
+    BvhBuilder builder(pool, primitives);
+    UINT32 subtreeSize = pool ? (std::max)(4096u, triangleCount / (8 * (pool->GetThreadCount() + 1))) : UINT32_MAX;
+    std::vector<Range> subtrees;
+    std::vector<Range> open = { builder.GetRange(0, 0, triangleCount, pool && triangleCount >= ParallelBinningSize) };
+    m_nodes.resize(1);
+    while (!open.empty()) {
+        Range range = open.back();
+        open.pop_back();
+        if (range.count <= subtreeSize) {
+            subtrees.push_back(range);
+            continue;
+        }
+        Range left, right;
+        if (builder.Split(m_nodes, range, &left, &right, range.count >= ParallelBinningSize)) {
+            open.push_back(right);
+            open.push_back(left);
+        }
+    }
+
+    // Largest first, so the last tasks to start are short
+    std::sort(subtrees.begin(), subtrees.end(), [](const Range& a, const Range& b) { return a.count > b.count; });
+    std::vector<std::vector<BvhNode>> subtreeNodes(subtrees.size());
+    auto buildSubtrees = [&](size_t begin, size_t end) {
+        for (size_t s = begin; s < end; s++) builder.BuildSubtree(subtreeNodes[s], subtrees[s]);
+    };
+    if (pool) pool->ParallelFor(subtrees.size(), 1, buildSubtrees);
+    else buildSubtrees(0, subtrees.size());
+
+    // Each subtree root replaces its placeholder, the rest is appended with its child indices moved
+    for (size_t s = 0; s < subtrees.size(); s++) {
+        const std::vector<BvhNode>& nodes = subtreeNodes[s];
+        UINT32 base = static_cast<UINT32>(m_nodes.size()) - 1;
+        m_nodes.reserve(m_nodes.size() + nodes.size() - 1);
+        for (size_t n = 0; n < nodes.size(); n++) {
+            BvhNode node = nodes[n];
+            if (node.triangleCount == 0) node.leftOrFirst += base;
+            if (n == 0) m_nodes[subtrees[s].node] = node;
+            else m_nodes.push_back(node);
+        }
+    }
+
+    m_triangles.resize(triangleCount);
+    for (UINT32 t = 0; t < triangleCount; t++) m_triangles[t] = primitives[t].triangle;
+    ComputeStats(std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count());
+}
+
+void CpuBvh::Refit(const void* vertices, UINT32 vertexStride, UINT64 vertexCount,
+    const UINT32* indices, UINT64 indexCount) {
+    if (indexCount != UINT64(m_triangles.size()) * 3) { throw std::logic_error("The refit mesh has a different triangle count"); }
+    auto start = std::chrono::high_resolution_clock::now();
+
+    // Children come after their parent, so walking the nodes backwards visits both
+    // children of a node before the node itself
+    const UINT8* positions = static_cast<const UINT8*>(vertices);
+    for (size_t n = m_nodes.size(); n-- > 0;) {
+        BvhNode& node = m_nodes[n];
+        Bounds bounds = Bounds::Empty();
+        if (node.triangleCount > 0) {
+            for (UINT32 i = node.leftOrFirst; i < node.leftOrFirst + node.triangleCount; i++) {
+                const UINT32* triangle = indices + 3 * UINT64(m_triangles[i]);
+                for (int v = 0; v < 3; v++) {
+                    if (triangle[v] >= vertexCount) { throw std::runtime_error("Triangle index out of range"); }
+                    const float* position = reinterpret_cast<const float*>(positions + UINT64(triangle[v]) * vertexStride);
+                    bounds.Grow(_mm_setr_ps(position[0], position[1], position[2], 0.0f));
+                }
+            }
+        } else {
+            for (UINT32 child = node.leftOrFirst; child <= node.leftOrFirst + 1; child++) {
+                const BvhNode& c = m_nodes[child];
+                bounds.Grow(Bounds{
+                    _mm_setr_ps(c.boundsMin[0], c.boundsMin[1], c.boundsMin[2], 0.0f),
+                    _mm_setr_ps(c.boundsMax[0], c.boundsMax[1], c.boundsMax[2], 0.0f) });
+            }
+        }
+        float stored[4];
+        _mm_storeu_ps(stored, bounds.min);
+        memcpy(node.boundsMin, stored, sizeof(node.boundsMin));
+        _mm_storeu_ps(stored, bounds.max);
+        memcpy(node.boundsMax, stored, sizeof(node.boundsMax));
+    }
+
+    double refitMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+    ComputeStats(m_stats.buildMs);
+    m_stats.refitMs = refitMs;
+}
+
+void CpuBvh::ComputeStats(double buildMs) {
+    m_stats = {};
+    m_stats.nodeCount = m_nodes.size();
+    m_stats.buildMs = buildMs;
+    if (m_nodes.empty()) return;
+
+    auto area = [](const BvhNode& node) {
+        Bounds bounds = {
+            _mm_setr_ps(node.boundsMin[0], node.boundsMin[1], node.boundsMin[2], 0.0f),
+            _mm_setr_ps(node.boundsMax[0], node.boundsMax[1], node.boundsMax[2], 0.0f) };
+        return static_cast<double>(bounds.Area());
+    };
+    double rootArea = (std::max)(area(m_nodes[0]), double(FLT_MIN));
+
+    UINT64 leafTriangles = 0;
+    std::vector<std::pair<UINT32, UINT32>> stack = { { 0, 1 } }; // node, depth
+    while (!stack.empty()) {
+        UINT32 index = stack.back().first;
+        UINT32 depth = stack.back().second;
+        stack.pop_back();
+        const BvhNode& node = m_nodes[index];
+        m_stats.maxDepth = (std::max)(m_stats.maxDepth, depth);
+        if (node.triangleCount > 0) {
+            m_stats.leafCount++;
+            m_stats.maxLeafSize = (std::max)(m_stats.maxLeafSize, node.triangleCount);
+            leafTriangles += node.triangleCount;
+            m_stats.sahCost += IntersectionCost * node.triangleCount * area(node) / rootArea;
+        } else {
+            m_stats.sahCost += TraversalCost * area(node) / rootArea;
+            stack.push_back({ node.leftOrFirst, depth + 1 });
+            stack.push_back({ node.leftOrFirst + 1, depth + 1 });
+        }
+    }
+    m_stats.averageLeafSize = double(leafTriangles) / double(m_stats.leafCount);
+}
+
+bool CpuBvh::Write(LPCWSTR fileName) const {
+    BvhFileHeader header = {};
+    header.magic = BvhFileMagic;
+    header.version = BvhFileVersion;
+    header.headerSize = sizeof(BvhFileHeader);
+    header.nodeSize = sizeof(BvhNode);
+    header.nodeCount = m_nodes.size();
+    header.triangleCount = m_triangles.size();
+    header.nodeOffset = sizeof(BvhFileHeader);
+    header.triangleOffset = header.nodeOffset + header.nodeCount * sizeof(BvhNode);
+    header.sahCost = m_stats.sahCost;
+    header.checksum = MeshChecksum(m_nodes.data(), header.nodeCount * sizeof(BvhNode));
+    header.checksum = MeshChecksum(m_triangles.data(), header.triangleCount * sizeof(UINT32), header.checksum);
+
+    std::ofstream file(fileName, std::ios::binary | std::ios::trunc);
+    if (!file.good()) return false;
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char*>(m_nodes.data()), static_cast<std::streamsize>(header.nodeCount * sizeof(BvhNode)));
+    file.write(reinterpret_cast<const char*>(m_triangles.data()), static_cast<std::streamsize>(header.triangleCount * sizeof(UINT32)));
+    return file.good();
+}
+
+bool CpuBvh::Read(LPCWSTR fileName) {
+    std::ifstream file(fileName, std::ios::binary | std::ios::ate);
+    if (!file.good()) return false;
+    UINT64 fileSize = static_cast<UINT64>(file.tellg());
+    file.seekg(0);
+
+    BvhFileHeader header = {};
+    if (fileSize < sizeof(header) || !file.read(reinterpret_cast<char*>(&header), sizeof(header))) return false;
+    if (header.magic != BvhFileMagic || header.version != BvhFileVersion ||
+        header.headerSize != sizeof(BvhFileHeader) || header.nodeSize != sizeof(BvhNode)) return false;
+    if (header.nodeOffset != sizeof(BvhFileHeader) || header.nodeCount > fileSize / sizeof(BvhNode) ||
+        header.triangleCount > fileSize / sizeof(UINT32) ||
+        header.triangleOffset != header.nodeOffset + header.nodeCount * sizeof(BvhNode) ||
+        header.triangleOffset + header.triangleCount * sizeof(UINT32) > fileSize) return false;
+
+    std::vector<BvhNode> nodes(static_cast<size_t>(header.nodeCount));
+    std::vector<UINT32> triangles(static_cast<size_t>(header.triangleCount));
+    file.read(reinterpret_cast<char*>(nodes.data()), static_cast<std::streamsize>(header.nodeCount * sizeof(BvhNode)));
+    file.read(reinterpret_cast<char*>(triangles.data()), static_cast<std::streamsize>(header.triangleCount * sizeof(UINT32)));
+    if (!file.good()) return false;
+
+    UINT64 checksum = MeshChecksum(nodes.data(), header.nodeCount * sizeof(BvhNode));
+    checksum = MeshChecksum(triangles.data(), header.triangleCount * sizeof(UINT32), checksum);
+    if (checksum != header.checksum) return false;
+
+    // Node links are followed without checks afterwards, a corrupt file must not pass.
+    // Children after their parent also rules out cycles, and Refit relies on it.
+    for (size_t n = 0; n < nodes.size(); n++) {
+        const BvhNode& node = nodes[n];
+        bool valid = node.triangleCount > 0 ?
+            UINT64(node.leftOrFirst) + node.triangleCount <= triangles.size() :
+            UINT64(node.leftOrFirst) + 1 < nodes.size() && node.leftOrFirst > n;
+        if (!valid) return false;
+    }
+
+    m_nodes.swap(nodes);
+    m_triangles.swap(triangles);
+    ComputeStats(0.0);
+    return true;
+}
+
+namespace {
+
+// Vertices in the layout of the renderer: position, then color
+struct BenchmarkVertex {
+    float position[3];
+    float color[4];
+};
+
+// A rolling height field of about `triangleCount` triangles, two per grid cell
+void CreateHeightField(UINT64 triangleCount, std::vector<BenchmarkVertex>* vertices, std::vector<UINT32>* indices) {
+    UINT32 side = static_cast<UINT32>(std::ceil(std::sqrt(static_cast<double>(triangleCount) / 2.0)));
+    vertices->resize(size_t(side + 1) * (side + 1));
+    for (UINT32 z = 0; z <= side; z++) {
+        for (UINT32 x = 0; x <= side; x++) {
+            float fx = static_cast<float>(x), fz = static_cast<float>(z);
+            BenchmarkVertex& vertex = (*vertices)[size_t(z) * (side + 1) + x];
+            vertex = { { fx, 8.0f * std::sin(fx * 0.05f) * std::cos(fz * 0.03f) + std::sin(fx * 0.7f + fz * 0.4f), fz }, { 1.0f, 1.0f, 1.0f, 1.0f } };
+        }
+    }
+    indices->clear();
+    indices->reserve(size_t(triangleCount) * 3);
+    for (UINT32 cell = 0; cell < size_t(side) * side && indices->size() < triangleCount * 3; cell++) {
+        UINT32 x = cell % side, z = cell / side;
+        UINT32 corner = z * (side + 1) + x;
+        UINT32 quad[6] = { corner, corner + side + 1, corner + 1, corner + 1, corner + side + 1, corner + side + 2 };
+        indices->insert(indices->end(), quad, quad + (indices->size() + 6 <= triangleCount * 3 ? 6 : 3));
+    }
+}
+
+}
+
+std::wstring BenchmarkBvh(WorkerPool* pool, UINT64 maxTriangles) {
+    std::wstringstream ss;
+    ss.setf(std::ios::fixed);
+    ss.precision(2);
+
+    const UINT64 sizes[] = { 1000000, 2000000, 5000000, 10000000 };
+    for (UINT64 size : sizes) {
+        if (size > maxTriangles && size != sizes[0]) break;
+        std::vector<BenchmarkVertex> vertices;
+        std::vector<UINT32> indices;
+        CreateHeightField((std::min)(size, maxTriangles), &vertices, &indices);
+        UINT64 triangles = indices.size() / 3;
+
+        CpuBvh serial, parallel;
+        serial.Build(nullptr, vertices.data(), sizeof(BenchmarkVertex), vertices.size(), indices.data(), indices.size());
+        parallel.Build(pool, vertices.data(), sizeof(BenchmarkVertex), vertices.size(), indices.data(), indices.size());
+
+        const CpuBvh::Stats& stats = parallel.GetStats();
+        ss << L"BVH, " << triangles / 1000 << L"K triangles: serial " << serial.GetStats().buildMs << L" ms ("
+           << double(triangles) / serial.GetStats().buildMs / 1000.0 << L" Mtris/s), "
+           << (pool ? pool->GetThreadCount() : 0) + 1 << L" threads " << stats.buildMs << L" ms ("
+           << double(triangles) / stats.buildMs / 1000.0 << L" Mtris/s); SAH " << stats.sahCost
+           << L" (serial " << serial.GetStats().sahCost << L"), " << stats.nodeCount << L" nodes, "
+           << stats.leafCount << L" leaves of " << stats.averageLeafSize << L" triangles (max "
+           << stats.maxLeafSize << L"), depth " << stats.maxDepth << L"\n";
+    }
+    return ss.str();
+}
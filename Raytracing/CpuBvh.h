@@ -0,0 +1,98 @@
+#pragma once
+#include <windows.h>
+
+#include <string>
+#include <vector>
+
+#include "WorkerPool.h"
+
+// Node of a CPU BVH, laid out so the node array can be uploaded as is for a compute
+// shader traversal. The two children of an inner node are adjacent and come after it.
+struct BvhNode {
+	float boundsMin[3];
+	UINT32 leftOrFirst;   // inner node: index of the left child, the right one follows it. Leaf: first entry of the triangle list
+	float boundsMax[3];
+	UINT32 triangleCount; // 0 for inner nodes
+};
+static_assert(sizeof(BvhNode) == 32, "BvhNode layout is part of the file format");
+
+// Serialized BVH:
+//
+//   [BvhFileHeader][node block][triangle list]
+static const UINT32 BvhFileMagic = 0x48564252; // "RBVH"
+static const UINT32 BvhFileVersion = 1;
+
+struct BvhFileHeader {
+	UINT32 magic;
+	UINT32 version;
+	UINT32 headerSize;
+	UINT32 nodeSize;
+	UINT64 nodeCount;
+	UINT64 triangleCount;
+	UINT64 nodeOffset;
+	UINT64 triangleOffset;
+	double sahCost;
+	UINT64 checksum;      // FNV-1a over the node block followed by the triangle list
+};
+static_assert(sizeof(BvhFileHeader) == 64, "BvhFileHeader layout is part of the file format");
+
+// Bounding volume hierarchy over an indexed triangle mesh, built on the CPU with a
+// binned surface area heuristic. It is the reference structure for CPU ray queries and
+// for traversal fallbacks on the GPU.
+//
+// The top of the tree is split on the calling thread, with the binning of large nodes
+// spread over the pool. Once there are enough independent subtrees, each one is built
+// by a single task.
+class CpuBvh {
+
+public:
+	static const UINT BinCount = 16;
+	static const UINT MaxLeafSize = 8;                    // larger nodes are split even if SAH prefers a leaf
+	static const UINT64 ParallelBinningSize = 64 * 1024;  // nodes at least this large bin over the pool
+	static constexpr float TraversalCost = 1.0f;          // SAH costs, relative to intersecting one triangle
+	static constexpr float IntersectionCost = 1.0f;
+
+	struct Stats {
+		UINT64 nodeCount;
+		UINT64 leafCount;
+		UINT32 maxDepth;
+		UINT32 maxLeafSize;
+		double averageLeafSize;
+		double sahCost;       // expected cost of a ray through the root, see TraversalCost
+		double buildMs;       // 0 for a BVH read from a file
+		double refitMs;       // last Refit, 0 before any
+	};
+
+	CpuBvh() {}
+
+	// Positions are the first three floats of each `vertexStride` byte vertex, every
+	// three indices make a triangle. Builds on the calling thread only without a pool.
+	void Build(WorkerPool* pool, const void* vertices, UINT32 vertexStride, UINT64 vertexCount,
+		const UINT32* indices, UINT64 indexCount);
+	// Moves the bounds to new positions of the same triangles, keeping the topology of the
+	// last build. Much faster than a build, but the tree is still split for the positions
+	// it was built from: the SAH cost in the stats shows how far it has degraded.
+	void Refit(const void* vertices, UINT32 vertexStride, UINT64 vertexCount,
+		const UINT32* indices, UINT64 indexCount);
+
+	bool Write(LPCWSTR fileName) const;
+	// Validates the header, the block sizes and the checksum
+	bool Read(LPCWSTR fileName);
+
+	const std::vector<BvhNode>& GetNodes() const { return m_nodes; }
+	// Triangle indices in leaf order, leaves reference ranges of this list
+	const std::vector<UINT32>& GetTriangles() const { return m_triangles; }
+	const Stats& GetStats() const { return m_stats; }
+
+private:
+	void ComputeStats(double buildMs);
+
+	std::vector<BvhNode> m_nodes;
+	std::vector<UINT32> m_triangles;
+	Stats m_stats = {};
+};
+
+// Builds BVHs of synthetic height field meshes from 1M triangles up to `maxTriangles`,
+// on the calling thread and on `pool`. Reports the build rate in Mtris/s and the
+// quality of the trees.
+std::wstring BenchmarkBvh(WorkerPool* pool, UINT64 maxTriangles);
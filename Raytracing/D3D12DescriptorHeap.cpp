@@ -0,0 +1,118 @@
+#include "D3D12DescriptorHeap.h"
+
+#include <stdexcept>
+
+void D3D12DescriptorHeap::Init(ID3D12Device* device, D3D12_DESCRIPTOR_HEAP_TYPE type,
+    uint32_t persistentCount, uint32_t transientCount, uint32_t stagingCount) {
+
+    m_device = device;
+    m_type = type;
+    m_increment = device->GetDescriptorHandleIncrementSize(type);
+
+    D3D12_DESCRIPTOR_HEAP_DESC heapDesc = {};
+    heapDesc.NumDescriptors = persistentCount + transientCount;
+    heapDesc.Type = type;
+    heapDesc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_SHADER_VISIBLE;
+    HRESULT hr = device->CreateDescriptorHeap(&heapDesc, IID_PPV_ARGS(&m_heap));
+    if (FAILED(hr)) { throw std::runtime_error("Cannot create the shader visible descriptor heap"); }
+    m_heap->SetName(L"Shader Visible Descriptors");
+
+    D3D12_DESCRIPTOR_HEAP_DESC stagingDesc = {};
+    stagingDesc.NumDescriptors = stagingCount;
+    stagingDesc.Type = type;
+    stagingDesc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_NONE;
+    hr = device->CreateDescriptorHeap(&stagingDesc, IID_PPV_ARGS(&m_stagingHeap));
+    if (FAILED(hr)) { throw std::runtime_error("Cannot create the staging descriptor heap"); }
+    m_stagingHeap->SetName(L"Staging Descriptors");
+
+    m_persistent.Init(persistentCount);
+    m_transient.Init(transientCount);
+    m_staging.Init(stagingCount);
+    m_transientBase = persistentCount;
+}
+
+DescriptorHandle D3D12DescriptorHeap::AllocatePersistent(uint32_t count) {
+    uint32_t index = m_persistent.Allocate(count);
+    if (index == InvalidDescriptorIndex) { throw std::runtime_error("Out of persistent descriptors"); }
+    return MakeHandle(m_heap.Get(), index, count, true);
+}
+
+void D3D12DescriptorHeap::FreePersistent(const DescriptorHandle& handle) {
+    if (!handle.IsValid()) return;
+    m_unsubmittedFrees.push_back({ 0, handle.index, handle.count });
+}
+
+DescriptorHandle D3D12DescriptorHeap::AllocateTransient(uint32_t count) {
+    uint32_t index = m_transient.Allocate(count);
+    if (index == InvalidDescriptorIndex) { throw std::runtime_error("Out of transient descriptors"); }
+    return MakeHandle(m_heap.Get(), m_transientBase + index, count, true);
+}
+
+DescriptorHandle D3D12DescriptorHeap::AllocateStaging(uint32_t count) {
+    uint32_t index = m_staging.Allocate(count);
+    if (index == InvalidDescriptorIndex) { throw std::runtime_error("Out of staging descriptors"); }
+    return MakeHandle(m_stagingHeap.Get(), index, count, false);
+}
+
+void D3D12DescriptorHeap::FreeStaging(const DescriptorHandle& handle) {
+    // Staging descriptors are never read by the GPU, they can be reused right away
+    if (handle.IsValid()) m_staging.Free(handle.index, handle.count);
+}
+
+void D3D12DescriptorHeap::StageCopy(const DescriptorHandle& destination, uint32_t offset, D3D12_CPU_DESCRIPTOR_HANDLE source, uint32_t count) {
+    if (offset + count > destination.count) { throw std::logic_error("Descriptor copy overflows its destination"); }
+    m_copyDestinations.push_back(destination.Cpu(offset));
+    m_copySources.push_back(source);
+    m_copySizes.push_back(count);
+}
+
+void D3D12DescriptorHeap::FlushCopies() {
+    if (m_copySources.empty()) return;
+
+    // Each copy is one source range written to one destination range
+    UINT rangeCount = static_cast<UINT>(m_copySources.size());
+    m_device->CopyDescriptors(
+        rangeCount, m_copyDestinations.data(), m_copySizes.data(),
+        rangeCount, m_copySources.data(), m_copySizes.data(),
+        m_type);
+
+    m_copyDestinations.clear();
+    m_copySources.clear();
+    m_copySizes.clear();
+}
+
+void D3D12DescriptorHeap::Submit(UINT64 fenceValue) {
+    m_transient.Submit(fenceValue);
+    for (auto& pending : m_unsubmittedFrees) {
+        pending.fenceValue = fenceValue;
+        m_pendingFrees.push_back(pending);
+    }
+    m_unsubmittedFrees.clear();
+}
+
+void D3D12DescriptorHeap::Retire(UINT64 completedFenceValue) {
+    m_transient.Retire(completedFenceValue);
+    for (size_t i = 0; i < m_pendingFrees.size();) {
+        if (m_pendingFrees[i].fenceValue <= completedFenceValue) {
+            m_persistent.Free(m_pendingFrees[i].index, m_pendingFrees[i].count);
+            m_pendingFrees[i] = m_pendingFrees.back();
+            m_pendingFrees.pop_back();
+        } else {
+            i++;
+        }
+    }
+}
+
+DescriptorHandle D3D12DescriptorHeap::MakeHandle(ID3D12DescriptorHeap* heap, uint32_t index, uint32_t count, bool shaderVisible) const {
+    DescriptorHandle handle;
+    handle.index = index;
+    handle.count = count;
+    handle.increment = m_increment;
+    handle.cpu = heap->GetCPUDescriptorHandleForHeapStart();
+    handle.cpu.ptr += SIZE_T(index) * m_increment;
+    if (shaderVisible) {
+        handle.gpu = heap->GetGPUDescriptorHandleForHeapStart();
+        handle.gpu.ptr += UINT64(index) * m_increment;
+    }
+    return handle;
+}
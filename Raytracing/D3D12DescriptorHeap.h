@@ -0,0 +1,89 @@
+#pragma once
+#include <d3d12.h>
+#include <wrl.h>
+
+#include <vector>
+
+#include "DescriptorAllocator.h"
+
+using Microsoft::WRL::ComPtr;
+
+// A range of descriptors in one of the heaps of a D3D12DescriptorHeap
+struct DescriptorHandle {
+	D3D12_CPU_DESCRIPTOR_HANDLE cpu = {};
+	D3D12_GPU_DESCRIPTOR_HANDLE gpu = {}; // null for staging descriptors
+	uint32_t index = InvalidDescriptorIndex;
+	uint32_t count = 0;
+	uint32_t increment = 0;
+
+	bool IsValid() const { return index != InvalidDescriptorIndex; }
+	D3D12_CPU_DESCRIPTOR_HANDLE Cpu(uint32_t offset = 0) const { return { cpu.ptr + SIZE_T(offset) * increment }; }
+	D3D12_GPU_DESCRIPTOR_HANDLE Gpu(uint32_t offset = 0) const { return { gpu.ptr + UINT64(offset) * increment }; }
+};
+
+// One shader-visible heap split into a persistent region managed by a free list and
+// a transient ring reclaimed by fence value. Views are created in a CPU-only staging
+// heap and copied in, all queued copies going out in a single CopyDescriptors call.
+class D3D12DescriptorHeap {
+
+public:
+	D3D12DescriptorHeap() {}
+
+	void Init(ID3D12Device* device, D3D12_DESCRIPTOR_HEAP_TYPE type,
+		uint32_t persistentCount, uint32_t transientCount, uint32_t stagingCount);
+
+	// Persistent descriptors stay valid until freed. A freed range is only reused once
+	// the fence value of the next Submit() has completed.
+	DescriptorHandle AllocatePersistent(uint32_t count = 1);
+	void FreePersistent(const DescriptorHandle& handle);
+
+	// Transient descriptors are valid for the frame being recorded
+	DescriptorHandle AllocateTransient(uint32_t count);
+
+	DescriptorHandle AllocateStaging(uint32_t count = 1);
+	void FreeStaging(const DescriptorHandle& handle);
+
+	// Queues a copy of `count` descriptors from `source` to `destination` + `offset`
+	void StageCopy(const DescriptorHandle& destination, uint32_t offset, D3D12_CPU_DESCRIPTOR_HANDLE source, uint32_t count = 1);
+	void FlushCopies();
+
+	void Submit(UINT64 fenceValue);
+	void Retire(UINT64 completedFenceValue);
+
+	ID3D12DescriptorHeap* GetHeap() const { return m_heap.Get(); }
+
+	// Start of the heap, for tables of unbounded ranges. A persistent handle's index is
+	// the position of its first descriptor in such a table, usable as a bindless index.
+	D3D12_GPU_DESCRIPTOR_HANDLE GetBindlessTable() const { return m_heap->GetGPUDescriptorHandleForHeapStart(); }
+	const DescriptorFreeList& GetPersistent() const { return m_persistent; }
+	const DescriptorRing& GetTransient() const { return m_transient; }
+
+private:
+	struct PendingFree {
+		UINT64 fenceValue;
+		uint32_t index;
+		uint32_t count;
+	};
+
+	DescriptorHandle MakeHandle(ID3D12DescriptorHeap* heap, uint32_t index, uint32_t count, bool shaderVisible) const;
+
+	ComPtr<ID3D12Device> m_device;
+	D3D12_DESCRIPTOR_HEAP_TYPE m_type = D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV;
+	uint32_t m_increment = 0;
+
+	ComPtr<ID3D12DescriptorHeap> m_heap;
+	ComPtr<ID3D12DescriptorHeap> m_stagingHeap;
+
+	// The transient ring follows the persistent region in m_heap
+	DescriptorFreeList m_persistent;
+	DescriptorRing m_transient;
+	DescriptorFreeList m_staging;
+	uint32_t m_transientBase = 0;
+
+	std::vector<PendingFree> m_unsubmittedFrees;
+	std::vector<PendingFree> m_pendingFrees;
+
+	std::vector<D3D12_CPU_DESCRIPTOR_HANDLE> m_copyDestinations;
+	std::vector<D3D12_CPU_DESCRIPTOR_HANDLE> m_copySources;
+	std::vector<UINT> m_copySizes;
+};
@@ -0,0 +1,104 @@
+#include "D3D12FenceBackend.h"
+
+#include <stdexcept>
+
+D3D12FenceBackend::D3D12FenceBackend(ID3D12Device* device) {
+    m_device = device;
+    m_device->QueryInterface(IID_PPV_ARGS(&m_device1));
+}
+
+D3D12FenceBackend::~D3D12FenceBackend() {
+    // Release the fences before the events still registered with them
+    m_queues.clear();
+    for (auto& entry : m_waiters) {
+        if (entry.second->event) CloseHandle(entry.second->event);
+        for (HANDLE event : entry.second->events) CloseHandle(event);
+    }
+}
+
+uint32_t D3D12FenceBackend::AddQueue(ID3D12CommandQueue* queue, LPCWSTR name) {
+    Queue entry;
+    entry.queue = queue;
+    HRESULT hr = m_device->CreateFence(0, D3D12_FENCE_FLAG_NONE, IID_PPV_ARGS(&entry.fence));
+    if (FAILED(hr)) { throw std::runtime_error("Cannot create the timeline fence"); }
+    if (name) entry.fence->SetName(name);
+
+    m_queues.push_back(entry);
+    return static_cast<uint32_t>(m_queues.size() - 1);
+}
+
+void D3D12FenceBackend::Signal(uint32_t queue, uint64_t value) {
+    m_queues[queue].queue->Signal(m_queues[queue].fence.Get(), value);
+}
+
+uint64_t D3D12FenceBackend::GetCompletedValue(uint32_t queue) {
+    return m_queues[queue].fence->GetCompletedValue();
+}
+
+bool D3D12FenceBackend::Wait(const TimelinePoint* points, uint32_t count, bool waitAll, uint32_t timeoutMs) {
+    // One event per point without ID3D12Device1, WaitForMultipleObjects is limited to MAXIMUM_WAIT_OBJECTS handles
+    if (!m_device1 && count > MAXIMUM_WAIT_OBJECTS) { throw std::logic_error("Too many timeline points in a single wait"); }
+
+    Waiter& waiter = GetWaiter();
+    ULONGLONG start = GetTickCount64();
+
+    // Registrations left by earlier timed out waits can still set the events, so a
+    // wake-up only counts once the fences confirm it
+    while (!Satisfied(points, count, waitAll)) {
+        DWORD timeout = INFINITE;
+        if (timeoutMs != TimelineInfinite) {
+            ULONGLONG elapsed = GetTickCount64() - start;
+            if (elapsed >= timeoutMs) return false;
+            timeout = static_cast<DWORD>(timeoutMs - elapsed);
+        }
+
+        DWORD result = WAIT_FAILED;
+        if (m_device1) {
+            waiter.fences.resize(count);
+            waiter.values.resize(count);
+            for (uint32_t i = 0; i < count; i++) {
+                waiter.fences[i] = m_queues[points[i].queue].fence.Get();
+                waiter.values[i] = points[i].value;
+            }
+            HRESULT hr = m_device1->SetEventOnMultipleFenceCompletion(waiter.fences.data(), waiter.values.data(), count,
+                waitAll ? D3D12_MULTIPLE_FENCE_WAIT_FLAG_ALL : D3D12_MULTIPLE_FENCE_WAIT_FLAG_ANY, waiter.event);
+            if (FAILED(hr)) { throw std::runtime_error("Cannot register the timeline wait"); }
+            result = WaitForSingleObject(waiter.event, timeout);
+        }
+        else {
+            while (waiter.events.size() < count) {
+                HANDLE event = CreateEvent(nullptr, FALSE, FALSE, nullptr);
+                if (!event) { throw std::runtime_error("Cannot create a timeline event"); }
+                waiter.events.push_back(event);
+            }
+            for (uint32_t i = 0; i < count; i++) {
+                HRESULT hr = m_queues[points[i].queue].fence->SetEventOnCompletion(points[i].value, waiter.events[i]);
+                if (FAILED(hr)) { throw std::runtime_error("Cannot register the timeline wait"); }
+            }
+            result = WaitForMultipleObjects(count, waiter.events.data(), waitAll ? TRUE : FALSE, timeout);
+        }
+        if (result == WAIT_FAILED) { throw std::runtime_error("Timeline wait failed"); }
+    }
+    return true;
+}
+
+D3D12FenceBackend::Waiter& D3D12FenceBackend::GetWaiter() {
+    std::lock_guard<std::mutex> lock(m_waiterMutex);
+    std::unique_ptr<Waiter>& waiter = m_waiters[std::this_thread::get_id()];
+    if (!waiter) {
+        HANDLE event = CreateEvent(nullptr, FALSE, FALSE, nullptr);
+        if (!event) { throw std::runtime_error("Cannot create a timeline event"); }
+        waiter.reset(new Waiter());
+        waiter->event = event;
+    }
+    return *waiter;
+}
+
+bool D3D12FenceBackend::Satisfied(const TimelinePoint* points, uint32_t count, bool waitAll) {
+    for (uint32_t i = 0; i < count; i++) {
+        bool complete = GetCompletedValue(points[i].queue) >= points[i].value;
+        if (complete && !waitAll) return true;
+        if (!complete && waitAll) return false;
+    }
+    return waitAll;
+}
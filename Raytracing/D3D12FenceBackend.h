@@ -0,0 +1,58 @@
+#pragma once
+#include <d3d12.h>
+#include <wrl.h>
+
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "Timeline.h"
+
+using Microsoft::WRL::ComPtr;
+
+// One ID3D12Fence per command queue. Multi-point waits use a single event through
+// SetEventOnMultipleFenceCompletion when the device supports it. Each waiting thread
+// keeps its events for the lifetime of the backend: a timed out wait leaves them
+// registered with the fences, so they are only closed once the fences are released.
+class D3D12FenceBackend : public FenceBackend {
+
+public:
+	explicit D3D12FenceBackend(ID3D12Device* device);
+	~D3D12FenceBackend();
+
+	// Returns the timeline queue index of `queue`. Add every queue before the
+	// backend is shared with other threads.
+	uint32_t AddQueue(ID3D12CommandQueue* queue, LPCWSTR name = nullptr);
+
+	uint32_t GetQueueCount() const override { return static_cast<uint32_t>(m_queues.size()); }
+	void Signal(uint32_t queue, uint64_t value) override;
+	uint64_t GetCompletedValue(uint32_t queue) override;
+	bool Wait(const TimelinePoint* points, uint32_t count, bool waitAll, uint32_t timeoutMs) override;
+
+	ID3D12Fence* GetFence(uint32_t queue) const { return m_queues[queue].fence.Get(); }
+
+private:
+	struct Queue {
+		ComPtr<ID3D12CommandQueue> queue;
+		ComPtr<ID3D12Fence> fence;
+	};
+
+	struct Waiter {
+		HANDLE event = nullptr;      // SetEventOnMultipleFenceCompletion
+		std::vector<HANDLE> events;  // One per point without ID3D12Device1
+		std::vector<ID3D12Fence*> fences;
+		std::vector<UINT64> values;
+	};
+
+	Waiter& GetWaiter();
+	bool Satisfied(const TimelinePoint* points, uint32_t count, bool waitAll);
+
+	ComPtr<ID3D12Device> m_device;
+	ComPtr<ID3D12Device1> m_device1;
+	std::vector<Queue> m_queues;
+
+	std::unordered_map<std::thread::id, std::unique_ptr<Waiter>> m_waiters;
+	std::mutex m_waiterMutex;
+};
@@ -0,0 +1,94 @@
+#include "D3D12TimestampSource.h"
+
+#include <stdexcept>
+
+void D3D12TimestampSource::Init(ID3D12Device* device, ID3D12CommandQueue* queue, MemoryTracker* memory, uint32_t contexts) {
+    UINT64 frequency = 0;
+    if (FAILED(queue->GetTimestampFrequency(&frequency)) || frequency == 0) {
+        throw std::runtime_error("Cannot query the timestamp frequency");
+    }
+    m_msPerTick = 1000.0 / double(frequency);
+
+    UINT64 cpuOrigin = 0;
+    LARGE_INTEGER cpuFrequency = {};
+    if (FAILED(queue->GetClockCalibration(&m_gpuOrigin, &cpuOrigin)) || !QueryPerformanceFrequency(&cpuFrequency)) {
+        throw std::runtime_error("Cannot calibrate the timestamp clock");
+    }
+    m_cpuOriginMs = double(cpuOrigin) * 1000.0 / double(cpuFrequency.QuadPart);
+
+    D3D12_QUERY_HEAP_DESC queryHeapDesc = {};
+    queryHeapDesc.Type = D3D12_QUERY_HEAP_TYPE_TIMESTAMP;
+    queryHeapDesc.Count = 2 * contexts;
+    queryHeapDesc.NodeMask = 0;
+    HRESULT hr = device->CreateQueryHeap(&queryHeapDesc, IID_PPV_ARGS(&m_queryHeap));
+    if (FAILED(hr)) { throw std::runtime_error("Cannot create the timestamp query heap"); }
+
+    D3D12_RESOURCE_DESC resourceDesc = {};
+    resourceDesc.Dimension = D3D12_RESOURCE_DIMENSION_BUFFER;
+    resourceDesc.Alignment = 0;
+    resourceDesc.Width = sizeof(UINT64) * queryHeapDesc.Count;
+    resourceDesc.Height = 1;
+    resourceDesc.DepthOrArraySize = 1;
+    resourceDesc.MipLevels = 1;
+    resourceDesc.Format = DXGI_FORMAT_UNKNOWN;
+    resourceDesc.SampleDesc.Count = 1;
+    resourceDesc.SampleDesc.Quality = 0;
+    resourceDesc.Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR;
+    resourceDesc.Flags = D3D12_RESOURCE_FLAG_NONE;
+
+    D3D12_HEAP_PROPERTIES heapProperties = {};
+    heapProperties.Type = D3D12_HEAP_TYPE_READBACK;
+    heapProperties.CPUPageProperty = D3D12_CPU_PAGE_PROPERTY_UNKNOWN;
+    heapProperties.MemoryPoolPreference = D3D12_MEMORY_POOL_UNKNOWN;
+    heapProperties.CreationNodeMask = 1;
+    heapProperties.VisibleNodeMask = 1;
+
+    hr = device->CreateCommittedResource(
+        &heapProperties,
+        D3D12_HEAP_FLAG_NONE,
+        &resourceDesc,
+        D3D12_RESOURCE_STATE_COPY_DEST,
+        nullptr,
+        IID_PPV_ARGS(&m_readback));
+    if (FAILED(hr)) { throw std::runtime_error("Cannot create the timestamp readback buffer"); }
+    if (memory) memory->Track(m_readback.Get(), L"Timestamp Readback", MemoryCategory::Readback, ResidencyPriority::Pinned);
+
+    // Only read once the fence of the frame context has passed
+    void* data = nullptr;
+    m_readback->Map(0, nullptr, &data);
+    m_data = static_cast<const UINT64*>(data);
+    m_resolved.assign(contexts, false);
+}
+
+void D3D12TimestampSource::Begin(ID3D12GraphicsCommandList* commandList, uint32_t context) {
+    commandList->EndQuery(m_queryHeap.Get(), D3D12_QUERY_TYPE_TIMESTAMP, 2 * context);
+}
+
+void D3D12TimestampSource::End(ID3D12GraphicsCommandList* commandList, uint32_t context) {
+    commandList->EndQuery(m_queryHeap.Get(), D3D12_QUERY_TYPE_TIMESTAMP, 2 * context + 1);
+    commandList->ResolveQueryData(m_queryHeap.Get(), D3D12_QUERY_TYPE_TIMESTAMP,
+        2 * context, 2, m_readback.Get(), sizeof(UINT64) * 2 * context);
+    m_resolved[context] = true;
+}
+
+bool D3D12TimestampSource::ReadFrameTime(uint32_t context, double* ms) {
+    if (context >= m_resolved.size() || !m_resolved[context]) return false;
+
+    UINT64 begin = m_data[2 * context];
+    UINT64 end = m_data[2 * context + 1];
+    if (end <= begin) return false;
+    *ms = double(end - begin) * m_msPerTick;
+    return true;
+}
+
+bool D3D12TimestampSource::ReadSpan(uint32_t context, double* beginMs, double* endMs) {
+    if (context >= m_resolved.size() || !m_resolved[context]) return false;
+
+    UINT64 begin = m_data[2 * context];
+    UINT64 end = m_data[2 * context + 1];
+    if (end < begin) return false;
+    // Signed, timestamps taken before the calibration are negative offsets
+    *beginMs = m_cpuOriginMs + double(INT64(begin - m_gpuOrigin)) * m_msPerTick;
+    *endMs = m_cpuOriginMs + double(INT64(end - m_gpuOrigin)) * m_msPerTick;
+    return true;
+}
@@ -0,0 +1,38 @@
+#pragma once
+#include <d3d12.h>
+#include <wrl.h>
+
+#include <vector>
+
+#include "MemoryTracker.h"
+#include "ResolutionController.h"
+
+using Microsoft::WRL::ComPtr;
+
+// GPU frame times from a pair of timestamp queries per frame context. The queries
+// are resolved into a persistently mapped readback buffer at the end of the frame.
+// The queue clock is calibrated against the CPU clock, so spans read from sources on
+// different queues can be laid on one timeline.
+class D3D12TimestampSource : public GpuTimingSource {
+
+public:
+	D3D12TimestampSource() {}
+
+	void Init(ID3D12Device* device, ID3D12CommandQueue* queue, MemoryTracker* memory, uint32_t contexts);
+
+	void Begin(ID3D12GraphicsCommandList* commandList, uint32_t context);
+	void End(ID3D12GraphicsCommandList* commandList, uint32_t context);
+
+	bool ReadFrameTime(uint32_t context, double* ms) override;
+	// Begin and end of the last span of `context`, in ms of the CPU clock
+	bool ReadSpan(uint32_t context, double* beginMs, double* endMs);
+
+private:
+	ComPtr<ID3D12QueryHeap> m_queryHeap;
+	ComPtr<ID3D12Resource> m_readback;
+	const UINT64* m_data = nullptr;
+	double m_msPerTick = 0.0;
+	UINT64 m_gpuOrigin = 0;   // calibration pair, the same instant on both clocks
+	double m_cpuOriginMs = 0.0;
+	std::vector<bool> m_resolved;
+};
@@ -0,0 +1,107 @@
+#include "DescriptorAllocator.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+void DescriptorFreeList::Init(uint32_t capacity) {
+    m_capacity = capacity;
+    m_freeCount = capacity;
+    m_free.clear();
+    if (capacity) m_free.push_back({ 0, capacity });
+}
+
+uint32_t DescriptorFreeList::Allocate(uint32_t count) {
+    if (count == 0) return InvalidDescriptorIndex;
+
+    for (size_t i = 0; i < m_free.size(); i++) {
+        auto& range = m_free[i];
+        if (range.second < count) continue;
+
+        uint32_t index = range.first;
+        range.first += count;
+        range.second -= count;
+        if (range.second == 0) m_free.erase(m_free.begin() + i);
+
+        m_freeCount -= count;
+        return index;
+    }
+    return InvalidDescriptorIndex;
+}
+
+void DescriptorFreeList::Free(uint32_t index, uint32_t count) {
+    if (count == 0) return;
+    if (index >= m_capacity || count > m_capacity - index) {
+        throw std::logic_error("Descriptor range is outside of the free list");
+    }
+
+    auto next = std::lower_bound(m_free.begin(), m_free.end(), std::make_pair(index, 0u));
+    if (next != m_free.end() && index + count > next->first) {
+        throw std::logic_error("Descriptor range freed twice");
+    }
+    if (next != m_free.begin()) {
+        auto previous = next - 1;
+        if (previous->first + previous->second > index) {
+            throw std::logic_error("Descriptor range freed twice");
+        }
+        if (previous->first + previous->second == index) {
+            // Merge into the previous range, and the next one if it now touches
+            previous->second += count;
+            if (next != m_free.end() && previous->first + previous->second == next->first) {
+                previous->second += next->second;
+                m_free.erase(next);
+            }
+            m_freeCount += count;
+            return;
+        }
+    }
+    if (next != m_free.end() && index + count == next->first) {
+        next->first = index;
+        next->second += count;
+    } else {
+        m_free.insert(next, { index, count });
+    }
+    m_freeCount += count;
+}
+
+uint32_t DescriptorFreeList::GetLargestFreeRange() const {
+    uint32_t largest = 0;
+    for (const auto& range : m_free) largest = (std::max)(largest, range.second);
+    return largest;
+}
+
+
+void DescriptorRing::Init(uint32_t capacity) {
+    m_capacity = capacity;
+    m_head = 0;
+    m_tail = 0;
+    m_pending.clear();
+}
+
+uint32_t DescriptorRing::Allocate(uint32_t count) {
+    if (count == 0 || count > m_capacity) return InvalidDescriptorIndex;
+
+    uint64_t start = m_head;
+    uint64_t position = start % m_capacity;
+    if (position + count > m_capacity) {
+        // Tables have to be contiguous, skip the end of the ring
+        start += m_capacity - position;
+        position = 0;
+    }
+    if (start + count - m_tail > m_capacity) return InvalidDescriptorIndex;
+
+    m_head = start + count;
+    return static_cast<uint32_t>(position);
+}
+
+void DescriptorRing::Submit(uint64_t fenceValue) {
+    if (!m_pending.empty() && m_pending.back().second == m_head) return;
+    if (m_pending.empty() && m_tail == m_head) return;
+    m_pending.push_back({ fenceValue, m_head });
+}
+
+void DescriptorRing::Retire(uint64_t completedFenceValue) {
+    while (!m_pending.empty() && m_pending.front().first <= completedFenceValue) {
+        m_tail = m_pending.front().second;
+        m_pending.pop_front();
+    }
+}
@@ -0,0 +1,60 @@
+#pragma once
+#include <cstdint>
+#include <deque>
+#include <utility>
+#include <vector>
+
+// Index bookkeeping for descriptor heaps. Nothing here touches a device, the
+// D3D12DescriptorHeap wrapper maps the indices to CPU and GPU handles.
+
+static const uint32_t InvalidDescriptorIndex = 0xFFFFFFFF;
+
+// First-fit free list over [0, capacity), for descriptors that live until freed.
+// Freed ranges are merged with their neighbours to limit fragmentation.
+class DescriptorFreeList {
+
+public:
+	DescriptorFreeList() {}
+
+	void Init(uint32_t capacity);
+
+	// Returns the first index of `count` contiguous descriptors, InvalidDescriptorIndex if no range fits
+	uint32_t Allocate(uint32_t count);
+	void Free(uint32_t index, uint32_t count);
+
+	uint32_t GetCapacity() const { return m_capacity; }
+	uint32_t GetFreeCount() const { return m_freeCount; }
+	uint32_t GetLargestFreeRange() const;
+	uint32_t GetFreeRangeCount() const { return static_cast<uint32_t>(m_free.size()); }
+
+private:
+	std::vector<std::pair<uint32_t, uint32_t>> m_free; // first index, count, sorted by index
+	uint32_t m_capacity = 0;
+	uint32_t m_freeCount = 0;
+};
+
+// Ring over [0, capacity) for descriptors written every frame. Ranges allocated
+// since the last Submit() are reclaimed once the GPU passes the submitted fence value.
+class DescriptorRing {
+
+public:
+	DescriptorRing() {}
+
+	void Init(uint32_t capacity);
+
+	// Contiguous range, InvalidDescriptorIndex when the ring is full until earlier frames retire
+	uint32_t Allocate(uint32_t count);
+	void Submit(uint64_t fenceValue);
+	void Retire(uint64_t completedFenceValue);
+
+	uint32_t GetCapacity() const { return m_capacity; }
+	uint32_t GetUsedCount() const { return static_cast<uint32_t>(m_head - m_tail); }
+
+private:
+	uint32_t m_capacity = 0;
+
+	// Monotonic counters, wrapped modulo m_capacity on use
+	uint64_t m_head = 0;
+	uint64_t m_tail = 0;
+	std::deque<std::pair<uint64_t, uint64_t>> m_pending; // fence value, head at submit
+};
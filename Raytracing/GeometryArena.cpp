@@ -0,0 +1,160 @@
+#include "GeometryArena.h"
+
+#include <stdexcept>
+
+static const D3D12_RESOURCE_STATES VertexArenaState = D3D12_RESOURCE_STATE_VERTEX_AND_CONSTANT_BUFFER | D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE;
+static const D3D12_RESOURCE_STATES IndexArenaState = D3D12_RESOURCE_STATE_INDEX_BUFFER | D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE;
+
+static ComPtr<ID3D12Resource> CreateArenaBuffer(ID3D12Device* device, UINT64 size) {
+    D3D12_RESOURCE_DESC resourceDesc = {};
+    resourceDesc.Dimension = D3D12_RESOURCE_DIMENSION_BUFFER;
+    resourceDesc.Alignment = 0;
+    resourceDesc.Width = size;
+    resourceDesc.Height = 1;
+    resourceDesc.DepthOrArraySize = 1;
+    resourceDesc.MipLevels = 1;
+    resourceDesc.Format = DXGI_FORMAT_UNKNOWN;
+    resourceDesc.SampleDesc.Count = 1;
+    resourceDesc.SampleDesc.Quality = 0;
+    resourceDesc.Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR;
+    resourceDesc.Flags = D3D12_RESOURCE_FLAG_NONE;
+
+    D3D12_HEAP_PROPERTIES heapProperties = {};
+    heapProperties.Type = D3D12_HEAP_TYPE_DEFAULT;
+    heapProperties.CPUPageProperty = D3D12_CPU_PAGE_PROPERTY_UNKNOWN;
+    heapProperties.MemoryPoolPreference = D3D12_MEMORY_POOL_UNKNOWN;
+    heapProperties.CreationNodeMask = 1;
+    heapProperties.VisibleNodeMask = 1;
+
+    ComPtr<ID3D12Resource> buffer;
+    HRESULT hr = device->CreateCommittedResource(
+        &heapProperties,
+        D3D12_HEAP_FLAG_NONE,
+        &resourceDesc,
+        D3D12_RESOURCE_STATE_COPY_DEST,
+        nullptr,
+        IID_PPV_ARGS(&buffer));
+    if (FAILED(hr)) { throw std::runtime_error("Cannot create the geometry arena"); }
+    return buffer;
+}
+
+void GeometryArena::Init(ID3D12Device* device, MemoryTracker* memory, UINT vertexStride, UINT64 vertexCapacity, UINT64 indexCapacity) {
+    m_vertexStride = vertexStride;
+    m_vertexCapacity = vertexCapacity;
+    m_indexCapacity = indexCapacity;
+    m_vertexCount = 0;
+    m_indexCount = 0;
+    m_meshes.clear();
+
+    m_vertexBuffer = CreateArenaBuffer(device, vertexCapacity * vertexStride);
+    m_indexBuffer = CreateArenaBuffer(device, indexCapacity * sizeof(UINT32));
+    m_copying = true;
+
+    if (memory) {
+        memory->Track(m_vertexBuffer.Get(), L"Vertex Arena", MemoryCategory::Geometry, ResidencyPriority::Pinned);
+        memory->Track(m_indexBuffer.Get(), L"Index Arena", MemoryCategory::Geometry, ResidencyPriority::Pinned);
+    }
+}
+
+UINT GeometryArena::AddMesh(ID3D12GraphicsCommandList* commandList, UploadRing& ring, const UploadSync& sync,
+    const void* vertices, UINT vertexCount, const UINT32* indices, UINT indexCount) {
+
+    std::vector<UINT32> sequentialIndices;
+    if (!indices) {
+        sequentialIndices.resize(vertexCount);
+        for (UINT i = 0; i < vertexCount; i++) sequentialIndices[i] = i;
+        indices = sequentialIndices.data();
+        indexCount = vertexCount;
+    }
+
+    if (m_vertexCount + vertexCount > m_vertexCapacity || m_indexCount + indexCount > m_indexCapacity) {
+        throw std::logic_error("Geometry arena is full");
+    }
+
+    MeshRange mesh = {};
+    mesh.baseVertex = static_cast<UINT>(m_vertexCount);
+    mesh.vertexCount = vertexCount;
+    mesh.firstIndex = static_cast<UINT>(m_indexCount);
+    mesh.indexCount = indexCount;
+
+    TransitionToCopy(commandList);
+    ring.CopyBuffer(commandList, m_vertexBuffer.Get(), m_vertexCount * m_vertexStride,
+        vertices, UINT64(vertexCount) * m_vertexStride, sync);
+    ring.CopyBuffer(commandList, m_indexBuffer.Get(), m_indexCount * sizeof(UINT32),
+        indices, UINT64(indexCount) * sizeof(UINT32), sync);
+
+    m_vertexCount += vertexCount;
+    m_indexCount += indexCount;
+    m_meshes.push_back(mesh);
+    return static_cast<UINT>(m_meshes.size() - 1);
+}
+
+void GeometryArena::UpdateVertices(ID3D12GraphicsCommandList* commandList, UploadRing& ring, const UploadSync& sync,
+    UINT mesh, const void* vertices) {
+    const MeshRange& range = m_meshes[mesh];
+    TransitionToCopy(commandList);
+    ring.CopyBuffer(commandList, m_vertexBuffer.Get(), UINT64(range.baseVertex) * m_vertexStride,
+        vertices, UINT64(range.vertexCount) * m_vertexStride, sync);
+}
+
+void GeometryArena::FinishUploads(ID3D12GraphicsCommandList* commandList) {
+    if (!m_copying) return;
+
+    D3D12_RESOURCE_BARRIER barriers[2] = {};
+    for (auto& barrier : barriers) {
+        barrier.Type = D3D12_RESOURCE_BARRIER_TYPE_TRANSITION;
+        barrier.Flags = D3D12_RESOURCE_BARRIER_FLAG_NONE;
+        barrier.Transition.StateBefore = D3D12_RESOURCE_STATE_COPY_DEST;
+        barrier.Transition.Subresource = D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES;
+    }
+    barriers[0].Transition.pResource = m_vertexBuffer.Get();
+    barriers[0].Transition.StateAfter = VertexArenaState;
+    barriers[1].Transition.pResource = m_indexBuffer.Get();
+    barriers[1].Transition.StateAfter = IndexArenaState;
+    commandList->ResourceBarrier(2, barriers);
+
+    m_copying = false;
+}
+
+void GeometryArena::TransitionToCopy(ID3D12GraphicsCommandList* commandList) {
+    if (m_copying) return;
+
+    D3D12_RESOURCE_BARRIER barriers[2] = {};
+    for (auto& barrier : barriers) {
+        barrier.Type = D3D12_RESOURCE_BARRIER_TYPE_TRANSITION;
+        barrier.Flags = D3D12_RESOURCE_BARRIER_FLAG_NONE;
+        barrier.Transition.StateAfter = D3D12_RESOURCE_STATE_COPY_DEST;
+        barrier.Transition.Subresource = D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES;
+    }
+    barriers[0].Transition.pResource = m_vertexBuffer.Get();
+    barriers[0].Transition.StateBefore = VertexArenaState;
+    barriers[1].Transition.pResource = m_indexBuffer.Get();
+    barriers[1].Transition.StateBefore = IndexArenaState;
+    commandList->ResourceBarrier(2, barriers);
+
+    m_copying = true;
+}
+
+D3D12_VERTEX_BUFFER_VIEW GeometryArena::GetVertexBufferView() const {
+    D3D12_VERTEX_BUFFER_VIEW view = {};
+    view.BufferLocation = m_vertexBuffer->GetGPUVirtualAddress();
+    view.StrideInBytes = m_vertexStride;
+    view.SizeInBytes = static_cast<UINT>(m_vertexCount * m_vertexStride);
+    return view;
+}
+
+D3D12_INDEX_BUFFER_VIEW GeometryArena::GetIndexBufferView() const {
+    D3D12_INDEX_BUFFER_VIEW view = {};
+    view.BufferLocation = m_indexBuffer->GetGPUVirtualAddress();
+    view.Format = DXGI_FORMAT_R32_UINT;
+    view.SizeInBytes = static_cast<UINT>(m_indexCount * sizeof(UINT32));
+    return view;
+}
+
+D3D12_GPU_VIRTUAL_ADDRESS GeometryArena::GetVertexAddress(UINT mesh) const {
+    return m_vertexBuffer->GetGPUVirtualAddress() + UINT64(m_meshes[mesh].baseVertex) * m_vertexStride;
+}
+
+D3D12_GPU_VIRTUAL_ADDRESS GeometryArena::GetIndexAddress(UINT mesh) const {
+    return m_indexBuffer->GetGPUVirtualAddress() + UINT64(m_meshes[mesh].firstIndex) * sizeof(UINT32);
+}
@@ -0,0 +1,69 @@
+#pragma once
+#include <d3d12.h>
+#include <wrl.h>
+
+#include <vector>
+
+#include "MemoryTracker.h"
+#include "UploadRing.h"
+
+using Microsoft::WRL::ComPtr;
+
+// One vertex buffer and one 32-bit index buffer shared by every mesh. Meshes are
+// sub-allocated linearly and referenced through the mesh table, so all draws and
+// hit shaders bind the same two buffers and select a mesh by its offsets.
+class GeometryArena {
+
+public:
+	struct MeshRange {
+		UINT baseVertex;
+		UINT vertexCount;
+		UINT firstIndex;
+		UINT indexCount;
+	};
+
+	GeometryArena() {}
+
+	void Init(ID3D12Device* device, MemoryTracker* memory, UINT vertexStride, UINT64 vertexCapacity, UINT64 indexCapacity);
+
+	// Streams the mesh into the arenas through `ring` and returns its index in the mesh
+	// table. Meshes without indices get a sequential index list so every draw is indexed.
+	UINT AddMesh(ID3D12GraphicsCommandList* commandList, UploadRing& ring, const UploadSync& sync,
+		const void* vertices, UINT vertexCount, const UINT32* indices = nullptr, UINT indexCount = 0);
+
+	// Overwrites the vertices of `mesh` in place with as many new ones, for geometry that
+	// deforms. The indices are left as they are.
+	void UpdateVertices(ID3D12GraphicsCommandList* commandList, UploadRing& ring, const UploadSync& sync,
+		UINT mesh, const void* vertices);
+
+	// Transitions the arenas back to their read states after a batch of AddMesh or UpdateVertices calls.
+	void FinishUploads(ID3D12GraphicsCommandList* commandList);
+
+	const MeshRange& GetMesh(UINT mesh) const { return m_meshes[mesh]; }
+	UINT GetMeshCount() const { return static_cast<UINT>(m_meshes.size()); }
+
+	ID3D12Resource* GetVertexBuffer() const { return m_vertexBuffer.Get(); }
+	ID3D12Resource* GetIndexBuffer() const { return m_indexBuffer.Get(); }
+	D3D12_VERTEX_BUFFER_VIEW GetVertexBufferView() const;
+	D3D12_INDEX_BUFFER_VIEW GetIndexBufferView() const;
+
+	D3D12_GPU_VIRTUAL_ADDRESS GetVertexAddress(UINT mesh) const;
+	D3D12_GPU_VIRTUAL_ADDRESS GetIndexAddress(UINT mesh) const;
+	UINT GetVertexStride() const { return m_vertexStride; }
+	UINT64 GetVertexCapacity() const { return m_vertexCapacity; }
+	UINT64 GetIndexCapacity() const { return m_indexCapacity; }
+
+private:
+	void TransitionToCopy(ID3D12GraphicsCommandList* commandList);
+
+	ComPtr<ID3D12Resource> m_vertexBuffer;
+	ComPtr<ID3D12Resource> m_indexBuffer;
+	UINT m_vertexStride = 0;
+	UINT64 m_vertexCapacity = 0;
+	UINT64 m_indexCapacity = 0;
+	UINT64 m_vertexCount = 0;
+	UINT64 m_indexCount = 0;
+	bool m_copying = false;
+
+	std::vector<MeshRange> m_meshes;
+};
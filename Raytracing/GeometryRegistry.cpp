@@ -0,0 +1,42 @@
+#include "GeometryRegistry.h"
+
+#include <stdexcept>
+
+using namespace DirectX;
+
+void GeometryRegistry::Init(BlasManager* blas, TopLevelInstances* instances) {
+    m_blas = blas;
+    m_instances = instances;
+    m_geometries.clear();
+    m_meshes.clear();
+    m_instanceCounts.clear();
+    m_shared = 0;
+}
+
+UINT GeometryRegistry::Register(UINT mesh, const D3D12_RAYTRACING_GEOMETRY_DESC& geometry, GeometryHint hint) {
+    auto found = m_geometries.find(mesh);
+    if (found != m_geometries.end()) {
+        m_shared++;
+        return found->second;
+    }
+
+    // Geometries double as BLAS indices, a BLAS requested elsewhere would shift them
+    UINT index = m_blas->Request(geometry, hint);
+    if (index != m_meshes.size()) { throw std::logic_error("A BLAS was requested outside the geometry registry"); }
+    m_geometries[mesh] = index;
+    m_meshes.push_back(mesh);
+    m_instanceCounts.push_back(0);
+    return index;
+}
+
+UINT GeometryRegistry::GetGeometry(UINT mesh) const {
+    auto found = m_geometries.find(mesh);
+    if (found == m_geometries.end()) { throw std::logic_error("The mesh is not registered"); }
+    return found->second;
+}
+
+InstanceHandle GeometryRegistry::AddInstance(UINT mesh, FXMMATRIX transform) {
+    UINT geometry = GetGeometry(mesh);
+    m_instanceCounts[geometry]++;
+    return { m_instances->Add(geometry, transform) };
+}
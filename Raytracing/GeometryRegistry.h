@@ -0,0 +1,54 @@
+#pragma once
+#include <d3d12.h>
+#include <DirectXMath.h>
+
+#include <unordered_map>
+#include <vector>
+
+#include "BlasManager.h"
+#include "TopLevelInstances.h"
+
+// A TLAS instance, as handed out by the registry. Stays valid for the life of the scene.
+struct InstanceHandle {
+	UINT index;
+};
+
+// Maps meshes to a single BLAS each and places instances of them. However many
+// instances share a mesh, its BLAS is built once, and an instance costs its transform
+// and its desc. A geometry is the index of the BLAS in the BLAS manager: descs carry it
+// as InstanceID, and the hit shaders find the geometry record of the mesh with it.
+class GeometryRegistry {
+
+public:
+	GeometryRegistry() {}
+
+	GeometryRegistry(const GeometryRegistry&) = delete;
+	GeometryRegistry& operator=(const GeometryRegistry&) = delete;
+
+	// Every BLAS of `blas` has to be requested through the registry
+	void Init(BlasManager* blas, TopLevelInstances* instances);
+
+	// Requests the BLAS of `mesh` the first time, later calls return the same geometry
+	UINT Register(UINT mesh, const D3D12_RAYTRACING_GEOMETRY_DESC& geometry, GeometryHint hint);
+	bool IsRegistered(UINT mesh) const { return m_geometries.count(mesh) != 0; }
+	UINT GetGeometry(UINT mesh) const;
+	UINT GetMesh(UINT geometry) const { return m_meshes[geometry]; }
+	UINT GetGeometryCount() const { return static_cast<UINT>(m_meshes.size()); }
+
+	InstanceHandle AddInstance(UINT mesh, DirectX::FXMMATRIX transform);
+	void SetTransform(InstanceHandle instance, DirectX::FXMMATRIX transform) { m_instances->SetTransform(instance.index, transform); }
+	UINT GetInstanceCount() const { return m_instances->GetCount(); }
+	UINT GetInstanceCount(UINT geometry) const { return m_instanceCounts[geometry]; }
+
+	// Registrations answered with an existing BLAS
+	UINT64 GetSharedCount() const { return m_shared; }
+
+private:
+	BlasManager* m_blas = nullptr;
+	TopLevelInstances* m_instances = nullptr;
+
+	std::unordered_map<UINT, UINT> m_geometries; // mesh, geometry
+	std::vector<UINT> m_meshes;                  // per geometry
+	std::vector<UINT> m_instanceCounts;          // per geometry
+	UINT64 m_shared = 0;
+};
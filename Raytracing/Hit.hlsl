@@ -2,26 +2,54 @@ struct HitInfo { float4 colorAndDistance; };
 struct Attributes { float2 bary; };
 struct Vertex { float3 pos; float4 color; };
 
-StructuredBuffer<Vertex> vertices : register(t0);
-StructuredBuffer<int> indices : register(t1);
+// Where the mesh of an instance lives, indexed by InstanceID()
+struct GeometryRecord {
+    uint vertexBuffer; // bindless indices
+    uint indexBuffer;
+    uint baseVertex;
+    uint firstIndex;
+};
+
+// Bindless: every SRV of the descriptor heap, one space per element type
+StructuredBuffer<Vertex> vertexBuffers[] : register(t0, space1);
+StructuredBuffer<uint> indexBuffers[] : register(t0, space2);
+StructuredBuffer<GeometryRecord> geometryBuffers[] : register(t0, space3);
+
+cbuffer HitConstants : register(b0) {
+    uint geometryRecords; // bindless index of the geometry record buffer
+};
 
 struct ShadowHitInfo { bool isHit; };
-RaytracingAccelerationStructure SceneBVH : register(t2);
+RaytracingAccelerationStructure SceneBVH : register(t0);
 
 static const float3 lightColor = float3(0.9, 0.9, 0.85);
 static const float3 lightPos = float3(2.0f, 3.0f, 4.0f);
 
-[shader("closesthit")] 
-void ClosestHit(inout HitInfo payload, Attributes attrib) {
+// Neighbouring rays can hit different instances, so the buffer indices are not uniform
+Vertex LoadVertex(GeometryRecord geometry, uint corner) {
+    uint index = indexBuffers[NonUniformResourceIndex(geometry.indexBuffer)][geometry.firstIndex + 3 * PrimitiveIndex() + corner];
+    return vertexBuffers[NonUniformResourceIndex(geometry.vertexBuffer)][geometry.baseVertex + index];
+}
+
+// Shader permutation feature, shadows are on unless the variant turns them off
+#ifndef SHADOWS
+#define SHADOWS 1
+#endif
+
+// Dimmed when another instance sits between the hit point and the light
+float ShadowFactor() {
+#if SHADOWS
     float3 worldOrigin = WorldRayOrigin() + RayTCurrent() * WorldRayDirection();
-    float3 lightDir = normalize(lightPos - worldOrigin);
+    float lightDistance = length(lightPos - worldOrigin);
+    float3 lightDir = (lightPos - worldOrigin) / lightDistance;
 
+    // Ends at the light, so only instances between the hit and the light can occlude it,
+    // the volume the TLAS keeps for shadows
     RayDesc ray;
     ray.Origin = worldOrigin;
     ray.Direction = lightDir;
     ray.TMin = 0.01;
-    ray.TMax = 100000;
-    bool hit = true;
+    ray.TMax = lightDistance;
 
     ShadowHitInfo shadowPayload;
     shadowPayload.isHit = false;
@@ -36,44 +64,29 @@ void ClosestHit(inout HitInfo payload, Attributes attrib) {
         ray,
         shadowPayload);
 
-    float factor = shadowPayload.isHit ? 0.3 : 1.0;
+    return shadowPayload.isHit ? 0.3 : 1.0;
+#else
+    return 1.0;
+#endif
+}
+
+[shader("closesthit")] 
+void ClosestHit(inout HitInfo payload, Attributes attrib) {
+    float factor = ShadowFactor();
 
     float3 barycentrics = float3(1.f - attrib.bary.x - attrib.bary.y, attrib.bary.x, attrib.bary.y);
 
-    uint startIdx = 3 * PrimitiveIndex();
-    float3 hitColor = vertices[indices[startIdx + 0]].color * barycentrics.x +
-                      vertices[indices[startIdx + 1]].color * barycentrics.y +
-                      vertices[indices[startIdx + 2]].color * barycentrics.z;
+    GeometryRecord geometry = geometryBuffers[geometryRecords][InstanceID()];
+    float3 hitColor = LoadVertex(geometry, 0).color * barycentrics.x +
+                      LoadVertex(geometry, 1).color * barycentrics.y +
+                      LoadVertex(geometry, 2).color * barycentrics.z;
 
     payload.colorAndDistance = float4(lightColor * hitColor * factor, RayTCurrent());
 }
 
 [shader("closesthit")] 
 void PlaneClosestHit(inout HitInfo payload, Attributes attrib) {
-    float3 worldOrigin = WorldRayOrigin() + RayTCurrent() * WorldRayDirection();
-    float3 lightDir = normalize(lightPos - worldOrigin);
-
-    RayDesc ray;
-    ray.Origin = worldOrigin;
-    ray.Direction = lightDir;
-    ray.TMin = 0.01;
-    ray.TMax = 100000;
-    bool hit = true;
-
-    ShadowHitInfo shadowPayload;
-    shadowPayload.isHit = false;
-
-    TraceRay(
-        SceneBVH,
-        RAY_FLAG_NONE,
-        0xFF,
-        1,
-        0,
-        1,
-        ray,
-        shadowPayload);
-
-    float factor = shadowPayload.isHit ? 0.3 : 1.0;
+    float factor = ShadowFactor();
 
     float3 barycentrics = float3(1.f - attrib.bary.x - attrib.bary.y, attrib.bary.x, attrib.bary.y);
     payload.colorAndDistance = float4(lightColor * factor, RayTCurrent());
@@ -0,0 +1,370 @@
+#include "InstanceCuller.h"
+
+#include <emmintrin.h>
+
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <random>
+#include <sstream>
+
+using namespace DirectX;
+
+namespace {
+
+// Plane through a, b and c with `inside` on its positive side. False when the points
+// are too close to a line to give a normal.
+bool InwardPlane(FXMVECTOR a, FXMVECTOR b, FXMVECTOR c, GXMVECTOR inside, XMFLOAT4* plane) {
+    XMVECTOR ab = XMVectorSubtract(b, a);
+    XMVECTOR ac = XMVectorSubtract(c, a);
+    XMVECTOR normal = XMVector3Cross(ab, ac);
+    float length = XMVectorGetX(XMVector3Length(normal));
+    if (length <= 1e-6f * XMVectorGetX(XMVector3Length(ab)) * XMVectorGetX(XMVector3Length(ac))) return false;
+
+    normal = XMVectorScale(normal, 1.0f / length);
+    float distance = -XMVectorGetX(XMVector3Dot(normal, a));
+    if (XMVectorGetX(XMVector3Dot(normal, inside)) + distance < 0.0f) {
+        normal = XMVectorNegate(normal);
+        distance = -distance;
+    }
+    XMStoreFloat4(plane, XMVectorSetW(normal, distance));
+    return true;
+}
+
+float PlaneDistance(const XMFLOAT4& plane, FXMVECTOR point) {
+    return XMVectorGetX(XMVector3Dot(XMLoadFloat4(&plane), point)) + plane.w;
+}
+
+bool InsidePlanes(const XMFLOAT4* planes, UINT count, float x, float y, float z, float radius) {
+    for (UINT p = 0; p < count; p++) {
+        if (planes[p].x * x + planes[p].y * y + planes[p].z * z + planes[p].w < -radius) return false;
+    }
+    return true;
+}
+
+__m128 InsidePlanes(const XMFLOAT4* planes, UINT count, __m128 x, __m128 y, __m128 z, __m128 negRadius) {
+    __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+    for (UINT p = 0; p < count; p++) {
+        __m128 distance = _mm_add_ps(_mm_add_ps(_mm_add_ps(
+            _mm_mul_ps(_mm_set1_ps(planes[p].x), x),
+            _mm_mul_ps(_mm_set1_ps(planes[p].y), y)),
+            _mm_mul_ps(_mm_set1_ps(planes[p].z), z)),
+            _mm_set1_ps(planes[p].w));
+        inside = _mm_and_ps(inside, _mm_cmpge_ps(distance, negRadius));
+    }
+    return inside;
+}
+
+// One instance, the same operations in the same order as a lane of the kernel
+bool Survives(const CullSource& source, const CullVolume& volume, size_t i, bool* caster) {
+    const float* const* e = source.elements;
+    UINT blas = source.bottomLevels[i];
+    float lx = source.bounds[0][blas], ly = source.bounds[1][blas], lz = source.bounds[2][blas];
+    float x = e[0][i] * lx + e[1][i] * ly + e[2][i] * lz + e[3][i];
+    float y = e[4][i] * lx + e[5][i] * ly + e[6][i] * lz + e[7][i];
+    float z = e[8][i] * lx + e[9][i] * ly + e[10][i] * lz + e[11][i];
+
+    // Exact for rotations with scale, the transforms of the scene
+    float column0 = e[0][i] * e[0][i] + e[4][i] * e[4][i] + e[8][i] * e[8][i];
+    float column1 = e[1][i] * e[1][i] + e[5][i] * e[5][i] + e[9][i] * e[9][i];
+    float column2 = e[2][i] * e[2][i] + e[6][i] * e[6][i] + e[10][i] * e[10][i];
+    float scale = column1 > column2 ? column1 : column2;
+    scale = column0 > scale ? column0 : scale;
+    float radius = source.bounds[3][blas] * std::sqrt(scale);
+
+    float dx = x - volume.camera.x, dy = y - volume.camera.y, dz = z - volume.camera.z;
+    float distance = std::sqrt(dx * dx + dy * dy + dz * dz);
+    float nearest = distance > volume.nearDistance ? distance : volume.nearDistance;
+    *caster = false;
+    if (radius * volume.sizeScale < volume.minScreenSize * nearest) return false;
+    if (distance - radius <= volume.maxDistance && InsidePlanes(volume.viewPlanes, 6, x, y, z, radius)) return true;
+    *caster = volume.casterPlaneCount && InsidePlanes(volume.casterPlanes, volume.casterPlaneCount, x, y, z, radius);
+    return *caster;
+}
+
+}
+
+size_t CullInstances(const CullSource& source, const CullVolume& volume, size_t begin, size_t end, UINT* kept, size_t* casters) {
+    const __m128 cameraX = _mm_set1_ps(volume.camera.x);
+    const __m128 cameraY = _mm_set1_ps(volume.camera.y);
+    const __m128 cameraZ = _mm_set1_ps(volume.camera.z);
+    const __m128 nearDistance = _mm_set1_ps(volume.nearDistance);
+    const __m128 maxDistance = _mm_set1_ps(volume.maxDistance);
+    const __m128 sizeScale = _mm_set1_ps(volume.sizeScale);
+    const __m128 minScreenSize = _mm_set1_ps(volume.minScreenSize);
+
+    size_t count = 0;
+    size_t i = begin;
+    for (; i + 4 <= end; i += 4) {
+        __m128 e[12];
+        for (int k = 0; k < 12; k++) e[k] = _mm_loadu_ps(source.elements[k] + i);
+
+        // The local spheres are gathered per BLAS, the rest stays in lanes
+        const UINT* blas = source.bottomLevels + i;
+        __m128 local[4];
+        for (int k = 0; k < 4; k++) {
+            const float* bounds = source.bounds[k];
+            local[k] = _mm_set_ps(bounds[blas[3]], bounds[blas[2]], bounds[blas[1]], bounds[blas[0]]);
+        }
+        __m128 x = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(e[0], local[0]), _mm_mul_ps(e[1], local[1])), _mm_mul_ps(e[2], local[2])), e[3]);
+        __m128 y = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(e[4], local[0]), _mm_mul_ps(e[5], local[1])), _mm_mul_ps(e[6], local[2])), e[7]);
+        __m128 z = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(e[8], local[0]), _mm_mul_ps(e[9], local[1])), _mm_mul_ps(e[10], local[2])), e[11]);
+
+        __m128 column0 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e[0], e[0]), _mm_mul_ps(e[4], e[4])), _mm_mul_ps(e[8], e[8]));
+        __m128 column1 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e[1], e[1]), _mm_mul_ps(e[5], e[5])), _mm_mul_ps(e[9], e[9]));
+        __m128 column2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e[2], e[2]), _mm_mul_ps(e[6], e[6])), _mm_mul_ps(e[10], e[10]));
+        __m128 radius = _mm_mul_ps(local[3], _mm_sqrt_ps(_mm_max_ps(column0, _mm_max_ps(column1, column2))));
+        __m128 negRadius = _mm_sub_ps(_mm_setzero_ps(), radius);
+
+        __m128 dx = _mm_sub_ps(x, cameraX);
+        __m128 dy = _mm_sub_ps(y, cameraY);
+        __m128 dz = _mm_sub_ps(z, cameraZ);
+        __m128 distance = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz)));
+        __m128 large = _mm_cmpge_ps(_mm_mul_ps(radius, sizeScale), _mm_mul_ps(minScreenSize, _mm_max_ps(distance, nearDistance)));
+
+        __m128 visible = _mm_and_ps(_mm_cmple_ps(_mm_sub_ps(distance, radius), maxDistance),
+            InsidePlanes(volume.viewPlanes, 6, x, y, z, negRadius));
+        __m128 keep = visible;
+        if (volume.casterPlaneCount) {
+            keep = _mm_or_ps(keep, InsidePlanes(volume.casterPlanes, volume.casterPlaneCount, x, y, z, negRadius));
+        }
+        keep = _mm_and_ps(keep, large);
+
+        int keepMask = _mm_movemask_ps(keep);
+        int casterMask = _mm_movemask_ps(_mm_andnot_ps(visible, keep));
+        for (int k = 0; k < 4; k++) {
+            if (keepMask & (1 << k)) kept[count++] = static_cast<UINT>(i + k);
+            if (casterMask & (1 << k)) (*casters)++;
+        }
+    }
+
+    for (; i < end; i++) {
+        bool caster;
+        if (!Survives(source, volume, i, &caster)) continue;
+        kept[count++] = static_cast<UINT>(i);
+        if (caster) (*casters)++;
+    }
+    return count;
+}
+
+void InstanceCuller::Init(WorkerPool* pool) {
+    m_pool = pool;
+    for (auto& bounds : m_bounds) bounds.clear();
+    m_survivors.clear();
+    m_chunks.clear();
+    m_frames = 0;
+    m_tested = 0;
+    m_kept = 0;
+    m_casters = 0;
+    m_cullMs = 0.0;
+}
+
+void InstanceCuller::SetBounds(UINT blas, const BoundingSphere& sphere) {
+    // BLASes without bounds are never culled
+    if (blas >= m_bounds[0].size()) {
+        for (int k = 0; k < 3; k++) m_bounds[k].resize(blas + 1, 0.0f);
+        m_bounds[3].resize(blas + 1, FLT_MAX);
+    }
+    m_bounds[0][blas] = sphere.Center.x;
+    m_bounds[1][blas] = sphere.Center.y;
+    m_bounds[2][blas] = sphere.Center.z;
+    m_bounds[3][blas] = sphere.Radius;
+}
+
+const std::vector<UINT>& InstanceCuller::Cull(const TopLevelInstances& instances, const BlasManager& blas, const CullView& view) {
+    auto start = std::chrono::high_resolution_clock::now();
+    if (m_bounds[0].size() < blas.GetCount()) {
+        for (int k = 0; k < 3; k++) m_bounds[k].resize(blas.GetCount(), 0.0f);
+        m_bounds[3].resize(blas.GetCount(), FLT_MAX);
+    }
+
+    CullVolume volume = GetVolume(view);
+    CullSource source = {};
+    for (UINT e = 0; e < 12; e++) source.elements[e] = instances.GetElements(e).data();
+    source.bottomLevels = instances.GetBottomLevels().data();
+    for (int k = 0; k < 4; k++) source.bounds[k] = m_bounds[k].data();
+
+    size_t count = instances.GetCount();
+    size_t casters = 0;
+    if (!m_pool || count <= ChunkSize) {
+        m_survivors.resize(count);
+        m_survivors.resize(CullInstances(source, volume, 0, count, m_survivors.data(), &casters));
+    } else {
+        // Each chunk fills a list of its own, joined in order so the survivors stay ascending
+        size_t chunkCount = (count + ChunkSize - 1) / ChunkSize;
+        m_chunks.resize(chunkCount);
+        std::vector<size_t> chunkCasters(chunkCount, 0);
+        m_pool->ParallelFor(count, ChunkSize, [&](size_t begin, size_t end) {
+            std::vector<UINT>& chunk = m_chunks[begin / ChunkSize];
+            chunk.resize(end - begin);
+            chunk.resize(CullInstances(source, volume, begin, end, chunk.data(), &chunkCasters[begin / ChunkSize]));
+        });
+        m_survivors.clear();
+        for (size_t c = 0; c < chunkCount; c++) {
+            m_survivors.insert(m_survivors.end(), m_chunks[c].begin(), m_chunks[c].end());
+            casters += chunkCasters[c];
+        }
+    }
+
+    m_frames++;
+    m_tested += count;
+    m_kept += m_survivors.size();
+    m_casters += casters;
+    m_cullMs += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+    return m_survivors;
+}
+
+CullVolume InstanceCuller::GetVolume(const CullView& view) {
+    CullVolume volume = {};
+    XMMATRIX viewI = XMMatrixInverse(nullptr, view.view);
+    float p00 = XMVectorGetX(view.projection.r[0]);
+    float p11 = XMVectorGetY(view.projection.r[1]);
+    float nearDistance = -XMVectorGetZ(view.projection.r[3]) / XMVectorGetZ(view.projection.r[2]);
+
+    // Near corners then far corners, each (-x, -y), (+x, -y), (+x, +y), (-x, +y)
+    XMVECTOR corners[8];
+    XMVECTOR center = XMVectorZero();
+    for (int i = 0; i < 8; i++) {
+        float depth = i < 4 ? nearDistance : MaxDistance;
+        float x = (i % 4 == 1 || i % 4 == 2) ? depth / p00 : -depth / p00;
+        float y = (i % 4 >= 2) ? depth / p11 : -depth / p11;
+        corners[i] = XMVector3TransformCoord(XMVectorSet(x, y, depth, 1.0f), viewI);
+        center = XMVectorAdd(center, XMVectorScale(corners[i], 0.125f));
+    }
+
+    // Near, far, left, right, bottom, top
+    static const int faces[6][4] = { { 0, 1, 2, 3 }, { 4, 5, 6, 7 }, { 0, 3, 7, 4 }, { 1, 2, 6, 5 }, { 0, 1, 5, 4 }, { 3, 2, 6, 7 } };
+    static const int edges[12][2] = { { 0, 1 }, { 1, 2 }, { 2, 3 }, { 3, 0 }, { 4, 5 }, { 5, 6 }, { 6, 7 }, { 7, 4 }, { 0, 4 }, { 1, 5 }, { 2, 6 }, { 3, 7 } };
+    for (int f = 0; f < 6; f++) {
+        InwardPlane(corners[faces[f][0]], corners[faces[f][1]], corners[faces[f][2]], center, &volume.viewPlanes[f]);
+    }
+
+    XMStoreFloat3(&volume.camera, viewI.r[3]);
+    volume.nearDistance = nearDistance;
+    volume.maxDistance = MaxDistance;
+    volume.sizeScale = p11 * view.viewportHeight;
+    volume.minScreenSize = MinScreenSize;
+    if (!view.shadows) return volume;
+
+    // The hull of the frustum and the light: the faces the light is inside of, and a
+    // plane through the light for every edge between a face it is inside of and one it
+    // is outside of. A silhouette plane too thin to build is left out, which only makes
+    // the volume larger.
+    XMVECTOR light = XMLoadFloat3(&view.lightPosition);
+    bool lightInside[6];
+    for (int f = 0; f < 6; f++) {
+        lightInside[f] = PlaneDistance(volume.viewPlanes[f], light) >= 0.0f;
+        if (lightInside[f]) volume.casterPlanes[volume.casterPlaneCount++] = volume.viewPlanes[f];
+    }
+    for (const auto& edge : edges) {
+        int adjacent[2], found = 0;
+        for (int f = 0; f < 6 && found < 2; f++) {
+            const int* face = faces[f];
+            bool hasA = std::find(face, face + 4, edge[0]) != face + 4;
+            bool hasB = std::find(face, face + 4, edge[1]) != face + 4;
+            if (hasA && hasB) adjacent[found++] = f;
+        }
+        if (lightInside[adjacent[0]] == lightInside[adjacent[1]]) continue;
+        XMFLOAT4 plane;
+        if (InwardPlane(corners[edge[0]], corners[edge[1]], light, center, &plane)) {
+            volume.casterPlanes[volume.casterPlaneCount++] = plane;
+        }
+    }
+    return volume;
+}
+
+namespace {
+
+template <typename F>
+double BestOf(UINT iterations, const F& run) {
+    double best = 0.0;
+    for (UINT i = 0; i < iterations; i++) {
+        auto start = std::chrono::high_resolution_clock::now();
+        run();
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+        if (i == 0 || ms < best) best = ms;
+    }
+    return best;
+}
+
+}
+
+std::wstring BenchmarkCulling(WorkerPool* pool, size_t count, UINT iterations) {
+    count = (std::max)(count, size_t(4));
+    std::mt19937 random(1);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+
+    // Cubes and planes scattered over a square field around the camera, rotated about y and scaled
+    float side = 2.5f * std::sqrt(static_cast<float>(count));
+    std::vector<float> elements[12];
+    for (auto& element : elements) element.resize(count);
+    std::vector<UINT> bottomLevels(count);
+    for (size_t i = 0; i < count; i++) {
+        XMMATRIX transform = XMMatrixScaling(0.5f + 1.5f * unit(random), 0.5f + 1.5f * unit(random), 0.5f + 1.5f * unit(random))
+            * XMMatrixRotationY(6.2831853f * unit(random))
+            * XMMatrixTranslation((unit(random) - 0.5f) * side, 2.0f * unit(random) - 1.0f, (unit(random) - 0.5f) * side);
+        XMFLOAT3X4 desc;
+        XMStoreFloat3x4(&desc, transform);
+        for (int row = 0; row < 3; row++) {
+            for (int column = 0; column < 4; column++) elements[4 * row + column][i] = desc.m[row][column];
+        }
+        bottomLevels[i] = static_cast<UINT>(random() % 2);
+    }
+    float boundsX[2] = { 0.0f, 0.0f }, boundsY[2] = { 0.0f, 0.0f }, boundsZ[2] = { 0.0f, 0.0f };
+    float boundsRadius[2] = { 0.87f, 0.71f };
+
+    CullSource source = {};
+    for (int e = 0; e < 12; e++) source.elements[e] = elements[e].data();
+    source.bottomLevels = bottomLevels.data();
+    source.bounds[0] = boundsX;
+    source.bounds[1] = boundsY;
+    source.bounds[2] = boundsZ;
+    source.bounds[3] = boundsRadius;
+
+    CullView view = {};
+    view.view = XMMatrixLookAtLH(XMVectorSet(0.0f, 3.0f, 0.0f, 1.0f), XMVectorSet(0.0f, 0.0f, 20.0f, 1.0f), XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f));
+    view.projection = XMMatrixPerspectiveFovLH(XMConvertToRadians(60.f), 16.0f / 9.0f, 1.0f, 1000.0f);
+    view.viewportHeight = 1080.0f;
+    view.lightPosition = XMFLOAT3(-60.0f, 80.0f, -30.0f);
+    view.shadows = true;
+    CullVolume volume = InstanceCuller::GetVolume(view);
+
+    // The loop and the kernels have to agree before their timings mean anything
+    std::vector<UINT> expected, kept(count);
+    size_t casters = 0;
+    auto loop = [&]() {
+        expected.clear();
+        for (size_t i = 0; i < count; i++) {
+            bool caster;
+            if (Survives(source, volume, i, &caster)) expected.push_back(static_cast<UINT>(i));
+        }
+    };
+    loop();
+    size_t keptCount = CullInstances(source, volume, 0, count, kept.data(), &casters);
+    bool match = keptCount == expected.size() && std::equal(expected.begin(), expected.end(), kept.begin());
+
+    size_t chunkCount = (count + InstanceCuller::ChunkSize - 1) / InstanceCuller::ChunkSize;
+    std::vector<std::vector<UINT>> chunks(chunkCount);
+    auto parallel = [&]() {
+        pool->ParallelFor(count, InstanceCuller::ChunkSize, [&](size_t begin, size_t end) {
+            std::vector<UINT>& chunk = chunks[begin / InstanceCuller::ChunkSize];
+            chunk.resize(end - begin);
+            size_t chunkCasters = 0;
+            chunk.resize(CullInstances(source, volume, begin, end, chunk.data(), &chunkCasters));
+        });
+    };
+
+    double loopMs = BestOf(iterations, loop);
+    double serialMs = BestOf(iterations, [&]() { size_t c = 0; CullInstances(source, volume, 0, count, kept.data(), &c); });
+    double parallelMs = pool ? BestOf(iterations, parallel) : serialMs;
+
+    std::wstringstream ss;
+    ss.setf(std::ios::fixed);
+    ss.precision(2);
+    ss << L"Culling, " << count << L" instances" << (match ? L"" : L" (MISMATCH)") << L": " << keptCount << L" kept ("
+       << 100.0 * double(keptCount) / double(count) << L"%, " << casters << L" for shadows only, "
+       << volume.casterPlaneCount << L" light volume planes); loop " << loopMs << L" ms, SIMD " << serialMs
+       << L" ms, SIMD on " << (pool ? pool->GetThreadCount() : 0) + 1 << L" threads " << parallelMs << L" ms\n";
+    return ss.str();
+}
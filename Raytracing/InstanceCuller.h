@@ -0,0 +1,101 @@
+#pragma once
+#include <windows.h>
+#include <DirectXCollision.h>
+#include <DirectXMath.h>
+
+#include <string>
+#include <vector>
+
+#include "TopLevelInstances.h"
+#include "WorkerPool.h"
+
+// Where the frame looks from, and the point light its shadow rays trace towards
+struct CullView {
+	DirectX::XMMATRIX view;
+	DirectX::XMMATRIX projection;    // perspective, left-handed
+	float viewportHeight;            // pixels
+	DirectX::XMFLOAT3 lightPosition;
+	bool shadows;
+};
+
+// Convex volumes as inward planes (xyz normal, w distance), what the kernel tests against
+struct CullVolume {
+	static const UINT MaxPlanes = 18;  // the 6 frustum planes and up to 12 silhouette planes
+
+	DirectX::XMFLOAT4 viewPlanes[6];   // the view frustum, its far plane at MaxDistance
+	DirectX::XMFLOAT4 casterPlanes[MaxPlanes];
+	UINT casterPlaneCount;             // 0 without shadows
+	DirectX::XMFLOAT3 camera;
+	float nearDistance;
+	float maxDistance;
+	float sizeScale;                   // projected diameter in pixels of a unit radius at distance 1
+	float minScreenSize;
+};
+
+// Instances and the local bounds of their BLAS as structure of arrays
+struct CullSource {
+	const float* elements[12];         // the 3x4 transforms, laid out like InstanceDescSource
+	const UINT* bottomLevels;
+	const float* bounds[4];            // bounds[0..2][blas] center, bounds[3][blas] radius
+};
+
+// Drops the instances of a large scene that cannot contribute to the frame before the
+// TLAS is built, so its build cost and depth follow what is visible instead of what
+// exists. An instance is kept if its bounding sphere is in the view frustum, closer
+// than MaxDistance and at least MinScreenSize pixels across. With shadows an instance
+// outside the view can still shadow a visible point: it is kept if it touches the
+// light volume, the convex hull of the view frustum and the light, which holds every
+// shadow ray from the frustum towards the light. Casters get the screen size test too,
+// a caster too small to see casts a shadow too small to see.
+//
+// Every test is conservative: a sphere is only dropped when it lies outside one of the
+// planes of a volume. The spheres are transformed and tested four at a time in SSE
+// registers, in chunks over the pool for large scenes.
+class InstanceCuller {
+
+public:
+	static constexpr float MaxDistance = 250.0f;
+	static constexpr float MinScreenSize = 1.0f;  // projected diameter in pixels
+	static const size_t ChunkSize = 16384;        // a multiple of 4
+
+	InstanceCuller() {}
+
+	InstanceCuller(const InstanceCuller&) = delete;
+	InstanceCuller& operator=(const InstanceCuller&) = delete;
+
+	void Init(WorkerPool* pool = nullptr);
+	// Bounds of the geometry of `blas` in its own space
+	void SetBounds(UINT blas, const DirectX::BoundingSphere& sphere);
+
+	// Indices of the instances to keep, ascending
+	const std::vector<UINT>& Cull(const TopLevelInstances& instances, const BlasManager& blas, const CullView& view);
+
+	static CullVolume GetVolume(const CullView& view);
+
+	UINT64 GetFrameCount() const { return m_frames; }
+	UINT64 GetTestedCount() const { return m_tested; }
+	UINT64 GetKeptCount() const { return m_kept; }
+	UINT64 GetCasterCount() const { return m_casters; } // kept outside the view, for shadows only
+	double GetCullMs() const { return m_cullMs; }
+
+private:
+	WorkerPool* m_pool = nullptr;
+	std::vector<float> m_bounds[4];
+	std::vector<UINT> m_survivors;
+	std::vector<std::vector<UINT>> m_chunks; // survivors per chunk on the pool
+
+	UINT64 m_frames = 0;
+	UINT64 m_tested = 0;
+	UINT64 m_kept = 0;
+	UINT64 m_casters = 0;
+	double m_cullMs = 0.0;
+};
+
+// Writes the instances of [begin, end) that survive `volume` to `kept`, returns how
+// many. `casters` counts the ones kept for shadows only.
+size_t CullInstances(const CullSource& source, const CullVolume& volume, size_t begin, size_t end, UINT* kept, size_t* casters);
+
+// Times the sphere tests of a scalar loop against the serial and parallel kernels for
+// `count` random instances spread around the camera. Returns the report, best of
+// `iterations` runs each.
+std::wstring BenchmarkCulling(WorkerPool* pool, size_t count, UINT iterations);
@@ -0,0 +1,172 @@
+#include "InstanceDescKernel.h"
+
+#include <DirectXMath.h>
+#include <emmintrin.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstring>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+
+using namespace DirectX;
+
+// The kernel writes the desc as three transform rows and one 16-byte tail
+static_assert(sizeof(D3D12_RAYTRACING_INSTANCE_DESC) == 64, "Unexpected instance desc size");
+static_assert(offsetof(D3D12_RAYTRACING_INSTANCE_DESC, AccelerationStructure) == 56, "Unexpected instance desc layout");
+
+static void WriteInstanceDesc(const InstanceDescSource& source, size_t instance, D3D12_RAYTRACING_INSTANCE_DESC* desc) {
+    for (int row = 0; row < 3; row++) {
+        for (int column = 0; column < 4; column++) {
+            desc->Transform[row][column] = source.elements[4 * row + column][instance];
+        }
+    }
+    UINT blas = source.bottomLevels[instance];
+    desc->InstanceID = blas;
+    desc->InstanceMask = 0xFF;
+    desc->InstanceContributionToHitGroupIndex = blas * source.hitGroupStride;
+    desc->Flags = D3D12_RAYTRACING_INSTANCE_FLAG_NONE;
+    desc->AccelerationStructure = source.addresses[blas];
+}
+
+static __m128 LoadElements(const float* element, const UINT* indices, size_t i) {
+    if (!indices) return _mm_loadu_ps(element + i);
+    return _mm_set_ps(element[indices[i + 3]], element[indices[i + 2]], element[indices[i + 1]], element[indices[i]]);
+}
+
+void WriteInstanceDescs(const InstanceDescSource& source, size_t begin, size_t end, D3D12_RAYTRACING_INSTANCE_DESC* descs) {
+    if (reinterpret_cast<uintptr_t>(descs) & 15) { throw std::logic_error("Instance descs must be 16-byte aligned"); }
+
+    size_t i = begin;
+    for (; i + 4 <= end; i += 4) {
+        D3D12_RAYTRACING_INSTANCE_DESC* desc = descs + i;
+
+        // Each row element holds four instances, the transpose turns them into one row per instance
+        for (int row = 0; row < 3; row++) {
+            __m128 a = LoadElements(source.elements[4 * row + 0], source.indices, i);
+            __m128 b = LoadElements(source.elements[4 * row + 1], source.indices, i);
+            __m128 c = LoadElements(source.elements[4 * row + 2], source.indices, i);
+            __m128 d = LoadElements(source.elements[4 * row + 3], source.indices, i);
+            _MM_TRANSPOSE4_PS(a, b, c, d);
+            _mm_stream_ps(desc[0].Transform[row], a);
+            _mm_stream_ps(desc[1].Transform[row], b);
+            _mm_stream_ps(desc[2].Transform[row], c);
+            _mm_stream_ps(desc[3].Transform[row], d);
+        }
+
+        // InstanceID | mask << 24, hit group index | flags << 24, then the BLAS address
+        for (int k = 0; k < 4; k++) {
+            UINT blas = source.bottomLevels[source.indices ? source.indices[i + k] : i + k];
+            D3D12_GPU_VIRTUAL_ADDRESS address = source.addresses[blas];
+            __m128i tail = _mm_set_epi32(
+                static_cast<int>(address >> 32),
+                static_cast<int>(address & 0xFFFFFFFF),
+                static_cast<int>((blas * source.hitGroupStride) & 0xFFFFFF),
+                static_cast<int>((blas & 0xFFFFFF) | 0xFF000000u));
+            _mm_stream_si128(reinterpret_cast<__m128i*>(reinterpret_cast<UINT8*>(desc + k) + sizeof(desc[k].Transform)), tail);
+        }
+    }
+
+    for (; i < end; i++) WriteInstanceDesc(source, source.indices ? source.indices[i] : i, descs + i);
+
+    // Streaming stores are weakly ordered, complete them before the GPU or another thread reads
+    _mm_sfence();
+}
+
+void WriteInstanceDescsParallel(WorkerPool* pool, const InstanceDescSource& source, size_t count, D3D12_RAYTRACING_INSTANCE_DESC* descs) {
+    if (!pool || count <= InstanceDescChunkSize) {
+        WriteInstanceDescs(source, 0, count, descs);
+        return;
+    }
+    pool->ParallelFor(count, InstanceDescChunkSize, [&](size_t begin, size_t end) {
+        WriteInstanceDescs(source, begin, end, descs);
+    });
+}
+
+namespace {
+
+// The loop the kernel replaces: a transpose and a copy per instance
+void WriteInstanceDescsLoop(const std::vector<XMMATRIX>& transforms, const InstanceDescSource& source, D3D12_RAYTRACING_INSTANCE_DESC* descs) {
+    for (size_t i = 0; i < transforms.size(); i++) {
+        descs[i].InstanceID = source.bottomLevels[i];
+        descs[i].InstanceContributionToHitGroupIndex = source.bottomLevels[i] * source.hitGroupStride;
+        descs[i].Flags = D3D12_RAYTRACING_INSTANCE_FLAG_NONE;
+        XMMATRIX m = XMMatrixTranspose(transforms[i]);
+        memcpy(descs[i].Transform, &m, sizeof(descs[i].Transform));
+        descs[i].AccelerationStructure = source.addresses[source.bottomLevels[i]];
+        descs[i].InstanceMask = 0xFF;
+    }
+}
+
+template <typename F>
+double BestOf(UINT iterations, const F& run) {
+    double best = 0.0;
+    for (UINT i = 0; i < iterations; i++) {
+        auto start = std::chrono::high_resolution_clock::now();
+        run();
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+        if (i == 0 || ms < best) best = ms;
+    }
+    return best;
+}
+
+}
+
+std::wstring BenchmarkInstanceDescs(WorkerPool* pool, size_t count, UINT iterations) {
+    count = (std::max)(count, size_t(4));
+    std::mt19937 random(1);
+    std::uniform_real_distribution<float> value(-100.0f, 100.0f);
+
+    std::vector<XMMATRIX> transforms(count);
+    std::vector<float> elements[12];
+    for (auto& element : elements) element.resize(count);
+    std::vector<UINT> bottomLevels(count);
+    std::vector<D3D12_GPU_VIRTUAL_ADDRESS> addresses(16);
+    for (size_t i = 0; i < addresses.size(); i++) addresses[i] = 0x10000 * (i + 1);
+
+    for (size_t i = 0; i < count; i++) {
+        XMFLOAT3X4 desc;
+        for (int row = 0; row < 3; row++) {
+            for (int column = 0; column < 4; column++) {
+                desc.m[row][column] = value(random);
+                elements[4 * row + column][i] = desc.m[row][column];
+            }
+        }
+        transforms[i] = XMLoadFloat3x4(&desc);
+        bottomLevels[i] = static_cast<UINT>(random() % addresses.size());
+    }
+
+    InstanceDescSource source = {};
+    for (int e = 0; e < 12; e++) source.elements[e] = elements[e].data();
+    source.bottomLevels = bottomLevels.data();
+    source.addresses = addresses.data();
+    source.hitGroupStride = 2;
+
+    // Both paths have to agree before their timings mean anything
+    std::vector<D3D12_RAYTRACING_INSTANCE_DESC> expected(count);
+    std::vector<D3D12_RAYTRACING_INSTANCE_DESC> written(count);
+    WriteInstanceDescsLoop(transforms, source, expected.data());
+    WriteInstanceDescsParallel(pool, source, count, written.data());
+    bool match = memcmp(expected.data(), written.data(), count * sizeof(D3D12_RAYTRACING_INSTANCE_DESC)) == 0;
+
+    // Write-combined like the upload heap the descs go to
+    SIZE_T size = count * sizeof(D3D12_RAYTRACING_INSTANCE_DESC);
+    void* memory = VirtualAlloc(nullptr, size, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE | PAGE_WRITECOMBINE);
+    if (!memory) { throw std::runtime_error("Cannot allocate write-combined memory"); }
+    D3D12_RAYTRACING_INSTANCE_DESC* descs = static_cast<D3D12_RAYTRACING_INSTANCE_DESC*>(memory);
+    WriteInstanceDescs(source, 0, count, descs); // commit the pages outside the timings
+
+    double loopMs = BestOf(iterations, [&]() { WriteInstanceDescsLoop(transforms, source, descs); });
+    double serialMs = BestOf(iterations, [&]() { WriteInstanceDescs(source, 0, count, descs); });
+    double parallelMs = BestOf(iterations, [&]() { WriteInstanceDescsParallel(pool, source, count, descs); });
+    VirtualFree(memory, 0, MEM_RELEASE);
+
+    std::wstringstream ss;
+    ss << L"Instance descs, " << count << L" instances" << (match ? L"" : L" (MISMATCH)") << L": loop "
+       << loopMs << L" ms, SIMD " << serialMs << L" ms, SIMD on " << (pool ? pool->GetThreadCount() : 0) + 1
+       << L" threads " << parallelMs << L" ms\n";
+    return ss.str();
+}
@@ -0,0 +1,35 @@
+#pragma once
+#include <d3d12.h>
+
+#include <string>
+
+#include "WorkerPool.h"
+
+// Instances as structure of arrays, what the instance desc kernel reads. The 3x4
+// matrix is stored the way the desc holds it (row-major, translation in the last
+// column), one array per element.
+struct InstanceDescSource {
+	const float* elements[12];                    // elements[4 * row + column][instance]
+	const UINT* bottomLevels;                     // index into `addresses` per instance
+	const UINT* indices;                          // instance of each desc, nullptr when desc i is instance i
+	const D3D12_GPU_VIRTUAL_ADDRESS* addresses;
+	UINT hitGroupStride;                          // InstanceContributionToHitGroupIndex = BLAS index * stride
+};
+
+// Chunks of the parallel kernel, large enough to amortize a task and a multiple of 4
+static const size_t InstanceDescChunkSize = 16384;
+
+// Writes the descs [begin, end) to `descs[begin, end)`. Four instances are transposed at
+// a time in SSE registers and written with streaming stores, so the write-combined
+// upload heap is filled in full lines without being read. With `indices` the elements
+// are gathered instead of loaded. InstanceID is the BLAS index, the mask 0xFF. `descs`
+// must be 16-byte aligned.
+void WriteInstanceDescs(const InstanceDescSource& source, size_t begin, size_t end, D3D12_RAYTRACING_INSTANCE_DESC* descs);
+
+// The same over [0, count), in InstanceDescChunkSize chunks on `pool`
+void WriteInstanceDescsParallel(WorkerPool* pool, const InstanceDescSource& source, size_t count, D3D12_RAYTRACING_INSTANCE_DESC* descs);
+
+// Times the per-instance transpose and copy loop against the serial and parallel
+// kernels for `count` random instances written to write-combined memory. Returns the
+// report, best of `iterations` runs each.
+std::wstring BenchmarkInstanceDescs(WorkerPool* pool, size_t count, UINT iterations);
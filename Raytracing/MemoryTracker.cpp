@@ -0,0 +1,311 @@
+#include "MemoryTracker.h"
+
+#include <algorithm>
+#include <cwchar>
+#include <cwctype>
+#include <iomanip>
+#include <sstream>
+
+D3D12ResidencyDevice::D3D12ResidencyDevice(ID3D12Device* device) {
+    m_device = device;
+    m_device->QueryInterface(IID_PPV_ARGS(&m_device1));
+
+    ComPtr<IDXGIFactory4> factory;
+    if (SUCCEEDED(CreateDXGIFactory1(IID_PPV_ARGS(&factory)))) {
+        factory->EnumAdapterByLuid(m_device->GetAdapterLuid(), IID_PPV_ARGS(&m_adapter));
+    }
+}
+
+UINT64 D3D12ResidencyDevice::GetAllocationSize(const D3D12_RESOURCE_DESC& desc) {
+    return m_device->GetResourceAllocationInfo(0, 1, &desc).SizeInBytes;
+}
+
+HRESULT D3D12ResidencyDevice::MakeResident(UINT count, ID3D12Pageable* const* objects) {
+    return m_device->MakeResident(count, objects);
+}
+
+HRESULT D3D12ResidencyDevice::Evict(UINT count, ID3D12Pageable* const* objects) {
+    return m_device->Evict(count, objects);
+}
+
+HRESULT D3D12ResidencyDevice::SetPriority(UINT count, ID3D12Pageable* const* objects, D3D12_RESIDENCY_PRIORITY priority) {
+    if (!m_device1) return E_NOINTERFACE;
+    std::vector<D3D12_RESIDENCY_PRIORITY> priorities(count, priority);
+    return m_device1->SetResidencyPriority(count, objects, priorities.data());
+}
+
+UINT64 D3D12ResidencyDevice::QueryLocalBudget() {
+    if (!m_adapter) return 0;
+    DXGI_QUERY_VIDEO_MEMORY_INFO info = {};
+    if (FAILED(m_adapter->QueryVideoMemoryInfo(0, DXGI_MEMORY_SEGMENT_GROUP_LOCAL, &info))) return 0;
+    return info.Budget;
+}
+
+
+void MemoryTracker::Init(ResidencyDevice* device) {
+    m_device = device;
+    m_allocations.clear();
+    m_frame = 0;
+}
+
+ID3D12Resource* MemoryTracker::Track(ID3D12Resource* resource, LPCWSTR name, MemoryCategory category, ResidencyPriority priority) {
+    if (!resource) return resource;
+    resource->SetName(name);
+
+    // Swap chain buffers and placed resources may not report committed heap properties
+    D3D12_HEAP_PROPERTIES heapProperties = {};
+    D3D12_HEAP_FLAGS heapFlags = D3D12_HEAP_FLAG_NONE;
+    if (FAILED(resource->GetHeapProperties(&heapProperties, &heapFlags))) {
+        heapProperties.Type = D3D12_HEAP_TYPE_DEFAULT;
+    }
+
+    D3D12_RESOURCE_DESC desc = resource->GetDesc();
+
+    Allocation* allocation = Find(resource);
+    if (!allocation) {
+        m_allocations.push_back({});
+        allocation = &m_allocations.back();
+        allocation->resource = resource;
+        allocation->resident = true;
+        allocation->demoted = false;
+    }
+    allocation->name = name;
+    allocation->category = category;
+    allocation->heapType = heapProperties.Type;
+    allocation->priority = priority;
+    allocation->size = m_device ? m_device->GetAllocationSize(desc) : desc.Width * desc.Height * desc.DepthOrArraySize;
+    allocation->lastUsedFrame = m_frame;
+
+    EnforceBudget();
+    return resource;
+}
+
+void MemoryTracker::Use(ID3D12Resource* resource) {
+    Allocation* allocation = Find(resource);
+    if (!allocation) return;
+    allocation->lastUsedFrame = m_frame;
+
+    ID3D12Pageable* pageable = allocation->resource.Get();
+    if (!allocation->resident) {
+        m_device->MakeResident(1, &pageable);
+        allocation->resident = true;
+    }
+    if (allocation->demoted) {
+        m_device->SetPriority(1, &pageable, D3D12_RESIDENCY_PRIORITY_NORMAL);
+        allocation->demoted = false;
+    }
+}
+
+void MemoryTracker::NextFrame() {
+    m_frame++;
+    ReleaseUnreferenced();
+    EnforceBudget();
+}
+
+void MemoryTracker::SetBudget(MemoryCategory category, UINT64 bytes) {
+    m_budgets[static_cast<UINT>(category)] = bytes;
+    EnforceBudget();
+}
+
+void MemoryTracker::SetTotalBudget(UINT64 bytes) {
+    m_totalBudget = bytes;
+    EnforceBudget();
+}
+
+void MemoryTracker::SetBudgets(const MemoryBudgets& budgets) {
+    m_totalBudget = budgets.total;
+    std::copy(std::begin(budgets.categories), std::end(budgets.categories), m_budgets);
+    EnforceBudget();
+}
+
+MemoryBudgets MemoryTracker::ParseBudgets(int argc, const LPCWSTR* argv) {
+    auto sameName = [](LPCWSTR a, LPCWSTR b) {
+        for (; *a && *b; a++, b++) {
+            if (std::towupper(*a) != std::towupper(*b)) return false;
+        }
+        return *a == *b;
+    };
+
+    MemoryBudgets budgets;
+    for (int i = 1; argv && i + 2 < argc; i++) {
+        if (std::wcscmp(argv[i], L"-budget") != 0) continue;
+        UINT64 bytes = std::wcstoull(argv[i + 2], nullptr, 10) * 1024 * 1024;
+        if (sameName(argv[i + 1], L"Total")) budgets.total = bytes;
+        for (UINT c = 0; c < static_cast<UINT>(MemoryCategory::Count); c++) {
+            if (sameName(argv[i + 1], CategoryName(static_cast<MemoryCategory>(c)))) budgets.categories[c] = bytes;
+        }
+    }
+    return budgets;
+}
+
+UINT64 MemoryTracker::GetCategoryTotal(MemoryCategory category) const {
+    UINT64 total = 0;
+    for (const auto& allocation : m_allocations) {
+        if (allocation.category == category) total += allocation.size;
+    }
+    return total;
+}
+
+UINT64 MemoryTracker::GetHeapTotal(D3D12_HEAP_TYPE heapType) const {
+    UINT64 total = 0;
+    for (const auto& allocation : m_allocations) {
+        if (allocation.heapType == heapType) total += allocation.size;
+    }
+    return total;
+}
+
+UINT64 MemoryTracker::GetResidentTotal() const {
+    UINT64 total = 0;
+    for (const auto& allocation : m_allocations) {
+        if (allocation.resident) total += allocation.size;
+    }
+    return total;
+}
+
+UINT64 MemoryTracker::GetEvictedTotal() const {
+    UINT64 total = 0;
+    for (const auto& allocation : m_allocations) {
+        if (!allocation.resident) total += allocation.size;
+    }
+    return total;
+}
+
+std::wstring MemoryTracker::Report() const {
+    const double mb = 1.0 / (1024.0 * 1024.0);
+
+    std::wstringstream ss;
+    ss << std::fixed << std::setprecision(2);
+    ss << L"GPU memory (frame " << m_frame << L"): resident " << GetResidentTotal() * mb
+       << L" MB, evicted " << GetEvictedTotal() * mb
+       << L" MB, budget " << GetEffectiveTotalBudget() * mb << L" MB\n";
+
+    for (UINT i = 0; i < static_cast<UINT>(MemoryCategory::Count); i++) {
+        MemoryCategory category = static_cast<MemoryCategory>(i);
+        UINT count = 0;
+        for (const auto& allocation : m_allocations) {
+            if (allocation.category == category) count++;
+        }
+        if (count == 0) continue;
+
+        ss << L"  " << std::left << std::setw(22) << CategoryName(category) << std::right
+           << std::setw(10) << GetCategoryTotal(category) * mb << L" MB  (" << count << L" resources)";
+        if (m_budgets[i]) ss << L"  budget " << m_budgets[i] * mb << L" MB";
+        ss << L"\n";
+    }
+
+    ss << L"  Default heap " << GetHeapTotal(D3D12_HEAP_TYPE_DEFAULT) * mb
+       << L" MB, upload heap " << GetHeapTotal(D3D12_HEAP_TYPE_UPLOAD) * mb
+       << L" MB, readback heap " << GetHeapTotal(D3D12_HEAP_TYPE_READBACK) * mb << L" MB\n";
+    return ss.str();
+}
+
+LPCWSTR MemoryTracker::CategoryName(MemoryCategory category) {
+    switch (category) {
+    case MemoryCategory::Geometry:              return L"Geometry";
+    case MemoryCategory::Constant:              return L"Constant";
+    case MemoryCategory::Instance:              return L"Instance";
+    case MemoryCategory::AccelerationStructure: return L"AccelerationStructure";
+    case MemoryCategory::Scratch:               return L"Scratch";
+    case MemoryCategory::ShaderTable:           return L"ShaderTable";
+    case MemoryCategory::RenderTarget:          return L"RenderTarget";
+    case MemoryCategory::Upload:                return L"Upload";
+    case MemoryCategory::Readback:              return L"Readback";
+    default:                                    return L"Unknown";
+    }
+}
+
+MemoryTracker::Allocation* MemoryTracker::Find(ID3D12Resource* resource) {
+    for (auto& allocation : m_allocations) {
+        if (allocation.resource.Get() == resource) return &allocation;
+    }
+    return nullptr;
+}
+
+void MemoryTracker::ReleaseUnreferenced() {
+    // Drop the entries whose only remaining reference is the tracker's own
+    for (size_t i = 0; i < m_allocations.size();) {
+        ID3D12Resource* resource = m_allocations[i].resource.Get();
+        resource->AddRef();
+        if (resource->Release() == 1) {
+            std::swap(m_allocations[i], m_allocations.back());
+            m_allocations.pop_back();
+        } else {
+            i++;
+        }
+    }
+}
+
+void MemoryTracker::EnforceBudget() {
+    if (!m_device) return;
+
+    // What is over each budget, counted once. Demoted allocations are the first the OS
+    // pages out, they no longer count against a budget.
+    const UINT categoryCount = static_cast<UINT>(MemoryCategory::Count);
+    UINT64 over[categoryCount] = {};
+    UINT64 total = 0;
+    for (const auto& allocation : m_allocations) {
+        if (!allocation.resident || allocation.demoted) continue;
+        over[static_cast<UINT>(allocation.category)] += allocation.size;
+        total += allocation.size;
+    }
+    UINT64 totalBudget = GetEffectiveTotalBudget();
+    UINT64 totalOver = totalBudget && total > totalBudget ? total - totalBudget : 0;
+    UINT64 remaining = totalOver;
+    for (UINT i = 0; i < categoryCount; i++) {
+        over[i] = m_budgets[i] && over[i] > m_budgets[i] ? over[i] - m_budgets[i] : 0;
+        remaining += over[i];
+    }
+    if (!remaining) return;
+
+    // Only default heap resources left unused for IdleFrames can be paged out, lowest
+    // priority and least recently used first.
+    std::vector<Allocation*> candidates;
+    for (auto& allocation : m_allocations) {
+        if (!allocation.resident || allocation.demoted) continue;
+        if (allocation.priority == ResidencyPriority::Pinned) continue;
+        if (allocation.heapType != D3D12_HEAP_TYPE_DEFAULT) continue;
+        if (allocation.lastUsedFrame + IdleFrames > m_frame) continue;
+        candidates.push_back(&allocation);
+    }
+    std::sort(candidates.begin(), candidates.end(), [](const Allocation* a, const Allocation* b) {
+        if (a->priority != b->priority) return a->priority < b->priority;
+        return a->lastUsedFrame < b->lastUsedFrame;
+    });
+
+    std::vector<ID3D12Pageable*> evicted;
+    std::vector<ID3D12Pageable*> demoted;
+    for (Allocation* allocation : candidates) {
+        UINT64& categoryOver = over[static_cast<UINT>(allocation->category)];
+        if (!totalOver && !categoryOver) continue;
+
+        if (allocation->priority == ResidencyPriority::Low) {
+            allocation->resident = false;
+            evicted.push_back(allocation->resource.Get());
+        } else {
+            allocation->demoted = true;
+            demoted.push_back(allocation->resource.Get());
+        }
+
+        UINT64 freedTotal = (std::min)(totalOver, allocation->size);
+        UINT64 freedCategory = (std::min)(categoryOver, allocation->size);
+        totalOver -= freedTotal;
+        categoryOver -= freedCategory;
+        remaining -= freedTotal + freedCategory;
+        if (!remaining) break;
+    }
+
+    if (!evicted.empty()) {
+        m_device->Evict(static_cast<UINT>(evicted.size()), evicted.data());
+    }
+    if (!demoted.empty()) {
+        m_device->SetPriority(static_cast<UINT>(demoted.size()), demoted.data(), D3D12_RESIDENCY_PRIORITY_MINIMUM);
+    }
+}
+
+UINT64 MemoryTracker::GetEffectiveTotalBudget() const {
+    UINT64 osBudget = m_device ? m_device->QueryLocalBudget() : 0;
+    if (!m_totalBudget) return osBudget;
+    if (!osBudget) return m_totalBudget;
+    return (std::min)(m_totalBudget, osBudget);
+}
+
@@ -0,0 +1,131 @@
+#pragma once
+#include <d3d12.h>
+#include <dxgi1_4.h>
+#include <wrl.h>
+
+#include <string>
+#include <vector>
+
+using Microsoft::WRL::ComPtr;
+
+enum class MemoryCategory : UINT {
+	Geometry = 0,
+	Constant,
+	Instance,
+	AccelerationStructure,
+	Scratch,
+	ShaderTable,
+	RenderTarget,
+	Upload,
+	Readback,
+	Count
+};
+
+// Low resources are evicted under pressure, Normal ones only demoted,
+// Pinned ones are never touched.
+enum class ResidencyPriority : UINT {
+	Low = 0,
+	Normal,
+	Pinned
+};
+
+// Budgets in bytes, 0 leaves one unlimited
+struct MemoryBudgets {
+	UINT64 total = 0;
+	UINT64 categories[static_cast<UINT>(MemoryCategory::Count)] = {};
+};
+
+// The device calls the tracker depends on, so the accounting can run against a fake device.
+class ResidencyDevice {
+public:
+	virtual ~ResidencyDevice() {}
+
+	virtual UINT64 GetAllocationSize(const D3D12_RESOURCE_DESC& desc) = 0;
+	virtual HRESULT MakeResident(UINT count, ID3D12Pageable* const* objects) = 0;
+	virtual HRESULT Evict(UINT count, ID3D12Pageable* const* objects) = 0;
+	virtual HRESULT SetPriority(UINT count, ID3D12Pageable* const* objects, D3D12_RESIDENCY_PRIORITY priority) = 0;
+	virtual UINT64 QueryLocalBudget() = 0; // 0 when unknown
+};
+
+class D3D12ResidencyDevice : public ResidencyDevice {
+
+public:
+	D3D12ResidencyDevice() {}
+	D3D12ResidencyDevice(ID3D12Device* device);
+
+	UINT64 GetAllocationSize(const D3D12_RESOURCE_DESC& desc) override;
+	HRESULT MakeResident(UINT count, ID3D12Pageable* const* objects) override;
+	HRESULT Evict(UINT count, ID3D12Pageable* const* objects) override;
+	HRESULT SetPriority(UINT count, ID3D12Pageable* const* objects, D3D12_RESIDENCY_PRIORITY priority) override;
+	UINT64 QueryLocalBudget() override;
+
+private:
+	ComPtr<ID3D12Device> m_device;
+	ComPtr<ID3D12Device1> m_device1;
+	ComPtr<IDXGIAdapter3> m_adapter;
+};
+
+// Not thread-safe. Resources are tracked while the renderer initializes and from its
+// render thread afterwards, which alone marks them used and advances the frames.
+class MemoryTracker {
+
+public:
+	// Frames an allocation stays unused before it can be paged out, at least the frames
+	// the GPU may trail the CPU by
+	static const UINT64 IdleFrames = 4;
+
+	MemoryTracker() {}
+	~MemoryTracker() {}
+
+	void Init(ResidencyDevice* device);
+
+	// Names the resource and starts accounting for it. Returns the resource for chaining.
+	ID3D12Resource* Track(ID3D12Resource* resource, LPCWSTR name, MemoryCategory category,
+		ResidencyPriority priority = ResidencyPriority::Normal);
+	// Called for every resource a frame binds, what goes unused for IdleFrames is paged
+	// out first under pressure
+	void Use(ID3D12Resource* resource);
+	void NextFrame();
+
+	void SetBudget(MemoryCategory category, UINT64 bytes);
+	void SetTotalBudget(UINT64 bytes);
+	void SetBudgets(const MemoryBudgets& budgets);
+
+	// Reads every "-budget NAME MB" of a command line, NAME being a category as listed
+	// in the report or Total. Unknown names are ignored.
+	static MemoryBudgets ParseBudgets(int argc, const LPCWSTR* argv);
+
+	UINT64 GetCategoryTotal(MemoryCategory category) const;
+	UINT64 GetHeapTotal(D3D12_HEAP_TYPE heapType) const;
+	UINT64 GetResidentTotal() const;
+	UINT64 GetEvictedTotal() const;
+	UINT64 GetFrame() const { return m_frame; }
+
+	std::wstring Report() const;
+	static LPCWSTR CategoryName(MemoryCategory category);
+
+private:
+	struct Allocation {
+		ComPtr<ID3D12Resource> resource;
+		std::wstring name;
+		MemoryCategory category;
+		D3D12_HEAP_TYPE heapType;
+		ResidencyPriority priority;
+		UINT64 size;
+		UINT64 lastUsedFrame;
+		bool resident;
+		bool demoted;
+	};
+
+	ResidencyDevice* m_device = nullptr;
+	std::vector<Allocation> m_allocations;
+
+	UINT64 m_frame = 0;
+	UINT64 m_totalBudget = 0;
+	UINT64 m_budgets[static_cast<UINT>(MemoryCategory::Count)] = {};
+
+	Allocation* Find(ID3D12Resource* resource);
+	void ReleaseUnreferenced();
+	void EnforceBudget();
+	UINT64 GetEffectiveTotalBudget() const;
+};
@@ -0,0 +1,124 @@
+#include "MeshFile.h"
+
+#include <fstream>
+#include <vector>
+
+static UINT64 AlignOffset(UINT64 offset, UINT64 alignment) {
+    return (offset + alignment - 1) & ~(alignment - 1);
+}
+
+// Compared term by term, so a crafted header cannot wrap the sum past the end of the file
+static bool BlockInFile(UINT64 offset, UINT64 size, UINT64 fileSize) {
+    return offset <= fileSize && size <= fileSize - offset;
+}
+
+UINT64 MeshChecksum(const void* data, UINT64 size, UINT64 seed) {
+    const UINT8* bytes = static_cast<const UINT8*>(data);
+    UINT64 hash = seed;
+    for (UINT64 i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
+bool WriteMeshFile(LPCWSTR fileName,
+    const void* vertices, UINT32 vertexStride, UINT64 vertexCount,
+    const UINT32* indices, UINT64 indexCount, UINT32 alignment) {
+
+    if (alignment < sizeof(MeshFileHeader) || (alignment & (alignment - 1)) != 0) return false;
+
+    MeshFileHeader header = {};
+    header.magic = MeshFileMagic;
+    header.version = MeshFileVersion;
+    header.headerSize = sizeof(MeshFileHeader);
+    header.alignment = alignment;
+    header.vertexStride = vertexStride;
+    header.indexFormat = indexCount ? DXGI_FORMAT_R32_UINT : DXGI_FORMAT_UNKNOWN;
+    header.vertexCount = vertexCount;
+    header.indexCount = indexCount;
+    header.vertexOffset = AlignOffset(sizeof(MeshFileHeader), alignment);
+    header.vertexSize = vertexCount * vertexStride;
+    header.indexOffset = indexCount ? AlignOffset(header.vertexOffset + header.vertexSize, alignment) : 0;
+    header.indexSize = indexCount * sizeof(UINT32);
+    header.checksum = MeshChecksum(vertices, header.vertexSize);
+    header.checksum = MeshChecksum(indices, header.indexSize, header.checksum);
+
+    std::ofstream file(fileName, std::ios::binary | std::ios::trunc);
+    if (!file.good()) return false;
+
+    std::vector<char> padding(alignment, 0);
+    UINT64 position = 0;
+    auto writeAt = [&](UINT64 offset, const void* data, UINT64 size) {
+        file.write(padding.data(), static_cast<std::streamsize>(offset - position));
+        file.write(static_cast<const char*>(data), static_cast<std::streamsize>(size));
+        position = offset + size;
+    };
+
+    writeAt(0, &header, sizeof(header));
+    writeAt(header.vertexOffset, vertices, header.vertexSize);
+    if (indexCount) writeAt(header.indexOffset, indices, header.indexSize);
+
+    return file.good();
+}
+
+MappedMesh::~MappedMesh() {
+    Close();
+}
+
+bool MappedMesh::Open(LPCWSTR fileName, bool verifyChecksum) {
+    Close();
+
+    m_file = CreateFileW(fileName, GENERIC_READ, FILE_SHARE_READ, nullptr,
+        OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (m_file == INVALID_HANDLE_VALUE) return false;
+
+    LARGE_INTEGER fileSize = {};
+    GetFileSizeEx(m_file, &fileSize);
+    m_fileSize = static_cast<UINT64>(fileSize.QuadPart);
+    if (m_fileSize < sizeof(MeshFileHeader)) { Close(); return false; }
+
+    m_mapping = CreateFileMappingW(m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!m_mapping) { Close(); return false; }
+
+    m_view = static_cast<const UINT8*>(MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0));
+    if (!m_view) { Close(); return false; }
+
+    const MeshFileHeader& header = Header();
+    bool valid =
+        header.magic == MeshFileMagic &&
+        header.version == MeshFileVersion &&
+        header.headerSize == sizeof(MeshFileHeader) &&
+        header.alignment != 0 && (header.alignment & (header.alignment - 1)) == 0 &&
+        header.vertexOffset % header.alignment == 0 &&
+        header.indexOffset % header.alignment == 0 &&
+        (header.vertexStride == 0 || header.vertexCount <= m_fileSize / header.vertexStride) &&
+        header.vertexSize == header.vertexCount * header.vertexStride &&
+        BlockInFile(header.vertexOffset, header.vertexSize, m_fileSize) &&
+        BlockInFile(header.indexOffset, header.indexSize, m_fileSize);
+
+    if (valid && header.indexCount) {
+        valid = header.indexFormat == DXGI_FORMAT_R32_UINT && header.indexCount <= m_fileSize / sizeof(UINT32) &&
+            header.indexSize == header.indexCount * sizeof(UINT32);
+    }
+
+    if (valid && verifyChecksum) {
+        UINT64 checksum = MeshChecksum(m_view + header.vertexOffset, header.vertexSize);
+        checksum = MeshChecksum(m_view + header.indexOffset, header.indexSize, checksum);
+        valid = checksum == header.checksum;
+    }
+
+    if (!valid) { Close(); return false; }
+    return true;
+}
+
+void MappedMesh::Close() {
+    if (m_view) UnmapViewOfFile(m_view);
+    if (m_mapping) CloseHandle(m_mapping);
+    if (m_file != INVALID_HANDLE_VALUE) CloseHandle(m_file);
+
+    m_view = nullptr;
+    m_mapping = nullptr;
+    m_file = INVALID_HANDLE_VALUE;
+    m_fileSize = 0;
+}
@@ -0,0 +1,66 @@
+#pragma once
+#include <windows.h>
+#include <dxgiformat.h>
+
+// Binary mesh container. The vertex and index blocks are stored exactly as the
+// GPU buffers expect them, so loading is a map plus a copy into upload memory.
+//
+//   [MeshFileHeader][pad][vertex block][pad][index block]
+//
+// Blocks start at multiples of `alignment` from the beginning of the file.
+
+static const UINT32 MeshFileMagic = 0x48534D52; // "RMSH"
+static const UINT32 MeshFileVersion = 1;
+static const UINT32 MeshFileDefaultAlignment = 256;
+
+struct MeshFileHeader {
+	UINT32 magic;
+	UINT32 version;
+	UINT32 headerSize;
+	UINT32 alignment;
+	UINT32 vertexStride;
+	UINT32 indexFormat;  // DXGI_FORMAT of the index block, DXGI_FORMAT_UNKNOWN if none
+	UINT64 vertexCount;
+	UINT64 indexCount;
+	UINT64 vertexOffset;
+	UINT64 vertexSize;
+	UINT64 indexOffset;
+	UINT64 indexSize;
+	UINT64 checksum;     // FNV-1a over the vertex block followed by the index block
+};
+static_assert(sizeof(MeshFileHeader) == 80, "MeshFileHeader layout is part of the file format");
+
+UINT64 MeshChecksum(const void* data, UINT64 size, UINT64 seed = 0xcbf29ce484222325ull);
+
+bool WriteMeshFile(LPCWSTR fileName,
+	const void* vertices, UINT32 vertexStride, UINT64 vertexCount,
+	const UINT32* indices = nullptr, UINT64 indexCount = 0,
+	UINT32 alignment = MeshFileDefaultAlignment);
+
+// Read-only view of a mesh file mapped into the address space.
+class MappedMesh {
+
+public:
+	MappedMesh() {}
+	~MappedMesh();
+
+	MappedMesh(const MappedMesh&) = delete;
+	MappedMesh& operator=(const MappedMesh&) = delete;
+
+	// Validates the header and block bounds. The checksum pass touches every byte,
+	// so it is only done on request.
+	bool Open(LPCWSTR fileName, bool verifyChecksum = false);
+	void Close();
+
+	bool IsOpen() const { return m_view != nullptr; }
+	const MeshFileHeader& Header() const { return *reinterpret_cast<const MeshFileHeader*>(m_view); }
+
+	const void* Vertices() const { return m_view + Header().vertexOffset; }
+	const void* Indices() const { return Header().indexSize ? m_view + Header().indexOffset : nullptr; }
+
+private:
+	HANDLE m_file = INVALID_HANDLE_VALUE;
+	HANDLE m_mapping = nullptr;
+	const UINT8* m_view = nullptr;
+	UINT64 m_fileSize = 0;
+};
@@ -0,0 +1,144 @@
+#include "PipelineCache.h"
+
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <stdexcept>
+
+void PipelineCache::Init(ID3D12Device* device, const std::wstring& fileName) {
+    m_device = device;
+    m_fileName = fileName;
+    if (m_fileName.empty()) return;
+
+    ComPtr<ID3D12Device1> device1;
+    if (FAILED(m_device.As(&device1))) return;
+
+    std::ifstream file(m_fileName, std::ios::binary);
+    if (file.good()) {
+        m_libraryData.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    }
+
+    // A library from another driver or adapter is rejected, start over with an empty one
+    if (m_libraryData.empty() ||
+        FAILED(device1->CreatePipelineLibrary(m_libraryData.data(), m_libraryData.size(), IID_PPV_ARGS(&m_library)))) {
+        m_libraryData.clear();
+        m_library.Reset();
+        device1->CreatePipelineLibrary(nullptr, 0, IID_PPV_ARGS(&m_library));
+    }
+}
+
+ComPtr<ID3D12RootSignature> PipelineCache::GetRootSignature(const void* serialized, size_t size) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    UINT64 key = HashRootSignature(serialized, size);
+
+    ComPtr<ID3D12RootSignature>& rootSignature = m_rootSignatures[key];
+    if (rootSignature) return rootSignature;
+
+    if (FAILED(m_device->CreateRootSignature(0, serialized, size, IID_PPV_ARGS(&rootSignature)))) {
+        m_rootSignatures.erase(key);
+        return nullptr;
+    }
+    m_rootSignatureKeys[rootSignature.Get()] = key;
+    return rootSignature;
+}
+
+ComPtr<ID3D12PipelineState> PipelineCache::GetGraphicsPipeline(const D3D12_GRAPHICS_PIPELINE_STATE_DESC& desc) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    UINT64 key = HashGraphicsPipelineDesc(desc, GetRootSignatureKey(desc.pRootSignature));
+
+    ComPtr<ID3D12PipelineState>& pipeline = m_pipelines[key];
+    if (pipeline) {
+        m_hits++;
+        return pipeline;
+    }
+
+    std::wstring name = GetPipelineName(key);
+    if (m_library && SUCCEEDED(m_library->LoadGraphicsPipeline(name.c_str(), &desc, IID_PPV_ARGS(&pipeline)))) {
+        m_loads++;
+        return pipeline;
+    }
+
+    if (FAILED(m_device->CreateGraphicsPipelineState(&desc, IID_PPV_ARGS(&pipeline)))) {
+        m_pipelines.erase(key);
+        return nullptr;
+    }
+    m_creates++;
+    if (m_library && SUCCEEDED(m_library->StorePipeline(name.c_str(), pipeline.Get()))) m_dirty = true;
+    return pipeline;
+}
+
+ComPtr<ID3D12PipelineState> PipelineCache::GetComputePipeline(const D3D12_COMPUTE_PIPELINE_STATE_DESC& desc) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    UINT64 key = HashComputePipelineDesc(desc, GetRootSignatureKey(desc.pRootSignature));
+
+    ComPtr<ID3D12PipelineState>& pipeline = m_pipelines[key];
+    if (pipeline) {
+        m_hits++;
+        return pipeline;
+    }
+
+    std::wstring name = GetPipelineName(key);
+    if (m_library && SUCCEEDED(m_library->LoadComputePipeline(name.c_str(), &desc, IID_PPV_ARGS(&pipeline)))) {
+        m_loads++;
+        return pipeline;
+    }
+
+    if (FAILED(m_device->CreateComputePipelineState(&desc, IID_PPV_ARGS(&pipeline)))) {
+        m_pipelines.erase(key);
+        return nullptr;
+    }
+    m_creates++;
+    if (m_library && SUCCEEDED(m_library->StorePipeline(name.c_str(), pipeline.Get()))) m_dirty = true;
+    return pipeline;
+}
+
+bool PipelineCache::Save() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!m_library || !m_dirty) return true;
+
+    std::vector<UINT8> data(m_library->GetSerializedSize());
+    if (FAILED(m_library->Serialize(data.data(), data.size()))) return false;
+
+    // Written aside then renamed, a crash mid-write leaves the previous library
+    std::wstring temporary = m_fileName + L".tmp";
+    {
+        std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+        if (!file.good()) return false;
+        file.write(reinterpret_cast<const char*>(data.data()), static_cast<std::streamsize>(data.size()));
+        if (!file.good()) return false;
+    }
+    if (!MoveFileExW(temporary.c_str(), m_fileName.c_str(), MOVEFILE_REPLACE_EXISTING)) return false;
+
+    m_dirty = false;
+    return true;
+}
+
+UINT PipelineCache::GetHitCount() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_hits;
+}
+
+UINT PipelineCache::GetLoadCount() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_loads;
+}
+
+UINT PipelineCache::GetCreateCount() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_creates;
+}
+
+UINT64 PipelineCache::GetRootSignatureKey(ID3D12RootSignature* rootSignature) const {
+    auto key = m_rootSignatureKeys.find(rootSignature);
+    if (key == m_rootSignatureKeys.end()) { throw std::logic_error("Root signature not created by the pipeline cache"); }
+    return key->second;
+}
+
+std::wstring PipelineCache::GetPipelineName(UINT64 key) {
+    std::wstringstream ss;
+    ss << L"PSO_" << std::hex;
+    ss.width(16);
+    ss.fill(L'0');
+    ss << key;
+    return ss.str();
+}
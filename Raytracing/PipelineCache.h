@@ -0,0 +1,60 @@
+#pragma once
+#include <d3d12.h>
+#include <wrl.h>
+
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "PipelineStateHash.h"
+
+using Microsoft::WRL::ComPtr;
+
+// Root signatures and pipeline states keyed by the canonical hash of their
+// description. A description seen before returns the existing object. New pipelines
+// are stored in an ID3D12PipelineLibrary that Save() writes to disk, the next launch
+// loads them from it instead of compiling again. The library is tied to the driver,
+// one that fails to load is replaced by an empty one.
+class PipelineCache {
+
+public:
+	PipelineCache() {}
+
+	PipelineCache(const PipelineCache&) = delete;
+	PipelineCache& operator=(const PipelineCache&) = delete;
+
+	// Without a file name, or on a device without pipeline libraries, only deduplicates
+	void Init(ID3D12Device* device, const std::wstring& fileName = std::wstring());
+
+	ComPtr<ID3D12RootSignature> GetRootSignature(const void* serialized, size_t size);
+
+	// The root signature must come from GetRootSignature, its key stands in for the pointer
+	ComPtr<ID3D12PipelineState> GetGraphicsPipeline(const D3D12_GRAPHICS_PIPELINE_STATE_DESC& desc);
+	ComPtr<ID3D12PipelineState> GetComputePipeline(const D3D12_COMPUTE_PIPELINE_STATE_DESC& desc);
+
+	// Writes the library if pipelines were added since it was loaded
+	bool Save();
+
+	UINT GetHitCount() const;     // returned an existing pipeline
+	UINT GetLoadCount() const;    // loaded from the library
+	UINT GetCreateCount() const;  // compiled by the driver
+
+private:
+	UINT64 GetRootSignatureKey(ID3D12RootSignature* rootSignature) const;
+	static std::wstring GetPipelineName(UINT64 key);
+
+	ComPtr<ID3D12Device> m_device;
+	ComPtr<ID3D12PipelineLibrary> m_library;
+	std::wstring m_fileName;
+	std::vector<UINT8> m_libraryData; // must outlive m_library
+	bool m_dirty = false;
+
+	mutable std::mutex m_mutex;
+	std::unordered_map<UINT64, ComPtr<ID3D12RootSignature>> m_rootSignatures;
+	std::unordered_map<ID3D12RootSignature*, UINT64> m_rootSignatureKeys;
+	std::unordered_map<UINT64, ComPtr<ID3D12PipelineState>> m_pipelines;
+	UINT m_hits = 0;
+	UINT m_loads = 0;
+	UINT m_creates = 0;
+};
@@ -0,0 +1,198 @@
+#include "PipelineStateHash.h"
+
+#include <algorithm>
+#include <cctype>
+
+namespace {
+
+// Graphics and compute descriptions never hash the same
+enum PipelineKind : UINT32 {
+    GraphicsPipeline = 1,
+    ComputePipeline = 2,
+};
+
+// FNV-1a over the canonical form, fed one field at a time so that padding and
+// pointers never reach the hash
+class Hasher {
+
+public:
+    explicit Hasher(UINT64 seed = 0xcbf29ce484222325ull) : m_hash(seed) {}
+
+    void Bytes(const void* data, size_t size) {
+        const UINT8* bytes = static_cast<const UINT8*>(data);
+        for (size_t i = 0; i < size; i++) {
+            m_hash ^= bytes[i];
+            m_hash *= 0x100000001b3ull;
+        }
+    }
+
+    template <typename T>
+    void Value(T value) { Bytes(&value, sizeof(value)); }
+
+    // HLSL semantics are case-insensitive
+    void Semantic(LPCSTR name) {
+        UINT64 length = 0;
+        for (LPCSTR c = name; c && *c; c++) length++;
+        Value(length);
+        for (UINT64 i = 0; i < length; i++) Value(static_cast<char>(std::toupper(static_cast<unsigned char>(name[i]))));
+    }
+
+    void Shader(const D3D12_SHADER_BYTECODE& shader) {
+        UINT64 size = shader.pShaderBytecode ? shader.BytecodeLength : 0;
+        Value(size);
+        Bytes(shader.pShaderBytecode, static_cast<size_t>(size));
+    }
+
+    UINT64 Get() const { return m_hash; }
+
+private:
+    UINT64 m_hash;
+};
+
+void HashStreamOutput(Hasher& hasher, const D3D12_STREAM_OUTPUT_DESC& streamOutput) {
+    hasher.Value(streamOutput.NumEntries);
+    if (streamOutput.NumEntries == 0) return;
+
+    for (UINT i = 0; i < streamOutput.NumEntries; i++) {
+        const D3D12_SO_DECLARATION_ENTRY& entry = streamOutput.pSODeclaration[i];
+        hasher.Value(entry.Stream);
+        hasher.Semantic(entry.SemanticName);
+        hasher.Value(entry.SemanticIndex);
+        hasher.Value(entry.StartComponent);
+        hasher.Value(entry.ComponentCount);
+        hasher.Value(entry.OutputSlot);
+    }
+    hasher.Value(streamOutput.NumStrides);
+    for (UINT i = 0; i < streamOutput.NumStrides; i++) hasher.Value(streamOutput.pBufferStrides[i]);
+    hasher.Value(streamOutput.RasterizedStream);
+}
+
+void HashRenderTargetBlend(Hasher& hasher, const D3D12_RENDER_TARGET_BLEND_DESC& blend) {
+    hasher.Value(blend.BlendEnable != FALSE);
+    if (blend.BlendEnable) {
+        hasher.Value(blend.SrcBlend);
+        hasher.Value(blend.DestBlend);
+        hasher.Value(blend.BlendOp);
+        hasher.Value(blend.SrcBlendAlpha);
+        hasher.Value(blend.DestBlendAlpha);
+        hasher.Value(blend.BlendOpAlpha);
+    }
+    hasher.Value(blend.LogicOpEnable != FALSE);
+    if (blend.LogicOpEnable) hasher.Value(blend.LogicOp);
+    hasher.Value(blend.RenderTargetWriteMask);
+}
+
+void HashBlend(Hasher& hasher, const D3D12_BLEND_DESC& blend, UINT renderTargetCount) {
+    hasher.Value(blend.AlphaToCoverageEnable != FALSE);
+    hasher.Value(blend.IndependentBlendEnable != FALSE);
+
+    // Without independent blending every target uses the first description
+    UINT count = blend.IndependentBlendEnable ? renderTargetCount : 1;
+    for (UINT i = 0; i < count && i < D3D12_SIMULTANEOUS_RENDER_TARGET_COUNT; i++) {
+        HashRenderTargetBlend(hasher, blend.RenderTarget[i]);
+    }
+}
+
+void HashRasterizer(Hasher& hasher, const D3D12_RASTERIZER_DESC& rasterizer) {
+    hasher.Value(rasterizer.FillMode);
+    hasher.Value(rasterizer.CullMode);
+    hasher.Value(rasterizer.FrontCounterClockwise != FALSE);
+    hasher.Value(rasterizer.DepthBias);
+    hasher.Value(rasterizer.DepthBiasClamp);
+    hasher.Value(rasterizer.SlopeScaledDepthBias);
+    hasher.Value(rasterizer.DepthClipEnable != FALSE);
+    hasher.Value(rasterizer.MultisampleEnable != FALSE);
+    hasher.Value(rasterizer.AntialiasedLineEnable != FALSE);
+    hasher.Value(rasterizer.ForcedSampleCount);
+    hasher.Value(rasterizer.ConservativeRaster);
+}
+
+void HashStencilOp(Hasher& hasher, const D3D12_DEPTH_STENCILOP_DESC& op) {
+    hasher.Value(op.StencilFailOp);
+    hasher.Value(op.StencilDepthFailOp);
+    hasher.Value(op.StencilPassOp);
+    hasher.Value(op.StencilFunc);
+}
+
+void HashDepthStencil(Hasher& hasher, const D3D12_DEPTH_STENCIL_DESC& depthStencil) {
+    hasher.Value(depthStencil.DepthEnable != FALSE);
+    if (depthStencil.DepthEnable) {
+        hasher.Value(depthStencil.DepthWriteMask);
+        hasher.Value(depthStencil.DepthFunc);
+    }
+    hasher.Value(depthStencil.StencilEnable != FALSE);
+    if (depthStencil.StencilEnable) {
+        hasher.Value(depthStencil.StencilReadMask);
+        hasher.Value(depthStencil.StencilWriteMask);
+        HashStencilOp(hasher, depthStencil.FrontFace);
+        HashStencilOp(hasher, depthStencil.BackFace);
+    }
+}
+
+void HashInputLayout(Hasher& hasher, const D3D12_INPUT_LAYOUT_DESC& inputLayout) {
+    hasher.Value(inputLayout.NumElements);
+    for (UINT i = 0; i < inputLayout.NumElements; i++) {
+        const D3D12_INPUT_ELEMENT_DESC& element = inputLayout.pInputElementDescs[i];
+        hasher.Semantic(element.SemanticName);
+        hasher.Value(element.SemanticIndex);
+        hasher.Value(element.Format);
+        hasher.Value(element.InputSlot);
+        hasher.Value(element.AlignedByteOffset);
+        hasher.Value(element.InputSlotClass);
+        // Only meaningful for per-instance data
+        hasher.Value(element.InputSlotClass == D3D12_INPUT_CLASSIFICATION_PER_INSTANCE_DATA ? element.InstanceDataStepRate : 0u);
+    }
+}
+
+}
+
+UINT64 HashRootSignature(const void* serialized, size_t size) {
+    Hasher hasher;
+    hasher.Value(PipelineStateHashVersion);
+    hasher.Bytes(serialized, size);
+    return hasher.Get();
+}
+
+UINT64 HashGraphicsPipelineDesc(const D3D12_GRAPHICS_PIPELINE_STATE_DESC& desc, UINT64 rootSignatureKey) {
+    Hasher hasher;
+    hasher.Value(PipelineStateHashVersion);
+    hasher.Value(GraphicsPipeline);
+    hasher.Value(rootSignatureKey);
+
+    hasher.Shader(desc.VS);
+    hasher.Shader(desc.PS);
+    hasher.Shader(desc.DS);
+    hasher.Shader(desc.HS);
+    hasher.Shader(desc.GS);
+    HashStreamOutput(hasher, desc.StreamOutput);
+
+    UINT renderTargetCount = (std::min)(desc.NumRenderTargets, UINT(D3D12_SIMULTANEOUS_RENDER_TARGET_COUNT));
+    HashBlend(hasher, desc.BlendState, renderTargetCount);
+    hasher.Value(desc.SampleMask);
+    HashRasterizer(hasher, desc.RasterizerState);
+    HashDepthStencil(hasher, desc.DepthStencilState);
+    HashInputLayout(hasher, desc.InputLayout);
+    hasher.Value(desc.IBStripCutValue);
+    hasher.Value(desc.PrimitiveTopologyType);
+
+    hasher.Value(desc.NumRenderTargets);
+    for (UINT i = 0; i < renderTargetCount; i++) hasher.Value(desc.RTVFormats[i]);
+    hasher.Value(desc.DSVFormat);
+    hasher.Value(desc.SampleDesc.Count);
+    hasher.Value(desc.SampleDesc.Quality);
+    hasher.Value(desc.NodeMask);
+    hasher.Value(desc.Flags);
+    return hasher.Get();
+}
+
+UINT64 HashComputePipelineDesc(const D3D12_COMPUTE_PIPELINE_STATE_DESC& desc, UINT64 rootSignatureKey) {
+    Hasher hasher;
+    hasher.Value(PipelineStateHashVersion);
+    hasher.Value(ComputePipeline);
+    hasher.Value(rootSignatureKey);
+
+    hasher.Shader(desc.CS);
+    hasher.Value(desc.NodeMask);
+    hasher.Value(desc.Flags);
+    return hasher.Get();
+}
@@ -0,0 +1,15 @@
+#pragma once
+#include <d3d12.h>
+
+// Canonical hashes of pipeline state descriptions. Only what changes the resulting
+// pipeline is hashed: shader bytecode by content, semantic names case-insensitively,
+// blend factors of disabled blending, depth and stencil state that is switched off,
+// render targets past NumRenderTargets and the cached blob are all left out. The
+// root signature is identified by a key from HashRootSignature, pointers never
+// take part, so hashes are stable across runs.
+
+static const UINT32 PipelineStateHashVersion = 1;
+
+UINT64 HashRootSignature(const void* serialized, size_t size);
+UINT64 HashGraphicsPipelineDesc(const D3D12_GRAPHICS_PIPELINE_STATE_DESC& desc, UINT64 rootSignatureKey);
+UINT64 HashComputePipelineDesc(const D3D12_COMPUTE_PIPELINE_STATE_DESC& desc, UINT64 rootSignatureKey);
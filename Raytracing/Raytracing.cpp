@@ -1,66 +1,156 @@
 #include "Raytracing.h"
 
-Raytracing::Raytracing(HWND hwnd, UINT width, UINT height, std::wstring name) {
+Raytracing::Raytracing(HWND hwnd, UINT width, UINT height, std::wstring name, const RaytracingOptions& options) {
     m_hwnd = hwnd;
 	m_width = width;
 	m_height = height;
 	m_title = name;
 	m_aspectRatio = static_cast<float>(m_width) / static_cast<float>(m_height);
     m_camera = Camera(XMVectorSet(0.0f, 3.0f, 5.0f, 0.0f), m_aspectRatio);
+    SetFramesInFlight(options.framesInFlight);
+    m_compactBottomLevels = options.compactBottomLevels;
+    m_sceneInstances = options.sceneInstances;
+    m_benchmarkScene = options.benchmarkScene;
+    m_dynamicGeometry = options.dynamicGeometry;
+    m_cullInstances = options.cullInstances;
+    m_memoryBudgets = options.memoryBudgets;
+
+    m_resolution.SetTargetFrameTime(1000.0 / 60.0);
+    m_resolution.SetScaleRange(0.5f, 1.0f);
 }
 
 Raytracing::~Raytracing() { }
 
-void Raytracing::MainLoop() {
-    if (!m_fence) return;
-    Update();
-    Render();
+void Raytracing::Start() {
+    if (m_rendering) return;
+    m_rendering = true;
+    m_renderThread = std::thread(&Raytracing::RenderLoop, this);
+    SetTimer(m_hwnd, TitleTimer, 500, nullptr);
+}
+
+void Raytracing::Stop() {
+    if (!m_rendering) return;
+    m_rendering = false;
+    m_renderThread.join();
+    KillTimer(m_hwnd, TitleTimer);
+}
+
+void Raytracing::RenderLoop() {
+    while (m_rendering) {
+        auto start = std::chrono::steady_clock::now();
+        WaitForFrameContext();
+        auto waited = std::chrono::steady_clock::now();
+
+        // Picked up after the wait so the frame uses the newest input
+        ApplySnapshot();
+        Update();
+        Render();
+        auto end = std::chrono::steady_clock::now();
+
+        std::lock_guard<std::mutex> lock(m_statsMutex);
+        m_cpuWaitMs += std::chrono::duration<double, std::milli>(waited - start).count();
+        m_renderMs += std::chrono::duration<double, std::milli>(end - waited).count();
+        m_gpuMs += m_resolution.GetLastFrameTime();
+        m_dispatchScale += double(m_dispatchWidth) / double(m_width);
+        m_statsFrames++;
+    }
+}
+
+void Raytracing::PublishSnapshot() {
+    m_input.view = m_camera.GetView();
+    m_input.projection = m_camera.GetProjection();
+
+    // A full queue means the render thread is stalled, the title timer retries
+    m_inputPending = !m_snapshots.Push(m_input);
+}
+
+void Raytracing::ApplySnapshot() {
+    m_snapshots.PopLatest(m_snapshot);
+
+    if (m_snapshot.framesInFlight != m_framesInFlight) {
+        SetFramesInFlight(m_snapshot.framesInFlight);
+    }
+    if (m_snapshot.memoryReports != m_memoryReports) {
+        m_memoryReports = m_snapshot.memoryReports;
+        OutputDebugString(m_memory.Report().c_str());
+    }
+
+    UpdateDispatchSize();
+}
+
+void Raytracing::UpdateDispatchSize() {
+    // Rasterized frames say nothing about the cost of tracing rays
+    if (m_snapshot.raster) return;
+
+    if (!m_snapshot.dynamicResolution) {
+        m_dispatchWidth = m_width;
+        m_dispatchHeight = m_height;
+        return;
+    }
+
+    // The frame context was just waited on, its timestamps are readable
+    m_resolution.Update(m_frameContext);
+    m_resolution.GetDispatchSize(m_width, m_height, &m_dispatchWidth, &m_dispatchHeight);
+}
+
+void Raytracing::SetFramesInFlight(UINT count) {
+    UINT maxCount = MaxFramesInFlight;
+    count = (std::max)(2u, (std::min)(count, maxCount));
+    if (m_timeline) {
+        // Drain the GPU so every context is free before the ring size changes
+        WaitForPreviousFrame();
+        m_frameContext = 0;
+    }
+    m_framesInFlight = count;
 }
 
 void Raytracing::Update() {
-    XMMATRIX model = XMMatrixIdentity();
-    XMVECTOR rotAxis = XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f);
-    XMMATRIX rotation = XMMatrixRotationAxis(rotAxis, XMConvertToRadians(0));
-    XMMATRIX translation = XMMatrixTranslation(0.0f, -1.f, 0.0f);
-    XMMATRIX scale = XMMatrixScaling(4.f, 4.f, 4.f);
-    m_instances[1].second = scale * translation * rotation * model;
+    m_memory.NextFrame();
+
+    // Only the transforms that differ are marked for the next TLAS build
+    UINT instanceCount = (std::min)(m_instances.GetCount(), m_snapshot.instanceCount);
+    for (UINT i = 0; i < instanceCount; i++) {
+        m_instances.SetTransform(i, m_snapshot.instances[i]);
+    }
 
     XMVECTOR det;
-    m_cbData.view = m_camera.GetView();
-    m_cbData.projection = m_camera.GetProjection();
-    m_cbData.viewI = XMMatrixInverse(&det, m_camera.GetView());
-    m_cbData.projectionI = XMMatrixInverse(&det, m_camera.GetProjection());
-
-    // update constant data
-    uint8_t* pData;
-    m_constantBuffer->Map(0, nullptr, (void**)&pData);
-    memcpy(pData, &m_cbData, sizeof(ConstantBuffer));
-    m_constantBuffer->Unmap(0, nullptr);
-
-    // update instance data
-    InstanceData* current = nullptr;
-    D3D12_RANGE range = { 0, 0 };
-    m_instanceBuffer->Map(0, &range, reinterpret_cast<void**>(&current));
-    for (const auto& inst : m_instances) {
-        current->model = inst.second;
+    m_cbData.view = m_snapshot.view;
+    m_cbData.projection = m_snapshot.projection;
+    m_cbData.viewI = XMMatrixInverse(&det, m_snapshot.view);
+    m_cbData.projectionI = XMMatrixInverse(&det, m_snapshot.projection);
+
+    // update constant data, the slot of the current frame context is no longer read by the GPU
+    memcpy(m_constantData + m_frameContext * m_constantSlotSize, &m_cbData, sizeof(ConstantBuffer));
+
+    // update instance data, only for the instances the raster pass draws
+    InstanceData* current = reinterpret_cast<InstanceData*>(m_instanceData + m_frameContext * m_instanceSlotSize);
+    UINT rasterInstances = (std::min)(GetRasterInstanceCount(), m_instances.GetCount());
+    for (UINT i = 0; i < rasterInstances; i++) {
+        current->model = m_instances.GetTransform(i);
         current++;
     }
-    m_instanceBuffer->Unmap(0, nullptr);
 }
 
 void Raytracing::Render() {
-    WaitForPreviousFrame();
-
     UpdateRenderPipeline();
 
     ExecuteRenderCommand();
+    m_frames[m_frameContext].fenceValue = m_timeline->GetLastSignaled(m_directQueue).value;
 
     m_swapChain->Present(0, 0);
+
+    m_frameContext = (m_frameContext + 1) % m_framesInFlight;
 }
 
 void Raytracing::UpdateRenderPipeline() {
-    m_commandAllocator->Reset();
-    m_commandList->Reset(m_commandAllocator.Get(), m_pipelineState.Get());
+    ID3D12CommandAllocator* commandAllocator = m_frames[m_frameContext].commandAllocator.Get();
+    commandAllocator->Reset();
+    m_commandList->Reset(commandAllocator, m_pipelineState.Get());
+    m_gpuTimer.Begin(m_commandList.Get(), m_frameContext);
+    m_bottomLevelsRecorded = false;
+    CompactBottomLevelAS();
+    UpdateDynamicGeometry();
+    if (!m_snapshot.raster) UpdateTopLevelAS();
 
     m_commandList->SetGraphicsRootSignature(m_rootSignature.Get());
     m_commandList->RSSetViewports(1, &m_viewport);
@@ -81,92 +171,86 @@ void Raytracing::UpdateRenderPipeline() {
 
     m_commandList->OMSetRenderTargets(1, &rtvHandle, FALSE, &dsvHandle);
 
-    if (m_raster) {
+    if (m_snapshot.raster) {
         const float clearColor[] = { 0.2f, 0.2f, 0.2f, 1.0f };
         m_commandList->ClearRenderTargetView(rtvHandle, clearColor, 0, nullptr);
         m_commandList->ClearDepthStencilView(dsvHandle, D3D12_CLEAR_FLAG_DEPTH, 1.0f, 0, 0, nullptr);
         m_commandList->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
 
-        std::vector<ID3D12DescriptorHeap*> heaps = { m_cbvSrvHeap.Get() };
+        std::vector<ID3D12DescriptorHeap*> heaps = { m_descriptors.GetHeap() };
         m_commandList->SetDescriptorHeaps(static_cast<UINT>(heaps.size()), heaps.data());
 
-        D3D12_GPU_DESCRIPTOR_HANDLE handle = m_cbvSrvHeap->GetGPUDescriptorHandleForHeapStart();
-        m_commandList->SetGraphicsRootDescriptorTable(0, handle); // CBV
-        m_commandList->SetGraphicsRootDescriptorTable(1, handle); // SRV
-        m_commandList->SetGraphicsRoot32BitConstant(2, 0, 0);
+        // The bindless table spans the whole heap, draws only pass the index of the instance buffer
+        m_commandList->SetGraphicsRootConstantBufferView(IdxCBV,
+            m_constantBuffer->GetGPUVirtualAddress() + UINT64(m_frameContext) * m_constantSlotSize);
+        m_commandList->SetGraphicsRootDescriptorTable(IdxBindless, m_descriptors.GetBindlessTable());
+        m_commandList->SetGraphicsRoot32BitConstant(IdxInstance, m_bindlessInstances[m_frameContext].index, 0);
+        m_memory.Use(m_constantBuffer.Get());
+        m_memory.Use(m_instanceBuffer.Get());
 
+        // Bound once, each draw selects its mesh through the arena offsets
         m_commandList->IASetVertexBuffers(0, 1, &m_vertexBufferView);
         m_commandList->IASetIndexBuffer(&m_indexBufferView);
-        m_commandList->DrawIndexedInstanced(m_indicesCount, 1, 0, 0, 0);
 
-        m_commandList->SetGraphicsRoot32BitConstant(2, 1, 0);
-
-        m_commandList->IASetVertexBuffers(0, 1, &m_planeBufferView);
-        m_commandList->DrawInstanced(m_planeVertCount, 1, 0, 0);
+        UINT meshes[] = { m_cubeMesh, m_planeMesh, m_flagMesh };
+        UINT meshCount = GetRasterInstanceCount();
+        for (UINT i = 0; i < meshCount; i++) {
+            const GeometryArena::MeshRange& mesh = m_geometry.GetMesh(meshes[i]);
+            m_commandList->SetGraphicsRoot32BitConstant(IdxInstance, i, 1);
+            m_commandList->DrawIndexedInstanced(mesh.indexCount, 1, mesh.firstIndex, mesh.baseVertex, 0);
+        }
     } else {
-        CreateTopLevelAS(m_instances, true);
-
-        std::vector<ID3D12DescriptorHeap*> heaps = { m_srvUavHeap.Get() };
+        std::vector<ID3D12DescriptorHeap*> heaps = { m_descriptors.GetHeap() };
         m_commandList->SetDescriptorHeaps(static_cast<UINT>(heaps.size()), heaps.data());
 
         D3D12_RESOURCE_BARRIER resourceBarrierToUav = {};
         resourceBarrierToUav.Type = D3D12_RESOURCE_BARRIER_TYPE_TRANSITION;
         resourceBarrierToUav.Flags = D3D12_RESOURCE_BARRIER_FLAG_NONE;
         resourceBarrierToUav.Transition.pResource = m_outputResource.Get();
-        resourceBarrierToUav.Transition.StateBefore = D3D12_RESOURCE_STATE_COPY_SOURCE;
+        resourceBarrierToUav.Transition.StateBefore = D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE;
         resourceBarrierToUav.Transition.StateAfter = D3D12_RESOURCE_STATE_UNORDERED_ACCESS;
         resourceBarrierToUav.Transition.Subresource = D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES;
         m_commandList->ResourceBarrier(1, &resourceBarrierToUav);
 
-        D3D12_GPU_VIRTUAL_ADDRESS sbtAddress = m_sbtStorage->GetGPUVirtualAddress();
+        // The variant matching the features of this frame, each has its own shader table
+        const RaytracingVariant& variant = GetRaytracingVariant(m_snapshot.shaderFeatures);
+        D3D12_GPU_VIRTUAL_ADDRESS sbtAddress = variant.sbtStorage->GetGPUVirtualAddress();
+        m_memory.Use(variant.sbtStorage.Get());
+        m_memory.Use(m_constantBuffer.Get());
+        m_memory.Use(m_geometryRecords.Get());
         D3D12_DISPATCH_RAYS_DESC desc = {};
-        desc.RayGenerationShaderRecord.StartAddress = sbtAddress;
-        desc.RayGenerationShaderRecord.SizeInBytes = m_rayGenSectionSize;
+        // One ray generation record per frame context, each pointing at its own descriptors
+        desc.RayGenerationShaderRecord.StartAddress = sbtAddress + m_frameContext * m_rayGenEntrySize;
+        desc.RayGenerationShaderRecord.SizeInBytes = m_rayGenEntrySize;
 
         desc.MissShaderTable.StartAddress = sbtAddress + m_rayGenSectionSize;
         desc.MissShaderTable.SizeInBytes = m_missSectionSize;
         desc.MissShaderTable.StrideInBytes = m_missEntrySize;
 
-        desc.HitGroupTable.StartAddress = sbtAddress + m_rayGenSectionSize + m_missSectionSize;
+        // The hit records of each frame context embed its own TLAS
+        desc.HitGroupTable.StartAddress = sbtAddress + m_rayGenSectionSize + m_missSectionSize
+            + UINT64(m_frameContext) * m_hitGroupSectionStride;
         desc.HitGroupTable.SizeInBytes = m_hitGroupSectionSize;
         desc.HitGroupTable.StrideInBytes = m_hitGroupEntrySize;
 
-        desc.Width = m_width;
-        desc.Height = m_height;
+        // Only the top-left dispatch rectangle of the output is written
+        desc.Width = m_dispatchWidth;
+        desc.Height = m_dispatchHeight;
         desc.Depth = 1;
 
-        m_commandList->SetPipelineState1(m_rtStateObject.Get());
+        m_commandList->SetPipelineState1(variant.stateObject.Get());
         m_commandList->DispatchRays(&desc);
 
-        D3D12_RESOURCE_BARRIER resourceBarrierToCopySrc = {};
-        resourceBarrierToCopySrc.Type = D3D12_RESOURCE_BARRIER_TYPE_TRANSITION;
-        resourceBarrierToCopySrc.Flags = D3D12_RESOURCE_BARRIER_FLAG_NONE;
-        resourceBarrierToCopySrc.Transition.pResource = m_outputResource.Get();
-        resourceBarrierToCopySrc.Transition.StateBefore = D3D12_RESOURCE_STATE_UNORDERED_ACCESS;
-        resourceBarrierToCopySrc.Transition.StateAfter = D3D12_RESOURCE_STATE_COPY_SOURCE;
-        resourceBarrierToCopySrc.Transition.Subresource = D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES;
-        m_commandList->ResourceBarrier(1, &resourceBarrierToCopySrc);
-
-        D3D12_RESOURCE_BARRIER resourceBarrierToCopyDst = {};
-        resourceBarrierToCopyDst.Type = D3D12_RESOURCE_BARRIER_TYPE_TRANSITION;
-        resourceBarrierToCopyDst.Flags = D3D12_RESOURCE_BARRIER_FLAG_NONE;
-        resourceBarrierToCopyDst.Transition.pResource = m_renderTargets[m_frameIndex].Get();
-        resourceBarrierToCopyDst.Transition.StateBefore = D3D12_RESOURCE_STATE_RENDER_TARGET;
-        resourceBarrierToCopyDst.Transition.StateAfter = D3D12_RESOURCE_STATE_COPY_DEST;
-        resourceBarrierToCopyDst.Transition.Subresource = D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES;
-        m_commandList->ResourceBarrier(1, &resourceBarrierToCopyDst);
-
-        m_commandList->CopyResource(m_renderTargets[m_frameIndex].Get(), m_outputResource.Get());
-
-        D3D12_RESOURCE_BARRIER resourceBarrierToTarget = {};
-        resourceBarrierToTarget.Type = D3D12_RESOURCE_BARRIER_TYPE_TRANSITION;
-        resourceBarrierToTarget.Flags = D3D12_RESOURCE_BARRIER_FLAG_NONE;
-        resourceBarrierToTarget.Transition.pResource = m_renderTargets[m_frameIndex].Get();
-        resourceBarrierToTarget.Transition.StateBefore = D3D12_RESOURCE_STATE_COPY_DEST;
-        resourceBarrierToTarget.Transition.StateAfter = D3D12_RESOURCE_STATE_RENDER_TARGET;
-        resourceBarrierToTarget.Transition.Subresource = D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES;
-        m_commandList->ResourceBarrier(1, &resourceBarrierToTarget);
+        D3D12_RESOURCE_BARRIER resourceBarrierToSrv = {};
+        resourceBarrierToSrv.Type = D3D12_RESOURCE_BARRIER_TYPE_TRANSITION;
+        resourceBarrierToSrv.Flags = D3D12_RESOURCE_BARRIER_FLAG_NONE;
+        resourceBarrierToSrv.Transition.pResource = m_outputResource.Get();
+        resourceBarrierToSrv.Transition.StateBefore = D3D12_RESOURCE_STATE_UNORDERED_ACCESS;
+        resourceBarrierToSrv.Transition.StateAfter = D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE;
+        resourceBarrierToSrv.Transition.Subresource = D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES;
+        m_commandList->ResourceBarrier(1, &resourceBarrierToSrv);
 
+        RecordUpscale(rtvHandle);
     }
     
     D3D12_RESOURCE_BARRIER resourceBarrierToPresent = {};
@@ -178,24 +262,107 @@ void Raytracing::UpdateRenderPipeline() {
     resourceBarrierToPresent.Transition.Subresource = D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES;
     m_commandList->ResourceBarrier(1, &resourceBarrierToPresent);
 
+    m_gpuTimer.End(m_commandList.Get(), m_frameContext);
+}
+
+void Raytracing::RecordUpscale(D3D12_CPU_DESCRIPTOR_HANDLE rtvHandle) {
+    // The upscale pass has no depth buffer
+    m_commandList->OMSetRenderTargets(1, &rtvHandle, FALSE, nullptr);
+    m_commandList->SetGraphicsRootSignature(m_upscaleSignature.Get());
+    m_commandList->SetPipelineState(m_upscalePipeline.Get());
+
+    m_commandList->SetGraphicsRootDescriptorTable(0, m_outputSrv.gpu);
+
+    // Texture coordinates of the traced rectangle, clamped half a texel inside so
+    // bilinear filtering never reads stale texels outside of it
+    float params[4] = {
+        float(m_dispatchWidth) / float(m_outputWidth),
+        float(m_dispatchHeight) / float(m_outputHeight),
+        (float(m_dispatchWidth) - 0.5f) / float(m_outputWidth),
+        (float(m_dispatchHeight) - 0.5f) / float(m_outputHeight),
+    };
+    m_commandList->SetGraphicsRoot32BitConstants(1, _countof(params), params, 0);
+
+    m_commandList->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+    m_commandList->DrawInstanced(3, 1, 0, 0);
 }
 
 void Raytracing::WaitForPreviousFrame() {
-    if (m_fence->GetCompletedValue() < m_fenceValue) {
-        m_fence->SetEventOnCompletion(m_fenceValue, m_fenceEvent);
-        WaitForSingleObject(m_fenceEvent, INFINITE);
+    m_timeline->WaitIdle(m_directQueue);
+
+    UINT64 completed = m_timeline->GetCompletedValue(m_directQueue);
+    m_uploadRing.Retire(completed);
+    m_scratch.Retire(completed);
+    m_blasCompactor.Retire();
+    m_blas.Retire();
+    m_asyncBuilds.Retire();
+    m_descriptors.Retire(completed);
+
+    m_frameIndex = m_swapChain->GetCurrentBackBufferIndex();
+}
+
+void Raytracing::WaitForFrameContext() {
+    // Only the frame that last used this context has to be finished, newer ones keep running
+    m_timeline->Wait({ m_directQueue, m_frames[m_frameContext].fenceValue });
+
+    // Its builds on the compute queue are done as well, the direct queue waited for them
+    double renderBeginMs, renderEndMs;
+    if (m_gpuTimer.ReadSpan(m_frameContext, &renderBeginMs, &renderEndMs)) {
+        m_asyncBuilds.AddFrame(m_frameContext, renderBeginMs, renderEndMs);
     }
 
+    // Non-blocking: whatever else the GPU already finished is released too
+    UINT64 completed = m_timeline->GetCompletedValue(m_directQueue);
+    m_uploadRing.Retire(completed);
+    m_scratch.Retire(completed);
+    m_blasCompactor.Retire();
+    m_blas.Retire();
+    m_asyncBuilds.Retire();
+    m_descriptors.Retire(completed);
+
     m_frameIndex = m_swapChain->GetCurrentBackBufferIndex();
 }
 
+void Raytracing::UpdateTitle() {
+    double waitMs = 0.0;
+    double renderMs = 0.0;
+    double gpuMs = 0.0;
+    double scale = 0.0;
+    {
+        std::lock_guard<std::mutex> lock(m_statsMutex);
+        if (m_statsFrames) {
+            waitMs = m_cpuWaitMs / m_statsFrames;
+            renderMs = m_renderMs / m_statsFrames;
+            gpuMs = m_gpuMs / m_statsFrames;
+            scale = m_dispatchScale / m_statsFrames;
+        }
+        m_cpuWaitMs = 0.0;
+        m_renderMs = 0.0;
+        m_gpuMs = 0.0;
+        m_dispatchScale = 0.0;
+        m_statsFrames = 0;
+    }
+
+    std::wstringstream ss;
+    ss << m_title << L" - " << m_input.framesInFlight << L" frames in flight, CPU wait "
+       << std::fixed << std::setprecision(2) << waitMs << L" ms, render " << renderMs << L" ms/frame, GPU "
+       << gpuMs << L" ms at " << int(scale * 100.0 + 0.5) << L"%" << (m_input.dynamicResolution ? L" (dynamic)" : L"")
+       << ((m_input.shaderFeatures & ShaderFeatureShadows) ? L", shadows" : L"");
+    SetWindowText(m_hwnd, ss.str().c_str());
+
+    if (m_inputPending) PublishSnapshot();
+}
+
 void Raytracing::ExecuteRenderCommand() {
     m_commandList->Close();
     ID3D12CommandList* ppCommandLists[] = { m_commandList.Get() };
     m_commandQueue->ExecuteCommandLists(_countof(ppCommandLists), ppCommandLists);
 
-    m_fenceValue++;
-    m_commandQueue->Signal(m_fence.Get(), m_fenceValue);
+    TimelinePoint submitted = m_timeline->Signal(m_directQueue);
+    m_uploadRing.Submit(submitted.value);
+    m_scratch.Submit(submitted.value);
+    m_blasCompactor.Submit(submitted);
+    m_descriptors.Submit(submitted.value);
 }
 
 void Raytracing::KeyDown(UINT8 key) { }
@@ -205,8 +372,21 @@ void Raytracing::KeyUp(UINT8 key) {
         PostQuitMessage(0);
     }
     if (key == VK_SPACE) {
-        m_raster = !m_raster;
+        m_input.raster = !m_input.raster;
     }
+    if (key == 'M') {
+        m_input.memoryReports++;
+    }
+    if (key == 'R') {
+        m_input.dynamicResolution = !m_input.dynamicResolution;
+    }
+    if (key == 'F') {
+        m_input.framesInFlight = m_input.framesInFlight < MaxFramesInFlight ? m_input.framesInFlight + 1 : 2;
+    }
+    if (key == 'S') {
+        m_input.shaderFeatures ^= ShaderFeatureShadows;
+    }
+    PublishSnapshot();
 }
 
 void Raytracing::MouseMove(UINT8 wParam, UINT32 lParam) {
@@ -220,25 +400,36 @@ void Raytracing::MouseMove(UINT8 wParam, UINT32 lParam) {
     if (!lmb) return;
 
     m_camera.Move(x - mouse.x, y - mouse.y);
+    PublishSnapshot();
 }
 
 void Raytracing::MouseWheel(float wParam) {
     m_camera.Zoom(GET_WHEEL_DELTA_WPARAM(wParam));
+    PublishSnapshot();
 }
 
 void Raytracing::Init() {
     std::wstringstream ss;
     ss << "Start" << "\n";
     OutputDebugString(ss.str().c_str());
+    StartShaderCompiles();
 
 	IDXGIFactory4* dxgiFactory;
     CreateDXGIFactory2(GetDebugFlag(), IID_PPV_ARGS(&dxgiFactory));
 	CreateDevice(dxgiFactory);
+    m_residencyDevice = D3D12ResidencyDevice(m_device.Get());
+    m_memory.Init(&m_residencyDevice);
+    m_memory.SetBudgets(m_memoryBudgets);
 	CreateSwapChain(dxgiFactory);
 	CreateRTV();
     CreateFence();
+    m_gpuTimer.Init(m_device.Get(), m_commandQueue.Get(), &m_memory, MaxFramesInFlight);
+    m_descriptors.Init(m_device.Get(), D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV, 1024, 256, 64);
+    m_pipelineCache.Init(m_device.Get(), L"PipelineCache.bin");
     CreateRootSignature();
 	CreateGraphicsPSO();
+    CreateUpscalePipeline();
+    if (!m_pipelineCache.Save()) OutputDebugString(L"Cannot write the pipeline library\n");
     CreateCommandList();
 
     CreateInputBuffer();
@@ -250,21 +441,71 @@ void Raytracing::Init() {
     CreateConstantBuffer();
     CreateInstanceBuffer();
     CreateCbvSrvHeap();
+    CreateGeometryRecords();
 
     InitViewport();
 
+    // The acceleration structures may still be building on the compute queue, the
+    // first frame waits for them on its context instead of Init
     ExecuteRenderCommand();
-    WaitForPreviousFrame();
+    m_frames[m_frameContext].fenceValue = m_timeline->GetLastSignaled(m_directQueue).value;
+    m_frameIndex = m_swapChain->GetCurrentBackBufferIndex();
+    if (m_benchmarkScene) {
+        WaitForPreviousFrame();
+        BenchmarkScene();
+    }
 
     CreateRaytracingPipeline();
+    ss.str(L"");
+    ss << L"Shaders: " << m_shaderCompiler->GetArchiveHitCount() << L" from the archive, "
+       << m_shaderCache.GetHitCount() << L" from cache, "
+       << m_shaderCache.GetMissCount() << L" compiled, " << m_shaderCompiler->GetTotalCompileMs()
+       << L" ms of compilation, longest " << m_shaderCompiler->GetLongestCompileMs() << L" ms\n";
+    ss << L"Pipelines: " << m_pipelineCache.GetHitCount() << L" shared, " << m_pipelineCache.GetLoadCount()
+       << L" from the library, " << m_pipelineCache.GetCreateCount() << L" created\n";
+    OutputDebugString(ss.str().c_str());
     CreateRaytracingOutputBuffer();
     CreateShaderResourceHeap();
     CreateShaderBindingTable();
+
+    // Initial scene state, the render thread starts from it before any input arrives. Snapshots
+    // carry the first instances, the rest of the scene stays where it was placed.
+    m_input.instanceCount = (std::min)(m_instances.GetCount(), UINT(MaxSnapshotInstances));
+    for (UINT i = 0; i < m_input.instanceCount; i++) {
+        m_input.instances[i] = m_instances.GetTransform(i);
+    }
+    m_input.instances[1] = XMMatrixScaling(4.f, 4.f, 4.f) * XMMatrixTranslation(0.0f, -1.f, 0.0f);
+    m_input.framesInFlight = m_framesInFlight;
+    m_input.shaderFeatures = RaytracingFeatures;
+    m_input.raster = false;
+    m_input.dynamicResolution = true;
+    PublishSnapshot();
+    m_snapshot = m_input;
 }
 
 void Raytracing::Destroy() {
+    Stop();
     WaitForPreviousFrame();
-    CloseHandle(m_fenceEvent);
+    OutputDebugString(m_memory.Report().c_str());
+
+    std::wstringstream ss;
+    ss << L"TLAS: " << m_instances.GetUpdateCount() << L" updates, " << m_instances.GetRebuildCount()
+       << L" rebuilds, " << m_instances.GetWrittenCount() << L" instance descs written\n";
+    if (m_cullInstances && m_culler.GetFrameCount()) {
+        UINT64 frames = m_culler.GetFrameCount();
+        ss << L"Culling: " << m_culler.GetKeptCount() / frames << L" of " << m_culler.GetTestedCount() / frames
+           << L" instances kept per frame, " << m_culler.GetCasterCount() / frames << L" for shadows only, "
+           << std::fixed << std::setprecision(3) << m_culler.GetCullMs() / frames << L" ms per frame, "
+           << m_instances.GetVisibleChangeCount() << L" visible set changes\n";
+        ss.unsetf(std::ios::fixed);
+    }
+    if (m_dynamicGeometry) {
+        ss << L"Dynamic BLAS: " << m_refits.GetRefitCount() << L" refits, " << m_refits.GetRebuildCount()
+           << L" rebuilds, worst degradation " << std::fixed << std::setprecision(2) << m_refits.GetWorstDegradation() << L"x\n";
+    }
+    ss << m_asyncBuilds.Report();
+    OutputDebugString(ss.str().c_str());
+    m_timeline.reset();
 }
 
 UINT Raytracing::GetDebugFlag() {
@@ -354,76 +595,32 @@ void Raytracing::CreateRTV() {
 
     for (int i = 0; i < FrameCount; i++) {
         m_swapChain->GetBuffer(i, IID_PPV_ARGS(&m_renderTargets[i]));
+        m_memory.Track(m_renderTargets[i].Get(), L"Back Buffer", MemoryCategory::RenderTarget, ResidencyPriority::Pinned);
         m_device->CreateRenderTargetView(m_renderTargets[i].Get(), nullptr, rtvHandle);
         rtvHandle.ptr += m_rtvDescriptorSize;
     }
 }
 
 void Raytracing::CreateFence() {
-    m_device->CreateFence(0, D3D12_FENCE_FLAG_NONE, IID_PPV_ARGS(&m_fence));
-    m_fenceValue = 0;
-    m_fenceEvent = CreateEvent(nullptr, FALSE, FALSE, nullptr);
+    m_fenceBackend.reset(new D3D12FenceBackend(m_device.Get()));
+    m_directQueue = m_fenceBackend->AddQueue(m_commandQueue.Get(), L"Direct Queue Fence");
+
+    // Large batches of acceleration structure builds run here
+    D3D12_COMMAND_QUEUE_DESC cqDesc = {};
+    cqDesc.Flags = D3D12_COMMAND_QUEUE_FLAG_NONE;
+    cqDesc.Type = D3D12_COMMAND_LIST_TYPE_COMPUTE;
+    m_device->CreateCommandQueue(&cqDesc, IID_PPV_ARGS(&m_computeCommandQueue));
+    m_computeQueue = m_fenceBackend->AddQueue(m_computeCommandQueue.Get(), L"Compute Queue Fence");
+    m_timeline.reset(new Timeline(m_fenceBackend.get()));
 }
 
 void Raytracing::CreateRootSignature() {
-    D3D12_DESCRIPTOR_RANGE1 ranges[ParametersCount - 1];
-    ranges[IdxCBV].RangeType = D3D12_DESCRIPTOR_RANGE_TYPE_CBV;
-    ranges[IdxCBV].NumDescriptors = 1;
-    ranges[IdxCBV].BaseShaderRegister = 0;
-    ranges[IdxCBV].RegisterSpace = 0;
-    ranges[IdxCBV].OffsetInDescriptorsFromTableStart = D3D12_DESCRIPTOR_RANGE_OFFSET_APPEND;
-    ranges[IdxCBV].Flags = D3D12_DESCRIPTOR_RANGE_FLAG_DATA_STATIC;
-           
-    ranges[IdxSRV].RangeType = D3D12_DESCRIPTOR_RANGE_TYPE_SRV;
-    ranges[IdxSRV].NumDescriptors = 1;
-    ranges[IdxSRV].BaseShaderRegister = 0;
-    ranges[IdxSRV].RegisterSpace = 0;
-    ranges[IdxSRV].OffsetInDescriptorsFromTableStart = 1; //
-    ranges[IdxSRV].Flags = D3D12_DESCRIPTOR_RANGE_FLAG_DATA_STATIC;
-
-    D3D12_ROOT_DESCRIPTOR_TABLE1 descriptorTables[ParametersCount - 1];
-    descriptorTables[IdxCBV].NumDescriptorRanges = 1;
-    descriptorTables[IdxCBV].pDescriptorRanges = &ranges[0];
-                    
-    descriptorTables[IdxSRV].NumDescriptorRanges = 1;
-    descriptorTables[IdxSRV].pDescriptorRanges = &ranges[1];
-
-    D3D12_ROOT_CONSTANTS rootConstants;
-    rootConstants.Num32BitValues = 1;
-    rootConstants.ShaderRegister = 1;
-    rootConstants.RegisterSpace = 0;
-
-    D3D12_ROOT_PARAMETER1 rootParameters[ParametersCount];
-    rootParameters[IdxCBV].ParameterType = D3D12_ROOT_PARAMETER_TYPE_DESCRIPTOR_TABLE;
-    rootParameters[IdxCBV].DescriptorTable = descriptorTables[0];
-    rootParameters[IdxCBV].ShaderVisibility = D3D12_SHADER_VISIBILITY_ALL;
-    rootParameters[IdxSRV].ParameterType = D3D12_ROOT_PARAMETER_TYPE_DESCRIPTOR_TABLE;
-    rootParameters[IdxSRV].DescriptorTable = descriptorTables[1];
-    rootParameters[IdxSRV].ShaderVisibility = D3D12_SHADER_VISIBILITY_ALL;
-    rootParameters[IdxInstance].ParameterType = D3D12_ROOT_PARAMETER_TYPE_32BIT_CONSTANTS;
-    rootParameters[IdxInstance].Constants = rootConstants;
-    rootParameters[IdxInstance].ShaderVisibility = D3D12_SHADER_VISIBILITY_ALL;
-
-    D3D12_VERSIONED_ROOT_SIGNATURE_DESC rootSignatureDesc;
-    rootSignatureDesc.Version = D3D_ROOT_SIGNATURE_VERSION_1_1;
-    rootSignatureDesc.Desc_1_1.NumParameters = _countof(rootParameters);
-    rootSignatureDesc.Desc_1_1.pParameters = rootParameters;
-    rootSignatureDesc.Desc_1_1.NumStaticSamplers = 0;
-    rootSignatureDesc.Desc_1_1.pStaticSamplers = nullptr;
-    rootSignatureDesc.Desc_1_1.Flags = D3D12_ROOT_SIGNATURE_FLAG_ALLOW_INPUT_ASSEMBLER_INPUT_LAYOUT;
-
-    ID3DBlob* signature;
-    ID3DBlob* error;
-    D3D12SerializeVersionedRootSignature(&rootSignatureDesc, &signature, &error);
-
-    m_device->CreateRootSignature(0, signature->GetBufferPointer(), signature->GetBufferSize(), IID_PPV_ARGS(&m_rootSignature));
+    m_rootSignature = GetRootSignature(RasterLayout::Serialize());
 }
 
 void Raytracing::CreateGraphicsPSO() {
-    D3D12_SHADER_BYTECODE vsBytecode = {};
-    CompileShader(L"VertexShader.hlsl", "vs_5_0", &vsBytecode);
-    D3D12_SHADER_BYTECODE psBytecode = {};
-    CompileShader(L"PixelShader.hlsl", "ps_5_0", &psBytecode);
+    D3D12_SHADER_BYTECODE vsBytecode = ShaderCompiler::Wait(m_shaders.vertex);
+    D3D12_SHADER_BYTECODE psBytecode = ShaderCompiler::Wait(m_shaders.pixel);
 
     D3D12_INPUT_ELEMENT_DESC inputLayout[] = {
         { "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT   , 0,  0, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
@@ -496,36 +693,132 @@ void Raytracing::CreateGraphicsPSO() {
     psoDesc.DepthStencilState = depthStencilDesc;
     psoDesc.BlendState = blendDesc;
 
-    m_device->CreateGraphicsPipelineState(&psoDesc, IID_PPV_ARGS(&m_pipelineState));
+    m_pipelineState = m_pipelineCache.GetGraphicsPipeline(psoDesc);
+    if (!m_pipelineState) { throw std::runtime_error("Cannot create the graphics pipeline"); }
+}
+
+void Raytracing::CreateUpscalePipeline() {
+    D3D12_DESCRIPTOR_RANGE1 range = {};
+    range.RangeType = D3D12_DESCRIPTOR_RANGE_TYPE_SRV;
+    range.NumDescriptors = 1;
+    range.BaseShaderRegister = 0;
+    range.RegisterSpace = 0;
+    range.OffsetInDescriptorsFromTableStart = 0;
+    range.Flags = D3D12_DESCRIPTOR_RANGE_FLAG_DATA_VOLATILE;
+
+    D3D12_ROOT_PARAMETER1 rootParameters[2] = {};
+    rootParameters[0].ParameterType = D3D12_ROOT_PARAMETER_TYPE_DESCRIPTOR_TABLE;
+    rootParameters[0].DescriptorTable.NumDescriptorRanges = 1;
+    rootParameters[0].DescriptorTable.pDescriptorRanges = &range;
+    rootParameters[0].ShaderVisibility = D3D12_SHADER_VISIBILITY_PIXEL;
+    rootParameters[1].ParameterType = D3D12_ROOT_PARAMETER_TYPE_32BIT_CONSTANTS;
+    rootParameters[1].Constants.Num32BitValues = 4; // uv scale, uv clamp
+    rootParameters[1].Constants.ShaderRegister = 0;
+    rootParameters[1].Constants.RegisterSpace = 0;
+    rootParameters[1].ShaderVisibility = D3D12_SHADER_VISIBILITY_PIXEL;
+
+    D3D12_STATIC_SAMPLER_DESC sampler = {};
+    sampler.Filter = D3D12_FILTER_MIN_MAG_MIP_LINEAR;
+    sampler.AddressU = D3D12_TEXTURE_ADDRESS_MODE_CLAMP;
+    sampler.AddressV = D3D12_TEXTURE_ADDRESS_MODE_CLAMP;
+    sampler.AddressW = D3D12_TEXTURE_ADDRESS_MODE_CLAMP;
+    sampler.ComparisonFunc = D3D12_COMPARISON_FUNC_NEVER;
+    sampler.MaxLOD = D3D12_FLOAT32_MAX;
+    sampler.ShaderRegister = 0;
+    sampler.RegisterSpace = 0;
+    sampler.ShaderVisibility = D3D12_SHADER_VISIBILITY_PIXEL;
+
+    D3D12_VERSIONED_ROOT_SIGNATURE_DESC rootSignatureDesc;
+    rootSignatureDesc.Version = D3D_ROOT_SIGNATURE_VERSION_1_1;
+    rootSignatureDesc.Desc_1_1.NumParameters = _countof(rootParameters);
+    rootSignatureDesc.Desc_1_1.pParameters = rootParameters;
+    rootSignatureDesc.Desc_1_1.NumStaticSamplers = 1;
+    rootSignatureDesc.Desc_1_1.pStaticSamplers = &sampler;
+    rootSignatureDesc.Desc_1_1.Flags = D3D12_ROOT_SIGNATURE_FLAG_NONE;
+
+    ComPtr<ID3DBlob> signature;
+    ComPtr<ID3DBlob> error;
+    HRESULT hr = D3D12SerializeVersionedRootSignature(&rootSignatureDesc, &signature, &error);
+    if (FAILED(hr)) { throw std::runtime_error("Cannot serialize the upscale root signature"); }
+    m_upscaleSignature = m_pipelineCache.GetRootSignature(signature->GetBufferPointer(), signature->GetBufferSize());
+
+    // Full screen triangle generated from SV_VertexID, no input layout
+    D3D12_SHADER_BYTECODE vsBytecode = ShaderCompiler::Wait(m_shaders.upscaleVertex);
+    D3D12_SHADER_BYTECODE psBytecode = ShaderCompiler::Wait(m_shaders.upscalePixel);
+
+    D3D12_RASTERIZER_DESC rasterizerDesc = {};
+    rasterizerDesc.FillMode = D3D12_FILL_MODE_SOLID;
+    rasterizerDesc.CullMode = D3D12_CULL_MODE_NONE;
+    rasterizerDesc.DepthClipEnable = TRUE;
+
+    D3D12_BLEND_DESC blendDesc = {};
+    blendDesc.RenderTarget[0].RenderTargetWriteMask = D3D12_COLOR_WRITE_ENABLE_ALL;
+
+    D3D12_GRAPHICS_PIPELINE_STATE_DESC psoDesc = {};
+    psoDesc.pRootSignature = m_upscaleSignature.Get();
+    psoDesc.VS = vsBytecode;
+    psoDesc.PS = psBytecode;
+    psoDesc.PrimitiveTopologyType = D3D12_PRIMITIVE_TOPOLOGY_TYPE_TRIANGLE;
+    psoDesc.RTVFormats[0] = DXGI_FORMAT_R8G8B8A8_UNORM;
+    psoDesc.DSVFormat = DXGI_FORMAT_UNKNOWN;
+    psoDesc.NumRenderTargets = 1;
+    psoDesc.SampleDesc.Count = 1;
+    psoDesc.SampleMask = UINT_MAX;
+    psoDesc.RasterizerState = rasterizerDesc;
+    psoDesc.BlendState = blendDesc;
+
+    m_upscalePipeline = m_pipelineCache.GetGraphicsPipeline(psoDesc);
+    if (!m_upscalePipeline) { throw std::runtime_error("Cannot create the upscale pipeline"); }
 }
 
 void Raytracing::CreateCommandList() {
-    m_device->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_DIRECT, IID_PPV_ARGS(&m_commandAllocator));
-    m_device->CreateCommandList(0, D3D12_COMMAND_LIST_TYPE_DIRECT, m_commandAllocator.Get(), m_pipelineState.Get(), IID_PPV_ARGS(&m_commandList));
+    for (UINT i = 0; i < MaxFramesInFlight; i++) {
+        m_device->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_DIRECT, IID_PPV_ARGS(&m_frames[i].commandAllocator));
+    }
+    m_device->CreateCommandList(0, D3D12_COMMAND_LIST_TYPE_DIRECT, m_frames[m_frameContext].commandAllocator.Get(), m_pipelineState.Get(), IID_PPV_ARGS(&m_commandList));
 }
 
-HRESULT Raytracing::CompileShader(LPCWSTR filename, LPCSTR target, D3D12_SHADER_BYTECODE* byteCode) {
-    ID3DBlob* vertexShader;
-    ID3DBlob* errorBuff;
-    HRESULT hr = D3DCompileFromFile(
-        filename,
-        nullptr, nullptr,
-        "main", target,
-        D3DCOMPILE_DEBUG | D3DCOMPILE_SKIP_OPTIMIZATION, 0,
-        &vertexShader, &errorBuff);
-
-    if (FAILED(hr)) {
-        OutputDebugStringA((char*)errorBuff->GetBufferPointer());
-        return hr;
+void Raytracing::StartShaderCompiles() {
+    m_shaderCompiler.reset(new ShaderCompiler(&m_shaderCache));
+
+    // Shipping builds carry the archive and never reach the compiler
+    if (m_shaderArchive.Open(GetExecutableRelativePath(ShaderArchiveName).c_str())) {
+        m_shaderCompiler->UseArchive(&m_shaderArchive);
+    }
+    else {
+        m_shaderCache.Init(L"ShaderCache");
     }
+    m_shaders = SubmitShaders(m_shaderCompiler.get());
+}
 
-    byteCode->BytecodeLength = vertexShader->GetBufferSize();
-    byteCode->pShaderBytecode = vertexShader->GetBufferPointer();
+Raytracing::Shaders Raytracing::SubmitShaders(ShaderCompiler* compiler) {
+    Shaders shaders;
+    shaders.vertex = compiler->Compile(L"VertexShader.hlsl", "vs_5_1");
+    shaders.pixel = compiler->Compile(L"PixelShader.hlsl", "ps_5_1");
+    shaders.upscaleVertex = compiler->Compile(L"Upscale.hlsl", "vs_5_0", "VSMain");
+    shaders.upscalePixel = compiler->Compile(L"Upscale.hlsl", "ps_5_0", "PSMain");
+    shaders.rayGenLibrary = compiler->CompileLibrary(L"RayGen.hlsl");
+    shaders.missLibrary = compiler->CompileLibrary(L"Miss.hlsl");
+    shaders.hitLibrary.CompileLibrary(compiler, L"Hit.hlsl", RaytracingFeatures);
+    shaders.shadowLibrary = compiler->CompileLibrary(L"ShadowRay.hlsl");
+    return shaders;
+}
 
-    return hr;
+bool Raytracing::BuildShaderArchive(LPCWSTR fileName) {
+    // In memory only, the archive is the only output of the build step
+    ShaderCache cache;
+    ShaderCompiler compiler(&cache, ShaderBuild::Optimized);
+    SubmitShaders(&compiler);
+    try {
+        return compiler.WriteArchive(fileName);
+    }
+    catch (const std::exception& e) {
+        OutputDebugStringA(e.what());
+        return false;
+    }
 }
 
-ID3D12Resource* Raytracing::CreateBuffer(int bufferSize, D3D12_RESOURCE_STATES resourceStates, D3D12_HEAP_TYPE heapType, D3D12_RESOURCE_FLAGS flags) {
+ComPtr<ID3D12Resource> Raytracing::CreateBuffer(UINT64 bufferSize, D3D12_RESOURCE_STATES resourceStates, D3D12_HEAP_TYPE heapType, D3D12_RESOURCE_FLAGS flags) {
     D3D12_RESOURCE_DESC resourceDesc = {};
     resourceDesc.Dimension = D3D12_RESOURCE_DIMENSION_BUFFER;
     resourceDesc.Alignment = 0;
@@ -546,7 +839,7 @@ ID3D12Resource* Raytracing::CreateBuffer(int bufferSize, D3D12_RESOURCE_STATES r
     heapProperties.CreationNodeMask = 1;
     heapProperties.VisibleNodeMask = 1;
 
-    ID3D12Resource* pBuffer;
+    ComPtr<ID3D12Resource> pBuffer;
     m_device->CreateCommittedResource(
         &heapProperties,
         D3D12_HEAP_FLAG_NONE,
@@ -559,106 +852,195 @@ ID3D12Resource* Raytracing::CreateBuffer(int bufferSize, D3D12_RESOURCE_STATES r
 }
 
 void Raytracing::CreateInputBuffer() {
-    int vBufferSize = sizeof(m_vertices);
-    m_vertexBuffer = CreateBuffer(
-        vBufferSize,
-        D3D12_RESOURCE_STATE_GENERIC_READ,
-        D3D12_HEAP_TYPE_UPLOAD);
-    m_vertexBuffer->SetName(L"Vertex Buffer");
+    m_uploadRing.Init(m_device.Get(), &m_memory, 32 * 1024 * 1024);
 
-    D3D12_RANGE range = { 0, 0 };
-    UINT8* pVertexDataBegin;
-    m_vertexBuffer->Map(0, &range, reinterpret_cast<void**>(&pVertexDataBegin));
-    memcpy(pVertexDataBegin, m_vertices, vBufferSize);
-    m_vertexBuffer->Unmap(0, nullptr);
-
-    m_vertexBufferView.BufferLocation = m_vertexBuffer->GetGPUVirtualAddress();
-    m_vertexBufferView.StrideInBytes = sizeof(Vertex);
-    m_vertexBufferView.SizeInBytes = vBufferSize;
-
-    int iBufferSize = sizeof(m_indices);
-    m_indexBuffer = CreateBuffer(
-        iBufferSize,
-        D3D12_RESOURCE_STATE_GENERIC_READ,
-        D3D12_HEAP_TYPE_UPLOAD);
-    m_indexBuffer->SetName(L"Index Buffer");
-
-    UINT8* pIndexDataBegin;
-    m_indexBuffer->Map(0, &range, reinterpret_cast<void**>(&pIndexDataBegin));
-    memcpy(pIndexDataBegin, m_indices, iBufferSize);
-    m_indexBuffer->Unmap(0, nullptr);
-
-    m_indexBufferView.BufferLocation = m_indexBuffer->GetGPUVirtualAddress();
-    m_indexBufferView.Format = DXGI_FORMAT_R32_UINT;
-    m_indexBufferView.SizeInBytes = iBufferSize;
-
-    // Plane
-    int pBufferSize = sizeof(m_planeVertices);
-    m_planeBuffer = CreateBuffer(
-        pBufferSize,
-        D3D12_RESOURCE_STATE_GENERIC_READ,
-        D3D12_HEAP_TYPE_UPLOAD);
-    m_planeBuffer->SetName(L"Plane Vertex Buffer");
+    // The built-in meshes are written out once, after that they go through the mapped file path
+    if (GetFileAttributesW(L"Cube.mesh") == INVALID_FILE_ATTRIBUTES) {
+        WriteMeshFile(L"Cube.mesh", m_vertices, sizeof(Vertex), m_verticesCount,
+            reinterpret_cast<const UINT32*>(m_indices), m_indicesCount);
+    }
+    if (GetFileAttributesW(L"Plane.mesh") == INVALID_FILE_ATTRIBUTES) {
+        WriteMeshFile(L"Plane.mesh", m_planeVertices, sizeof(Vertex), m_planeVertCount);
+    }
+
+    LPCWSTR fileNames[] = { L"Cube.mesh", L"Plane.mesh" };
+    MappedMesh meshes[_countof(fileNames)];
+    UINT64 vertexCapacity = 0;
+    UINT64 indexCapacity = 0;
+    for (UINT i = 0; i < _countof(fileNames); i++) {
+        if (!meshes[i].Open(fileNames[i])) { throw std::runtime_error("Cannot load mesh file"); }
+        const MeshFileHeader& header = meshes[i].Header();
+        if (header.vertexStride != sizeof(Vertex)) { throw std::runtime_error("Mesh vertex layout does not match"); }
+
+        vertexCapacity += header.vertexCount;
+        indexCapacity += header.indexCount ? header.indexCount : header.vertexCount;
+    }
+    if (m_dynamicGeometry) {
+        // Striped flag, the positions are set by DeformFlag
+        m_flagVertices.resize((FlagCells + 1) * (FlagCells + 1));
+        for (UINT v = 0; v <= FlagCells; v++) {
+            bool stripe = (v * 6 / (FlagCells + 1)) % 2 != 0;
+            for (UINT u = 0; u <= FlagCells; u++) {
+                m_flagVertices[v * (FlagCells + 1) + u].color = stripe ? XMFLOAT4(0.9f, 0.9f, 0.9f, 1.0f) : XMFLOAT4(0.8f, 0.1f, 0.1f, 1.0f);
+            }
+        }
+        m_flagIndices.clear();
+        for (UINT v = 0; v < FlagCells; v++) {
+            for (UINT u = 0; u < FlagCells; u++) {
+                UINT32 corner = v * (FlagCells + 1) + u;
+                UINT32 quad[6] = { corner + FlagCells + 1, corner + 1, corner, corner + FlagCells + 1, corner + FlagCells + 2, corner + 1 };
+                m_flagIndices.insert(m_flagIndices.end(), quad, quad + 6);
+            }
+        }
+        DeformFlag(0);
+        vertexCapacity += m_flagVertices.size();
+        indexCapacity += m_flagIndices.size();
+    }
+
+    // The blocks are already in GPU layout: copy the mapped bytes straight through the upload ring
+    m_geometry.Init(m_device.Get(), &m_memory, sizeof(Vertex), vertexCapacity, indexCapacity);
+    UploadSync sync = GetUploadSync();
+    UINT meshIds[_countof(fileNames)];
+    for (UINT i = 0; i < _countof(fileNames); i++) {
+        const MeshFileHeader& header = meshes[i].Header();
+        meshIds[i] = m_geometry.AddMesh(m_commandList.Get(), m_uploadRing, sync,
+            meshes[i].Vertices(), static_cast<UINT>(header.vertexCount),
+            static_cast<const UINT32*>(meshes[i].Indices()), static_cast<UINT>(header.indexCount));
+    }
+    if (m_dynamicGeometry) {
+        m_flagMesh = m_geometry.AddMesh(m_commandList.Get(), m_uploadRing, sync,
+            m_flagVertices.data(), static_cast<UINT>(m_flagVertices.size()),
+            m_flagIndices.data(), static_cast<UINT>(m_flagIndices.size()));
+    }
+    m_geometry.FinishUploads(m_commandList.Get());
 
-    UINT8* pPlaneDataBegin;
-    m_planeBuffer->Map(0, &range, reinterpret_cast<void**>(&pPlaneDataBegin));
-    memcpy(pPlaneDataBegin, m_planeVertices, pBufferSize);
-    m_planeBuffer->Unmap(0, nullptr);
+    m_cubeMesh = meshIds[0];
+    m_planeMesh = meshIds[1];
+    m_vertexBufferView = m_geometry.GetVertexBufferView();
+    m_indexBufferView = m_geometry.GetIndexBufferView();
+}
 
-    m_planeBufferView.BufferLocation = m_planeBuffer->GetGPUVirtualAddress();
-    m_planeBufferView.StrideInBytes = sizeof(Vertex);
-    m_planeBufferView.SizeInBytes = pBufferSize;
+UploadSync Raytracing::GetUploadSync() {
+    // Recording continues in the same allocator, it is reset once the frame has finished
+    UploadSync sync;
+    sync.submit = [this]() {
+        ExecuteRenderCommand();
+        m_commandList->Reset(m_frames[m_frameContext].commandAllocator.Get(), m_pipelineState.Get());
+    };
+    sync.wait = [this](UINT64 value) { m_timeline->Wait({ m_directQueue, value }); };
+    return sync;
+}
 
+void Raytracing::DeformFlag(UINT frame) {
+    // Hung from its left edge, the waves grow towards the free edge
+    float time = static_cast<float>(frame) / 60.0f;
+    for (UINT v = 0; v <= FlagCells; v++) {
+        for (UINT u = 0; u <= FlagCells; u++) {
+            float fu = static_cast<float>(u) / FlagCells;
+            float fv = static_cast<float>(v) / FlagCells;
+            float wave = 0.5f * fu * std::sin(6.0f * fu - 4.0f * time) + 0.1f * fu * std::sin(5.0f * fv + 3.0f * time);
+            m_flagVertices[v * (FlagCells + 1) + u].pos = XMFLOAT3(1.5f + 2.0f * fu, 0.5f + 1.5f * fv - 0.3f * fu * fu, wave);
+        }
+    }
 }
 
 void Raytracing::CreateConstantBuffer() {
-    const UINT cBufferSize = sizeof(ConstantBuffer);
+    m_constantSlotSize = ROUND_UP(static_cast<UINT>(sizeof(ConstantBuffer)), D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT);
     m_constantBuffer = CreateBuffer(
-        cBufferSize,
+        UINT64(m_constantSlotSize) * MaxFramesInFlight,
         D3D12_RESOURCE_STATE_GENERIC_READ,
         D3D12_HEAP_TYPE_UPLOAD,
         D3D12_RESOURCE_FLAG_NONE);
-    m_constantBuffer.Get()->SetName(L"Constant Buffer Upload Resource Heap");
+    m_memory.Track(m_constantBuffer.Get(), L"Constant Buffer Upload Resource Heap", MemoryCategory::Constant);
+
+    // Persistently mapped, each frame context writes its own slot
+    D3D12_RANGE range = { 0, 0 };
+    m_constantBuffer->Map(0, &range, reinterpret_cast<void**>(&m_constantData));
 }
 
 void Raytracing::CreateInstanceBuffer() {
-    uint32_t iBufferSize = ROUND_UP(
-        static_cast<uint32_t>(m_instances.size()) * sizeof(InstanceData),
-        D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT);
+    // Sized for the raster pass, the TLAS instances have their own descs
+    m_instanceSlotSize = ROUND_UP(
+        UINT64(GetRasterInstanceCount()) * sizeof(InstanceData),
+        UINT64(D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT));
 
     m_instanceBuffer = CreateBuffer(
-        iBufferSize,
+        m_instanceSlotSize * MaxFramesInFlight,
         D3D12_RESOURCE_STATE_GENERIC_READ,
         D3D12_HEAP_TYPE_UPLOAD,
         D3D12_RESOURCE_FLAG_NONE);
-    m_instanceBuffer.Get()->SetName(L"Instance Buffer Upload Resource Heap");
+    m_memory.Track(m_instanceBuffer.Get(), L"Instance Buffer Upload Resource Heap", MemoryCategory::Instance);
+
+    D3D12_RANGE range = { 0, 0 };
+    m_instanceBuffer->Map(0, &range, reinterpret_cast<void**>(&m_instanceData));
 }
 
 void Raytracing::CreateCbvSrvHeap() {
-    D3D12_DESCRIPTOR_HEAP_DESC cbvSrvHeapDesc = {};
-    cbvSrvHeapDesc.NumDescriptors = 2;
-    cbvSrvHeapDesc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV;
-    cbvSrvHeapDesc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_SHADER_VISIBLE;
-    m_device->CreateDescriptorHeap(&cbvSrvHeapDesc, IID_PPV_ARGS(&m_cbvSrvHeap));
-
-    D3D12_CONSTANT_BUFFER_VIEW_DESC cbvDesc = {};
-    cbvDesc.BufferLocation = m_constantBuffer->GetGPUVirtualAddress();
-    cbvDesc.SizeInBytes = sizeof(ConstantBuffer);
-
-    D3D12_CPU_DESCRIPTOR_HANDLE handle = m_cbvSrvHeap->GetCPUDescriptorHandleForHeapStart();
-    m_device->CreateConstantBufferView(&cbvDesc, handle);
-
-    D3D12_SHADER_RESOURCE_VIEW_DESC srvDesc;
-    srvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
-    srvDesc.Format = DXGI_FORMAT_UNKNOWN;
-    srvDesc.ViewDimension = D3D12_SRV_DIMENSION_BUFFER;
-    srvDesc.Buffer.FirstElement = 0;
-    srvDesc.Buffer.NumElements = static_cast<UINT>(m_instances.size());
-    srvDesc.Buffer.StructureByteStride = sizeof(InstanceData);
-    srvDesc.Buffer.Flags = D3D12_BUFFER_SRV_FLAG_NONE;
-
-    handle.ptr += m_device->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
-    m_device->CreateShaderResourceView(m_instanceBuffer.Get(), &srvDesc, handle);
+    // A CBV and an instance SRV per frame context. The SRVs are bindless, the raster
+    // pass reads the instance buffer of its frame context through its index.
+    m_constantViews = m_descriptors.AllocateStaging(MaxFramesInFlight);
+    m_instanceViews = m_descriptors.AllocateStaging(MaxFramesInFlight);
+
+    for (UINT i = 0; i < MaxFramesInFlight; i++) {
+        D3D12_CONSTANT_BUFFER_VIEW_DESC cbvDesc = {};
+        cbvDesc.BufferLocation = m_constantBuffer->GetGPUVirtualAddress() + UINT64(i) * m_constantSlotSize;
+        cbvDesc.SizeInBytes = m_constantSlotSize;
+        m_device->CreateConstantBufferView(&cbvDesc, m_constantViews.Cpu(i));
+
+        D3D12_SHADER_RESOURCE_VIEW_DESC srvDesc;
+        srvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
+        srvDesc.Format = DXGI_FORMAT_UNKNOWN;
+        srvDesc.ViewDimension = D3D12_SRV_DIMENSION_BUFFER;
+        srvDesc.Buffer.FirstElement = UINT64(i) * m_instanceSlotSize / sizeof(InstanceData);
+        srvDesc.Buffer.NumElements = GetRasterInstanceCount();
+        srvDesc.Buffer.StructureByteStride = sizeof(InstanceData);
+        srvDesc.Buffer.Flags = D3D12_BUFFER_SRV_FLAG_NONE;
+        m_device->CreateShaderResourceView(m_instanceBuffer.Get(), &srvDesc, m_instanceViews.Cpu(i));
+
+        m_bindlessInstances[i] = m_descriptors.AllocatePersistent();
+        m_descriptors.StageCopy(m_bindlessInstances[i], 0, m_instanceViews.Cpu(i));
+    }
+    m_descriptors.FlushCopies();
+}
+
+void Raytracing::CreateGeometryRecords() {
+    // Bindless views over the whole geometry arena, the records locate each mesh inside it
+    m_geometryRecords = CreateBuffer(
+        m_registry.GetGeometryCount() * sizeof(GeometryRecord),
+        D3D12_RESOURCE_STATE_GENERIC_READ,
+        D3D12_HEAP_TYPE_UPLOAD,
+        D3D12_RESOURCE_FLAG_NONE);
+    m_memory.Track(m_geometryRecords.Get(), L"Geometry Records", MemoryCategory::Geometry);
+
+    m_geometryViews = m_descriptors.AllocateStaging(3);
+    m_bindlessVertices = m_descriptors.AllocatePersistent();
+    m_bindlessIndices = m_descriptors.AllocatePersistent();
+    m_bindlessGeometry = m_descriptors.AllocatePersistent();
+
+    auto createView = [this](ID3D12Resource* buffer, UINT elementCount, UINT stride, UINT slot, const DescriptorHandle& handle) {
+        D3D12_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+        srvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
+        srvDesc.Format = DXGI_FORMAT_UNKNOWN;
+        srvDesc.ViewDimension = D3D12_SRV_DIMENSION_BUFFER;
+        srvDesc.Buffer.FirstElement = 0;
+        srvDesc.Buffer.NumElements = elementCount;
+        srvDesc.Buffer.StructureByteStride = stride;
+        srvDesc.Buffer.Flags = D3D12_BUFFER_SRV_FLAG_NONE;
+        m_device->CreateShaderResourceView(buffer, &srvDesc, m_geometryViews.Cpu(slot));
+        m_descriptors.StageCopy(handle, 0, m_geometryViews.Cpu(slot));
+    };
+    createView(m_geometry.GetVertexBuffer(), static_cast<UINT>(m_geometry.GetVertexCapacity()), m_geometry.GetVertexStride(), 0, m_bindlessVertices);
+    createView(m_geometry.GetIndexBuffer(), static_cast<UINT>(m_geometry.GetIndexCapacity()), sizeof(UINT32), 1, m_bindlessIndices);
+    createView(m_geometryRecords.Get(), m_registry.GetGeometryCount(), sizeof(GeometryRecord), 2, m_bindlessGeometry);
+    m_descriptors.FlushCopies();
+
+    GeometryRecord* records;
+    m_geometryRecords->Map(0, nullptr, reinterpret_cast<void**>(&records));
+    for (UINT i = 0; i < m_registry.GetGeometryCount(); i++) {
+        const GeometryArena::MeshRange& range = m_geometry.GetMesh(m_registry.GetMesh(i));
+        records[i] = { m_bindlessVertices.index, m_bindlessIndices.index, range.baseVertex, range.firstIndex };
+    }
+    m_geometryRecords->Unmap(0, nullptr);
 }
 
 void Raytracing::CreateDepthStencilBuffer() {
@@ -703,6 +1085,7 @@ void Raytracing::CreateDepthStencilBuffer() {
     );
 
     m_depthStencilHeap->SetName(L"Depth/Stencil Resource Heap");
+    m_memory.Track(m_depthStencilBuffer.Get(), L"Depth/Stencil Buffer", MemoryCategory::RenderTarget, ResidencyPriority::Pinned);
 
     D3D12_DEPTH_STENCIL_VIEW_DESC depthStencilDesc = {};
     depthStencilDesc.Format = DXGI_FORMAT_D32_FLOAT;
@@ -727,84 +1110,129 @@ void Raytracing::InitViewport() {
     m_scissorRect.bottom = m_height;
 }
 
-Raytracing::AccelerationStructureBuffers Raytracing::CreateBottomLevelAS(
-    ComPtr<ID3D12Resource> vertexBuffer, uint32_t vertexCount,
-    ComPtr<ID3D12Resource> indexBuffer, uint32_t indexCount) {
-   
+D3D12_RAYTRACING_GEOMETRY_DESC Raytracing::GetGeometryDesc(UINT mesh) {
+    const GeometryArena::MeshRange& range = m_geometry.GetMesh(mesh);
+
     D3D12_RAYTRACING_GEOMETRY_DESC rtGeometryDesc = {};
     rtGeometryDesc.Type = D3D12_RAYTRACING_GEOMETRY_TYPE_TRIANGLES;
-    rtGeometryDesc.Triangles.VertexBuffer.StartAddress = vertexBuffer->GetGPUVirtualAddress();
+    rtGeometryDesc.Triangles.VertexBuffer.StartAddress = m_geometry.GetVertexAddress(mesh);
     rtGeometryDesc.Triangles.VertexBuffer.StrideInBytes = sizeof(Vertex);
-    rtGeometryDesc.Triangles.VertexCount = vertexCount;
+    rtGeometryDesc.Triangles.VertexCount = range.vertexCount;
     rtGeometryDesc.Triangles.VertexFormat = DXGI_FORMAT_R32G32B32_FLOAT;
-    rtGeometryDesc.Triangles.IndexBuffer = indexBuffer ? indexBuffer->GetGPUVirtualAddress() : 0;
-    rtGeometryDesc.Triangles.IndexFormat = indexBuffer ? DXGI_FORMAT_R32_UINT : DXGI_FORMAT_UNKNOWN;
-    rtGeometryDesc.Triangles.IndexCount = indexCount;
+    rtGeometryDesc.Triangles.IndexBuffer = m_geometry.GetIndexAddress(mesh);
+    rtGeometryDesc.Triangles.IndexFormat = DXGI_FORMAT_R32_UINT;
+    rtGeometryDesc.Triangles.IndexCount = range.indexCount;
     rtGeometryDesc.Triangles.Transform3x4 = 0;
     rtGeometryDesc.Flags = D3D12_RAYTRACING_GEOMETRY_FLAG_OPAQUE;
+    return rtGeometryDesc;
+}
 
-    D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_INPUTS prebuildDesc;
-    prebuildDesc.Type = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL;
-    prebuildDesc.DescsLayout = D3D12_ELEMENTS_LAYOUT_ARRAY;
-    prebuildDesc.NumDescs = 1;
-    prebuildDesc.pGeometryDescs = &rtGeometryDesc;
-    prebuildDesc.Flags = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_NONE;
-
-    D3D12_RAYTRACING_ACCELERATION_STRUCTURE_PREBUILD_INFO info = {};
-    m_device->GetRaytracingAccelerationStructurePrebuildInfo(&prebuildDesc, &info);
-
-    // Buffer sizes need to be 256-byte-aligned
-    UINT64 scratchSize = ROUND_UP(info.ScratchDataSizeInBytes, D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT);
-    UINT64 resultSize = ROUND_UP(info.ResultDataMaxSizeInBytes, D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT);
-
-    AccelerationStructureBuffers buffers;
-    buffers.pScratch = CreateBuffer(
-        static_cast<int>(scratchSize),
-        D3D12_RESOURCE_STATE_COMMON, 
-        D3D12_HEAP_TYPE_DEFAULT, 
-        D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
-    buffers.pScratch->SetName(L"Buffer Scratch");
-    buffers.pResult = CreateBuffer(
-        static_cast<int>(resultSize),
-        D3D12_RESOURCE_STATE_RAYTRACING_ACCELERATION_STRUCTURE, 
-        D3D12_HEAP_TYPE_DEFAULT,
-        D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
-    buffers.pResult->SetName(L"Buffer Result");
-
-
-    D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_DESC buildDesc;
-    buildDesc.Inputs.Type = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL;
-    buildDesc.Inputs.DescsLayout = D3D12_ELEMENTS_LAYOUT_ARRAY;
-    buildDesc.Inputs.NumDescs = 1;
-    buildDesc.Inputs.pGeometryDescs = &rtGeometryDesc;
-    buildDesc.DestAccelerationStructureData = { buffers.pResult->GetGPUVirtualAddress() };
-    buildDesc.ScratchAccelerationStructureData = { buffers.pScratch->GetGPUVirtualAddress() };
-    buildDesc.SourceAccelerationStructureData = 0;
-    buildDesc.Inputs.Flags = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_NONE;
+void Raytracing::BuildBottomLevelAS() {
+    if (!m_blas.HasPending()) return;
+
+    if (!m_blas.IsAsyncBatch()) {
+        m_blas.Record(m_commandList.Get(), &m_scratch, m_directQueue);
+        m_bottomLevelsRecorded = true;
+        return;
+    }
 
-    // Build the AS
-    m_commandList->BuildRaytracingAccelerationStructure(&buildDesc, 0, nullptr);
+    // The geometry uploads recorded so far run first, the compute queue waits for them
+    // and this queue waits for the builds before anything recorded next reads them
+    ExecuteRenderCommand();
+    m_commandList->Reset(m_frames[m_frameContext].commandAllocator.Get(), nullptr);
+    m_blas.SubmitAsync(m_timeline->GetLastSignaled(m_directQueue), m_commandQueue.Get());
+}
 
-    D3D12_RESOURCE_BARRIER uavBarrier;
-    uavBarrier.Type = D3D12_RESOURCE_BARRIER_TYPE_UAV;
-    uavBarrier.UAV.pResource = buffers.pResult.Get();
-    uavBarrier.Flags = D3D12_RESOURCE_BARRIER_FLAG_NONE;
-    m_commandList->ResourceBarrier(1, &uavBarrier);
+void Raytracing::UpdateDynamicGeometry() {
+    if (!m_dynamicGeometry) return;
+
+    // The flag moves first, its BLAS and then the TLAS follow on the GPU in this frame
+    DeformFlag(++m_flagFrame);
+    m_geometry.UpdateVertices(m_commandList.Get(), m_uploadRing, GetUploadSync(), m_flagMesh, m_flagVertices.data());
+    m_geometry.FinishUploads(m_commandList.Get());
 
-    return buffers;
+    m_refits.Deformed(m_registry.GetGeometry(m_flagMesh), m_flagVertices.data());
+    if (m_cullInstances) {
+        BoundingSphere bounds;
+        BoundingSphere::CreateFromPoints(bounds, m_flagVertices.size(), &m_flagVertices[0].pos, sizeof(Vertex));
+        m_culler.SetBounds(m_registry.GetGeometry(m_flagMesh), bounds);
+    }
+    if (!m_refits.Schedule()) return;
+    BuildBottomLevelAS();
+    m_instances.BottomLevelsUpdated();
+}
+
+void Raytracing::CompactBottomLevelAS() {
+    if (m_blasCompactor.IsIdle()) return;
+
+    // Only the structures whose size has already been read back, nothing waits here
+    std::vector<BlasCompactor::Compacted> compacted = m_blasCompactor.Compact(m_commandList.Get(), m_directQueue);
+    if (compacted.empty()) return;
+
+    for (const auto& blas : compacted) {
+        m_blas.Relocate(blas.id, blas.page, blas.address);
+    }
+    m_instances.Invalidate();
+    m_bottomLevelsRecorded = true;
+
+    if (!m_blasCompactor.IsIdle()) return;
+    UINT64 source = m_blasCompactor.GetSourceTotal();
+    UINT64 compactedTotal = m_blasCompactor.GetCompactedTotal();
+    std::wstringstream ss;
+    ss << L"BLAS compaction: " << m_blasCompactor.GetCompactedCount() << L" structures, "
+       << source / 1024 << L" KB built, " << compactedTotal / 1024 << L" KB compacted ("
+       << std::fixed << std::setprecision(1) << 100.0 * double(source - compactedTotal) / double(source)
+       << L"% saved, " << source / m_blasCompactor.GetCompactedCount() / 1024 << L" -> "
+       << compactedTotal / m_blasCompactor.GetCompactedCount() / 1024 << L" KB per mesh), "
+       << m_blasCompactor.GetPoolSize() / 1024 << L" KB pool\n";
+    OutputDebugString(ss.str().c_str());
+}
+
+void Raytracing::CullInstances() {
+    if (!m_cullInstances) return;
+
+    CullView view = {};
+    view.view = m_cbData.view;
+    view.projection = m_cbData.projection;
+    view.viewportHeight = static_cast<float>(m_height);
+    view.lightPosition = m_lightPosition;
+    view.shadows = (m_snapshot.shaderFeatures & ShaderFeatureShadows) != 0;
+    // An unchanged set leaves the slots and the TLAS as they are
+    m_instances.SetVisible(m_culler.Cull(m_instances, m_blas, view));
 }
 
-void Raytracing::CreateTopLevelAS(
-    const std::vector<std::pair<ComPtr<ID3D12Resource>, DirectX::XMMATRIX>>& instances, 
-    bool updateOnly) {
+void Raytracing::UpdateTopLevelAS() {
+    CullInstances();
+
+    // Nothing moved since this context last built its TLAS, it is still exact
+    if (m_instances.IsBuilt(m_frameContext)) return;
+
+    // BLAS work recorded on the direct list so far runs first, the compute queue waits for it
+    TimelinePoint after = {};
+    if (m_bottomLevelsRecorded) {
+        ExecuteRenderCommand();
+        m_commandList->Reset(m_frames[m_frameContext].commandAllocator.Get(), m_pipelineState.Get());
+        after = m_timeline->GetLastSignaled(m_directQueue);
+        m_bottomLevelsRecorded = false;
+    }
+
+    // The TLAS of this context was last traced by a frame that has completed, the
+    // build can run while the frame before this one is still tracing its own
+    CreateTopLevelAS(m_asyncBuilds.Begin(m_frameContext));
+    m_asyncBuilds.Submit(after, m_commandQueue.Get());
+}
+
+void Raytracing::CreateTopLevelAS(ID3D12GraphicsCommandList4* commandList) {
     UINT64 resultSize;
     UINT64 scratchSize;
     UINT64 instanceDescSize;
-    if (!updateOnly) {
+    // Later full builds, after a BLAS moved or the instances drifted, reuse the buffers
+    bool created = !m_topLevelASBuffers.pResult[0];
+    if (created) {
         D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_INPUTS prebuildDesc = {};
         prebuildDesc.Type = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL;
         prebuildDesc.DescsLayout = D3D12_ELEMENTS_LAYOUT_ARRAY;
-        prebuildDesc.NumDescs = static_cast<UINT>(instances.size());
+        prebuildDesc.NumDescs = m_instances.GetCount();
         prebuildDesc.Flags = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_ALLOW_UPDATE;
 
         D3D12_RAYTRACING_ACCELERATION_STRUCTURE_PREBUILD_INFO info = {};
@@ -815,252 +1243,271 @@ void Raytracing::CreateTopLevelAS(
         info.ScratchDataSizeInBytes = ROUND_UP(info.ScratchDataSizeInBytes, D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT);
         
         resultSize = info.ResultDataMaxSizeInBytes;
-        scratchSize = info.ScratchDataSizeInBytes;
+        scratchSize = (std::max)(info.ScratchDataSizeInBytes, info.UpdateScratchDataSizeInBytes);
         instanceDescSize = ROUND_UP(
-            sizeof(D3D12_RAYTRACING_INSTANCE_DESC) * static_cast<UINT64>(instances.size()),
+            sizeof(D3D12_RAYTRACING_INSTANCE_DESC) * static_cast<UINT64>(m_instances.GetCount()),
             D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT);
 
-        m_topLevelASBuffers.pScratch = CreateBuffer(
-            static_cast<int>(scratchSize),
-            D3D12_RESOURCE_STATE_UNORDERED_ACCESS,
-            D3D12_HEAP_TYPE_DEFAULT,
-            D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
-        m_topLevelASBuffers.pScratch->SetName(L"Top Level Buffer Scratch");
-        m_topLevelASBuffers.pResult = CreateBuffer(
-            static_cast<int>(resultSize),
-            D3D12_RESOURCE_STATE_RAYTRACING_ACCELERATION_STRUCTURE,
-            D3D12_HEAP_TYPE_DEFAULT,
-            D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
-        m_topLevelASBuffers.pResult->SetName(L"Top Level Buffer Scratch");
+        // Updates reuse the arena, so reserve for whichever of build and update is larger
+        m_topLevelScratchSize = ROUND_UP(scratchSize, D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT);
+        m_asyncBuilds.GetScratch()->Reserve(m_topLevelScratchSize);
+        // One TLAS per frame context, so the build of a frame never writes the one still being traced
+        for (auto& result : m_topLevelASBuffers.pResult) {
+            result = CreateBuffer(
+                resultSize,
+                D3D12_RESOURCE_STATE_RAYTRACING_ACCELERATION_STRUCTURE,
+                D3D12_HEAP_TYPE_DEFAULT,
+                D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
+            m_memory.Track(result.Get(), L"Top Level Buffer Result", MemoryCategory::AccelerationStructure, ResidencyPriority::Pinned);
+        }
 
+        // One instance desc slot per frame context so updates never overwrite descs in flight
+        m_topLevelInstanceDescSize = instanceDescSize;
         m_topLevelASBuffers.pInstanceDesc = CreateBuffer(
-            static_cast<int>(instanceDescSize),
+            instanceDescSize * MaxFramesInFlight,
             D3D12_RESOURCE_STATE_GENERIC_READ,
             D3D12_HEAP_TYPE_UPLOAD,
             D3D12_RESOURCE_FLAG_NONE);
-        m_topLevelASBuffers.pInstanceDesc->SetName(L"Top Level Buffer Instance");
+        m_memory.Track(m_topLevelASBuffers.pInstanceDesc.Get(), L"Top Level Buffer Instance", MemoryCategory::Instance);
     }
 
-    D3D12_RAYTRACING_INSTANCE_DESC* instanceDescs;
-    m_topLevelASBuffers.pInstanceDesc->Map(0, nullptr, reinterpret_cast<void**>(&instanceDescs));
-    if (!instanceDescs) { throw std::logic_error("Cannot map the instance descriptor buffer - is it in the upload heap?"); }
-    if (!updateOnly) { ZeroMemory(instanceDescs, instanceDescSize); }
-
-    for (uint32_t i = 0; i < instances.size(); i++) {
-        instanceDescs[i].InstanceID = static_cast<UINT>(i);
-        instanceDescs[i].InstanceContributionToHitGroupIndex = static_cast<UINT>(2 * i);
-        instanceDescs[i].Flags = D3D12_RAYTRACING_INSTANCE_FLAG_NONE;
-        DirectX::XMMATRIX m = XMMatrixTranspose(instances[i].second);
-        memcpy(instanceDescs[i].Transform, &m, sizeof(instanceDescs[i].Transform));
-        instanceDescs[i].AccelerationStructure = instances[i].first->GetGPUVirtualAddress();
-        instanceDescs[i].InstanceMask = 0xFF;
-    }
+    UINT64 instanceDescOffset = m_frameContext * m_topLevelInstanceDescSize;
+    UINT8* instanceData = nullptr;
+    D3D12_RANGE readRange = { 0, 0 };
+    m_topLevelASBuffers.pInstanceDesc->Map(0, &readRange, reinterpret_cast<void**>(&instanceData));
+    if (!instanceData) { throw std::logic_error("Cannot map the instance descriptor buffer - is it in the upload heap?"); }
+    D3D12_RAYTRACING_INSTANCE_DESC* instanceDescs = reinterpret_cast<D3D12_RAYTRACING_INSTANCE_DESC*>(instanceData + instanceDescOffset);
+    if (created) { ZeroMemory(instanceData, m_topLevelInstanceDescSize * MaxFramesInFlight); }
+
+    // Only the descs changed since this frame context last built are written
+    m_instances.WriteSlot(m_frameContext, instanceDescs, m_blas);
 
     m_topLevelASBuffers.pInstanceDesc->Unmap(0, nullptr);
 
-    D3D12_GPU_VIRTUAL_ADDRESS pSourceAS = updateOnly ? m_topLevelASBuffers.pResult->GetGPUVirtualAddress() : 0;
+    // Updates are out of place, from the newest TLAS into the one of this context
+    bool rebuild = created || m_instances.NeedsRebuild();
+    D3D12_GPU_VIRTUAL_ADDRESS pSourceAS = rebuild ? 0 : m_topLevelASBuffers.pResult[m_latestTopLevel]->GetGPUVirtualAddress();
 
     D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAGS flags = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_ALLOW_UPDATE;
-    if (updateOnly) {
+    if (!rebuild) {
         flags = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_PERFORM_UPDATE;
     }
 
     D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_DESC buildDesc = {};
     buildDesc.Inputs.Type = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL;
     buildDesc.Inputs.DescsLayout = D3D12_ELEMENTS_LAYOUT_ARRAY;
-    buildDesc.Inputs.InstanceDescs = m_topLevelASBuffers.pInstanceDesc->GetGPUVirtualAddress();
-    buildDesc.Inputs.NumDescs = static_cast<UINT>(instances.size());
-    buildDesc.DestAccelerationStructureData = { m_topLevelASBuffers.pResult->GetGPUVirtualAddress() };
-    buildDesc.ScratchAccelerationStructureData = { m_topLevelASBuffers.pScratch->GetGPUVirtualAddress() };
+    buildDesc.Inputs.InstanceDescs = m_topLevelASBuffers.pInstanceDesc->GetGPUVirtualAddress() + instanceDescOffset;
+    m_memory.Use(m_topLevelASBuffers.pInstanceDesc.Get());
+    buildDesc.Inputs.NumDescs = m_instances.GetVisibleCount();
+    buildDesc.DestAccelerationStructureData = { m_topLevelASBuffers.pResult[m_frameContext]->GetGPUVirtualAddress() };
+    buildDesc.ScratchAccelerationStructureData = { m_asyncBuilds.GetScratch()->Acquire(commandList, m_topLevelScratchSize) };
     buildDesc.SourceAccelerationStructureData = pSourceAS;
     buildDesc.Inputs.Flags = flags;
 
-    m_commandList->BuildRaytracingAccelerationStructure(&buildDesc, 0, nullptr);
+    commandList->BuildRaytracingAccelerationStructure(&buildDesc, 0, nullptr);
 
     D3D12_RESOURCE_BARRIER uavBarrier;
     uavBarrier.Type = D3D12_RESOURCE_BARRIER_TYPE_UAV;
-    uavBarrier.UAV.pResource = m_topLevelASBuffers.pResult.Get();
+    uavBarrier.UAV.pResource = m_topLevelASBuffers.pResult[m_frameContext].Get();
     uavBarrier.Flags = D3D12_RESOURCE_BARRIER_FLAG_NONE;
-    m_commandList->ResourceBarrier(1, &uavBarrier);
+    commandList->ResourceBarrier(1, &uavBarrier);
+    m_instances.OnBuilt(m_frameContext, rebuild);
+    m_latestTopLevel = m_frameContext;
 }
 
 void Raytracing::CreateAccelerationStructures() {
-    AccelerationStructureBuffers bottomLevelBuffers = CreateBottomLevelAS(
-        m_vertexBuffer, m_verticesCount, m_indexBuffer, m_indicesCount);
-
-    AccelerationStructureBuffers planeBottomLevelBuffers =
-        CreateBottomLevelAS(m_planeBuffer, m_planeVertCount);
+    m_scratch.Init(m_device.Get(), &m_memory);
+    m_scratch.ResetStats();
+    if (m_compactBottomLevels) m_blasCompactor.Init(m_device.Get(), &m_memory, m_timeline.get());
+    m_blas.Init(m_device.Get(), &m_memory, m_timeline.get(), m_fenceBackend.get(),
+        m_computeCommandQueue.Get(), m_computeQueue, m_compactBottomLevels ? &m_blasCompactor : nullptr);
+    m_asyncBuilds.Init(m_device.Get(), &m_memory, m_timeline.get(), m_fenceBackend.get(),
+        m_computeCommandQueue.Get(), m_computeQueue, MaxFramesInFlight);
+
+    m_instances.Init(MaxFramesInFlight, &m_workers);
+    m_registry.Init(&m_blas, &m_instances);
+    m_registry.Register(m_cubeMesh, GetGeometryDesc(m_cubeMesh), GeometryHint::Static);
+    m_registry.Register(m_planeMesh, GetGeometryDesc(m_planeMesh), GeometryHint::Static);
+    if (m_dynamicGeometry) m_registry.Register(m_flagMesh, GetGeometryDesc(m_flagMesh), GeometryHint::Dynamic);
+
+    // The culler tests the instances against the bounding sphere of their mesh
+    m_culler.Init(&m_workers);
+    BoundingSphere bounds;
+    BoundingSphere::CreateFromPoints(bounds, m_verticesCount, &m_vertices[0].pos, sizeof(Vertex));
+    m_culler.SetBounds(m_registry.GetGeometry(m_cubeMesh), bounds);
+    BoundingSphere::CreateFromPoints(bounds, m_planeVertCount, &m_planeVertices[0].pos, sizeof(Vertex));
+    m_culler.SetBounds(m_registry.GetGeometry(m_planeMesh), bounds);
+    if (m_dynamicGeometry) {
+        BoundingSphere::CreateFromPoints(bounds, m_flagVertices.size(), &m_flagVertices[0].pos, sizeof(Vertex));
+        m_culler.SetBounds(m_registry.GetGeometry(m_flagMesh), bounds);
+    }
 
-    m_instances = { 
-        { bottomLevelBuffers.pResult, XMMatrixIdentity() },
-        { planeBottomLevelBuffers.pResult, XMMatrixIdentity() },
-    };
-    CreateTopLevelAS(m_instances);
+    // Every initial build goes to the compute queue, Init carries on with the pipelines
+    // while they run
+    ID3D12GraphicsCommandList4* buildList = m_asyncBuilds.Begin(m_frameContext);
+    m_blas.Record(buildList, m_asyncBuilds.GetScratch(), m_computeQueue);
+
+    // The raster path draws the first instance of each mesh
+    m_registry.AddInstance(m_cubeMesh, XMMatrixIdentity());
+    m_registry.AddInstance(m_planeMesh, XMMatrixIdentity());
+    if (m_dynamicGeometry) {
+        m_registry.AddInstance(m_flagMesh, XMMatrixIdentity());
+        m_refits.Init(&m_blas, &m_workers);
+        m_refits.Add(m_registry.GetGeometry(m_flagMesh), GetGeometryDesc(m_flagMesh), m_flagVertices.data(), sizeof(Vertex),
+            m_flagVertices.size(), m_flagIndices.data(), m_flagIndices.size());
+    }
+    for (UINT i = 0; i < m_sceneInstances; i++) {
+        UINT mesh;
+        XMMATRIX transform = GetSceneInstance(i, m_sceneInstances, &mesh);
+        m_registry.AddInstance(mesh, transform);
+    }
+    CreateTopLevelAS(buildList);
 
-    // Store the AS buffers. The rest of the buffers will be released once we exit the function
-    m_bottomLevelAS = bottomLevelBuffers.pResult;
-}
+    // The geometry uploads recorded so far run first
+    ExecuteRenderCommand();
+    m_commandList->Reset(m_frames[m_frameContext].commandAllocator.Get(), nullptr);
+    // The compacted sizes are copied on the compute queue as well, and read once it passed them
+    TimelinePoint built = m_asyncBuilds.Submit(m_timeline->GetLastSignaled(m_directQueue), m_commandQueue.Get());
+    m_blasCompactor.Submit(built);
 
-ComPtr<ID3D12RootSignature> Raytracing::CreateRayGenSignature() {
-
-    D3D12_DESCRIPTOR_RANGE rangeUav = {};
-    rangeUav.BaseShaderRegister = 0;
-    rangeUav.NumDescriptors = 1;
-    rangeUav.RegisterSpace = 0;
-    rangeUav.RangeType = D3D12_DESCRIPTOR_RANGE_TYPE_UAV;
-    rangeUav.OffsetInDescriptorsFromTableStart = 0;
-
-    D3D12_DESCRIPTOR_RANGE rangeSrv = {};
-    rangeSrv.BaseShaderRegister = 0;
-    rangeSrv.NumDescriptors = 1;
-    rangeSrv.RegisterSpace = 0;
-    rangeSrv.RangeType = D3D12_DESCRIPTOR_RANGE_TYPE_SRV;
-    rangeSrv.OffsetInDescriptorsFromTableStart = 1;
-
-    D3D12_DESCRIPTOR_RANGE rangeCbv = {};
-    rangeCbv.BaseShaderRegister = 0;
-    rangeCbv.NumDescriptors = 1;
-    rangeCbv.RegisterSpace = 0;
-    rangeCbv.RangeType = D3D12_DESCRIPTOR_RANGE_TYPE_CBV;
-    rangeCbv.OffsetInDescriptorsFromTableStart = 2;
-
-    std::vector<D3D12_DESCRIPTOR_RANGE> rangeStorage = { rangeUav, rangeSrv, rangeCbv };
-
-    D3D12_ROOT_PARAMETER param = {};
-    param.ParameterType = D3D12_ROOT_PARAMETER_TYPE_DESCRIPTOR_TABLE;
-    param.DescriptorTable.NumDescriptorRanges = 3;
-    param.DescriptorTable.pDescriptorRanges = rangeStorage.data();
-
-    D3D12_ROOT_SIGNATURE_DESC rootDesc = {};
-    rootDesc.NumParameters = 1;
-    rootDesc.pParameters = &param;
-    rootDesc.Flags = D3D12_ROOT_SIGNATURE_FLAG_LOCAL_ROOT_SIGNATURE;
-
-    ID3DBlob* pSigBlob;
-    ID3DBlob* pErrorBlob;
-    D3D12SerializeRootSignature(&rootDesc, D3D_ROOT_SIGNATURE_VERSION_1_0, &pSigBlob, &pErrorBlob);
-
-    ID3D12RootSignature* pRootSig;
-    m_device->CreateRootSignature(0, pSigBlob->GetBufferPointer(), pSigBlob->GetBufferSize(), IID_PPV_ARGS(&pRootSig));
-    return pRootSig;
+    std::wstringstream ss;
+    ss << L"Scene: " << m_registry.GetInstanceCount() << L" instances of " << m_registry.GetGeometryCount() << L" BLAS, "
+       << m_memory.GetCategoryTotal(MemoryCategory::AccelerationStructure) / 1024 << L" KB of acceleration structures, "
+       << m_memory.GetCategoryTotal(MemoryCategory::Instance) / 1024 << L" KB of instance descs\n";
+    ss << L"AS scratch: " << m_asyncBuilds.GetScratch()->GetSize() / 1024 << L" KB arena for "
+       << m_asyncBuilds.GetScratch()->GetRequestedTotal() / 1024 << L" KB of builds\n";
+    ss << L"BLAS: " << m_blas.GetBuildCount() << L" builds in " << m_blas.GetBatchCount() << L" batches on the compute queue\n";
+    OutputDebugString(ss.str().c_str());
 }
 
-ComPtr<ID3D12RootSignature> Raytracing::CreateMissSignature() {
-    D3D12_ROOT_SIGNATURE_DESC rootDesc = {};
-    rootDesc.NumParameters = 0;
-    rootDesc.pParameters = {};
-    rootDesc.Flags = D3D12_ROOT_SIGNATURE_FLAG_LOCAL_ROOT_SIGNATURE;
-
-    ID3DBlob* pSigBlob;
-    ID3DBlob* pErrorBlob;
-    D3D12SerializeRootSignature(&rootDesc, D3D_ROOT_SIGNATURE_VERSION_1_0, &pSigBlob, &pErrorBlob);
-
-    ID3D12RootSignature* pRootSig;
-    m_device->CreateRootSignature(0, pSigBlob->GetBufferPointer(), pSigBlob->GetBufferSize(), IID_PPV_ARGS(&pRootSig));
-    return pRootSig;
+XMMATRIX Raytracing::GetSceneInstance(UINT index, UINT count, UINT* mesh) const {
+    // A square grid behind the original scene, with a plane tile in every fourth cell
+    UINT side = static_cast<UINT>(std::ceil(std::sqrt(static_cast<double>(count))));
+    float x = (static_cast<float>(index % side) - 0.5f * static_cast<float>(side)) * 2.5f;
+    float z = -6.0f - static_cast<float>(index / side) * 2.5f;
+    if (index % 4 == 3) {
+        *mesh = m_planeMesh;
+        return XMMatrixTranslation(x, -1.0f, z);
+    }
+    *mesh = m_cubeMesh;
+    return XMMatrixScaling(0.5f, 0.5f, 0.5f) * XMMatrixTranslation(x, -0.5f, z);
 }
 
-ComPtr<ID3D12RootSignature> Raytracing::CreateHitSignature() {
-    std::vector<D3D12_ROOT_PARAMETER> params = { {}, {}, {}, {} };
-    params[0].ParameterType = D3D12_ROOT_PARAMETER_TYPE_SRV;
-    params[0].Descriptor.RegisterSpace = 0;
-    params[0].Descriptor.ShaderRegister = 0;
-    params[0].ShaderVisibility = D3D12_SHADER_VISIBILITY_ALL;
-         
-    params[1].ParameterType = D3D12_ROOT_PARAMETER_TYPE_SRV;
-    params[1].Descriptor.RegisterSpace = 0;
-    params[1].Descriptor.ShaderRegister = 1;
-    params[1].ShaderVisibility = D3D12_SHADER_VISIBILITY_ALL;
-
-    params[2].ParameterType = D3D12_ROOT_PARAMETER_TYPE_CBV;
-    params[2].Descriptor.RegisterSpace = 0;
-    params[2].Descriptor.ShaderRegister = 0;
-    params[2].ShaderVisibility = D3D12_SHADER_VISIBILITY_ALL;
-
-    D3D12_DESCRIPTOR_RANGE range = {};
-    range.BaseShaderRegister = 2;
-    range.NumDescriptors = 1;
-    range.RegisterSpace = 0;
-    range.RangeType = D3D12_DESCRIPTOR_RANGE_TYPE_SRV;
-    range.OffsetInDescriptorsFromTableStart = 1;
+void Raytracing::BenchmarkScene() {
+    D3D12_QUERY_HEAP_DESC queryHeapDesc = {};
+    queryHeapDesc.Type = D3D12_QUERY_HEAP_TYPE_TIMESTAMP;
+    queryHeapDesc.Count = 2;
+    ComPtr<ID3D12QueryHeap> queryHeap;
+    if (FAILED(m_device->CreateQueryHeap(&queryHeapDesc, IID_PPV_ARGS(&queryHeap)))) {
+        throw std::runtime_error("Cannot create the benchmark query heap");
+    }
+    ComPtr<ID3D12Resource> readback = CreateBuffer(2 * sizeof(UINT64), D3D12_RESOURCE_STATE_COPY_DEST, D3D12_HEAP_TYPE_READBACK);
+    UINT64 frequency = 1;
+    m_commandQueue->GetTimestampFrequency(&frequency);
 
-    params[3].ParameterType = D3D12_ROOT_PARAMETER_TYPE_DESCRIPTOR_TABLE;
-    params[3].DescriptorTable.NumDescriptorRanges = 1;
-    params[3].DescriptorTable.pDescriptorRanges = &range;
+    // Runs before compaction, every BLAS still sits in its own build buffer
+    UINT64 bottomLevelSize = 0;
+    for (UINT i = 0; i < m_blas.GetCount(); i++) bottomLevelSize += m_blas.Get(i).resource->GetDesc().Width;
 
-    D3D12_ROOT_SIGNATURE_DESC rootDesc = {};
-    rootDesc.NumParameters = UINT(params.size());
-    rootDesc.pParameters = params.data();
-    rootDesc.Flags = D3D12_ROOT_SIGNATURE_FLAG_LOCAL_ROOT_SIGNATURE;
+    std::wstringstream ss;
+    ss << L"Scene benchmark: " << m_registry.GetGeometryCount() << L" BLAS (" << bottomLevelSize / 1024
+       << L" KB) shared by every instance\n";
+    for (UINT count = 1000; count <= 1000000; count *= 10) {
+        // Same instances as -instances, in a TLAS of their own
+        TopLevelInstances instances;
+        instances.Init(1, &m_workers);
+        for (UINT i = 0; i < count; i++) {
+            UINT mesh;
+            XMMATRIX transform = GetSceneInstance(i, count, &mesh);
+            instances.Add(m_registry.GetGeometry(mesh), transform);
+        }
 
-    ID3DBlob* pSigBlob;
-    ID3DBlob* pErrorBlob;
-    D3D12SerializeRootSignature(&rootDesc, D3D_ROOT_SIGNATURE_VERSION_1_0, &pSigBlob, &pErrorBlob);
+        D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_DESC buildDesc = {};
+        buildDesc.Inputs.Type = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL;
+        buildDesc.Inputs.DescsLayout = D3D12_ELEMENTS_LAYOUT_ARRAY;
+        buildDesc.Inputs.NumDescs = count;
+        buildDesc.Inputs.Flags = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_ALLOW_UPDATE;
+        D3D12_RAYTRACING_ACCELERATION_STRUCTURE_PREBUILD_INFO info = {};
+        m_device->GetRaytracingAccelerationStructurePrebuildInfo(&buildDesc.Inputs, &info);
+
+        UINT64 resultSize = ROUND_UP(info.ResultDataMaxSizeInBytes, D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BYTE_ALIGNMENT);
+        UINT64 scratchSize = ROUND_UP(info.ScratchDataSizeInBytes, D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BYTE_ALIGNMENT);
+        UINT64 descSize = sizeof(D3D12_RAYTRACING_INSTANCE_DESC) * UINT64(count);
+        ComPtr<ID3D12Resource> result = CreateBuffer(resultSize, D3D12_RESOURCE_STATE_RAYTRACING_ACCELERATION_STRUCTURE,
+            D3D12_HEAP_TYPE_DEFAULT, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
+        ComPtr<ID3D12Resource> scratch = CreateBuffer(scratchSize, D3D12_RESOURCE_STATE_UNORDERED_ACCESS,
+            D3D12_HEAP_TYPE_DEFAULT, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
+        ComPtr<ID3D12Resource> descs = CreateBuffer(descSize, D3D12_RESOURCE_STATE_GENERIC_READ, D3D12_HEAP_TYPE_UPLOAD);
+
+        D3D12_RAYTRACING_INSTANCE_DESC* descData = nullptr;
+        D3D12_RANGE readRange = { 0, 0 };
+        descs->Map(0, &readRange, reinterpret_cast<void**>(&descData));
+        auto start = std::chrono::high_resolution_clock::now();
+        instances.WriteSlot(0, descData, m_blas);
+        double writeMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+        descs->Unmap(0, nullptr);
+
+        buildDesc.Inputs.InstanceDescs = descs->GetGPUVirtualAddress();
+        buildDesc.DestAccelerationStructureData = result->GetGPUVirtualAddress();
+        buildDesc.ScratchAccelerationStructureData = scratch->GetGPUVirtualAddress();
+
+        // The GPU is idle between the runs, the allocator of the current context is free
+        m_frames[m_frameContext].commandAllocator->Reset();
+        m_commandList->Reset(m_frames[m_frameContext].commandAllocator.Get(), nullptr);
+        m_commandList->EndQuery(queryHeap.Get(), D3D12_QUERY_TYPE_TIMESTAMP, 0);
+        m_commandList->BuildRaytracingAccelerationStructure(&buildDesc, 0, nullptr);
+        m_commandList->EndQuery(queryHeap.Get(), D3D12_QUERY_TYPE_TIMESTAMP, 1);
+        m_commandList->ResolveQueryData(queryHeap.Get(), D3D12_QUERY_TYPE_TIMESTAMP, 0, 2, readback.Get(), 0);
+        ExecuteRenderCommand();
+        WaitForPreviousFrame();
+
+        UINT64* ticks = nullptr;
+        D3D12_RANGE ticksRange = { 0, 2 * sizeof(UINT64) };
+        D3D12_RANGE writtenRange = { 0, 0 };
+        readback->Map(0, &ticksRange, reinterpret_cast<void**>(&ticks));
+        double buildMs = double(ticks[1] - ticks[0]) * 1000.0 / double(frequency);
+        readback->Unmap(0, &writtenRange);
+
+        ss << L"  " << count << L" instances: TLAS " << resultSize / 1024 << L" KB, scratch " << scratchSize / 1024
+           << L" KB, descs " << descSize / 1024 << L" KB, " << (resultSize + descSize) / count << L" B per instance; descs written in "
+           << writeMs << L" ms, built in " << buildMs << L" ms\n";
+    }
+    m_sceneBenchmarkReport = ss.str();
+}
 
-    ID3D12RootSignature* pRootSig;
-    m_device->CreateRootSignature(0, pSigBlob->GetBufferPointer(), pSigBlob->GetBufferSize(), IID_PPV_ARGS(&pRootSig));
-    return pRootSig;
+ComPtr<ID3D12RootSignature> Raytracing::GetRootSignature(ID3DBlob* serialized) {
+    ComPtr<ID3D12RootSignature> rootSignature = m_pipelineCache.GetRootSignature(serialized->GetBufferPointer(), serialized->GetBufferSize());
+    if (!rootSignature) { throw std::runtime_error("Cannot create root signature"); }
+    return rootSignature;
 }
 
-IDxcBlob* Raytracing::CompileShaderLibrary(LPCWSTR fileName) {
-    static IDxcCompiler* pCompiler = nullptr;
-    static IDxcLibrary* pLibrary = nullptr;
-    static IDxcIncludeHandler* dxcIncludeHandler;
-
-    HRESULT hr;
-
-    // Initialize the DXC compiler and compiler helper
-    DxcCreateInstance(CLSID_DxcCompiler, __uuidof(IDxcCompiler), (void**)&pCompiler);
-    DxcCreateInstance(CLSID_DxcLibrary, __uuidof(IDxcLibrary), (void**)&pLibrary);
-    pLibrary->CreateIncludeHandler(&dxcIncludeHandler);
-
-    // Open and read the file
-    std::ifstream shaderFile(fileName);
-    if (shaderFile.good() == false) { throw std::logic_error("Cannot find shader file"); }
-    std::stringstream strStream;
-    strStream << shaderFile.rdbuf();
-    std::string sShader = strStream.str();
-
-    // Create blob from the string
-    IDxcBlobEncoding* pTextBlob;
-    pLibrary->CreateBlobWithEncodingFromPinned((LPBYTE)sShader.c_str(), (uint32_t)sShader.size(), 0, &pTextBlob);
-    if (!pTextBlob) { throw std::logic_error("Cannot create blob file"); }
-
-    // Compile
-    IDxcOperationResult* pResult;
-    pCompiler->Compile(
-        pTextBlob, fileName, 
-        L"", L"lib_6_3",
-        nullptr, 0,
-        nullptr, 0, 
-        dxcIncludeHandler, &pResult);
-
-    // Verify the result
-    HRESULT resultCode;
-    pResult->GetStatus(&resultCode);
-    if (FAILED(resultCode)) {
-        IDxcBlobEncoding* pError;
-        hr = pResult->GetErrorBuffer(&pError);
-        if (FAILED(hr)) { throw std::logic_error("Failed to get shader compiler error"); }
-
-        // Convert error blob to a string
-        std::vector<char> infoLog(pError->GetBufferSize() + 1);
-        memcpy(infoLog.data(), pError->GetBufferPointer(), pError->GetBufferSize());
-        infoLog[pError->GetBufferSize()] = 0;
-
-        std::string errorMsg = "Shader Compiler Error:\n";
-        errorMsg.append(infoLog.data());
-
-        MessageBoxA(nullptr, errorMsg.c_str(), "Error!", MB_OK);
-        throw std::logic_error("Failed compile shader");
+void Raytracing::CreateRaytracingPipeline() {
+    // Shared by every variant
+    m_rayGenLibrary = ShaderCompiler::Wait(m_shaders.rayGenLibrary);
+    m_missLibrary = ShaderCompiler::Wait(m_shaders.missLibrary);
+    m_shadowLibrary = ShaderCompiler::Wait(m_shaders.shadowLibrary);
+
+    // Shadow hit groups share the layout, and so the object, of the primary ones
+    m_rayGenSignature = GetRootSignature(RayGenLayout::Serialize());
+    m_missSignature   = GetRootSignature(MissLayout::Serialize());
+    m_hitSignature    = GetRootSignature(HitLayout::Serialize());
+    m_shadowSignature = GetRootSignature(HitLayout::Serialize());
+    m_globalSignature = GetRootSignature(GlobalLayout::Serialize());
+
+    m_rtVariants.resize(m_shaders.hitLibrary.GetCount());
+    for (UINT i = 0; i < m_rtVariants.size(); i++) {
+        WithShaderFeatures<RaytracingFeatures>(m_shaders.hitLibrary.GetFeatures(i), [&](auto features) {
+            CreateRaytracingVariant(features, &m_rtVariants[i]);
+        });
     }
+}
 
-    IDxcBlob* pBlob;
-    pResult->GetResult(&pBlob);
-    return pBlob;
+const Raytracing::RaytracingVariant& Raytracing::GetRaytracingVariant(UINT32 features) const {
+    return m_rtVariants[m_shaders.hitLibrary.GetIndex(features)];
 }
 
-void Raytracing::CreateRaytracingPipeline() {
+template <typename Features>
+void Raytracing::CreateRaytracingVariant(Features, RaytracingVariant* variant) {
     UINT64 subobjectCount =
         4 +     // DXIL libraries
         3 +     // Hit group declarations
@@ -1077,10 +1524,7 @@ void Raytracing::CreateRaytracingPipeline() {
     
     // Libraries --------------------
 
-    m_rayGenLibrary = CompileShaderLibrary(L"RayGen.hlsl");
-    m_missLibrary = CompileShaderLibrary(L"Miss.hlsl");
-    m_hitLibrary = CompileShaderLibrary(L"Hit.hlsl");
-    m_shadowLibrary = CompileShaderLibrary(L"ShadowRay.hlsl");
+    D3D12_SHADER_BYTECODE hitLibrary = ShaderCompiler::Wait(m_shaders.hitLibrary.Get(Features::Bits));
 
 
     D3D12_EXPORT_DESC rayGenExportDesc = {};
@@ -1089,8 +1533,7 @@ void Raytracing::CreateRaytracingPipeline() {
     rayGenExportDesc.Flags = D3D12_EXPORT_FLAG_NONE;
 
     D3D12_DXIL_LIBRARY_DESC rayGenLibDesc;
-    rayGenLibDesc.DXILLibrary.BytecodeLength = m_rayGenLibrary->GetBufferSize();
-    rayGenLibDesc.DXILLibrary.pShaderBytecode = m_rayGenLibrary->GetBufferPointer();
+    rayGenLibDesc.DXILLibrary = m_rayGenLibrary;
     rayGenLibDesc.NumExports = 1;
     rayGenLibDesc.pExports = &rayGenExportDesc;
 
@@ -1100,14 +1543,14 @@ void Raytracing::CreateRaytracingPipeline() {
     subobjects[currentIndex++] = rayGenLibSubobject;
 
     D3D12_EXPORT_DESC missExportDesc = { L"Miss" , nullptr, D3D12_EXPORT_FLAG_NONE };
-    D3D12_DXIL_LIBRARY_DESC missLibDesc = { {m_missLibrary->GetBufferPointer(), m_missLibrary->GetBufferSize()}, 1, &missExportDesc };
+    D3D12_DXIL_LIBRARY_DESC missLibDesc = { m_missLibrary, 1, &missExportDesc };
     subobjects[currentIndex++] = { D3D12_STATE_SUBOBJECT_TYPE_DXIL_LIBRARY, &missLibDesc };
 
     std::vector<D3D12_EXPORT_DESC> hitExportDesc = {
         { L"ClosestHit" , nullptr, D3D12_EXPORT_FLAG_NONE },
         { L"PlaneClosestHit" , nullptr, D3D12_EXPORT_FLAG_NONE } };
     D3D12_DXIL_LIBRARY_DESC hitLibDesc = {
-        {m_hitLibrary->GetBufferPointer(), m_hitLibrary->GetBufferSize()},
+        hitLibrary,
         2, hitExportDesc.data() };
     subobjects[currentIndex++] = { D3D12_STATE_SUBOBJECT_TYPE_DXIL_LIBRARY, &hitLibDesc };
 
@@ -1115,7 +1558,7 @@ void Raytracing::CreateRaytracingPipeline() {
         { L"ShadowClosestHit" , nullptr, D3D12_EXPORT_FLAG_NONE },
         { L"ShadowMiss" , nullptr, D3D12_EXPORT_FLAG_NONE } };
     D3D12_DXIL_LIBRARY_DESC shadowLibDesc = {
-        {m_shadowLibrary->GetBufferPointer(), m_shadowLibrary->GetBufferSize()},
+        m_shadowLibrary,
         2, shadowExportDesc.data() };
     subobjects[currentIndex++] = { D3D12_STATE_SUBOBJECT_TYPE_DXIL_LIBRARY, &shadowLibDesc };
 
@@ -1173,11 +1616,6 @@ void Raytracing::CreateRaytracingPipeline() {
 
     // Root Signature --------------------
 
-    m_rayGenSignature = CreateRayGenSignature();
-    m_missSignature   = CreateMissSignature();
-    m_hitSignature    = CreateHitSignature();
-    m_shadowSignature = CreateHitSignature();
-
     ID3D12RootSignature* rayGenSignature = m_rayGenSignature.Get();
     ID3D12RootSignature* missSignature   = m_missSignature.Get();
     ID3D12RootSignature* hitSignature    = m_hitSignature.Get();
@@ -1220,37 +1658,17 @@ void Raytracing::CreateRaytracingPipeline() {
 
     // Root signature --------------------
 
-    ID3DBlob* serializedRootSignature;
-    ID3DBlob* error;
-
-    ID3D12RootSignature* globalRootSignature;
-    D3D12_ROOT_SIGNATURE_DESC rootDesc = { 0, nullptr, D3D12_ROOT_SIGNATURE_FLAG_NONE };
-    D3D12SerializeRootSignature(&rootDesc, D3D_ROOT_SIGNATURE_VERSION_1, &serializedRootSignature, &error);
-
-    m_device->CreateRootSignature(0,
-        serializedRootSignature->GetBufferPointer(),
-        serializedRootSignature->GetBufferSize(),
-        IID_PPV_ARGS(&globalRootSignature));
-    serializedRootSignature->Release();
-
-    subobjects[currentIndex++] = { D3D12_STATE_SUBOBJECT_TYPE_GLOBAL_ROOT_SIGNATURE, &globalRootSignature };
-
-    ID3D12RootSignature* localRootSignature;
-    rootDesc.Flags = D3D12_ROOT_SIGNATURE_FLAG_LOCAL_ROOT_SIGNATURE;
-    D3D12SerializeRootSignature(&rootDesc, D3D_ROOT_SIGNATURE_VERSION_1, &serializedRootSignature, &error);
+    ID3D12RootSignature* globalSignature = m_globalSignature.Get();
+    subobjects[currentIndex++] = { D3D12_STATE_SUBOBJECT_TYPE_GLOBAL_ROOT_SIGNATURE, &globalSignature };
 
-    m_device->CreateRootSignature(0,
-        serializedRootSignature->GetBufferPointer(),
-        serializedRootSignature->GetBufferSize(),
-        IID_PPV_ARGS(&localRootSignature));
-    serializedRootSignature->Release();
-
-    subobjects[currentIndex++] = { D3D12_STATE_SUBOBJECT_TYPE_LOCAL_ROOT_SIGNATURE, &localRootSignature };
+    // Default for exports without an association, the empty miss layout
+    subobjects[currentIndex++] = { D3D12_STATE_SUBOBJECT_TYPE_LOCAL_ROOT_SIGNATURE, &missSignature };
 
     // Pipeline config --------------------
 
     D3D12_RAYTRACING_PIPELINE_CONFIG pipelineConfig = {};
-    pipelineConfig.MaxTraceRecursionDepth = 2;
+    // Closest hit shaders only trace the shadow ray in variants with shadows
+    pipelineConfig.MaxTraceRecursionDepth = Features::Shadows ? 2 : 1;
 
     D3D12_STATE_SUBOBJECT pipelineConfigObject = {};
     pipelineConfigObject.Type = D3D12_STATE_SUBOBJECT_TYPE_RAYTRACING_PIPELINE_CONFIG;
@@ -1265,9 +1683,9 @@ void Raytracing::CreateRaytracingPipeline() {
     pipelineDesc.NumSubobjects = currentIndex;
     pipelineDesc.pSubobjects = subobjects.data();
 
-    HRESULT hr = m_device->CreateStateObject(&pipelineDesc, IID_PPV_ARGS(&m_rtStateObject));
+    HRESULT hr = m_device->CreateStateObject(&pipelineDesc, IID_PPV_ARGS(&variant->stateObject));
     if (FAILED(hr)) { throw std::logic_error("Could not create the raytracing state object"); }
-    m_rtStateObject->QueryInterface(IID_PPV_ARGS(&m_rtStateObjectProps));
+    variant->stateObject->QueryInterface(IID_PPV_ARGS(&variant->properties));
 }
 
 void Raytracing::CreateRaytracingOutputBuffer() {
@@ -1276,8 +1694,11 @@ void Raytracing::CreateRaytracingOutputBuffer() {
     resourceDesc.Dimension = D3D12_RESOURCE_DIMENSION_TEXTURE2D;
     resourceDesc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
     resourceDesc.Flags = D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS;
-    resourceDesc.Width = m_width;
-    resourceDesc.Height = m_height;
+    // Large enough for the biggest dispatch the resolution controller can pick
+    m_outputWidth = (std::max)(m_width, static_cast<UINT>(m_width * m_resolution.GetMaxScale()));
+    m_outputHeight = (std::max)(m_height, static_cast<UINT>(m_height * m_resolution.GetMaxScale()));
+    resourceDesc.Width = m_outputWidth;
+    resourceDesc.Height = m_outputHeight;
     resourceDesc.Layout = D3D12_TEXTURE_LAYOUT_UNKNOWN;
     resourceDesc.MipLevels = 1;
     resourceDesc.SampleDesc.Count = 1;
@@ -1293,83 +1714,110 @@ void Raytracing::CreateRaytracingOutputBuffer() {
         &heapProperties,
         D3D12_HEAP_FLAG_NONE,
         &resourceDesc,
-        D3D12_RESOURCE_STATE_COPY_SOURCE,
+        D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE,
         nullptr,
         IID_PPV_ARGS(&m_outputResource));
-    m_outputResource->SetName(L"Raytracing output buffer");
+    m_memory.Track(m_outputResource.Get(), L"Raytracing output buffer", MemoryCategory::RenderTarget, ResidencyPriority::Pinned);
 }
 
 void Raytracing::CreateShaderResourceHeap() {
-    D3D12_DESCRIPTOR_HEAP_DESC heapDesc = {};
-    heapDesc.NumDescriptors = 3;
-    heapDesc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV;
-    heapDesc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_SHADER_VISIBLE;
-    m_device->CreateDescriptorHeap(&heapDesc, IID_PPV_ARGS(&m_srvUavHeap));
-
-    D3D12_CPU_DESCRIPTOR_HANDLE handle = m_srvUavHeap->GetCPUDescriptorHandleForHeapStart();
+    m_rayTracingViews = m_descriptors.AllocateStaging(2 + MaxFramesInFlight);
 
     D3D12_UNORDERED_ACCESS_VIEW_DESC uavDesc = {};
     uavDesc.ViewDimension = D3D12_UAV_DIMENSION_TEXTURE2D;
-    m_device->CreateUnorderedAccessView(m_outputResource.Get(), nullptr, &uavDesc, handle);
-
-    handle.ptr += m_device->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
-
-    D3D12_SHADER_RESOURCE_VIEW_DESC srvDesc;
-    srvDesc.Format = DXGI_FORMAT_UNKNOWN;
-    srvDesc.ViewDimension = D3D12_SRV_DIMENSION_RAYTRACING_ACCELERATION_STRUCTURE;
-    srvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
-    srvDesc.RaytracingAccelerationStructure.Location = m_topLevelASBuffers.pResult->GetGPUVirtualAddress();
-    m_device->CreateShaderResourceView(nullptr, &srvDesc, handle);
-
-    handle.ptr += m_device->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
+    m_device->CreateUnorderedAccessView(m_outputResource.Get(), nullptr, &uavDesc, m_rayTracingViews.Cpu(0));
+
+    D3D12_SHADER_RESOURCE_VIEW_DESC outputSrvDesc = {};
+    outputSrvDesc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+    outputSrvDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2D;
+    outputSrvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
+    outputSrvDesc.Texture2D.MipLevels = 1;
+    m_device->CreateShaderResourceView(m_outputResource.Get(), &outputSrvDesc, m_rayTracingViews.Cpu(1));
+
+    for (UINT i = 0; i < MaxFramesInFlight; i++) {
+        D3D12_SHADER_RESOURCE_VIEW_DESC srvDesc;
+        srvDesc.Format = DXGI_FORMAT_UNKNOWN;
+        srvDesc.ViewDimension = D3D12_SRV_DIMENSION_RAYTRACING_ACCELERATION_STRUCTURE;
+        srvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
+        srvDesc.RaytracingAccelerationStructure.Location = m_topLevelASBuffers.pResult[i]->GetGPUVirtualAddress();
+        m_device->CreateShaderResourceView(nullptr, &srvDesc, m_rayTracingViews.Cpu(2 + i));
+    }
 
-    D3D12_CONSTANT_BUFFER_VIEW_DESC cbvDesc = {};
-    cbvDesc.BufferLocation = m_constantBuffer->GetGPUVirtualAddress();
-    cbvDesc.SizeInBytes = sizeof(ConstantBuffer);
-    m_device->CreateConstantBufferView(&cbvDesc, handle);
+    // The ray generation table of each frame context differs by its TLAS and camera CBV.
+    // The SBT records point at these tables, so they stay in the persistent region.
+    for (UINT i = 0; i < MaxFramesInFlight; i++) {
+        m_rayGenTables[i] = m_descriptors.AllocatePersistent(3);
+        m_descriptors.StageCopy(m_rayGenTables[i], 0, m_rayTracingViews.Cpu(0));
+        m_descriptors.StageCopy(m_rayGenTables[i], 1, m_rayTracingViews.Cpu(2 + i));
+        m_descriptors.StageCopy(m_rayGenTables[i], 2, m_constantViews.Cpu(i));
+    }
+    m_outputSrv = m_descriptors.AllocatePersistent(1);
+    m_descriptors.StageCopy(m_outputSrv, 0, m_rayTracingViews.Cpu(1));
+    m_descriptors.FlushCopies();
 }
 
 void Raytracing::CreateShaderBindingTable() {
-    // A SBT entry is made of a program ID and a set of parameters, taking 8 bytes each. 
-    UINT m_progIdSize = D3D12_RAYTRACING_SHADER_RECORD_BYTE_ALIGNMENT;
-    m_rayGenEntrySize   = ROUND_UP(m_progIdSize + 8 * 1, D3D12_RAYTRACING_SHADER_RECORD_BYTE_ALIGNMENT);
-    m_missEntrySize     = ROUND_UP(m_progIdSize + 8 * 0, D3D12_RAYTRACING_SHADER_RECORD_BYTE_ALIGNMENT); // no param
-    m_hitGroupEntrySize = ROUND_UP(m_progIdSize + 8 * 2, D3D12_RAYTRACING_SHADER_RECORD_BYTE_ALIGNMENT);
+    // A SBT entry is made of a program ID and the root arguments of its local root signature
+    m_rayGenEntrySize   = RayGenLayout::ShaderRecordSize;
+    m_missEntrySize     = MissLayout::ShaderRecordSize;
+    m_hitGroupEntrySize = HitLayout::ShaderRecordSize;
 
-    m_rayGenSectionSize = m_rayGenEntrySize;
+    // Two records per geometry: primary hit group, then shadow hit group
+    m_rayGenSectionSize = m_rayGenEntrySize * MaxFramesInFlight;
     m_missSectionSize = m_missEntrySize * 2;
-    m_hitGroupSectionSize = m_hitGroupEntrySize * 3;
-    m_sbtSize = ROUND_UP(m_rayGenSectionSize + m_missSectionSize + m_hitGroupSectionSize, 256);
-
-    uint8_t* pData;
-    m_sbtStorage = CreateBuffer(m_sbtSize, D3D12_RESOURCE_STATE_GENERIC_READ, D3D12_HEAP_TYPE_UPLOAD);
-    m_sbtStorage->Map(0, nullptr, reinterpret_cast<void**>(&pData));
+    m_hitGroupSectionSize = m_hitGroupEntrySize * 2 * m_registry.GetGeometryCount();
+    m_hitGroupSectionStride = ROUND_UP(m_hitGroupSectionSize, D3D12_RAYTRACING_SHADER_TABLE_BYTE_ALIGNMENT);
+    m_sbtSize = ROUND_UP(m_rayGenSectionSize + m_missSectionSize + m_hitGroupSectionStride * MaxFramesInFlight, 256);
+
+    // Shader identifiers belong to a state object, each variant fills its own table
+    for (RaytracingVariant& variant : m_rtVariants) {
+        uint8_t* pData;
+        variant.sbtStorage = CreateBuffer(m_sbtSize, D3D12_RESOURCE_STATE_GENERIC_READ, D3D12_HEAP_TYPE_UPLOAD);
+        m_memory.Track(variant.sbtStorage.Get(), L"Shader Binding Table", MemoryCategory::ShaderTable);
+        variant.sbtStorage->Map(0, nullptr, reinterpret_cast<void**>(&pData));
+        WriteShaderBindingTable(variant.properties.Get(), pData);
+        variant.sbtStorage->Unmap(0, nullptr);
+    }
+}
 
-    auto heapPointer = reinterpret_cast<UINT64*>(m_srvUavHeap->GetGPUDescriptorHandleForHeapStart().ptr);
-    memcpy(pData, m_rtStateObjectProps->GetShaderIdentifier(L"RayGen"), m_progIdSize); // Copy the shader identifier
-    memcpy(pData + m_progIdSize, &heapPointer, 8 * 1); // Copy all its resources pointers or values in bulk
-    pData += m_rayGenEntrySize;
+void Raytracing::WriteShaderBindingTable(ID3D12StateObjectProperties* properties, uint8_t* pData) {
+    const UINT m_progIdSize = D3D12_SHADER_IDENTIFIER_SIZE_IN_BYTES;
+    for (UINT i = 0; i < MaxFramesInFlight; i++) {
+        // Each frame context reads its own descriptor table
+        UINT64 frameHeapPointer = m_rayGenTables[i].gpu.ptr;
+        memcpy(pData, properties->GetShaderIdentifier(L"RayGen"), m_progIdSize); // Copy the shader identifier
+        memcpy(pData + m_progIdSize + RayGenLayout::ArgumentOffset<RayGenTable>(), &frameHeapPointer, sizeof(frameHeapPointer));
+        pData += m_rayGenEntrySize;
+    }
 
-    memcpy(pData, m_rtStateObjectProps->GetShaderIdentifier(L"Miss"), m_progIdSize);
+    memcpy(pData, properties->GetShaderIdentifier(L"Miss"), m_progIdSize);
     pData += m_missEntrySize;
 
-    memcpy(pData, m_rtStateObjectProps->GetShaderIdentifier(L"ShadowMiss"), m_progIdSize);
+    memcpy(pData, properties->GetShaderIdentifier(L"ShadowMiss"), m_progIdSize);
     pData += m_missEntrySize;
 
-    std::vector<void*> vertexHeapPointer = {
-        (void*)(m_vertexBuffer->GetGPUVirtualAddress()),
-        (void*)(m_indexBuffer->GetGPUVirtualAddress())
+    // Every hit record of a section is the same apart from its program, the hit shaders find
+    // the geometry of an instance through its InstanceID, so records do not grow with instances
+    auto writeHitRecord = [&](LPCWSTR hitGroup, UINT64 tlas) {
+        UINT64 bindlessTable = m_descriptors.GetBindlessTable().ptr;
+        UINT32 geometryRecords = m_bindlessGeometry.index;
+
+        uint8_t* arguments = pData + m_progIdSize;
+        memcpy(pData, properties->GetShaderIdentifier(hitGroup), m_progIdSize);
+        memcpy(arguments + HitLayout::ArgumentOffset<HitBindless>(), &bindlessTable, sizeof(bindlessTable));
+        memcpy(arguments + HitLayout::ArgumentOffset<HitTlas>(), &tlas, sizeof(tlas));
+        memcpy(arguments + HitLayout::ArgumentOffset<HitGeometry>(), &geometryRecords, sizeof(geometryRecords));
+        pData += m_hitGroupEntrySize;
     };
-    memcpy(pData, m_rtStateObjectProps->GetShaderIdentifier(L"HitGroup"), m_progIdSize);
-    memcpy(pData + m_progIdSize, vertexHeapPointer.data(), 8 * vertexHeapPointer.size());
-    pData += m_hitGroupEntrySize;
-
-    memcpy(pData, m_rtStateObjectProps->GetShaderIdentifier(L"ShadowHitGroup"), m_progIdSize);
-    pData += m_hitGroupEntrySize;
-
-    memcpy(pData, m_rtStateObjectProps->GetShaderIdentifier(L"PlaneHitGroup"), m_progIdSize);
-    memcpy(pData + m_progIdSize, &heapPointer, 8 * 1);
 
-
-    m_sbtStorage->Unmap(0, nullptr);
+    // One section per frame context, shadow rays trace the TLAS of their frame
+    uint8_t* hitGroups = pData;
+    for (UINT context = 0; context < MaxFramesInFlight; context++) {
+        pData = hitGroups + context * m_hitGroupSectionStride;
+        UINT64 tlas = m_topLevelASBuffers.pResult[context]->GetGPUVirtualAddress();
+        for (UINT i = 0; i < m_registry.GetGeometryCount(); i++) {
+            writeHitRecord(m_registry.GetMesh(i) == m_planeMesh ? L"PlaneHitGroup" : L"HitGroup", tlas);
+            writeHitRecord(L"ShadowHitGroup", tlas);
+        }
+    }
 }
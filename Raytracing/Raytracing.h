@@ -14,33 +14,94 @@
 #include <sstream>   
 #include <vector>
 #include <unordered_set>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <memory>
+#include <thread>
+#include <atomic>
+#include <mutex>
 
 #include <wrl.h>
 #include <wrl/client.h>
 #include <shellapi.h>
 
 #include "Camera.h"
+#include "MemoryTracker.h"
+#include "MeshFile.h"
+#include "UploadRing.h"
+#include "ScratchArena.h"
+#include "BlasCompactor.h"
+#include "BlasManager.h"
+#include "TopLevelInstances.h"
+#include "GeometryRegistry.h"
+#include "BlasRefitScheduler.h"
+#include "AsyncBuildQueue.h"
+#include "InstanceCuller.h"
+#include "GeometryArena.h"
+#include "Timeline.h"
+#include "D3D12FenceBackend.h"
+#include "SnapshotQueue.h"
+#include "ResolutionController.h"
+#include "D3D12TimestampSource.h"
+#include "D3D12DescriptorHeap.h"
+#include "ShaderArchive.h"
+#include "ShaderCache.h"
+#include "ShaderCompiler.h"
+#include "ShaderPermutation.h"
+#include "PipelineCache.h"
+#include "RootSignatureLayout.h"
 
 #define ROUND_UP(v, powerOf2Alignment) (((v) + (powerOf2Alignment)-1) & ~((powerOf2Alignment)-1))
 
 using namespace DirectX;
 using Microsoft::WRL::ComPtr;
 
+// Launch options, main.cpp fills them from the command line
+struct RaytracingOptions {
+	UINT framesInFlight = 2;         // -frames N, how far the CPU may record ahead of the GPU
+	bool compactBottomLevels = true; // -nocompaction keeps the BLASes at their built size
+	UINT sceneInstances = 0;         // -instances N, cubes and planes added around the scene
+	bool benchmarkScene = false;     // -benchscene
+	bool dynamicGeometry = false;    // -dynamic
+	bool cullInstances = true;       // -nocull
+	MemoryBudgets memoryBudgets;     // -budget NAME MB, per memory category or Total
+};
+
 class Raytracing {
 
 public:
-	Raytracing() {}
-	Raytracing(HWND hwnd, UINT width, UINT height, std::wstring name);
+	Raytracing(HWND hwnd, UINT width, UINT height, std::wstring name, const RaytracingOptions& options = RaytracingOptions());
 	~Raytracing();
 
+	Raytracing(const Raytracing&) = delete;
+	Raytracing& operator=(const Raytracing&) = delete;
+
 	void Init();
 	void Destroy();
-	void MainLoop();
 
+	// Frames are recorded on a dedicated render thread between Start() and Stop()
+	void Start();
+	void Stop();
+
+	// Window thread only. Input edits the scene state and publishes a snapshot of it.
 	void KeyDown(UINT8 key);
 	void KeyUp(UINT8 key);
 	void MouseMove(UINT8 wParam, UINT32 lParam);
 	void MouseWheel(float wParam);
+	void UpdateTitle();
+
+	// Compiles every shader with full optimization into a shader archive, without
+	// creating a device. Run as a build step, Init then maps the archive if it sits
+	// next to the executable.
+	static bool BuildShaderArchive(LPCWSTR fileName);
+
+	// Timings of the -benchscene run made by Init, empty otherwise
+	const std::wstring& GetSceneBenchmarkReport() const { return m_sceneBenchmarkReport; }
+
+	static const UINT_PTR TitleTimer = 1;
+	static constexpr LPCWSTR ShaderArchiveName = L"Shaders.bin";
 
 private:
 
@@ -60,8 +121,15 @@ private:
 		XMMATRIX model;
 	};
 
+	// Where the hit shaders find the mesh of a TLAS instance, indexed by its InstanceID
+	struct GeometryRecord {
+		UINT vertexBuffer; // bindless SRV indices
+		UINT indexBuffer;
+		UINT baseVertex;
+		UINT firstIndex;
+	};
+
 	ConstantBuffer m_cbData = {};
-	XMFLOAT2 m_mouse = { 0.f, 0.f };
 
 	HWND m_hwnd = 0;
 	UINT m_width = 900;
@@ -69,11 +137,35 @@ private:
 	std::wstring m_title = L"";
 	float m_aspectRatio = 1.0f;
 
-	bool m_raster = false;
-
 	static const UINT FrameCount = 2;
+	static const UINT MaxFramesInFlight = 4;
+	static const UINT MaxSnapshotInstances = 16;
+
+	// Everything the render thread needs from the window thread to record a frame
+	struct FrameSnapshot {
+		XMMATRIX view;
+		XMMATRIX projection;
+		XMMATRIX instances[MaxSnapshotInstances];
+		UINT instanceCount;
+		UINT framesInFlight;
+		UINT memoryReports; // bumped for every report request
+		UINT32 shaderFeatures;
+		bool raster;
+		bool dynamicResolution;
+	};
 
+	// Window thread state
 	Camera m_camera;
+	XMFLOAT2 m_mouse = { 0.f, 0.f };
+	FrameSnapshot m_input = {};
+	bool m_inputPending = false;
+
+	// Render thread state, only the newest queued snapshot is applied each frame
+	SnapshotQueue<FrameSnapshot, 64> m_snapshots;
+	FrameSnapshot m_snapshot = {};
+	UINT m_memoryReports = 0;
+	std::thread m_renderThread;
+	std::atomic<bool> m_rendering{ false };
 
 	UINT m_frameIndex = 0;
 	D3D12_VIEWPORT m_viewport = {};
@@ -82,38 +174,100 @@ private:
 	ComPtr<ID3D12Device5> m_device;
 	ComPtr<IDXGISwapChain3> m_swapChain;
 
+	D3D12ResidencyDevice m_residencyDevice;
+	MemoryTracker m_memory;
+	MemoryBudgets m_memoryBudgets; // applied once the tracker has its device
+
 	ComPtr<ID3D12CommandQueue> m_commandQueue;
-	ComPtr<ID3D12CommandAllocator> m_commandAllocator;
 	ComPtr<ID3D12GraphicsCommandList4> m_commandList;
 
+	// Everything the CPU writes for a frame while older frames may still be on the GPU.
+	// The constant, instance and instance desc slots of a context are at index `m_frameContext`.
+	struct FrameContext {
+		ComPtr<ID3D12CommandAllocator> commandAllocator;
+		UINT64 fenceValue = 0;
+	};
+	FrameContext m_frames[MaxFramesInFlight];
+	UINT m_framesInFlight = 2;
+	UINT m_frameContext = 0;
+
+	// Render thread timings, averaged into the window title by the window thread
+	std::mutex m_statsMutex;
+	double m_cpuWaitMs = 0.0;
+	double m_renderMs = 0.0;
+	double m_gpuMs = 0.0;
+	double m_dispatchScale = 0.0;
+	UINT m_statsFrames = 0;
+
 	UINT m_rtvDescriptorSize = 0;
 	ComPtr<ID3D12DescriptorHeap> m_rtvHeap;
 	ComPtr<ID3D12Resource> m_renderTargets[FrameCount];
 
-	ComPtr<ID3D12Fence> m_fence;
-	UINT64 m_fenceValue = 0;
-	HANDLE m_fenceEvent = 0;
+	// Fence values of every queue go through the timeline
+	std::unique_ptr<D3D12FenceBackend> m_fenceBackend;
+	std::unique_ptr<Timeline> m_timeline;
+	uint32_t m_directQueue = 0;
+	ComPtr<ID3D12CommandQueue> m_computeCommandQueue;
+	uint32_t m_computeQueue = 0;
 
+	// Rasterization root signatures and pipelines, deduplicated by description and
+	// kept in a pipeline library across launches
+	PipelineCache m_pipelineCache;
 	ComPtr<ID3D12RootSignature> m_rootSignature;
 	ComPtr<ID3D12PipelineState> m_pipelineState;
 
-	ComPtr<ID3D12Resource> m_vertexBuffer;
-	ComPtr<ID3D12Resource> m_indexBuffer;
+	// All meshes live in the geometry arena, indexed through its mesh table
+	GeometryArena m_geometry;
+	UINT m_cubeMesh = 0;
+	UINT m_planeMesh = 0;
+	// Grid of FlagCells x FlagCells quads, deformed on the CPU every frame with -dynamic
+	static const UINT FlagCells = 32;
+	UINT m_flagMesh = 0;
+	std::vector<Vertex> m_flagVertices;
+	std::vector<UINT32> m_flagIndices;
+	UINT m_flagFrame = 0;
 	ComPtr<ID3D12Resource> m_depthStencilBuffer;
 	D3D12_VERTEX_BUFFER_VIEW m_vertexBufferView = {};
 	D3D12_INDEX_BUFFER_VIEW m_indexBufferView = {};
 	ComPtr<ID3D12DescriptorHeap> m_depthStencilHeap;
 
-	ComPtr<ID3D12Resource> m_constantBuffer; // CBV
-	ComPtr<ID3D12Resource> m_instanceBuffer; // SRV
-	ComPtr<ID3D12DescriptorHeap> m_cbvSrvHeap;
-
-
+	UploadRing m_uploadRing;
+
+	ComPtr<ID3D12Resource> m_constantBuffer; // CBV, one slot per frame context
+	ComPtr<ID3D12Resource> m_instanceBuffer; // SRV, one slot per frame context
+	UINT8* m_constantData = nullptr;
+	UINT8* m_instanceData = nullptr;
+	UINT m_constantSlotSize = 0;
+	UINT64 m_instanceSlotSize = 0;
+
+	// Every CBV/SRV/UAV lives in this heap. Views are created once in its staging heap;
+	// tables are copied into the persistent region, or into the transient ring per frame.
+	// Shaders index the persistent region directly: one table set at the heap start
+	// covers every buffer, draws and hit records only carry 32-bit indices.
+	D3D12DescriptorHeap m_descriptors;
+	DescriptorHandle m_constantViews; // staging, one CBV per frame context
+	DescriptorHandle m_instanceViews; // staging, one SRV per frame context
+	DescriptorHandle m_geometryViews; // staging: vertices, indices, geometry records
+	DescriptorHandle m_bindlessInstances[MaxFramesInFlight];
+	DescriptorHandle m_bindlessVertices;
+	DescriptorHandle m_bindlessIndices;
+	DescriptorHandle m_bindlessGeometry;
+
+	ComPtr<ID3D12Resource> m_geometryRecords; // one GeometryRecord per geometry of the registry
+
+
+	void PublishSnapshot();
+	void RenderLoop();
+	void ApplySnapshot();
 	void Update();
 	void Render();
 
+	// Between 2 and MaxFramesInFlight frames can be recorded ahead of the GPU
+	void SetFramesInFlight(UINT count);
+
 	void UpdateRenderPipeline();
 	void WaitForPreviousFrame();
+	void WaitForFrameContext();
 	void ExecuteRenderCommand();
 	
 	UINT GetDebugFlag();
@@ -127,15 +281,36 @@ private:
 	void CreateCommandList();
 
 	void CreateInputBuffer();
+	UploadSync GetUploadSync();
+	void DeformFlag(UINT frame);
 	void CreateDepthStencilBuffer();
 	void CreateConstantBuffer();
 	void CreateInstanceBuffer();
 	void CreateCbvSrvHeap();
+	void CreateGeometryRecords();
 	void InitViewport();
 
-	HRESULT CompileShader(LPCWSTR filename, LPCSTR target, D3D12_SHADER_BYTECODE* byteCode);
+	// Shaders come from the mapped archive when there is one. Otherwise they are
+	// compiled and kept in the on-disk cache, keyed by source and options. Every
+	// shader starts compiling at the beginning of Init, each pipeline only waits
+	// for the ones it uses.
+	MappedShaderArchive m_shaderArchive;
+	ShaderCache m_shaderCache;
+	std::unique_ptr<ShaderCompiler> m_shaderCompiler;
+	struct Shaders {
+		ShaderFuture vertex;
+		ShaderFuture pixel;
+		ShaderFuture upscaleVertex;
+		ShaderFuture upscalePixel;
+		ShaderFuture rayGenLibrary;
+		ShaderFuture missLibrary;
+		ShaderPermutations hitLibrary; // one variant per RaytracingFeatures combination
+		ShaderFuture shadowLibrary;
+	} m_shaders;
+	void StartShaderCompiles();
+	static Shaders SubmitShaders(ShaderCompiler* compiler);
 	
-	ID3D12Resource* CreateBuffer(int bufferSize, 
+	ComPtr<ID3D12Resource> CreateBuffer(UINT64 bufferSize, 
 		D3D12_RESOURCE_STATES resourceStates,
 		D3D12_HEAP_TYPE heapType = D3D12_HEAP_TYPE_DEFAULT,
 		D3D12_RESOURCE_FLAGS flags = D3D12_RESOURCE_FLAG_NONE);
@@ -172,61 +347,157 @@ private:
 		{{-0.5f, -0.0f, -0.5f}, {1.0f, 1.0f, 1.0f, 1.0f}}, // 1
 	};
 
-	enum GraphicsRootParameters : UINT32 {
-		IdxCBV = 0,
-		IdxSRV,
-		IdxInstance,
-		ParametersCount
-	};
+	// Camera, the bindless heap for the vertex shader, then the bindless index of the
+	// instance buffer and the instance drawn
+	using RasterCamera = RootLayout::RootCbv<0, 0, D3D12_ROOT_DESCRIPTOR_FLAG_DATA_STATIC_WHILE_SET_AT_EXECUTE>;
+	using RasterBindless = RootLayout::Table<D3D12_SHADER_VISIBILITY_ALL, RootLayout::Bindless<D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 1>>;
+	using RasterInstance = RootLayout::RootConstants<2, 1>;
+	using RasterLayout = RootSignatureLayout<D3D12_ROOT_SIGNATURE_FLAG_ALLOW_INPUT_ASSEMBLER_INPUT_LAYOUT,
+		RasterCamera, RasterBindless, RasterInstance>;
+
+	static constexpr UINT IdxCBV = RasterLayout::Index<RasterCamera>();
+	static constexpr UINT IdxBindless = RasterLayout::Index<RasterBindless>();
+	static constexpr UINT IdxInstance = RasterLayout::Index<RasterInstance>();
 
 	// #DXR
 	struct AccelerationStructureBuffers	{
-		ComPtr<ID3D12Resource> pScratch;      // Scratch memory for AS builder
-		ComPtr<ID3D12Resource> pResult;       // Where the AS is
+		ComPtr<ID3D12Resource> pResult[MaxFramesInFlight]; // Where the AS is, one per frame context
 		ComPtr<ID3D12Resource> pInstanceDesc; // Hold the matrices of the instances
 	};
 
-
-	ComPtr<ID3D12Resource> m_bottomLevelAS; // Storage for the bottom Level AS
+	// Bottom levels are queued with a static or dynamic hint and built in batches
+	BlasManager m_blas;
 
 	AccelerationStructureBuffers m_topLevelASBuffers;
-	std::vector<std::pair<ComPtr<ID3D12Resource>, XMMATRIX>> m_instances;
-
-
-	AccelerationStructureBuffers CreateBottomLevelAS(
-		ComPtr<ID3D12Resource> vertexBuffer, uint32_t vertexCount,
-		ComPtr<ID3D12Resource> indexBuffer = nullptr, uint32_t indexCount = 0);
-	void CreateTopLevelAS(
-		const std::vector<std::pair<ComPtr<ID3D12Resource>, DirectX::XMMATRIX>>& instances,
-		bool updateOnly = false);
+	UINT64 m_topLevelInstanceDescSize = 0; // per frame context slot
+	UINT64 m_topLevelScratchSize = 0;
+	UINT m_latestTopLevel = 0;             // frame context of the newest TLAS, the source of updates
+	TopLevelInstances m_instances;
+	// One BLAS per mesh, every instance of the scene is placed through it
+	GeometryRegistry m_registry;
+	// Cubes and planes added around the scene with -instances N
+	UINT m_sceneInstances = 0;
+	// -benchscene times TLAS builds of growing synthetic scenes at startup
+	bool m_benchmarkScene = false;
+	// -dynamic adds a waving flag, its BLAS is refit every frame and rebuilt once degraded
+	bool m_dynamicGeometry = false;
+	BlasRefitScheduler m_refits;
+	// The TLAS holds the instances that reach the frame, unless started with -nocull
+	bool m_cullInstances = true;
+	InstanceCuller m_culler;
+	const XMFLOAT3 m_lightPosition = { 2.0f, 3.0f, 4.0f }; // lightPos of Hit.hlsl
+	// Splits the instance desc writes of large TLAS
+	WorkerPool m_workers;
+
+	// Scratch memory shared by the AS builds of the direct queue
+	ScratchArena m_scratch;
+
+	// The TLAS of a frame and the initial BLAS builds run on the compute queue, under
+	// the rendering of the frame before. Refits and compaction copies stay on the direct
+	// queue, they rewrite BLASes an older frame may still trace; when a frame has some,
+	// its direct list is submitted before the builds so the compute queue can wait for it.
+	AsyncBuildQueue m_asyncBuilds;
+	bool m_bottomLevelsRecorded = false; // on the direct list of this frame
+
+	// Bottom levels are built with ALLOW_COMPACTION and copied to their compacted size
+	// a few frames later, unless started with -nocompaction
+	bool m_compactBottomLevels = true;
+	BlasCompactor m_blasCompactor;
+
+
+	D3D12_RAYTRACING_GEOMETRY_DESC GetGeometryDesc(UINT mesh);
+	// The raster pass draws the first instance of each mesh, the rest are only traced
+	UINT GetRasterInstanceCount() const { return m_dynamicGeometry ? 3 : 2; }
+	// Records the queued BLAS builds, or hands large batches to the compute queue
+	void BuildBottomLevelAS();
+	void CompactBottomLevelAS();
+	// Moves the dynamic meshes and queues their refits or rebuilds
+	void UpdateDynamicGeometry();
+	// Limits the TLAS to the instances in view or between the view and the light
+	void CullInstances();
+	// Hands the TLAS of this frame context to the compute queue, unless it is current
+	void UpdateTopLevelAS();
+	// A full build, or an update from the newest TLAS until the instances drifted too far
+	void CreateTopLevelAS(ID3D12GraphicsCommandList4* commandList);
 	void CreateAccelerationStructures();
+	// Synthetic instance `index` of a large scene: a mesh and where it goes
+	XMMATRIX GetSceneInstance(UINT index, UINT count, UINT* mesh) const;
+	void BenchmarkScene();
+	std::wstring m_sceneBenchmarkReport;
+
+
+	// Local root signatures. The ray generation table holds the output UAV, the TLAS SRV
+	// and the camera CBV of a frame. Hit groups see the bindless heap through one space
+	// per element type (vertices, indices, geometry records), the TLAS for shadow rays and
+	// the bindless index of the geometry records. Miss shaders take no arguments.
+	using RayGenTable = RootLayout::Table<D3D12_SHADER_VISIBILITY_ALL,
+		RootLayout::Uav<0, 0, 1, RootLayout::VolatileDescriptors>,
+		RootLayout::Srv<0, 0, 1, RootLayout::VolatileDescriptors>,
+		RootLayout::Cbv<0, 0, 1, RootLayout::VolatileDescriptors>>;
+	using RayGenLayout = RootSignatureLayout<D3D12_ROOT_SIGNATURE_FLAG_LOCAL_ROOT_SIGNATURE, RayGenTable>;
+
+	using HitBindless = RootLayout::Table<D3D12_SHADER_VISIBILITY_ALL,
+		RootLayout::Bindless<D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 1, RootLayout::VolatileDescriptors>,
+		RootLayout::Bindless<D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 2, RootLayout::VolatileDescriptors>,
+		RootLayout::Bindless<D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 3, RootLayout::VolatileDescriptors>>;
+	using HitTlas = RootLayout::RootSrv<0, 0, RootLayout::VolatileData>;
+	using HitGeometry = RootLayout::RootConstants<1, 0>;
+	using HitLayout = RootSignatureLayout<D3D12_ROOT_SIGNATURE_FLAG_LOCAL_ROOT_SIGNATURE, HitBindless, HitTlas, HitGeometry>;
+
+	using MissLayout = RootSignatureLayout<D3D12_ROOT_SIGNATURE_FLAG_LOCAL_ROOT_SIGNATURE>;
+	using GlobalLayout = RootSignatureLayout<D3D12_ROOT_SIGNATURE_FLAG_NONE>;
+
+	// Root signature for a serialized layout, identical layouts share one object
+	ComPtr<ID3D12RootSignature> GetRootSignature(ID3DBlob* serialized);
+
+	// Features the raytracing shaders are specialized on. Every combination gets its
+	// own state object and shader table, switching features only picks another one.
+	static constexpr UINT32 RaytracingFeatures = ShaderFeatureShadows;
+	struct RaytracingVariant {
+		ComPtr<ID3D12StateObject> stateObject;
+		ComPtr<ID3D12StateObjectProperties> properties;
+		ComPtr<ID3D12Resource> sbtStorage;
+	};
+	std::vector<RaytracingVariant> m_rtVariants; // indexed like m_shaders.hitLibrary
 
-
-	ComPtr<ID3D12RootSignature> CreateRayGenSignature();
-	ComPtr<ID3D12RootSignature> CreateMissSignature();
-	ComPtr<ID3D12RootSignature> CreateHitSignature();
-
-	IDxcBlob* CompileShaderLibrary(LPCWSTR fileName);
 	void CreateRaytracingPipeline();
+	template <typename Features>
+	void CreateRaytracingVariant(Features, RaytracingVariant* variant);
+	const RaytracingVariant& GetRaytracingVariant(UINT32 features) const;
 
-	ComPtr<IDxcBlob> m_rayGenLibrary;
-	ComPtr<IDxcBlob> m_hitLibrary;
-	ComPtr<IDxcBlob> m_missLibrary;
+	// Bytecode owned by the shader cache
+	D3D12_SHADER_BYTECODE m_rayGenLibrary = {};
+	D3D12_SHADER_BYTECODE m_missLibrary = {};
 
 	ComPtr<ID3D12RootSignature> m_rayGenSignature;
 	ComPtr<ID3D12RootSignature> m_hitSignature;
 	ComPtr<ID3D12RootSignature> m_missSignature;
-
-	ComPtr<ID3D12StateObject> m_rtStateObject;
-	ComPtr<ID3D12StateObjectProperties> m_rtStateObjectProps;
+	ComPtr<ID3D12RootSignature> m_globalSignature;
 
 	void CreateRaytracingOutputBuffer();
 	void CreateShaderResourceHeap();
 	ComPtr<ID3D12Resource> m_outputResource;
-	ComPtr<ID3D12DescriptorHeap> m_srvUavHeap;
+	DescriptorHandle m_rayTracingViews;                   // staging: output UAV, output SRV, TLAS SRV per frame context
+	DescriptorHandle m_rayGenTables[MaxFramesInFlight];   // persistent: output UAV, TLAS SRV, camera CBV
+	DescriptorHandle m_outputSrv;                         // persistent
+
+	// Dynamic resolution. Rays are traced into the top-left corner of m_outputResource,
+	// which is allocated at the largest scale, then stretched over the back buffer.
+	D3D12TimestampSource m_gpuTimer;
+	ResolutionController m_resolution{ &m_gpuTimer };
+	UINT m_outputWidth = 0;
+	UINT m_outputHeight = 0;
+	UINT m_dispatchWidth = 0;
+	UINT m_dispatchHeight = 0;
+	ComPtr<ID3D12RootSignature> m_upscaleSignature;
+	ComPtr<ID3D12PipelineState> m_upscalePipeline;
+
+	void UpdateDispatchSize();
+	void CreateUpscalePipeline();
+	void RecordUpscale(D3D12_CPU_DESCRIPTOR_HANDLE rtvHandle);
 
 	void CreateShaderBindingTable();
-	ComPtr<ID3D12Resource> m_sbtStorage;
+	void WriteShaderBindingTable(ID3D12StateObjectProperties* properties, uint8_t* pData);
 
 	uint32_t m_rayGenEntrySize = 0;
 	uint32_t m_missEntrySize = 0;
@@ -234,12 +505,10 @@ private:
 	uint32_t m_rayGenSectionSize = 0;
 	uint32_t m_missSectionSize = 0;
 	uint32_t m_hitGroupSectionSize = 0;
+	uint32_t m_hitGroupSectionStride = 0; // one section per frame context, each with its TLAS
 	uint32_t m_sbtSize = 0;
 
-	ComPtr<ID3D12Resource> m_planeBuffer;
-	D3D12_VERTEX_BUFFER_VIEW m_planeBufferView;
-
-	ComPtr<IDxcBlob> m_shadowLibrary;
+	D3D12_SHADER_BYTECODE m_shadowLibrary = {};
 	ComPtr<ID3D12RootSignature> m_shadowSignature;
 };
 
@@ -0,0 +1,80 @@
+#include "ResolutionController.h"
+
+#include <algorithm>
+#include <cmath>
+
+// Headroom kept below the target so small spikes do not miss the budget
+static const double BudgetHeadroom = 0.9;
+// Weight of a new measurement in the smoothed cost
+static const double CostSmoothing = 0.25;
+// Scale changes smaller than this are ignored to avoid oscillating between sizes
+static const float ScaleDeadBand = 0.02f;
+// Largest scale change applied in a single frame
+static const float MaxScaleStep = 0.1f;
+
+ResolutionController::ResolutionController(GpuTimingSource* source) : m_source(source) {
+    SetScaleRange(m_minScale, m_maxScale);
+}
+
+void ResolutionController::SetScaleRange(float minScale, float maxScale) {
+    m_minScale = (std::max)(0.05f, (std::min)(minScale, maxScale));
+    m_maxScale = (std::max)(m_minScale, maxScale);
+    m_scale = (std::max)(m_minScale, (std::min)(m_scale, m_maxScale));
+    for (uint32_t i = 0; i < MaxContexts; i++) m_contextScale[i] = m_scale;
+}
+
+float ResolutionController::Update(uint32_t context) {
+    context %= MaxContexts;
+
+    double ms = 0.0;
+    float measuredScale = m_contextScale[context];
+    if (m_source && m_source->ReadFrameTime(context, &ms) && ms > 0.0 && measuredScale > 0.0f) {
+        m_lastMs = ms;
+
+        double cost = ms / (double(measuredScale) * measuredScale);
+        m_costPerArea = m_costPerArea > 0.0 ? m_costPerArea + (cost - m_costPerArea) * CostSmoothing : cost;
+
+        float desired = static_cast<float>(std::sqrt(m_targetMs * BudgetHeadroom / m_costPerArea));
+        desired = (std::max)(m_minScale, (std::min)(desired, m_maxScale));
+
+        float step = desired - m_scale;
+        if (std::fabs(step) > ScaleDeadBand || desired == m_minScale || desired == m_maxScale) {
+            step = (std::max)(-MaxScaleStep, (std::min)(step, MaxScaleStep));
+            m_scale += step;
+        }
+    }
+
+    // The context now records the next frame at this scale
+    m_contextScale[context] = m_scale;
+    return m_scale;
+}
+
+void ResolutionController::GetDispatchSize(uint32_t outputWidth, uint32_t outputHeight, uint32_t* width, uint32_t* height) const {
+    auto scaled = [this](uint32_t size) {
+        uint32_t value = static_cast<uint32_t>(size * m_scale + 0.5f);
+        value = (value + 7) & ~7u;
+        uint32_t limit = static_cast<uint32_t>(size * m_maxScale);
+        return (std::max)(8u, (std::min)(value, limit));
+    };
+    *width = scaled(outputWidth);
+    *height = scaled(outputHeight);
+}
+
+
+SyntheticTimingSource::SyntheticTimingSource(double fixedMs, double msAtFullScale) {
+    m_fixedMs = fixedMs;
+    m_msAtFullScale = msAtFullScale;
+}
+
+void SyntheticTimingSource::Submit(uint32_t context, float scale) {
+    context %= ResolutionController::MaxContexts;
+    m_frameMs[context] = (m_fixedMs + m_msAtFullScale * scale * scale) * m_load;
+    m_valid[context] = true;
+}
+
+bool SyntheticTimingSource::ReadFrameTime(uint32_t context, double* ms) {
+    context %= ResolutionController::MaxContexts;
+    if (!m_valid[context]) return false;
+    *ms = m_frameMs[context];
+    return true;
+}
@@ -0,0 +1,74 @@
+#pragma once
+#include <cstdint>
+
+// Where the controller gets its GPU frame times from. A frame context is only
+// read back once the frame that last used it has finished on the GPU.
+class GpuTimingSource {
+
+public:
+	virtual ~GpuTimingSource() {}
+
+	// GPU time of the last finished frame recorded with `context`, false if none yet
+	virtual bool ReadFrameTime(uint32_t context, double* ms) = 0;
+};
+
+// Picks the ray dispatch scale for each frame so the GPU time stays within the
+// target frame budget. GPU time is modelled as proportional to the traced pixel
+// count, measured against the scale the frame was actually recorded with.
+class ResolutionController {
+
+public:
+	static const uint32_t MaxContexts = 8;
+
+	explicit ResolutionController(GpuTimingSource* source);
+
+	void SetTargetFrameTime(double ms) { m_targetMs = ms; }
+	void SetScaleRange(float minScale, float maxScale);
+
+	// Call once the frame that last used `context` has completed, before recording
+	// into it again. Returns the scale for the frame about to be recorded.
+	float Update(uint32_t context);
+
+	// Dispatch size for an output of `outputWidth` x `outputHeight` at the current scale,
+	// rounded to multiples of 8 so ray tiles stay full
+	void GetDispatchSize(uint32_t outputWidth, uint32_t outputHeight, uint32_t* width, uint32_t* height) const;
+
+	float GetScale() const { return m_scale; }
+	float GetMaxScale() const { return m_maxScale; }
+	double GetTargetFrameTime() const { return m_targetMs; }
+	double GetLastFrameTime() const { return m_lastMs; }
+
+private:
+	GpuTimingSource* m_source;
+
+	double m_targetMs = 1000.0 / 60.0;
+	float m_minScale = 0.5f;
+	float m_maxScale = 1.0f;
+	float m_scale = 1.0f;
+
+	// Milliseconds per unit of scale squared, smoothed over several frames
+	double m_costPerArea = 0.0;
+	double m_lastMs = 0.0;
+	float m_contextScale[MaxContexts] = {};
+};
+
+// Deterministic stand-in for GPU timestamps: frame time is fixedMs plus msAtFullScale
+// times the traced area. Spikes can be scripted to exercise the control loop.
+class SyntheticTimingSource : public GpuTimingSource {
+
+public:
+	SyntheticTimingSource(double fixedMs, double msAtFullScale);
+
+	// Records the frame of `context` as traced at `scale`
+	void Submit(uint32_t context, float scale);
+	void SetLoad(double multiplier) { m_load = multiplier; }
+
+	bool ReadFrameTime(uint32_t context, double* ms) override;
+
+private:
+	double m_fixedMs;
+	double m_msAtFullScale;
+	double m_load = 1.0;
+	double m_frameMs[ResolutionController::MaxContexts] = {};
+	bool m_valid[ResolutionController::MaxContexts] = {};
+};
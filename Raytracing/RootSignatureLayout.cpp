@@ -0,0 +1,28 @@
+#include "RootSignatureLayout.h"
+
+#include <wrl.h>
+
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+
+using Microsoft::WRL::ComPtr;
+
+ID3DBlob* SerializeRootSignature(UINT64 layoutKey, const D3D12_VERSIONED_ROOT_SIGNATURE_DESC& desc) {
+    static std::mutex mutex;
+    static std::unordered_map<UINT64, ComPtr<ID3DBlob>> blobs;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    ComPtr<ID3DBlob>& blob = blobs[layoutKey];
+    if (blob) return blob.Get();
+
+    ComPtr<ID3DBlob> error;
+    if (FAILED(D3D12SerializeVersionedRootSignature(&desc, &blob, &error))) {
+        blobs.erase(layoutKey);
+        std::string message = "Cannot serialize root signature";
+        if (error) message.append(": ").append(static_cast<const char*>(error->GetBufferPointer()), error->GetBufferSize());
+        throw std::runtime_error(message);
+    }
+    return blob.Get();
+}
@@ -0,0 +1,248 @@
+#pragma once
+#include <d3d12.h>
+
+#include <type_traits>
+
+// Root signatures described as types. A layout lists its parameters in order,
+// parameter indices, descriptor table offsets, the root cost in DWORDs and the size
+// of the matching shader record are all computed by the compiler:
+//
+//   using Camera   = RootLayout::RootCbv<0>;
+//   using Textures = RootLayout::Table<D3D12_SHADER_VISIBILITY_PIXEL, RootLayout::Srv<0, 0, 4>, RootLayout::Srv<4>>;
+//   using Layout   = RootSignatureLayout<D3D12_ROOT_SIGNATURE_FLAG_NONE, Camera, Textures>;
+//
+//   Layout::Index<Textures>()   1
+//   Layout::Cost                3
+//   Layout::Serialize()         blob, serialized once per layout
+//
+// Ranges inside a table follow each other unless they are Bindless, which cover the
+// whole heap from the table start and may overlap.
+
+namespace RootLayout {
+
+// Flags root signature 1.0 implied, for layouts that keep that behavior
+static const UINT VolatileDescriptors = D3D12_DESCRIPTOR_RANGE_FLAG_DESCRIPTORS_VOLATILE | D3D12_DESCRIPTOR_RANGE_FLAG_DATA_VOLATILE;
+static const UINT VolatileData = D3D12_ROOT_DESCRIPTOR_FLAG_DATA_VOLATILE;
+
+constexpr UINT64 HashSeed = 0xcbf29ce484222325ull;
+
+// FNV-1a over the 8 bytes of each value
+constexpr UINT64 HashAll(UINT64 hash) { return hash; }
+template <typename... Rest>
+constexpr UINT64 HashAll(UINT64 hash, UINT64 value, Rest... rest) {
+	for (UINT i = 0; i < 8; i++) {
+		hash ^= (value >> (8 * i)) & 0xff;
+		hash *= 0x100000001b3ull;
+	}
+	return HashAll(hash, rest...);
+}
+
+constexpr UINT SumOf() { return 0; }
+template <typename... Rest>
+constexpr UINT SumOf(UINT value, Rest... rest) { return value + SumOf(rest...); }
+
+constexpr UINT AlignUp(UINT value, UINT alignment) { return (value + alignment - 1) & ~(alignment - 1); }
+
+// Descriptor ranges --------------------
+
+template <D3D12_DESCRIPTOR_RANGE_TYPE Type, UINT Register, UINT Space, UINT Count, UINT Flags, bool FromTableStart>
+struct DescriptorRange {
+	static constexpr UINT DescriptorCount = Count;
+	static constexpr bool AtTableStart = FromTableStart;
+	static constexpr UINT64 Key = HashAll(HashSeed, Type, Register, Space, Count, Flags, FromTableStart);
+
+	static D3D12_DESCRIPTOR_RANGE1 Describe(UINT offset) {
+		D3D12_DESCRIPTOR_RANGE1 range = {};
+		range.RangeType = Type;
+		range.NumDescriptors = Count;
+		range.BaseShaderRegister = Register;
+		range.RegisterSpace = Space;
+		range.Flags = static_cast<D3D12_DESCRIPTOR_RANGE_FLAGS>(Flags);
+		range.OffsetInDescriptorsFromTableStart = offset;
+		return range;
+	}
+};
+
+template <UINT Register, UINT Space = 0, UINT Count = 1, UINT Flags = D3D12_DESCRIPTOR_RANGE_FLAG_NONE>
+using Srv = DescriptorRange<D3D12_DESCRIPTOR_RANGE_TYPE_SRV, Register, Space, Count, Flags, false>;
+template <UINT Register, UINT Space = 0, UINT Count = 1, UINT Flags = D3D12_DESCRIPTOR_RANGE_FLAG_NONE>
+using Uav = DescriptorRange<D3D12_DESCRIPTOR_RANGE_TYPE_UAV, Register, Space, Count, Flags, false>;
+template <UINT Register, UINT Space = 0, UINT Count = 1, UINT Flags = D3D12_DESCRIPTOR_RANGE_FLAG_NONE>
+using Cbv = DescriptorRange<D3D12_DESCRIPTOR_RANGE_TYPE_CBV, Register, Space, Count, Flags, false>;
+
+// Unbounded array over the whole heap, register 0 of its own space
+template <D3D12_DESCRIPTOR_RANGE_TYPE Type, UINT Space, UINT Flags = D3D12_DESCRIPTOR_RANGE_FLAG_DESCRIPTORS_VOLATILE>
+using Bindless = DescriptorRange<Type, 0, Space, UINT_MAX, Flags, true>;
+
+// Offset of range `index` from the table start. UINT_MAX marks a range placed after
+// an unbounded one, which has no offset.
+template <typename... Ranges>
+constexpr UINT RangeOffset(UINT index) {
+	const UINT counts[] = { Ranges::DescriptorCount... };
+	const bool atTableStart[] = { Ranges::AtTableStart... };
+	UINT offset = 0;
+	for (UINT i = 0; i < index; i++) {
+		if (atTableStart[i]) continue;
+		offset = counts[i] == UINT_MAX || offset == UINT_MAX ? UINT_MAX : offset + counts[i];
+	}
+	return atTableStart[index] ? 0 : offset;
+}
+
+template <typename... Ranges>
+constexpr bool ValidRangeOffsets() {
+	for (UINT i = 0; i < sizeof...(Ranges); i++) {
+		if (RangeOffset<Ranges...>(i) == UINT_MAX) return false;
+	}
+	return true;
+}
+
+// Root parameters --------------------
+// Cost is in DWORDs of the root signature, ArgumentSize and ArgumentAlignment in
+// bytes of a shader record.
+
+template <D3D12_SHADER_VISIBILITY Visibility, typename... Ranges>
+struct Table {
+	static_assert(sizeof...(Ranges) > 0, "A descriptor table needs at least one range");
+
+	static constexpr UINT Cost = 1;
+	static constexpr UINT ArgumentSize = sizeof(D3D12_GPU_DESCRIPTOR_HANDLE);
+	static constexpr UINT ArgumentAlignment = 8;
+	static constexpr UINT RangeCount = sizeof...(Ranges);
+	static constexpr UINT64 Key = HashAll(HashSeed, D3D12_ROOT_PARAMETER_TYPE_DESCRIPTOR_TABLE, Visibility, Ranges::Key...);
+
+	static_assert(ValidRangeOffsets<Ranges...>(), "Only Bindless ranges may follow an unbounded range");
+
+	static void Describe(D3D12_ROOT_PARAMETER1* parameter, D3D12_DESCRIPTOR_RANGE1* ranges) {
+		UINT index = 0;
+		int expand[] = { (ranges[index] = Ranges::Describe(RangeOffset<Ranges...>(index)), index++, 0)... };
+		(void)expand;
+
+		parameter->ParameterType = D3D12_ROOT_PARAMETER_TYPE_DESCRIPTOR_TABLE;
+		parameter->DescriptorTable.NumDescriptorRanges = RangeCount;
+		parameter->DescriptorTable.pDescriptorRanges = ranges;
+		parameter->ShaderVisibility = Visibility;
+	}
+};
+
+template <D3D12_ROOT_PARAMETER_TYPE Type, UINT Register, UINT Space, UINT Flags, D3D12_SHADER_VISIBILITY Visibility>
+struct RootDescriptor {
+	static constexpr UINT Cost = 2;
+	static constexpr UINT ArgumentSize = sizeof(D3D12_GPU_VIRTUAL_ADDRESS);
+	static constexpr UINT ArgumentAlignment = 8;
+	static constexpr UINT RangeCount = 0;
+	static constexpr UINT64 Key = HashAll(HashSeed, Type, Register, Space, Flags, Visibility);
+
+	static void Describe(D3D12_ROOT_PARAMETER1* parameter, D3D12_DESCRIPTOR_RANGE1*) {
+		parameter->ParameterType = Type;
+		parameter->Descriptor.ShaderRegister = Register;
+		parameter->Descriptor.RegisterSpace = Space;
+		parameter->Descriptor.Flags = static_cast<D3D12_ROOT_DESCRIPTOR_FLAGS>(Flags);
+		parameter->ShaderVisibility = Visibility;
+	}
+};
+
+template <UINT Register, UINT Space = 0, UINT Flags = D3D12_ROOT_DESCRIPTOR_FLAG_NONE, D3D12_SHADER_VISIBILITY Visibility = D3D12_SHADER_VISIBILITY_ALL>
+using RootCbv = RootDescriptor<D3D12_ROOT_PARAMETER_TYPE_CBV, Register, Space, Flags, Visibility>;
+template <UINT Register, UINT Space = 0, UINT Flags = D3D12_ROOT_DESCRIPTOR_FLAG_NONE, D3D12_SHADER_VISIBILITY Visibility = D3D12_SHADER_VISIBILITY_ALL>
+using RootSrv = RootDescriptor<D3D12_ROOT_PARAMETER_TYPE_SRV, Register, Space, Flags, Visibility>;
+template <UINT Register, UINT Space = 0, UINT Flags = D3D12_ROOT_DESCRIPTOR_FLAG_NONE, D3D12_SHADER_VISIBILITY Visibility = D3D12_SHADER_VISIBILITY_ALL>
+using RootUav = RootDescriptor<D3D12_ROOT_PARAMETER_TYPE_UAV, Register, Space, Flags, Visibility>;
+
+template <UINT Count, UINT Register, UINT Space = 0, D3D12_SHADER_VISIBILITY Visibility = D3D12_SHADER_VISIBILITY_ALL>
+struct RootConstants {
+	static constexpr UINT Cost = Count;
+	static constexpr UINT ArgumentSize = 4 * Count;
+	static constexpr UINT ArgumentAlignment = 4;
+	static constexpr UINT RangeCount = 0;
+	static constexpr UINT64 Key = HashAll(HashSeed, D3D12_ROOT_PARAMETER_TYPE_32BIT_CONSTANTS, Count, Register, Space, Visibility);
+
+	static void Describe(D3D12_ROOT_PARAMETER1* parameter, D3D12_DESCRIPTOR_RANGE1*) {
+		parameter->ParameterType = D3D12_ROOT_PARAMETER_TYPE_32BIT_CONSTANTS;
+		parameter->Constants.Num32BitValues = Count;
+		parameter->Constants.ShaderRegister = Register;
+		parameter->Constants.RegisterSpace = Space;
+		parameter->ShaderVisibility = Visibility;
+	}
+};
+
+}
+
+namespace RootLayout {
+
+// End of the first `count` root arguments of a shader record
+template <typename... Parameters>
+constexpr UINT ArgumentEnd(UINT count) {
+	const UINT sizes[] = { Parameters::ArgumentSize..., 0 };
+	const UINT alignments[] = { Parameters::ArgumentAlignment..., 1 };
+	UINT end = 0;
+	for (UINT i = 0; i < count; i++) end = AlignUp(end, alignments[i]) + sizes[i];
+	return end;
+}
+
+}
+
+// Serialized root signature for `desc`, cached under `layoutKey` for the lifetime of
+// the process. Throws if serialization fails.
+ID3DBlob* SerializeRootSignature(UINT64 layoutKey, const D3D12_VERSIONED_ROOT_SIGNATURE_DESC& desc);
+
+template <UINT Flags, typename... Parameters>
+struct RootSignatureLayout {
+	static constexpr UINT ParameterCount = sizeof...(Parameters);
+	static constexpr UINT RangeCount = RootLayout::SumOf(Parameters::RangeCount...);
+	static constexpr UINT Cost = RootLayout::SumOf(Parameters::Cost...);
+	static_assert(Cost <= D3D12_MAX_ROOT_COST, "Root signature exceeds 64 DWORDs");
+
+	static constexpr UINT64 Key = RootLayout::HashAll(RootLayout::HashSeed, Flags, Parameters::Key...);
+
+	// Root parameter index of `Parameter`, which must appear exactly once
+	template <typename Parameter>
+	static constexpr UINT Index() {
+		static_assert(RootLayout::SumOf(std::is_same<Parameter, Parameters>::value...) == 1,
+			"Parameter must appear exactly once in the layout");
+		const bool same[] = { std::is_same<Parameter, Parameters>::value..., false };
+		UINT index = 0;
+		while (!same[index]) index++;
+		return index;
+	}
+
+	// Byte offset of the argument of `Parameter` after the shader identifier of a record
+	template <typename Parameter>
+	static constexpr UINT ArgumentOffset() {
+		return RootLayout::ArgumentEnd<Parameters...>(Index<Parameter>() + 1) - Parameter::ArgumentSize;
+	}
+
+	// Root arguments of a local root signature in a shader record, each aligned to its size
+	static constexpr UINT ArgumentsSize = RootLayout::AlignUp(RootLayout::ArgumentEnd<Parameters...>(ParameterCount), 8);
+	static constexpr UINT ShaderRecordSize = RootLayout::AlignUp(
+		D3D12_SHADER_IDENTIFIER_SIZE_IN_BYTES + ArgumentsSize, D3D12_RAYTRACING_SHADER_RECORD_BYTE_ALIGNMENT);
+
+	// D3D12 description built from the types. Points into itself, so it is not copied.
+	struct Desc {
+		D3D12_ROOT_PARAMETER1 parameters[ParameterCount + 1] = {};
+		D3D12_DESCRIPTOR_RANGE1 ranges[RangeCount + 1] = {};
+		D3D12_VERSIONED_ROOT_SIGNATURE_DESC desc = {};
+
+		Desc() {
+			UINT parameter = 0;
+			UINT range = 0;
+			int expand[] = { 0, (Parameters::Describe(&parameters[parameter++], &ranges[range]), range += Parameters::RangeCount, 0)... };
+			(void)expand;
+
+			desc.Version = D3D_ROOT_SIGNATURE_VERSION_1_1;
+			desc.Desc_1_1.NumParameters = ParameterCount;
+			desc.Desc_1_1.pParameters = ParameterCount ? parameters : nullptr;
+			desc.Desc_1_1.NumStaticSamplers = 0;
+			desc.Desc_1_1.pStaticSamplers = nullptr;
+			desc.Desc_1_1.Flags = static_cast<D3D12_ROOT_SIGNATURE_FLAGS>(Flags);
+		}
+
+		Desc(const Desc&) = delete;
+		Desc& operator=(const Desc&) = delete;
+	};
+
+	// Serialized once per layout, every later call returns the same blob
+	static ID3DBlob* Serialize() {
+		Desc desc;
+		return SerializeRootSignature(Key, desc.desc);
+	}
+};
@@ -0,0 +1,83 @@
+#include "ScratchArena.h"
+
+#include <stdexcept>
+
+void ScratchArena::Init(ID3D12Device* device, MemoryTracker* memory) {
+    m_device = device;
+    m_memory = memory;
+}
+
+void ScratchArena::Reserve(UINT64 size) {
+    size = (size + D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BYTE_ALIGNMENT - 1) & ~UINT64(D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BYTE_ALIGNMENT - 1);
+    if (size <= m_size) return;
+
+    if (m_buffer) m_replaced.push_back(m_buffer);
+
+    D3D12_RESOURCE_DESC resourceDesc = {};
+    resourceDesc.Dimension = D3D12_RESOURCE_DIMENSION_BUFFER;
+    resourceDesc.Alignment = 0;
+    resourceDesc.Width = size;
+    resourceDesc.Height = 1;
+    resourceDesc.DepthOrArraySize = 1;
+    resourceDesc.MipLevels = 1;
+    resourceDesc.Format = DXGI_FORMAT_UNKNOWN;
+    resourceDesc.SampleDesc.Count = 1;
+    resourceDesc.SampleDesc.Quality = 0;
+    resourceDesc.Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR;
+    resourceDesc.Flags = D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS;
+
+    D3D12_HEAP_PROPERTIES heapProperties = {};
+    heapProperties.Type = D3D12_HEAP_TYPE_DEFAULT;
+    heapProperties.CPUPageProperty = D3D12_CPU_PAGE_PROPERTY_UNKNOWN;
+    heapProperties.MemoryPoolPreference = D3D12_MEMORY_POOL_UNKNOWN;
+    heapProperties.CreationNodeMask = 1;
+    heapProperties.VisibleNodeMask = 1;
+
+    m_buffer = nullptr;
+    HRESULT hr = m_device->CreateCommittedResource(
+        &heapProperties,
+        D3D12_HEAP_FLAG_NONE,
+        &resourceDesc,
+        D3D12_RESOURCE_STATE_UNORDERED_ACCESS,
+        nullptr,
+        IID_PPV_ARGS(&m_buffer));
+    if (FAILED(hr)) { throw std::runtime_error("Cannot create the scratch arena"); }
+    // Evicted under pressure while idle, Acquire makes it resident again
+    if (m_memory) m_memory->Track(m_buffer.Get(), L"Scratch Arena", MemoryCategory::Scratch, ResidencyPriority::Low);
+
+    m_size = size;
+    m_lastCommandList = nullptr;
+}
+
+D3D12_GPU_VIRTUAL_ADDRESS ScratchArena::Acquire(ID3D12GraphicsCommandList* commandList, UINT64 size) {
+    if (size > m_size) { throw std::logic_error("Scratch arena is smaller than the build - missing Reserve?"); }
+    m_requested += size;
+
+    if (m_lastCommandList == commandList) {
+        D3D12_RESOURCE_BARRIER uavBarrier = {};
+        uavBarrier.Type = D3D12_RESOURCE_BARRIER_TYPE_UAV;
+        uavBarrier.UAV.pResource = m_buffer.Get();
+        uavBarrier.Flags = D3D12_RESOURCE_BARRIER_FLAG_NONE;
+        commandList->ResourceBarrier(1, &uavBarrier);
+    }
+    m_lastCommandList = commandList;
+
+    if (m_memory) m_memory->Use(m_buffer.Get());
+    return m_buffer->GetGPUVirtualAddress();
+}
+
+void ScratchArena::Submit(UINT64 fenceValue) {
+    // Work in a new command list is ordered after this submission on the queue
+    m_lastCommandList = nullptr;
+
+    for (auto& buffer : m_replaced) {
+        m_retired.push_back({ fenceValue, buffer });
+    }
+    m_replaced.clear();
+}
+
+void ScratchArena::Retire(UINT64 completedFenceValue) {
+    while (!m_retired.empty() && m_retired.front().first <= completedFenceValue) {
+        m_retired.pop_front();
+    }
+}
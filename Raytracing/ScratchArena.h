@@ -0,0 +1,50 @@
+#pragma once
+#include <d3d12.h>
+#include <wrl.h>
+
+#include <deque>
+#include <utility>
+#include <vector>
+
+#include "MemoryTracker.h"
+
+using Microsoft::WRL::ComPtr;
+
+// Single scratch buffer shared by every acceleration structure build. The arena is
+// sized to the largest ScratchDataSizeInBytes of a batch, so the builds alias the
+// same memory and have to be separated by a UAV barrier on the scratch resource.
+class ScratchArena {
+
+public:
+	ScratchArena() {}
+
+	void Init(ID3D12Device* device, MemoryTracker* memory);
+
+	// Grows the buffer to at least `size` bytes. A replaced buffer may still be
+	// referenced by recorded commands and is kept until its fence value completes.
+	void Reserve(UINT64 size);
+
+	// Returns the scratch address for a build needing `size` bytes, emitting a UAV
+	// barrier if the previous build recorded in `commandList` used the arena.
+	D3D12_GPU_VIRTUAL_ADDRESS Acquire(ID3D12GraphicsCommandList* commandList, UINT64 size);
+
+	void Submit(UINT64 fenceValue);
+	void Retire(UINT64 completedFenceValue);
+
+	UINT64 GetSize() const { return m_size; }
+	// Sum of the sizes acquired since the last ResetStats, what separate buffers would have used
+	UINT64 GetRequestedTotal() const { return m_requested; }
+	void ResetStats() { m_requested = 0; }
+
+private:
+	ID3D12Device* m_device = nullptr;
+	MemoryTracker* m_memory = nullptr;
+
+	ComPtr<ID3D12Resource> m_buffer;
+	UINT64 m_size = 0;
+	UINT64 m_requested = 0;
+	ID3D12GraphicsCommandList* m_lastCommandList = nullptr;
+
+	std::vector<ComPtr<ID3D12Resource>> m_replaced;                 // not submitted yet
+	std::deque<std::pair<UINT64, ComPtr<ID3D12Resource>>> m_retired; // fence value, buffer
+};
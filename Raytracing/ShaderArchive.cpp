@@ -0,0 +1,178 @@
+#include "ShaderArchive.h"
+
+#include <algorithm>
+#include <fstream>
+
+static const UINT64 HashSeed = 0xcbf29ce484222325ull;
+
+static UINT64 HashBytes(const void* data, size_t size, UINT64 hash) {
+    const UINT8* bytes = static_cast<const UINT8*>(data);
+    for (size_t i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
+template <typename T>
+static UINT64 HashString(const std::basic_string<T>& value, UINT64 hash) {
+    UINT64 size = value.size();
+    hash = HashBytes(&size, sizeof(size), hash);
+    return HashBytes(value.data(), value.size() * sizeof(T), hash);
+}
+
+static UINT64 AlignOffset(UINT64 offset, UINT64 alignment) {
+    return (offset + alignment - 1) & ~(alignment - 1);
+}
+
+UINT64 ShaderArchiveKey(const ShaderRequest& request) {
+    UINT64 hash = HashString(request.fileName, HashSeed);
+    hash = HashString(request.entryPoint, hash);
+    hash = HashString(request.target, hash);
+    for (const auto& define : request.defines) {
+        hash = HashString(define.first, hash);
+        hash = HashString(define.second, hash);
+    }
+    return hash;
+}
+
+void ShaderArchiveWriter::Add(const ShaderRequest& request, const void* data, size_t size) {
+    UINT64 key = ShaderArchiveKey(request);
+    const UINT8* bytes = static_cast<const UINT8*>(data);
+
+    auto existing = std::find_if(m_shaders.begin(), m_shaders.end(),
+        [key](const std::pair<UINT64, ShaderBytecode>& shader) { return shader.first == key; });
+    if (existing != m_shaders.end()) {
+        existing->second.assign(bytes, bytes + size);
+    } else {
+        m_shaders.emplace_back(key, ShaderBytecode(bytes, bytes + size));
+    }
+}
+
+bool ShaderArchiveWriter::Write(LPCWSTR fileName) const {
+    std::vector<const std::pair<UINT64, ShaderBytecode>*> sorted;
+    for (const auto& shader : m_shaders) sorted.push_back(&shader);
+    std::sort(sorted.begin(), sorted.end(),
+        [](const std::pair<UINT64, ShaderBytecode>* a, const std::pair<UINT64, ShaderBytecode>* b) { return a->first < b->first; });
+
+    ShaderArchiveHeader header = {};
+    header.magic = ShaderArchiveMagic;
+    header.version = ShaderArchiveVersion;
+    header.headerSize = sizeof(ShaderArchiveHeader);
+    header.entryCount = static_cast<UINT32>(sorted.size());
+    header.entryOffset = sizeof(ShaderArchiveHeader);
+
+    std::vector<ShaderArchiveEntry> entries(sorted.size());
+    UINT64 offset = header.entryOffset + entries.size() * sizeof(ShaderArchiveEntry);
+    for (size_t i = 0; i < sorted.size(); i++) {
+        const ShaderBytecode& bytecode = sorted[i]->second;
+        offset = AlignOffset(offset, ShaderArchiveAlignment);
+        entries[i].key = sorted[i]->first;
+        entries[i].offset = offset;
+        entries[i].size = bytecode.size();
+        entries[i].checksum = HashBytes(bytecode.data(), bytecode.size(), HashSeed);
+        offset += bytecode.size();
+    }
+    header.fileSize = offset;
+
+    std::ofstream file(fileName, std::ios::binary | std::ios::trunc);
+    if (!file.good()) return false;
+
+    std::vector<char> padding(ShaderArchiveAlignment, 0);
+    UINT64 position = 0;
+    auto writeAt = [&](UINT64 at, const void* data, UINT64 size) {
+        file.write(padding.data(), static_cast<std::streamsize>(at - position));
+        file.write(static_cast<const char*>(data), static_cast<std::streamsize>(size));
+        position = at + size;
+    };
+
+    writeAt(0, &header, sizeof(header));
+    writeAt(header.entryOffset, entries.data(), entries.size() * sizeof(ShaderArchiveEntry));
+    for (size_t i = 0; i < sorted.size(); i++) {
+        writeAt(entries[i].offset, sorted[i]->second.data(), entries[i].size);
+    }
+
+    return file.good();
+}
+
+MappedShaderArchive::~MappedShaderArchive() {
+    Close();
+}
+
+bool MappedShaderArchive::Open(LPCWSTR fileName, bool verifyChecksums) {
+    Close();
+
+    m_file = CreateFileW(fileName, GENERIC_READ, FILE_SHARE_READ, nullptr,
+        OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (m_file == INVALID_HANDLE_VALUE) return false;
+
+    LARGE_INTEGER fileSize = {};
+    GetFileSizeEx(m_file, &fileSize);
+    m_fileSize = static_cast<UINT64>(fileSize.QuadPart);
+    if (m_fileSize < sizeof(ShaderArchiveHeader)) { Close(); return false; }
+
+    m_mapping = CreateFileMappingW(m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!m_mapping) { Close(); return false; }
+
+    m_view = static_cast<const UINT8*>(MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0));
+    if (!m_view) { Close(); return false; }
+
+    const ShaderArchiveHeader& header = Header();
+    bool valid =
+        header.magic == ShaderArchiveMagic &&
+        header.version == ShaderArchiveVersion &&
+        header.headerSize == sizeof(ShaderArchiveHeader) &&
+        header.fileSize == m_fileSize &&
+        header.entryOffset % alignof(ShaderArchiveEntry) == 0 &&
+        header.entryOffset + UINT64(header.entryCount) * sizeof(ShaderArchiveEntry) <= m_fileSize;
+
+    for (UINT i = 0; valid && i < header.entryCount; i++) {
+        const ShaderArchiveEntry& entry = Entries()[i];
+        valid = entry.offset + entry.size <= m_fileSize && (i == 0 || Entries()[i - 1].key < entry.key);
+        if (valid && verifyChecksums) {
+            valid = HashBytes(m_view + entry.offset, static_cast<size_t>(entry.size), HashSeed) == entry.checksum;
+        }
+    }
+
+    if (!valid) { Close(); return false; }
+    return true;
+}
+
+void MappedShaderArchive::Close() {
+    if (m_view) UnmapViewOfFile(m_view);
+    if (m_mapping) CloseHandle(m_mapping);
+    if (m_file != INVALID_HANDLE_VALUE) CloseHandle(m_file);
+
+    m_view = nullptr;
+    m_mapping = nullptr;
+    m_file = INVALID_HANDLE_VALUE;
+    m_fileSize = 0;
+}
+
+bool MappedShaderArchive::Find(const ShaderRequest& request, D3D12_SHADER_BYTECODE* bytecode) const {
+    if (!m_view) return false;
+
+    UINT64 key = ShaderArchiveKey(request);
+    const ShaderArchiveEntry* first = Entries();
+    const ShaderArchiveEntry* last = first + Header().entryCount;
+    const ShaderArchiveEntry* entry = std::lower_bound(first, last, key,
+        [](const ShaderArchiveEntry& e, UINT64 k) { return e.key < k; });
+    if (entry == last || entry->key != key) return false;
+
+    bytecode->pShaderBytecode = m_view + entry->offset;
+    bytecode->BytecodeLength = static_cast<SIZE_T>(entry->size);
+    return true;
+}
+
+std::wstring GetExecutableRelativePath(LPCWSTR fileName) {
+    std::vector<wchar_t> path(MAX_PATH);
+    DWORD length;
+    while ((length = GetModuleFileNameW(nullptr, path.data(), static_cast<DWORD>(path.size()))) == path.size()) {
+        path.resize(path.size() * 2);
+    }
+
+    std::wstring directory(path.data(), length);
+    size_t slash = directory.find_last_of(L"\\/");
+    directory = slash == std::wstring::npos ? std::wstring() : directory.substr(0, slash + 1);
+    return directory + fileName;
+}
@@ -0,0 +1,90 @@
+#pragma once
+#include <windows.h>
+#include <d3d12.h>
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "ShaderCache.h"
+
+// Every shader of a build compiled with full optimization, in one file that is
+// memory-mapped at startup. Bytecode is handed to D3D12 straight from the mapping.
+//
+//   [ShaderArchiveHeader][ShaderArchiveEntry x entryCount][pad][bytecode][pad][bytecode]...
+//
+// Entries are sorted by key. Bytecode starts at multiples of ShaderArchiveAlignment.
+
+static const UINT32 ShaderArchiveMagic = 0x52414853; // "SHAR"
+static const UINT32 ShaderArchiveVersion = 1;
+static const UINT32 ShaderArchiveAlignment = 16;
+
+struct ShaderArchiveHeader {
+	UINT32 magic;
+	UINT32 version;
+	UINT32 headerSize;
+	UINT32 entryCount;
+	UINT64 entryOffset;
+	UINT64 fileSize;
+};
+static_assert(sizeof(ShaderArchiveHeader) == 32, "ShaderArchiveHeader layout is part of the file format");
+
+struct ShaderArchiveEntry {
+	UINT64 key;      // ShaderArchiveKey of the request
+	UINT64 offset;   // from the beginning of the file
+	UINT64 size;
+	UINT64 checksum; // FNV-1a over the bytecode
+};
+static_assert(sizeof(ShaderArchiveEntry) == 32, "ShaderArchiveEntry layout is part of the file format");
+
+// Identifies a shader by what it is rather than how it was built: source file,
+// entry point, target and defines. Flags and compiler version are left out, the
+// archive holds a single optimized build of each shader.
+UINT64 ShaderArchiveKey(const ShaderRequest& request);
+
+class ShaderArchiveWriter {
+
+public:
+	// A second shader with the same key replaces the first
+	void Add(const ShaderRequest& request, const void* data, size_t size);
+	bool Write(LPCWSTR fileName) const;
+
+	UINT GetCount() const { return static_cast<UINT>(m_shaders.size()); }
+
+private:
+	std::vector<std::pair<UINT64, ShaderBytecode>> m_shaders;
+};
+
+// Read-only view of a shader archive mapped into the address space.
+class MappedShaderArchive {
+
+public:
+	MappedShaderArchive() {}
+	~MappedShaderArchive();
+
+	MappedShaderArchive(const MappedShaderArchive&) = delete;
+	MappedShaderArchive& operator=(const MappedShaderArchive&) = delete;
+
+	// Validates the header and the bounds of every entry. The checksum pass touches
+	// every byte, so it is only done on request.
+	bool Open(LPCWSTR fileName, bool verifyChecksums = false);
+	void Close();
+
+	bool IsOpen() const { return m_view != nullptr; }
+	UINT GetCount() const { return m_view ? Header().entryCount : 0; }
+
+	// Points into the mapping, valid until Close()
+	bool Find(const ShaderRequest& request, D3D12_SHADER_BYTECODE* bytecode) const;
+
+private:
+	const ShaderArchiveHeader& Header() const { return *reinterpret_cast<const ShaderArchiveHeader*>(m_view); }
+	const ShaderArchiveEntry* Entries() const { return reinterpret_cast<const ShaderArchiveEntry*>(m_view + Header().entryOffset); }
+
+	HANDLE m_file = INVALID_HANDLE_VALUE;
+	HANDLE m_mapping = nullptr;
+	const UINT8* m_view = nullptr;
+	UINT64 m_fileSize = 0;
+};
+
+// Full path of `fileName` next to the running executable
+std::wstring GetExecutableRelativePath(LPCWSTR fileName);
@@ -0,0 +1,224 @@
+#include "ShaderCache.h"
+
+#include <fstream>
+#include <iterator>
+#include <set>
+#include <sstream>
+
+static const UINT64 HashSeed = 0xcbf29ce484222325ull;
+
+static UINT64 HashBytes(const void* data, size_t size, UINT64 hash) {
+    const UINT8* bytes = static_cast<const UINT8*>(data);
+    for (size_t i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
+// Length prefixed so that ("ab", "c") and ("a", "bc") hash differently
+static UINT64 HashString(const std::string& value, UINT64 hash) {
+    UINT64 size = value.size();
+    hash = HashBytes(&size, sizeof(size), hash);
+    return HashBytes(value.data(), value.size(), hash);
+}
+
+static UINT64 HashString(const std::wstring& value, UINT64 hash) {
+    UINT64 size = value.size();
+    hash = HashBytes(&size, sizeof(size), hash);
+    return HashBytes(value.data(), value.size() * sizeof(wchar_t), hash);
+}
+
+static bool ReadFile(const std::wstring& fileName, std::string* contents) {
+    std::ifstream file(fileName, std::ios::binary);
+    if (!file.good()) return false;
+    contents->assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    return true;
+}
+
+static std::wstring DirectoryOf(const std::wstring& fileName) {
+    size_t slash = fileName.find_last_of(L"\\/");
+    return slash == std::wstring::npos ? std::wstring() : fileName.substr(0, slash + 1);
+}
+
+// Names of the files pulled in by #include directives, in order of appearance
+static std::vector<std::string> FindIncludes(const std::string& source) {
+    std::vector<std::string> includes;
+    std::istringstream lines(source);
+    std::string line;
+    while (std::getline(lines, line)) {
+        size_t position = line.find_first_not_of(" \t");
+        if (position == std::string::npos || line[position] != '#') continue;
+        position = line.find_first_not_of(" \t", position + 1);
+        if (position == std::string::npos || line.compare(position, 7, "include") != 0) continue;
+
+        size_t open = line.find_first_of("\"<", position + 7);
+        if (open == std::string::npos) continue;
+        size_t close = line.find(line[open] == '"' ? '"' : '>', open + 1);
+        if (close == std::string::npos) continue;
+        includes.push_back(line.substr(open + 1, close - open - 1));
+    }
+    return includes;
+}
+
+// Hashes `fileName` then, depth first, every file it includes. Each file is only
+// hashed once, on its first inclusion.
+static bool HashSourceTree(const std::wstring& fileName, std::set<std::wstring>& visited, UINT64* hash) {
+    if (!visited.insert(fileName).second) return true;
+
+    std::string source;
+    if (!ReadFile(fileName, &source)) return false;
+    *hash = HashString(fileName, *hash);
+    *hash = HashString(source, *hash);
+
+    std::wstring directory = DirectoryOf(fileName);
+    for (const std::string& include : FindIncludes(source)) {
+        std::wstring includeName = directory + std::wstring(include.begin(), include.end());
+        if (!HashSourceTree(includeName, visited, hash)) {
+            // Left to the compiler to report
+            *hash = HashString(includeName, *hash);
+        }
+    }
+    return true;
+}
+
+void ShaderCache::Init(const std::wstring& directory) {
+    m_directory = directory;
+    if (!m_directory.empty() && m_directory.back() != L'\\' && m_directory.back() != L'/') {
+        m_directory += L'\\';
+    }
+    CreateDirectoryW(m_directory.c_str(), nullptr);
+}
+
+bool ShaderCache::ComputeKey(const ShaderRequest& request, UINT64* key) const {
+    UINT64 hash = HashBytes(&ShaderCacheVersion, sizeof(ShaderCacheVersion), HashSeed);
+
+    std::set<std::wstring> visited;
+    if (!HashSourceTree(request.fileName, visited, &hash)) return false;
+
+    hash = HashString(request.entryPoint, hash);
+    hash = HashString(request.target, hash);
+    for (const auto& define : request.defines) {
+        hash = HashString(define.first, hash);
+        hash = HashString(define.second, hash);
+    }
+    hash = HashBytes(&request.flags, sizeof(request.flags), hash);
+    hash = HashString(request.compiler, hash);
+
+    *key = hash;
+    return true;
+}
+
+const ShaderBytecode* ShaderCache::Find(UINT64 key) {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto entry = m_entries.find(key);
+        if (entry != m_entries.end()) return entry->second.get();
+    }
+
+    std::unique_ptr<ShaderBytecode> bytecode(new ShaderBytecode());
+    if (m_directory.empty() || !ReadEntry(key, bytecode.get())) return nullptr;
+    bool inserted;
+    return Insert(key, std::move(bytecode), &inserted);
+}
+
+const ShaderBytecode* ShaderCache::Store(UINT64 key, const void* data, size_t size) {
+    const UINT8* bytes = static_cast<const UINT8*>(data);
+    bool inserted;
+    const ShaderBytecode* entry = Insert(key, std::unique_ptr<ShaderBytecode>(new ShaderBytecode(bytes, bytes + size)), &inserted);
+
+    // Whoever stored the key first also wrote it to disk
+    if (inserted && !m_directory.empty() && !WriteEntry(key, *entry)) {
+        OutputDebugStringW(L"Cannot write the shader cache entry\n");
+    }
+    return entry;
+}
+
+const ShaderBytecode* ShaderCache::Insert(UINT64 key, std::unique_ptr<ShaderBytecode> bytecode, bool* inserted) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::unique_ptr<ShaderBytecode>& entry = m_entries[key];
+    *inserted = !entry;
+    if (*inserted) entry = std::move(bytecode);
+    return entry.get();
+}
+
+const ShaderBytecode* ShaderCache::GetOrCompile(const ShaderRequest& request, const std::function<bool(ShaderBytecode*)>& compile) {
+    UINT64 key;
+    if (!ComputeKey(request, &key)) return nullptr;
+
+    if (const ShaderBytecode* cached = Find(key)) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_hits++;
+        return cached;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_misses++;
+    }
+    ShaderBytecode bytecode;
+    if (!compile(&bytecode)) return nullptr;
+    return Store(key, bytecode.data(), bytecode.size());
+}
+
+UINT ShaderCache::GetHitCount() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_hits;
+}
+
+UINT ShaderCache::GetMissCount() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_misses;
+}
+
+std::wstring ShaderCache::GetEntryPath(UINT64 key) const {
+    std::wstringstream ss;
+    ss << m_directory << std::hex;
+    ss.width(16);
+    ss.fill(L'0');
+    ss << key << L".bin";
+    return ss.str();
+}
+
+bool ShaderCache::ReadEntry(UINT64 key, ShaderBytecode* bytecode) const {
+    std::ifstream file(GetEntryPath(key), std::ios::binary | std::ios::ate);
+    if (!file.good()) return false;
+    UINT64 fileSize = static_cast<UINT64>(file.tellg());
+    file.seekg(0);
+
+    ShaderCacheEntryHeader header = {};
+    if (fileSize < sizeof(header) || !file.read(reinterpret_cast<char*>(&header), sizeof(header))) return false;
+    if (header.magic != ShaderCacheMagic || header.version != ShaderCacheVersion || header.key != key) {
+        return false;
+    }
+    // Checked before allocating, a corrupted size would otherwise reserve arbitrary memory
+    if (header.size != fileSize - sizeof(header)) return false;
+
+    bytecode->resize(static_cast<size_t>(header.size));
+    file.read(reinterpret_cast<char*>(bytecode->data()), static_cast<std::streamsize>(header.size));
+    if (!file.good()) return false;
+
+    // A truncated or corrupted entry is treated as a miss and rewritten
+    return HashBytes(bytecode->data(), bytecode->size(), HashSeed) == header.checksum;
+}
+
+bool ShaderCache::WriteEntry(UINT64 key, const ShaderBytecode& bytecode) const {
+    ShaderCacheEntryHeader header = {};
+    header.magic = ShaderCacheMagic;
+    header.version = ShaderCacheVersion;
+    header.key = key;
+    header.size = bytecode.size();
+    header.checksum = HashBytes(bytecode.data(), bytecode.size(), HashSeed);
+
+    // Written aside then renamed, a concurrent reader never sees a partial entry
+    std::wstring path = GetEntryPath(key);
+    std::wstring temporary = path + L".tmp";
+    {
+        std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+        if (!file.good()) return false;
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        file.write(reinterpret_cast<const char*>(bytecode.data()), static_cast<std::streamsize>(bytecode.size()));
+        if (!file.good()) return false;
+    }
+    return MoveFileExW(temporary.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+}
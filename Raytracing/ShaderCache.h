@@ -0,0 +1,85 @@
+#pragma once
+#include <windows.h>
+
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Preprocessor defines as name and value
+typedef std::vector<std::pair<std::string, std::string>> ShaderDefines;
+
+// Everything that changes the bytecode produced from a source file
+struct ShaderRequest {
+	std::wstring fileName;
+	std::string entryPoint;
+	std::string target;
+	ShaderDefines defines;
+	UINT32 flags = 0;
+	std::string compiler; // compiler name and version
+};
+
+typedef std::vector<UINT8> ShaderBytecode;
+
+static const UINT32 ShaderCacheMagic = 0x43444853; // "SHDC"
+static const UINT32 ShaderCacheVersion = 1;
+
+// Header of a cache entry file, followed by the bytecode
+struct ShaderCacheEntryHeader {
+	UINT32 magic;
+	UINT32 version;
+	UINT64 key;
+	UINT64 size;
+	UINT64 checksum; // FNV-1a over the bytecode
+};
+static_assert(sizeof(ShaderCacheEntryHeader) == 32, "ShaderCacheEntryHeader layout is part of the file format");
+
+// Content addressed cache of compiled shaders. The key hashes the source file, every
+// file it includes (followed recursively) and all the compile options, so an edit
+// anywhere in the include tree or a changed option gives a new key. Entries are kept
+// in memory and as one file per key in the cache directory, reused across launches.
+// Lookups and stores may come from several threads, compilation runs outside the lock.
+class ShaderCache {
+
+public:
+	ShaderCache() {}
+
+	ShaderCache(const ShaderCache&) = delete;
+	ShaderCache& operator=(const ShaderCache&) = delete;
+
+	// Creates the directory if needed. Without Init() the cache only lives in memory.
+	void Init(const std::wstring& directory);
+
+	// Returns false when the source file cannot be read. Missing includes only
+	// contribute their name, the compiler reports them.
+	bool ComputeKey(const ShaderRequest& request, UINT64* key) const;
+
+	// Bytecode stored under `key`, from memory or disk, nullptr on a miss.
+	// Returned bytecode stays valid for the lifetime of the cache.
+	const ShaderBytecode* Find(UINT64 key);
+	const ShaderBytecode* Store(UINT64 key, const void* data, size_t size);
+
+	// Cached bytecode for `request`, or the output of `compile` once stored.
+	// nullptr if the source cannot be read or `compile` returns false.
+	const ShaderBytecode* GetOrCompile(const ShaderRequest& request, const std::function<bool(ShaderBytecode*)>& compile);
+
+	UINT GetHitCount() const;
+	UINT GetMissCount() const;
+
+private:
+	std::wstring GetEntryPath(UINT64 key) const;
+	bool ReadEntry(UINT64 key, ShaderBytecode* bytecode) const;
+	bool WriteEntry(UINT64 key, const ShaderBytecode& bytecode) const;
+
+	// Keeps the entry already stored under `key` if there is one
+	const ShaderBytecode* Insert(UINT64 key, std::unique_ptr<ShaderBytecode> bytecode, bool* inserted);
+
+	std::wstring m_directory;
+	mutable std::mutex m_mutex;
+	std::unordered_map<UINT64, std::unique_ptr<ShaderBytecode>> m_entries;
+	UINT m_hits = 0;
+	UINT m_misses = 0;
+};
@@ -0,0 +1,211 @@
+#include "ShaderCompiler.h"
+
+#include <D3Dcompiler.h>
+#include <dxcapi.h>
+#include <wrl.h>
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+
+using Microsoft::WRL::ComPtr;
+
+// DXC objects are not free-threaded, each worker creates its own on first use
+struct DxcInstances {
+    ComPtr<IDxcCompiler> compiler;
+    ComPtr<IDxcLibrary> library;
+    ComPtr<IDxcIncludeHandler> includeHandler;
+};
+
+static DxcInstances& GetThreadDxc() {
+    thread_local DxcInstances instances;
+    if (!instances.compiler) {
+        if (FAILED(DxcCreateInstance(CLSID_DxcCompiler, IID_PPV_ARGS(&instances.compiler))) ||
+            FAILED(DxcCreateInstance(CLSID_DxcLibrary, IID_PPV_ARGS(&instances.library))) ||
+            FAILED(instances.library->CreateIncludeHandler(&instances.includeHandler))) {
+            instances = DxcInstances();
+            throw std::runtime_error("Cannot create the DXC compiler");
+        }
+    }
+    return instances;
+}
+
+ShaderCompiler::ShaderCompiler(ShaderCache* cache, ShaderBuild build, uint32_t threadCount) : m_cache(cache), m_build(build), m_pool(threadCount) {
+}
+
+ShaderFuture ShaderCompiler::CompileLibrary(const std::wstring& fileName, const ShaderDefines& defines) {
+    ShaderRequest request;
+    request.fileName = fileName;
+    request.target = "lib_6_3";
+    request.defines = defines;
+    request.flags = m_build == ShaderBuild::Optimized ? D3DCOMPILE_OPTIMIZATION_LEVEL3 : 0;
+    request.compiler = "dxc";
+    return Submit(request, &ShaderCompiler::CompileWithDxc);
+}
+
+ShaderFuture ShaderCompiler::Compile(const std::wstring& fileName, const std::string& target, const std::string& entryPoint,
+    const ShaderDefines& defines) {
+    ShaderRequest request;
+    request.fileName = fileName;
+    request.entryPoint = entryPoint;
+    request.target = target;
+    request.defines = defines;
+    request.flags = m_build == ShaderBuild::Optimized ? D3DCOMPILE_OPTIMIZATION_LEVEL3 : D3DCOMPILE_DEBUG | D3DCOMPILE_SKIP_OPTIMIZATION;
+    request.compiler = "d3dcompiler_" + std::to_string(D3D_COMPILER_VERSION);
+    return Submit(request, &ShaderCompiler::CompileWithFxc);
+}
+
+D3D12_SHADER_BYTECODE ShaderCompiler::Wait(const ShaderFuture& shader) {
+    D3D12_SHADER_BYTECODE bytecode = shader.get();
+    if (!bytecode.pShaderBytecode) { throw std::runtime_error("Cannot compile shader"); }
+    return bytecode;
+}
+
+bool ShaderCompiler::WriteArchive(LPCWSTR fileName) {
+    ShaderArchiveWriter writer;
+    for (const auto& requested : m_requested) {
+        D3D12_SHADER_BYTECODE bytecode = requested.second.get();
+        if (!bytecode.pShaderBytecode) return false;
+        writer.Add(requested.first, bytecode.pShaderBytecode, bytecode.BytecodeLength);
+    }
+    return writer.Write(fileName);
+}
+
+double ShaderCompiler::GetTotalCompileMs() const {
+    std::lock_guard<std::mutex> lock(m_statsMutex);
+    return m_totalCompileMs;
+}
+
+double ShaderCompiler::GetLongestCompileMs() const {
+    std::lock_guard<std::mutex> lock(m_statsMutex);
+    return m_longestCompileMs;
+}
+
+ShaderFuture ShaderCompiler::Submit(const ShaderRequest& request, bool (*compile)(const ShaderRequest&, ShaderBytecode*)) {
+    D3D12_SHADER_BYTECODE archived = {};
+    if (m_archive && m_archive->Find(request, &archived)) {
+        m_archiveHits++;
+        std::promise<D3D12_SHADER_BYTECODE> ready;
+        ready.set_value(archived);
+        ShaderFuture shader = ready.get_future().share();
+        m_requested.emplace_back(request, shader);
+        return shader;
+    }
+
+    ShaderFuture shader = m_pool.Submit([this, request, compile]() {
+        const ShaderBytecode* bytecode = m_cache->GetOrCompile(request, [&](ShaderBytecode* output) {
+            auto start = std::chrono::high_resolution_clock::now();
+            bool compiled = compile(request, output);
+            double ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+            std::lock_guard<std::mutex> lock(m_statsMutex);
+            m_totalCompileMs += ms;
+            m_longestCompileMs = (std::max)(m_longestCompileMs, ms);
+            return compiled;
+        });
+        D3D12_SHADER_BYTECODE result = {};
+        if (bytecode) result = { bytecode->data(), bytecode->size() };
+        return result;
+    }).share();
+    m_requested.emplace_back(request, shader);
+    return shader;
+}
+
+bool ShaderCompiler::CompileWithDxc(const ShaderRequest& request, ShaderBytecode* output) {
+    DxcInstances& dxc = GetThreadDxc();
+
+    // Open and read the file
+    std::ifstream shaderFile(request.fileName);
+    if (shaderFile.good() == false) { throw std::logic_error("Cannot find shader file"); }
+    std::stringstream strStream;
+    strStream << shaderFile.rdbuf();
+    std::string sShader = strStream.str();
+
+    // Create blob from the string
+    ComPtr<IDxcBlobEncoding> pTextBlob;
+    dxc.library->CreateBlobWithEncodingFromPinned((LPBYTE)sShader.c_str(), (uint32_t)sShader.size(), 0, &pTextBlob);
+    if (!pTextBlob) { throw std::logic_error("Cannot create blob file"); }
+
+    std::wstring entryPoint(request.entryPoint.begin(), request.entryPoint.end());
+    std::wstring target(request.target.begin(), request.target.end());
+
+    // DXC takes command line arguments instead of D3DCOMPILE flags
+    std::vector<LPCWSTR> arguments;
+    if (request.flags & D3DCOMPILE_DEBUG) arguments.push_back(L"-Zi");
+    if (request.flags & D3DCOMPILE_SKIP_OPTIMIZATION) arguments.push_back(L"-Od");
+    if ((request.flags & D3DCOMPILE_OPTIMIZATION_LEVEL2) == D3DCOMPILE_OPTIMIZATION_LEVEL3) arguments.push_back(L"-O3");
+
+    // DxcDefine points into the wide strings, which must not move once filled
+    std::vector<std::wstring> defineStrings;
+    defineStrings.reserve(2 * request.defines.size());
+    std::vector<DxcDefine> defines;
+    for (const auto& define : request.defines) {
+        defineStrings.emplace_back(define.first.begin(), define.first.end());
+        defineStrings.emplace_back(define.second.begin(), define.second.end());
+        defines.push_back({ defineStrings[defineStrings.size() - 2].c_str(), defineStrings.back().c_str() });
+    }
+
+    // Compile
+    ComPtr<IDxcOperationResult> pResult;
+    dxc.compiler->Compile(
+        pTextBlob.Get(), request.fileName.c_str(),
+        entryPoint.c_str(), target.c_str(),
+        arguments.data(), static_cast<UINT32>(arguments.size()),
+        defines.data(), static_cast<UINT32>(defines.size()),
+        dxc.includeHandler.Get(), &pResult);
+
+    // Verify the result
+    HRESULT resultCode;
+    pResult->GetStatus(&resultCode);
+    if (FAILED(resultCode)) {
+        ComPtr<IDxcBlobEncoding> pError;
+        HRESULT hr = pResult->GetErrorBuffer(&pError);
+        if (FAILED(hr)) { throw std::logic_error("Failed to get shader compiler error"); }
+
+        // Convert error blob to a string
+        std::vector<char> infoLog(pError->GetBufferSize() + 1);
+        memcpy(infoLog.data(), pError->GetBufferPointer(), pError->GetBufferSize());
+        infoLog[pError->GetBufferSize()] = 0;
+
+        std::string errorMsg = "Shader Compiler Error:\n";
+        errorMsg.append(infoLog.data());
+
+        MessageBoxA(nullptr, errorMsg.c_str(), "Error!", MB_OK);
+        throw std::logic_error("Failed compile shader");
+    }
+
+    ComPtr<IDxcBlob> pBlob;
+    pResult->GetResult(&pBlob);
+    const UINT8* data = static_cast<const UINT8*>(pBlob->GetBufferPointer());
+    output->assign(data, data + pBlob->GetBufferSize());
+    return true;
+}
+
+bool ShaderCompiler::CompileWithFxc(const ShaderRequest& request, ShaderBytecode* output) {
+    std::vector<D3D_SHADER_MACRO> macros;
+    for (const auto& define : request.defines) {
+        macros.push_back({ define.first.c_str(), define.second.c_str() });
+    }
+    macros.push_back({ nullptr, nullptr });
+
+    ComPtr<ID3DBlob> shader;
+    ComPtr<ID3DBlob> errorBuff;
+    HRESULT hr = D3DCompileFromFile(
+        request.fileName.c_str(),
+        macros.data(), nullptr,
+        request.entryPoint.c_str(), request.target.c_str(),
+        request.flags, 0,
+        &shader, &errorBuff);
+
+    if (FAILED(hr)) {
+        if (errorBuff) OutputDebugStringA((char*)errorBuff->GetBufferPointer());
+        return false;
+    }
+
+    const UINT8* data = static_cast<const UINT8*>(shader->GetBufferPointer());
+    output->assign(data, data + shader->GetBufferSize());
+    return true;
+}
@@ -0,0 +1,74 @@
+#pragma once
+#include <d3d12.h>
+
+#include <future>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "ShaderArchive.h"
+#include "ShaderCache.h"
+#include "WorkerPool.h"
+
+// Bytecode owned by the shader cache or the archive mapping, null if it failed to
+// compile. get() rethrows compile errors.
+typedef std::shared_future<D3D12_SHADER_BYTECODE> ShaderFuture;
+
+enum class ShaderBuild {
+	Debug,     // debug info, no optimization
+	Optimized, // what goes into the shader archive
+};
+
+// Compiles shaders on a worker pool, going through the shader archive and then the
+// shader cache first. Each worker keeps its own DXC compiler, library and include
+// handler for its lifetime, so DXC is only initialized once per thread.
+class ShaderCompiler {
+
+public:
+	// 0 uses one thread per hardware thread
+	explicit ShaderCompiler(ShaderCache* cache, ShaderBuild build = ShaderBuild::Debug, uint32_t threadCount = 0);
+
+	// Shaders found in the archive are served from it without compiling. The archive
+	// must stay open while their bytecode is in use.
+	void UseArchive(const MappedShaderArchive* archive) { m_archive = archive; }
+
+	// DXIL library for the raytracing pipeline, compiled with DXC
+	ShaderFuture CompileLibrary(const std::wstring& fileName, const ShaderDefines& defines = ShaderDefines());
+	// Shader model 5.x stage, compiled with D3DCompiler
+	ShaderFuture Compile(const std::wstring& fileName, const std::string& target, const std::string& entryPoint = "main",
+		const ShaderDefines& defines = ShaderDefines());
+
+	// Waits for the shader and throws if it failed to compile
+	static D3D12_SHADER_BYTECODE Wait(const ShaderFuture& shader);
+
+	// Waits for every shader requested so far and writes them to a shader archive
+	bool WriteArchive(LPCWSTR fileName);
+
+	UINT GetArchiveHitCount() const { return m_archiveHits; }
+
+	// Wall time spent compiling the shaders that missed the cache, summed and the longest
+	double GetTotalCompileMs() const;
+	double GetLongestCompileMs() const;
+
+private:
+	static bool CompileWithDxc(const ShaderRequest& request, ShaderBytecode* output);
+	static bool CompileWithFxc(const ShaderRequest& request, ShaderBytecode* output);
+
+	ShaderFuture Submit(const ShaderRequest& request, bool (*compile)(const ShaderRequest&, ShaderBytecode*));
+
+	ShaderCache* m_cache;
+	ShaderBuild m_build;
+	const MappedShaderArchive* m_archive = nullptr;
+	UINT m_archiveHits = 0;
+
+	// Everything requested, in order, for WriteArchive. Requests come from one thread.
+	std::vector<std::pair<ShaderRequest, ShaderFuture>> m_requested;
+
+	mutable std::mutex m_statsMutex;
+	double m_totalCompileMs = 0.0;
+	double m_longestCompileMs = 0.0;
+
+	// Last member, joined before the rest of the compiler goes away
+	WorkerPool m_pool;
+};
@@ -0,0 +1,14 @@
+#include "ShaderFeatures.h"
+
+static const char* const ShaderFeatureNames[ShaderFeatureCount] = {
+    "SHADOWS",
+    "SOFT_PARTICLES",
+};
+
+ShaderDefines GetShaderFeatureDefines(UINT32 features, UINT32 featureMask) {
+    ShaderDefines defines;
+    for (UINT32 i = 0; i < ShaderFeatureCount; i++) {
+        if (featureMask & (1u << i)) defines.emplace_back(ShaderFeatureNames[i], features & (1u << i) ? "1" : "0");
+    }
+    return defines;
+}
@@ -0,0 +1,50 @@
+#pragma once
+#include <windows.h>
+
+#include "ShaderCache.h"
+
+// Optional shader features. Each bit is a define set to 0 or 1, a shader is compiled
+// once per combination of the features it supports, so no variant branches on them.
+enum ShaderFeature : UINT32 {
+	ShaderFeatureShadows = 1 << 0,       // SHADOWS: closest hit shaders trace a shadow ray
+	ShaderFeatureSoftParticles = 1 << 1, // SOFT_PARTICLES: particles fade out from their center
+};
+static const UINT32 ShaderFeatureCount = 2;
+
+// Define of every feature in `featureMask`, 1 if it is in `features` and 0 otherwise
+ShaderDefines GetShaderFeatureDefines(UINT32 features, UINT32 featureMask);
+
+// Feature bits as constants, the CPU side of a variant is specialized on them
+template <UINT32 Features>
+struct ShaderFeatureSet {
+	static constexpr UINT32 Bits = Features;
+	static constexpr bool Shadows = (Features & ShaderFeatureShadows) != 0;
+	static constexpr bool SoftParticles = (Features & ShaderFeatureSoftParticles) != 0;
+};
+
+namespace ShaderFeatureDispatch {
+
+// Walks the subsets of FeatureMask from the largest down to the one matching
+template <UINT32 FeatureMask, UINT32 Subset>
+struct Subsets {
+	template <typename Function>
+	static void Call(UINT32 features, Function& function) {
+		if (features == Subset) function(ShaderFeatureSet<Subset>());
+		else Subsets<FeatureMask, (Subset - 1) & FeatureMask>::Call(features, function);
+	}
+};
+
+template <UINT32 FeatureMask>
+struct Subsets<FeatureMask, 0> {
+	template <typename Function>
+	static void Call(UINT32, Function& function) { function(ShaderFeatureSet<0>()); }
+};
+
+}
+
+// Calls `function(ShaderFeatureSet<F>())` with F the bits of `features` in FeatureMask.
+// Every combination is instantiated, the runtime bits only pick one of them.
+template <UINT32 FeatureMask, typename Function>
+void WithShaderFeatures(UINT32 features, Function function) {
+	ShaderFeatureDispatch::Subsets<FeatureMask, FeatureMask>::Call(features & FeatureMask, function);
+}
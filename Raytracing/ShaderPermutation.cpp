@@ -0,0 +1,50 @@
+#include "ShaderPermutation.h"
+
+// One variant per subset of the mask
+static UINT GetVariantCount(UINT32 featureMask) {
+    UINT count = 1;
+    for (UINT32 i = 0; i < ShaderFeatureCount; i++) {
+        if (featureMask & (1u << i)) count *= 2;
+    }
+    return count;
+}
+
+void ShaderPermutations::CompileLibrary(ShaderCompiler* compiler, const std::wstring& fileName, UINT32 featureMask) {
+    m_featureMask = featureMask;
+    m_variants.clear();
+    for (UINT i = 0; i < GetVariantCount(featureMask); i++) {
+        m_variants.push_back(compiler->CompileLibrary(fileName, GetShaderFeatureDefines(GetFeatures(i), m_featureMask)));
+    }
+}
+
+void ShaderPermutations::Compile(ShaderCompiler* compiler, const std::wstring& fileName, const std::string& target,
+    const std::string& entryPoint, UINT32 featureMask) {
+    m_featureMask = featureMask;
+    m_variants.clear();
+    for (UINT i = 0; i < GetVariantCount(featureMask); i++) {
+        m_variants.push_back(compiler->Compile(fileName, target, entryPoint, GetShaderFeatureDefines(GetFeatures(i), m_featureMask)));
+    }
+}
+
+// The supported feature bits packed together, lowest first
+UINT ShaderPermutations::GetIndex(UINT32 features) const {
+    UINT index = 0;
+    UINT position = 0;
+    for (UINT32 i = 0; i < ShaderFeatureCount; i++) {
+        if (!(m_featureMask & (1u << i))) continue;
+        if (features & (1u << i)) index |= 1u << position;
+        position++;
+    }
+    return index;
+}
+
+UINT32 ShaderPermutations::GetFeatures(UINT index) const {
+    UINT32 features = 0;
+    UINT position = 0;
+    for (UINT32 i = 0; i < ShaderFeatureCount; i++) {
+        if (!(m_featureMask & (1u << i))) continue;
+        if (index & (1u << position)) features |= 1u << i;
+        position++;
+    }
+    return features;
+}
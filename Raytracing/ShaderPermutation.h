@@ -0,0 +1,35 @@
+#pragma once
+#include <d3d12.h>
+
+#include <string>
+#include <vector>
+
+#include "ShaderCompiler.h"
+#include "ShaderFeatures.h"
+
+// Every variant of one shader, submitted to the compiler together so they build in
+// parallel and all land in the shader archive.
+class ShaderPermutations {
+
+public:
+	ShaderPermutations() {}
+
+	void CompileLibrary(ShaderCompiler* compiler, const std::wstring& fileName, UINT32 featureMask);
+	void Compile(ShaderCompiler* compiler, const std::wstring& fileName, const std::string& target,
+		const std::string& entryPoint, UINT32 featureMask);
+
+	// Variant for `features`, features the shader does not support are ignored
+	const ShaderFuture& Get(UINT32 features) const { return m_variants[GetIndex(features)]; }
+
+	// Dense index of the variant in [0, GetCount()), to keep objects built per variant
+	UINT GetIndex(UINT32 features) const;
+	UINT GetCount() const { return static_cast<UINT>(m_variants.size()); }
+	UINT32 GetFeatureMask() const { return m_featureMask; }
+
+	// Features of the variant at `index`
+	UINT32 GetFeatures(UINT index) const;
+
+private:
+	UINT32 m_featureMask = 0;
+	std::vector<ShaderFuture> m_variants;
+};
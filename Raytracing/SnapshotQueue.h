@@ -0,0 +1,50 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+
+// Lock-free single producer / single consumer ring. The producer only touches
+// m_head and the consumer only m_tail, so neither side ever blocks the other.
+template <typename T, size_t Capacity>
+class SnapshotQueue {
+	static_assert(Capacity > 0 && (Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+public:
+	SnapshotQueue() : m_head(0), m_tail(0) {}
+
+	SnapshotQueue(const SnapshotQueue&) = delete;
+	SnapshotQueue& operator=(const SnapshotQueue&) = delete;
+
+	// Producer side. Returns false when the consumer has fallen Capacity items behind.
+	bool Push(const T& item) {
+		size_t head = m_head.load(std::memory_order_relaxed);
+		if (head - m_tail.load(std::memory_order_acquire) == Capacity) return false;
+		m_items[head & (Capacity - 1)] = item;
+		m_head.store(head + 1, std::memory_order_release);
+		return true;
+	}
+
+	// Consumer side
+	bool Pop(T& item) {
+		size_t tail = m_tail.load(std::memory_order_relaxed);
+		if (tail == m_head.load(std::memory_order_acquire)) return false;
+		item = m_items[tail & (Capacity - 1)];
+		m_tail.store(tail + 1, std::memory_order_release);
+		return true;
+	}
+
+	// Drains the queue, leaving only the newest item in `item`
+	bool PopLatest(T& item) {
+		bool popped = false;
+		while (Pop(item)) popped = true;
+		return popped;
+	}
+
+private:
+	// Keep the two indices on separate cache lines
+	std::atomic<size_t> m_head;
+	char m_headPadding[64 - sizeof(std::atomic<size_t>)];
+	std::atomic<size_t> m_tail;
+	char m_tailPadding[64 - sizeof(std::atomic<size_t>)];
+
+	T m_items[Capacity];
+};
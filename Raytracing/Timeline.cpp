@@ -0,0 +1,178 @@
+#include "Timeline.h"
+
+#include <algorithm>
+#include <chrono>
+
+// Bound on how long the worker waits on the backend, so callbacks registered
+// for earlier points are picked up without an extra wake-up mechanism.
+static const uint32_t WorkerPollMs = 2;
+
+Timeline::Timeline(FenceBackend* backend) : m_backend(backend), m_terminating(false) {
+    m_worker = std::thread(&Timeline::WorkerLoop, this);
+}
+
+Timeline::~Timeline() {
+    {
+        // Set under the lock, the worker would otherwise miss the notification between
+        // checking the flag and going to sleep and never return from join
+        std::lock_guard<std::mutex> lock(m_callbackMutex);
+        m_terminating = true;
+    }
+    m_callbackAdded.notify_all();
+    if (m_worker.joinable()) m_worker.join();
+}
+
+TimelinePoint Timeline::Signal(uint32_t queue) {
+    std::lock_guard<std::mutex> lock(m_signalMutex);
+    // Queues may be added to the backend after the timeline was created
+    if (queue >= m_signaled.size()) m_signaled.resize(queue + 1, 0);
+    uint64_t value = ++m_signaled[queue];
+    m_backend->Signal(queue, value);
+    return { queue, value };
+}
+
+TimelinePoint Timeline::GetLastSignaled(uint32_t queue) const {
+    std::lock_guard<std::mutex> lock(m_signalMutex);
+    return { queue, queue < m_signaled.size() ? m_signaled[queue] : 0 };
+}
+
+uint64_t Timeline::GetCompletedValue(uint32_t queue) {
+    return m_backend->GetCompletedValue(queue);
+}
+
+bool Timeline::IsComplete(TimelinePoint point) {
+    return m_backend->GetCompletedValue(point.queue) >= point.value;
+}
+
+void Timeline::Wait(TimelinePoint point) {
+    if (IsComplete(point)) return;
+    m_backend->Wait(&point, 1, true, TimelineInfinite);
+}
+
+int Timeline::WaitAny(const std::vector<TimelinePoint>& points, uint32_t timeoutMs) {
+    for (size_t i = 0; i < points.size(); i++) {
+        if (IsComplete(points[i])) return static_cast<int>(i);
+    }
+    if (points.empty()) return -1;
+    if (!m_backend->Wait(points.data(), static_cast<uint32_t>(points.size()), false, timeoutMs)) return -1;
+
+    for (size_t i = 0; i < points.size(); i++) {
+        if (IsComplete(points[i])) return static_cast<int>(i);
+    }
+    return -1;
+}
+
+bool Timeline::WaitAll(const std::vector<TimelinePoint>& points, uint32_t timeoutMs) {
+    std::vector<TimelinePoint> pending;
+    for (const auto& point : points) {
+        if (!IsComplete(point)) pending.push_back(point);
+    }
+    if (pending.empty()) return true;
+    return m_backend->Wait(pending.data(), static_cast<uint32_t>(pending.size()), true, timeoutMs);
+}
+
+void Timeline::WaitIdle(uint32_t queue) {
+    Wait(GetLastSignaled(queue));
+}
+
+void Timeline::OnComplete(TimelinePoint point, std::function<void()> callback) {
+    {
+        std::lock_guard<std::mutex> lock(m_callbackMutex);
+        m_callbacks.push_back({ point, std::move(callback) });
+    }
+    m_callbackAdded.notify_one();
+}
+
+void Timeline::Flush() {
+    std::unique_lock<std::mutex> lock(m_callbackMutex);
+    m_callbacksDone.wait(lock, [this]() { return m_callbacks.empty() && m_running == 0; });
+}
+
+void Timeline::WorkerLoop() {
+    std::vector<Callback> ready;
+    std::vector<TimelinePoint> points;
+
+    while (!m_terminating) {
+        {
+            std::unique_lock<std::mutex> lock(m_callbackMutex);
+            m_callbackAdded.wait(lock, [this]() { return m_terminating || !m_callbacks.empty(); });
+            if (m_terminating) break;
+
+            // Split the completed callbacks off, keeping registration order
+            auto firstPending = std::stable_partition(m_callbacks.begin(), m_callbacks.end(),
+                [this](const Callback& c) { return IsComplete(c.point); });
+            ready.assign(std::make_move_iterator(m_callbacks.begin()), std::make_move_iterator(firstPending));
+            m_callbacks.erase(m_callbacks.begin(), firstPending);
+            m_running = static_cast<uint32_t>(ready.size());
+
+            points.clear();
+            for (const auto& c : m_callbacks) points.push_back(c.point);
+        }
+
+        for (auto& c : ready) c.callback();
+        ready.clear();
+
+        {
+            std::lock_guard<std::mutex> lock(m_callbackMutex);
+            m_running = 0;
+            if (m_callbacks.empty()) m_callbacksDone.notify_all();
+        }
+
+        if (!points.empty()) {
+            m_backend->Wait(points.data(), static_cast<uint32_t>(points.size()), false, WorkerPollMs);
+        }
+    }
+}
+
+
+MockFenceBackend::MockFenceBackend(uint32_t queueCount, bool autoComplete) {
+    m_autoComplete = autoComplete;
+    m_completed.resize(queueCount, 0);
+    m_signaled.resize(queueCount, 0);
+}
+
+void MockFenceBackend::Signal(uint32_t queue, uint64_t value) {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_signaled[queue] = value;
+        if (m_autoComplete) m_completed[queue] = value;
+    }
+    m_changed.notify_all();
+}
+
+uint64_t MockFenceBackend::GetCompletedValue(uint32_t queue) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_completed[queue];
+}
+
+bool MockFenceBackend::Wait(const TimelinePoint* points, uint32_t count, bool waitAll, uint32_t timeoutMs) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    auto satisfied = [&]() { return Satisfied(points, count, waitAll); };
+    if (timeoutMs == TimelineInfinite) {
+        m_changed.wait(lock, satisfied);
+        return true;
+    }
+    return m_changed.wait_for(lock, std::chrono::milliseconds(timeoutMs), satisfied);
+}
+
+void MockFenceBackend::Complete(uint32_t queue, uint64_t value) {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_completed[queue] = (std::max)(m_completed[queue], value);
+    }
+    m_changed.notify_all();
+}
+
+uint64_t MockFenceBackend::GetSignaledValue(uint32_t queue) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_signaled[queue];
+}
+
+bool MockFenceBackend::Satisfied(const TimelinePoint* points, uint32_t count, bool waitAll) const {
+    for (uint32_t i = 0; i < count; i++) {
+        bool complete = m_completed[points[i].queue] >= points[i].value;
+        if (complete && !waitAll) return true;
+        if (!complete && waitAll) return false;
+    }
+    return waitAll;
+}
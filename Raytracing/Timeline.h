@@ -0,0 +1,113 @@
+#pragma once
+#include <cstdint>
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Position on a queue's timeline: the work signaled on `queue` up to `value`.
+struct TimelinePoint {
+	uint32_t queue;
+	uint64_t value;
+};
+
+static const uint32_t TimelineInfinite = 0xFFFFFFFF;
+
+// What the timeline needs from the fences. The D3D12 backend wraps one ID3D12Fence
+// per queue, the mock backend completes values on request so the scheduling logic
+// can run without a device.
+class FenceBackend {
+
+public:
+	virtual ~FenceBackend() {}
+
+	virtual uint32_t GetQueueCount() const = 0;
+	virtual void Signal(uint32_t queue, uint64_t value) = 0;
+	virtual uint64_t GetCompletedValue(uint32_t queue) = 0;
+
+	// Blocks until any (or all) of the points completed, or the timeout expired.
+	// Returns false on timeout.
+	virtual bool Wait(const TimelinePoint* points, uint32_t count, bool waitAll, uint32_t timeoutMs) = 0;
+};
+
+// Monotonic per-queue fence values with blocking waits, non-blocking completion
+// queries and completion callbacks executed on a worker thread.
+class Timeline {
+
+public:
+	explicit Timeline(FenceBackend* backend);
+	~Timeline();
+
+	Timeline(const Timeline&) = delete;
+	Timeline& operator=(const Timeline&) = delete;
+
+	// Signals the next value on `queue` after the work already submitted to it
+	TimelinePoint Signal(uint32_t queue);
+	TimelinePoint GetLastSignaled(uint32_t queue) const;
+	uint64_t GetCompletedValue(uint32_t queue);
+
+	// Non-blocking
+	bool IsComplete(TimelinePoint point);
+
+	void Wait(TimelinePoint point);
+	// Index of a completed point, or -1 on timeout
+	int WaitAny(const std::vector<TimelinePoint>& points, uint32_t timeoutMs = TimelineInfinite);
+	bool WaitAll(const std::vector<TimelinePoint>& points, uint32_t timeoutMs = TimelineInfinite);
+	void WaitIdle(uint32_t queue);
+
+	// Runs `callback` on the worker thread once `point` completed. Callbacks for
+	// points that already completed run on the next worker iteration.
+	void OnComplete(TimelinePoint point, std::function<void()> callback);
+
+	// Blocks until every registered callback has run
+	void Flush();
+
+private:
+	struct Callback {
+		TimelinePoint point;
+		std::function<void()> callback;
+	};
+
+	void WorkerLoop();
+
+	FenceBackend* m_backend = nullptr;
+	std::vector<uint64_t> m_signaled;
+	mutable std::mutex m_signalMutex;
+
+	std::vector<Callback> m_callbacks;
+	uint32_t m_running = 0;
+	std::mutex m_callbackMutex;
+	std::condition_variable m_callbackAdded;
+	std::condition_variable m_callbacksDone;
+	std::atomic<bool> m_terminating;
+	std::thread m_worker;
+};
+
+// Backend without a device: a queue completes a value when the test says so, or
+// immediately on Signal when `autoComplete` is set.
+class MockFenceBackend : public FenceBackend {
+
+public:
+	MockFenceBackend(uint32_t queueCount, bool autoComplete = false);
+
+	uint32_t GetQueueCount() const override { return static_cast<uint32_t>(m_completed.size()); }
+	void Signal(uint32_t queue, uint64_t value) override;
+	uint64_t GetCompletedValue(uint32_t queue) override;
+	bool Wait(const TimelinePoint* points, uint32_t count, bool waitAll, uint32_t timeoutMs) override;
+
+	// Simulates the GPU reaching `value` on `queue`
+	void Complete(uint32_t queue, uint64_t value);
+	uint64_t GetSignaledValue(uint32_t queue);
+
+private:
+	bool Satisfied(const TimelinePoint* points, uint32_t count, bool waitAll) const;
+
+	bool m_autoComplete = false;
+	std::vector<uint64_t> m_completed;
+	std::vector<uint64_t> m_signaled;
+	std::mutex m_mutex;
+	std::condition_variable m_changed;
+};
@@ -0,0 +1,171 @@
+#include "TopLevelInstances.h"
+
+#include <algorithm>
+#include <cstring>
+
+using namespace DirectX;
+
+void TopLevelInstances::Init(UINT slotCount, WorkerPool* pool) {
+    m_pool = pool;
+    m_instances.clear();
+    for (auto& element : m_elements) element.clear();
+    m_bottomLevels.clear();
+    m_changes.clear();
+    m_version = 0;
+    m_bottomLevelVersion = 0;
+    m_changesStart = 0;
+    m_rebuild = true;
+    m_motion = 0.0f;
+    m_slotVersions.assign(slotCount, 0);
+    m_slotBuilds.assign(slotCount, SlotBuild{});
+    m_culled = false;
+    m_visible.clear();
+    m_descIndices.clear();
+}
+
+UINT TopLevelInstances::Add(UINT blas, FXMMATRIX transform) {
+    Instance instance = {};
+    instance.transform = transform;
+    instance.built = transform;
+    instance.blas = blas;
+    m_instances.push_back(instance);
+    for (auto& element : m_elements) element.push_back(0.0f);
+    m_bottomLevels.push_back(blas);
+    if (m_culled) m_descIndices.push_back(UINT(NotVisible)); // until the next SetVisible
+
+    // The instance count changed, the next build cannot be an update
+    UINT index = static_cast<UINT>(m_instances.size() - 1);
+    StoreElements(index);
+    Changed(index);
+    m_rebuild = true;
+    return index;
+}
+
+void TopLevelInstances::SetTransform(UINT index, FXMMATRIX transform) {
+    Instance& instance = m_instances[index];
+    if (memcmp(&instance.transform, &transform, sizeof(XMMATRIX)) == 0) return;
+
+    instance.transform = transform;
+    StoreElements(index);
+    float motion = GetMotion(instance.built, instance.transform);
+    m_motion += motion - instance.motion;
+    instance.motion = motion;
+    Changed(index);
+}
+
+void TopLevelInstances::Invalidate() {
+    for (UINT i = 0; i < GetCount(); i++) Changed(i);
+    m_rebuild = true;
+}
+
+void TopLevelInstances::SetVisible(const std::vector<UINT>& visible) {
+    if (m_culled && visible == m_visible) return;
+
+    m_culled = true;
+    m_visible = visible;
+    m_descIndices.assign(m_instances.size(), UINT(NotVisible));
+    for (UINT i = 0; i < m_visible.size(); i++) m_descIndices[m_visible[i]] = i;
+
+    // Every slot is older than the new start, the next build cannot be an update
+    m_changes.clear();
+    m_changesStart = ++m_version;
+    m_rebuild = true;
+    m_visibleChanges++;
+}
+
+bool TopLevelInstances::IsBuilt(UINT slot) const {
+    const SlotBuild& build = m_slotBuilds[slot];
+    return !m_rebuild && build.built && build.version == m_version && build.bottomLevelVersion == m_bottomLevelVersion;
+}
+
+bool TopLevelInstances::NeedsRebuild() const {
+    if (m_rebuild) return true;
+    return !m_instances.empty() && m_motion > RebuildMotion * static_cast<float>(m_instances.size());
+}
+
+UINT TopLevelInstances::WriteSlot(UINT slot, D3D12_RAYTRACING_INSTANCE_DESC* descs, const BlasManager& blas) {
+    UINT64 slotVersion = m_slotVersions[slot];
+    m_slotVersions[slot] = m_version;
+
+    UINT written = 0;
+    if (slotVersion < m_changesStart) {
+        std::vector<D3D12_GPU_VIRTUAL_ADDRESS> addresses(blas.GetCount());
+        for (UINT i = 0; i < blas.GetCount(); i++) addresses[i] = blas.Get(i).address;
+
+        InstanceDescSource source = {};
+        for (int e = 0; e < 12; e++) source.elements[e] = m_elements[e].data();
+        source.bottomLevels = m_bottomLevels.data();
+        source.indices = m_culled ? m_visible.data() : nullptr;
+        source.addresses = addresses.data();
+        source.hitGroupStride = 2;
+        WriteInstanceDescsParallel(m_pool, source, GetVisibleCount(), descs);
+        written = GetVisibleCount();
+    } else {
+        auto first = std::upper_bound(m_changes.begin(), m_changes.end(), std::make_pair(slotVersion, ~0u));
+        for (auto change = first; change != m_changes.end(); ++change) {
+            const Instance& instance = m_instances[change->second];
+            if (instance.version != change->first) continue; // changed again later in the list
+            UINT desc = m_culled ? m_descIndices[change->second] : change->second;
+            if (desc == NotVisible) continue;
+            WriteDesc(instance, descs + desc, blas);
+            written++;
+        }
+    }
+    m_written += written;
+    return written;
+}
+
+void TopLevelInstances::OnBuilt(UINT slot, bool rebuilt) {
+    m_slotBuilds[slot] = { true, m_version, m_bottomLevelVersion };
+    if (!rebuilt) {
+        m_updates++;
+        return;
+    }
+
+    m_rebuilds++;
+    m_rebuild = false;
+    m_motion = 0.0f;
+    for (auto& instance : m_instances) {
+        instance.built = instance.transform;
+        instance.motion = 0.0f;
+    }
+}
+
+float TopLevelInstances::GetMotion(FXMMATRIX from, CXMMATRIX to) {
+    // How far the basis vectors and the origin travelled, in scene units for a unit sized mesh
+    float motion = 0.0f;
+    for (int row = 0; row < 4; row++) {
+        motion += XMVectorGetX(XMVector3Length(XMVectorSubtract(to.r[row], from.r[row])));
+    }
+    return motion;
+}
+
+void TopLevelInstances::WriteDesc(const Instance& instance, D3D12_RAYTRACING_INSTANCE_DESC* desc, const BlasManager& blas) {
+    // Instances of a mesh share its BLAS, its geometry record and its hit records
+    desc->InstanceID = instance.blas;
+    desc->InstanceContributionToHitGroupIndex = 2 * instance.blas;
+    desc->Flags = D3D12_RAYTRACING_INSTANCE_FLAG_NONE;
+    XMMATRIX m = XMMatrixTranspose(instance.transform);
+    memcpy(desc->Transform, &m, sizeof(desc->Transform));
+    desc->AccelerationStructure = blas.Get(instance.blas).address;
+    desc->InstanceMask = 0xFF;
+}
+
+void TopLevelInstances::StoreElements(UINT index) {
+    XMFLOAT3X4 desc;
+    XMStoreFloat3x4(&desc, m_instances[index].transform);
+    for (int row = 0; row < 3; row++) {
+        for (int column = 0; column < 4; column++) m_elements[4 * row + column][index] = desc.m[row][column];
+    }
+}
+
+void TopLevelInstances::Changed(UINT index) {
+    // Once the list outgrows the instances, lagging slots are cheaper to write in full
+    if (m_changes.size() >= m_instances.size()) {
+        m_changes.clear();
+        m_changesStart = m_version;
+    }
+
+    m_instances[index].version = ++m_version;
+    m_changes.push_back({ m_version, index });
+}
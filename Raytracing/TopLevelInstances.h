@@ -0,0 +1,110 @@
+#pragma once
+#include <d3d12.h>
+#include <DirectXMath.h>
+
+#include <utility>
+#include <vector>
+
+#include "BlasManager.h"
+#include "InstanceDescKernel.h"
+#include "WorkerPool.h"
+
+// The instances of the TLAS, each with a version bumped whenever its transform changes.
+// Every frame context has its own slot of instance descs that remembers the version it
+// was written at, so only the instances changed since then are written again. Each slot
+// also has its own TLAS. When no transform changed since a slot was built it is left as
+// it is, otherwise it is updated from the newest TLAS until the instances moved far
+// enough from where the last full build put them that the updated tree has degraded,
+// then it is rebuilt.
+class TopLevelInstances {
+
+public:
+	// Average motion per instance (see GetMotion) past which updates give way to a rebuild
+	static constexpr float RebuildMotion = 2.0f;
+
+	TopLevelInstances() {}
+
+	// Full slot writes are split over `pool` when given
+	void Init(UINT slotCount, WorkerPool* pool = nullptr);
+
+	UINT Add(UINT blas, DirectX::FXMMATRIX transform);
+	// Bumps the version of the instance if the transform differs
+	void SetTransform(UINT index, DirectX::FXMMATRIX transform);
+	// A BLAS moved: every desc is written again and the next build is a full one
+	void Invalidate();
+	// A BLAS was refit or rebuilt in place: the descs still hold, but the TLAS has to be
+	// updated for the new bounds
+	void BottomLevelsUpdated() { m_bottomLevelVersion++; }
+	// Limits the TLAS to the instances of `visible`, ascending, its descs in that order.
+	// Another set moves the descs: every slot is written in full and the TLAS rebuilt.
+	void SetVisible(const std::vector<UINT>& visible);
+
+	UINT GetCount() const { return static_cast<UINT>(m_instances.size()); }
+	// Descs in the TLAS, every instance until SetVisible is called
+	UINT GetVisibleCount() const { return m_culled ? static_cast<UINT>(m_visible.size()) : GetCount(); }
+	UINT GetBottomLevel(UINT index) const { return m_instances[index].blas; }
+	const DirectX::XMMATRIX& GetTransform(UINT index) const { return m_instances[index].transform; }
+	// The transforms as the descs hold them, element 4 * row + column of every instance
+	const std::vector<float>& GetElements(UINT element) const { return m_elements[element]; }
+	const std::vector<UINT>& GetBottomLevels() const { return m_bottomLevels; }
+
+	// Nothing changed since the TLAS of `slot` was built, it is current
+	bool IsBuilt(UINT slot) const;
+	bool NeedsRebuild() const;
+
+	// Brings `slot` up to date, returns how many descs were written
+	UINT WriteSlot(UINT slot, D3D12_RAYTRACING_INSTANCE_DESC* descs, const BlasManager& blas);
+	void OnBuilt(UINT slot, bool rebuilt);
+
+	UINT64 GetUpdateCount() const { return m_updates; }
+	UINT64 GetRebuildCount() const { return m_rebuilds; }
+	UINT64 GetWrittenCount() const { return m_written; } // instance descs written in total
+	UINT64 GetVisibleChangeCount() const { return m_visibleChanges; }
+
+private:
+	struct Instance {
+		DirectX::XMMATRIX transform;
+		DirectX::XMMATRIX built;     // transform at the last full build
+		UINT blas;
+		UINT64 version;
+		float motion;                // from `built` to `transform`
+	};
+
+	struct SlotBuild {
+		bool built;
+		UINT64 version;
+		UINT64 bottomLevelVersion;
+	};
+
+	static float GetMotion(DirectX::FXMMATRIX from, DirectX::CXMMATRIX to);
+	static void WriteDesc(const Instance& instance, D3D12_RAYTRACING_INSTANCE_DESC* desc, const BlasManager& blas);
+	void Changed(UINT index);
+	void StoreElements(UINT index);
+
+	WorkerPool* m_pool = nullptr;
+	std::vector<Instance> m_instances;
+	// The same transforms as structure of arrays for the instance desc kernel
+	std::vector<float> m_elements[12];
+	std::vector<UINT> m_bottomLevels;
+	UINT64 m_version = 0;
+	UINT64 m_bottomLevelVersion = 0;
+	bool m_rebuild = true;
+	float m_motion = 0.0f;
+
+	// Changes in version order. Older entries of an instance are stale once it changed
+	// again. Slots older than m_changesStart missed dropped entries and are written in full.
+	std::vector<std::pair<UINT64, UINT>> m_changes; // version, instance
+	UINT64 m_changesStart = 0;
+	std::vector<UINT64> m_slotVersions;
+	std::vector<SlotBuild> m_slotBuilds; // what the TLAS of each slot was built from
+
+	static const UINT NotVisible = ~0u;
+	bool m_culled = false;
+	std::vector<UINT> m_visible;
+	std::vector<UINT> m_descIndices; // per instance, its desc in the slots or NotVisible
+
+	UINT64 m_updates = 0;
+	UINT64 m_rebuilds = 0;
+	UINT64 m_written = 0;
+	UINT64 m_visibleChanges = 0;
+};
@@ -0,0 +1,123 @@
+#include "UploadRing.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+static const UINT64 UploadChunkAlignment = 256;
+static const UINT64 UploadStreamParts = 4;
+
+void UploadRing::Init(ID3D12Device* device, MemoryTracker* memory, UINT64 size) {
+    m_size = (size + 0xFFFF) & ~0xFFFFull;
+
+    D3D12_RESOURCE_DESC resourceDesc = {};
+    resourceDesc.Dimension = D3D12_RESOURCE_DIMENSION_BUFFER;
+    resourceDesc.Alignment = 0;
+    resourceDesc.Width = m_size;
+    resourceDesc.Height = 1;
+    resourceDesc.DepthOrArraySize = 1;
+    resourceDesc.MipLevels = 1;
+    resourceDesc.Format = DXGI_FORMAT_UNKNOWN;
+    resourceDesc.SampleDesc.Count = 1;
+    resourceDesc.SampleDesc.Quality = 0;
+    resourceDesc.Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR;
+    resourceDesc.Flags = D3D12_RESOURCE_FLAG_NONE;
+
+    D3D12_HEAP_PROPERTIES heapProperties = {};
+    heapProperties.Type = D3D12_HEAP_TYPE_UPLOAD;
+    heapProperties.CPUPageProperty = D3D12_CPU_PAGE_PROPERTY_UNKNOWN;
+    heapProperties.MemoryPoolPreference = D3D12_MEMORY_POOL_UNKNOWN;
+    heapProperties.CreationNodeMask = 1;
+    heapProperties.VisibleNodeMask = 1;
+
+    HRESULT hr = device->CreateCommittedResource(
+        &heapProperties,
+        D3D12_HEAP_FLAG_NONE,
+        &resourceDesc,
+        D3D12_RESOURCE_STATE_GENERIC_READ,
+        nullptr,
+        IID_PPV_ARGS(&m_buffer));
+    if (FAILED(hr)) { throw std::runtime_error("Cannot create the upload ring"); }
+    if (memory) memory->Track(m_buffer.Get(), L"Upload Ring", MemoryCategory::Upload, ResidencyPriority::Pinned);
+
+    D3D12_RANGE range = { 0, 0 };
+    m_buffer->Map(0, &range, reinterpret_cast<void**>(&m_data));
+    Reset();
+}
+
+bool UploadRing::Allocate(UINT64 size, UINT64 alignment, UINT8** cpuAddress, UINT64* offset) {
+    if (size > m_size) return false;
+
+    UINT64 start = (m_head + alignment - 1) & ~(alignment - 1);
+    UINT64 position = start % m_size;
+    if (position + size > m_size) {
+        // Skip the tail end of the buffer so the allocation stays contiguous
+        start += m_size - position;
+        position = 0;
+    }
+    if (start + size - m_tail > m_size) return false;
+
+    m_head = start + size;
+    *cpuAddress = m_data + position;
+    *offset = position;
+    return true;
+}
+
+void UploadRing::Submit(UINT64 fenceValue) {
+    if (!m_pending.empty() && m_pending.back().second == m_head) return;
+    m_pending.push_back({ fenceValue, m_head });
+}
+
+void UploadRing::Retire(UINT64 completedFenceValue) {
+    while (!m_pending.empty() && m_pending.front().first <= completedFenceValue) {
+        m_tail = m_pending.front().second;
+        m_pending.pop_front();
+    }
+}
+
+void UploadRing::Reset() {
+    // Everything has retired, restart at the beginning of the buffer
+    m_pending.clear();
+    m_head = (m_head + m_size - 1) / m_size * m_size;
+    m_tail = m_head;
+}
+
+void UploadRing::CopyBuffer(ID3D12GraphicsCommandList* commandList,
+    ID3D12Resource* destination, UINT64 destinationOffset,
+    const void* source, UINT64 size,
+    const UploadSync& sync) {
+
+    const UINT8* src = static_cast<const UINT8*>(source);
+
+    while (size > 0) {
+        UINT64 chunk = (std::min)(size, m_size / UploadStreamParts);
+        UINT8* cpuAddress = nullptr;
+        UINT64 offset = 0;
+        if (!Allocate(chunk, UploadChunkAlignment, &cpuAddress, &offset)) {
+            // Copies recorded since the last Submit hold ring space no fence covers yet
+            UINT64 submitted = m_pending.empty() ? m_tail : m_pending.back().second;
+            if (m_head != submitted) {
+                sync.submit();
+                if (m_pending.empty() || m_pending.back().second != m_head) {
+                    throw std::logic_error("UploadSync::submit did not submit the ring");
+                }
+            }
+
+            // Retire the oldest submission, the newer ones keep the GPU busy meanwhile
+            if (!m_pending.empty()) {
+                UINT64 fenceValue = m_pending.front().first;
+                sync.wait(fenceValue);
+                Retire(fenceValue);
+            }
+            // Nothing left in flight, start over at the beginning of the buffer
+            if (m_pending.empty()) Reset();
+            continue;
+        }
+
+        memcpy(cpuAddress, src, static_cast<size_t>(chunk));
+        commandList->CopyBufferRegion(destination, destinationOffset, m_buffer.Get(), offset, chunk);
+
+        src += chunk;
+        destinationOffset += chunk;
+        size -= chunk;
+    }
+}
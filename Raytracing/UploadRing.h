@@ -0,0 +1,56 @@
+#pragma once
+#include <d3d12.h>
+#include <wrl.h>
+
+#include <deque>
+#include <functional>
+#include <utility>
+
+#include "MemoryTracker.h"
+
+using Microsoft::WRL::ComPtr;
+
+// How CopyBuffer makes room in a full ring. `submit` executes the copies recorded so far
+// and calls UploadRing::Submit with their fence value, `wait` blocks until the GPU has
+// passed a fence value.
+struct UploadSync {
+	std::function<void()> submit;
+	std::function<void(UINT64)> wait;
+};
+
+// Persistently mapped upload heap used as a ring. Allocations made since the last
+// Submit() are released once the GPU has passed the submitted fence value.
+class UploadRing {
+
+public:
+	UploadRing() {}
+
+	void Init(ID3D12Device* device, MemoryTracker* memory, UINT64 size);
+
+	// Returns false when the ring has no room left until earlier submissions retire.
+	bool Allocate(UINT64 size, UINT64 alignment, UINT8** cpuAddress, UINT64* offset);
+	void Submit(UINT64 fenceValue);
+	void Retire(UINT64 completedFenceValue);
+	void Reset();
+
+	// Streams `size` bytes from `source` into `destination` in chunks of a quarter of the
+	// ring. When the ring is full the pending copies are submitted and only the oldest
+	// submission is waited for, so the GPU copies one chunk while the next is filled.
+	void CopyBuffer(ID3D12GraphicsCommandList* commandList,
+		ID3D12Resource* destination, UINT64 destinationOffset,
+		const void* source, UINT64 size,
+		const UploadSync& sync);
+
+	ID3D12Resource* GetResource() const { return m_buffer.Get(); }
+	UINT64 GetSize() const { return m_size; }
+
+private:
+	ComPtr<ID3D12Resource> m_buffer;
+	UINT8* m_data = nullptr;
+	UINT64 m_size = 0;
+
+	// Monotonic byte counters, wrapped modulo m_size on use
+	UINT64 m_head = 0;
+	UINT64 m_tail = 0;
+	std::deque<std::pair<UINT64, UINT64>> m_pending; // fence value, head at submit
+};
@@ -0,0 +1,28 @@
+// Stretches the traced rectangle of the ray tracing output over the back buffer
+
+Texture2D<float4> gOutput : register(t0);
+SamplerState gLinear : register(s0);
+
+cbuffer UpscaleParams : register(b0) {
+    float2 uvScale; // dispatch size over output texture size
+    float2 uvClamp; // last texel center inside the dispatch rectangle
+}
+
+struct VSOutput {
+    float4 position : SV_POSITION;
+    float2 uv : TEXCOORD;
+};
+
+VSOutput VSMain(uint id : SV_VertexID) {
+    // One triangle covering the screen, uv spans 0 to 1 over the visible part
+    VSOutput output;
+    float2 uv = float2((id << 1) & 2, id & 2);
+    output.position = float4(uv * float2(2.f, -2.f) + float2(-1.f, 1.f), 0.f, 1.f);
+    output.uv = uv;
+    return output;
+}
+
+float4 PSMain(VSOutput input) : SV_TARGET {
+    float2 uv = min(input.uv * uvScale, uvClamp);
+    return gOutput.SampleLevel(gLinear, uv, 0);
+}
@@ -18,14 +18,18 @@ cbuffer ConstantBuffer : register(b0) {
     float4x4 projectionI;
 };
 
-uint instanceIdx : register(b1);
+cbuffer DrawConstants : register(b1) {
+    uint instanceBuffer; // bindless index of the frame's instance data
+    uint instanceIdx;
+};
 
-StructuredBuffer<InstanceData> instance : register(t0);
+// Bindless: every SRV of the descriptor heap
+StructuredBuffer<InstanceData> instanceBuffers[] : register(t0, space1);
 
 vs_out main(vs_in input) {
     vs_out output;
 
-    float4x4 model = instance[instanceIdx].model;
+    float4x4 model = instanceBuffers[instanceBuffer][instanceIdx].model;
     output.position = mul(mul(projection, view), mul(model, input.pos));
     //output.position = mul(mul(projection, view), input.pos);
     output.color = input.color;
@@ -0,0 +1,70 @@
+#pragma once
+#include <cstdint>
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Fixed set of worker threads consuming a FIFO of tasks. Results and exceptions
+// come back through the future returned by Submit().
+class WorkerPool {
+
+public:
+	// 0 uses one thread per hardware thread
+	explicit WorkerPool(uint32_t threadCount = 0);
+	// Runs the tasks still queued, then joins the threads
+	~WorkerPool();
+
+	WorkerPool(const WorkerPool&) = delete;
+	WorkerPool& operator=(const WorkerPool&) = delete;
+
+	template <typename F>
+	std::future<typename std::result_of<F()>::type> Submit(F&& task) {
+		typedef typename std::result_of<F()>::type Result;
+		auto packaged = std::make_shared<std::packaged_task<Result()>>(std::forward<F>(task));
+		std::future<Result> future = packaged->get_future();
+		Enqueue([packaged]() { (*packaged)(); });
+		return future;
+	}
+
+	// Calls `body(begin, end)` over [0, count) in chunks of `chunkSize`. The calling
+	// thread runs the first chunk and returns once every chunk is done, rethrowing the
+	// first exception.
+	template <typename F>
+	void ParallelFor(size_t count, size_t chunkSize, const F& body) {
+		if (count == 0) return;
+		std::vector<std::future<void>> chunks;
+		for (size_t begin = chunkSize; begin < count; begin += chunkSize) {
+			size_t end = (std::min)(begin + chunkSize, count);
+			chunks.push_back(Submit([&body, begin, end]() { body(begin, end); }));
+		}
+		// The queued chunks reference `body`, they have to finish even if this one throws
+		std::exception_ptr error;
+		try { body(size_t(0), (std::min)(chunkSize, count)); }
+		catch (...) { error = std::current_exception(); }
+		for (auto& chunk : chunks) chunk.wait();
+		if (error) std::rethrow_exception(error);
+		for (auto& chunk : chunks) chunk.get();
+	}
+
+	uint32_t GetThreadCount() const { return static_cast<uint32_t>(m_threads.size()); }
+
+private:
+	void Enqueue(std::function<void()> task);
+	void WorkerLoop();
+
+	std::vector<std::thread> m_threads;
+	std::deque<std::function<void()>> m_tasks;
+	std::mutex m_mutex;
+	std::condition_variable m_wake;
+	bool m_stopping = false;
+};
@@ -4,42 +4,130 @@
 _Use_decl_annotations_
 int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine, int nCmdShow) {
 
+	// -buildshaders FILE writes the optimized shader archive and exits, see the post-build step
+	int argc = 0;
+	LPWSTR* argv = CommandLineToArgvW(GetCommandLineW(), &argc);
+	for (int i = 1; argv && i + 1 < argc; i++) {
+		if (wcscmp(argv[i], L"-buildshaders") == 0) {
+			bool built = Raytracing::BuildShaderArchive(argv[i + 1]);
+			LocalFree(argv);
+			return built ? 0 : 1;
+		}
+	}
+	// -benchinstances [N] times the instance desc writes for N instances (1M by default) and exits
+	for (int i = 1; argv && i < argc; i++) {
+		if (wcscmp(argv[i], L"-benchinstances") == 0) {
+			size_t count = i + 1 < argc ? static_cast<size_t>(_wtoi(argv[i + 1])) : 0;
+			LocalFree(argv);
+			WorkerPool pool;
+			WriteReport(BenchmarkInstanceDescs(&pool, count > 0 ? count : 1000000, 10), L"benchinstances.txt");
+			return 0;
+		}
+	}
+	// -benchbvh [N] times CPU BVH builds from 1M up to N triangles (10M by default) and exits
+	for (int i = 1; argv && i < argc; i++) {
+		if (wcscmp(argv[i], L"-benchbvh") == 0) {
+			UINT64 count = i + 1 < argc ? static_cast<UINT64>(_wtoi64(argv[i + 1])) : 0;
+			LocalFree(argv);
+			WorkerPool pool;
+			WriteReport(BenchmarkBvh(&pool, count > 0 ? count : 10000000), L"benchbvh.txt");
+			return 0;
+		}
+	}
+	// -benchcull [N] times the TLAS instance culling of N instances (1M by default) and exits
+	for (int i = 1; argv && i < argc; i++) {
+		if (wcscmp(argv[i], L"-benchcull") == 0) {
+			size_t count = i + 1 < argc ? static_cast<size_t>(_wtoi(argv[i + 1])) : 0;
+			LocalFree(argv);
+			WorkerPool pool;
+			WriteReport(BenchmarkCulling(&pool, count > 0 ? count : 1000000, 10), L"benchcull.txt");
+			return 0;
+		}
+	}
+	// -benchrefit [N] traces the quality of a refit CPU BVH of N triangles (100K by default) and exits
+	for (int i = 1; argv && i < argc; i++) {
+		if (wcscmp(argv[i], L"-benchrefit") == 0) {
+			UINT64 count = i + 1 < argc ? static_cast<UINT64>(_wtoi64(argv[i + 1])) : 0;
+			LocalFree(argv);
+			WorkerPool pool;
+			WriteReport(BenchmarkRefit(&pool, count > 0 ? count : 100000, 60), L"benchrefit.txt");
+			return 0;
+		}
+	}
+	MemoryBudgets memoryBudgets = MemoryTracker::ParseBudgets(argc, argv);
+	LocalFree(argv);
+
+	RaytracingOptions options;
+
+	// -budget NAME MB caps a memory category as named in the memory report, or Total,
+	// idle resources are paged out past it
+	options.memoryBudgets = memoryBudgets;
+
+	// -frames N sets how many frames the CPU may record ahead of the GPU (2 to 4)
+	const char* framesArg = strstr(lpCmdLine, "-frames ");
+	if (framesArg) options.framesInFlight = static_cast<UINT>(atoi(framesArg + 8));
+
+	// -nocompaction keeps the bottom level acceleration structures at their built size
+	options.compactBottomLevels = strstr(lpCmdLine, "-nocompaction") == nullptr;
+
+	// -instances N adds N instances of the cube and plane around the scene
+	const char* instancesArg = strstr(lpCmdLine, "-instances ");
+	if (instancesArg) options.sceneInstances = static_cast<UINT>(atoi(instancesArg + 11));
+
+	// -benchscene reports TLAS memory and build times as the instance count grows
+	options.benchmarkScene = strstr(lpCmdLine, "-benchscene") != nullptr;
+
+	// -dynamic adds a deforming mesh whose BLAS is refit every frame
+	options.dynamicGeometry = strstr(lpCmdLine, "-dynamic") != nullptr;
+
+	// -nocull builds the TLAS from every instance instead of the ones that reach the frame
+	options.cullInstances = strstr(lpCmdLine, "-nocull") == nullptr;
+
 	InitWindow(hInstance, nCmdShow);
-	app = Raytracing(hwnd, width, height, windowTitle);
-	app.Init();
+	app = new Raytracing(hwnd, width, height, windowTitle, options);
+	app->Init();
+	if (options.benchmarkScene) WriteReport(app->GetSceneBenchmarkReport(), L"benchscene.txt");
+	app->Start();
 	WindowLoop();
-	app.Destroy();
+	app->Destroy();
+	delete app;
+	app = nullptr;
 	
 	return 0;
 }
 
 LRESULT CALLBACK WindowProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam) {
+	// Messages sent while the window is created arrive before the renderer exists
+	if (!app) return DefWindowProc(hWnd, message, wParam, lParam);
+
 	switch (message) {
 
 	case WM_LBUTTONDOWN:
 	case WM_RBUTTONDOWN:
 	case WM_MBUTTONDOWN:
 	case WM_MOUSEWHEEL:
-		app.MouseWheel(static_cast<FLOAT>(wParam));
+		app->MouseWheel(static_cast<FLOAT>(wParam));
 		return 0;
 
 	case WM_MOUSEMOVE:
-		app.MouseMove(static_cast<UINT8>(wParam), static_cast<UINT32>(lParam));
+		app->MouseMove(static_cast<UINT8>(wParam), static_cast<UINT32>(lParam));
 		return 0;
 
 	case WM_KEYDOWN:
-		app.KeyDown(static_cast<UINT8>(wParam));
+		app->KeyDown(static_cast<UINT8>(wParam));
 		return 0;
 
 	case WM_KEYUP:
-		app.KeyUp(static_cast<UINT8>(wParam));
+		app->KeyUp(static_cast<UINT8>(wParam));
 		return 0;
 
-	case WM_PAINT:
-		app.MainLoop();
+	case WM_TIMER:
+		if (wParam == Raytracing::TitleTimer) app->UpdateTitle();
 		return 0;
 
 	case WM_DESTROY:
+		// The swap chain must not outlive the window while the render thread presents
+		app->Stop();
 		PostQuitMessage(0);
 		return 0;
 	}
@@ -49,13 +137,39 @@ LRESULT CALLBACK WindowProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lPara
 }
 
 
+void WriteReport(const std::wstring& report, LPCWSTR fileName) {
+	OutputDebugString(report.c_str());
+
+	std::string text(WideCharToMultiByte(CP_UTF8, 0, report.c_str(), static_cast<int>(report.size()), nullptr, 0, nullptr, nullptr), '\0');
+	WideCharToMultiByte(CP_UTF8, 0, report.c_str(), static_cast<int>(report.size()), &text[0], static_cast<int>(text.size()), nullptr, nullptr);
+
+	// A windowed process has no console of its own: write to redirected output, or
+	// else to the console of the shell that started it
+	DWORD written = 0;
+	HANDLE output = GetStdHandle(STD_OUTPUT_HANDLE);
+	if (output && output != INVALID_HANDLE_VALUE) {
+		WriteFile(output, text.data(), static_cast<DWORD>(text.size()), &written, nullptr);
+	}
+	else if (AttachConsole(ATTACH_PARENT_PROCESS)) {
+		HANDLE console = CreateFileW(L"CONOUT$", GENERIC_WRITE, FILE_SHARE_WRITE, nullptr, OPEN_EXISTING, 0, nullptr);
+		if (console != INVALID_HANDLE_VALUE) {
+			WriteConsoleW(console, report.c_str(), static_cast<DWORD>(report.size()), &written, nullptr);
+			CloseHandle(console);
+		}
+		FreeConsole();
+	}
+
+	std::ofstream file(GetExecutableRelativePath(fileName), std::ios::binary | std::ios::trunc);
+	file.write(text.data(), static_cast<std::streamsize>(text.size()));
+	if (!file.good()) OutputDebugString(L"Cannot write the benchmark report next to the executable\n");
+}
+
+// Rendering happens on its own thread, this one sleeps until the next event
 void WindowLoop() {
 	MSG msg = {};
-	while (msg.message != WM_QUIT) {
-		if (PeekMessage(&msg, NULL, 0, 0, PM_REMOVE)) {
-			TranslateMessage(&msg);
-			DispatchMessage(&msg);
-		}
+	while (GetMessage(&msg, NULL, 0, 0) > 0) {
+		TranslateMessage(&msg);
+		DispatchMessage(&msg);
 	}
 }
 
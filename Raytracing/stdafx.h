@@ -6,10 +6,13 @@
 
 #include <windows.h>
 
+#include <fstream>
+
 #include "Raytracing.h"
+#include "CpuBvh.h"
 
 HWND hwnd;
-Raytracing app;
+Raytracing* app = nullptr;
 
 UINT width = 900;
 UINT height = 600;
@@ -18,4 +21,6 @@ LPCTSTR windowTitle = L"Raytracing";
 
 void InitWindow(HINSTANCE hInstance, int nCmdShow);
 void WindowLoop();
+// Benchmark results go to the debugger, the console the run was started from and a file next to the executable
+void WriteReport(const std::wstring& report, LPCWSTR fileName);
 LRESULT CALLBACK WindowProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam);
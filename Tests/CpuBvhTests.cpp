@@ -0,0 +1,223 @@
+#include "TestHarness.h"
+
+#include "CpuBvh.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+namespace {
+
+const UINT32 Stride = 3 * sizeof(float);
+
+// Flat grid of side x side quads in the xz plane, centred on the origin
+struct Grid {
+	explicit Grid(UINT32 side) : side(side) {
+		for (UINT32 z = 0; z <= side; z++) {
+			for (UINT32 x = 0; x <= side; x++) {
+				float position[3] = { float(x) - 0.5f * side, 0.0f, float(z) - 0.5f * side };
+				rest.insert(rest.end(), position, position + 3);
+			}
+		}
+		for (UINT32 z = 0; z < side; z++) {
+			for (UINT32 x = 0; x < side; x++) {
+				UINT32 corner = z * (side + 1) + x;
+				UINT32 quad[6] = { corner, corner + side + 1, corner + 1, corner + 1, corner + side + 1, corner + side + 2 };
+				indices.insert(indices.end(), quad, quad + 6);
+			}
+		}
+		positions = rest;
+	}
+
+	// Swirls the grid in its plane, `turns` full turns at the centre easing to none at
+	// the edge: neighbours stay neighbours, but the leaves of the flat build stretch
+	// across the grid as the rings turn apart
+	void Swirl(float turns) {
+		const float pi = 3.14159265f;
+		for (size_t v = 0; v < rest.size(); v += 3) {
+			float x = rest[v], z = rest[v + 2];
+			float angle = turns * 2.0f * pi * (std::max)(0.0f, 1.0f - std::sqrt(x * x + z * z) / (0.5f * side));
+			positions[v] = x * std::cos(angle) - z * std::sin(angle);
+			positions[v + 2] = x * std::sin(angle) + z * std::cos(angle);
+		}
+	}
+
+	UINT64 VertexCount() const { return positions.size() / 3; }
+
+	void Build(CpuBvh& bvh) const {
+		bvh.Build(nullptr, positions.data(), Stride, VertexCount(), indices.data(), indices.size());
+	}
+
+	void Refit(CpuBvh& bvh) const {
+		bvh.Refit(positions.data(), Stride, VertexCount(), indices.data(), indices.size());
+	}
+
+	UINT32 side;
+	std::vector<float> rest;
+	std::vector<float> positions;
+	std::vector<UINT32> indices;
+};
+
+bool Contains(const BvhNode& outer, const float* point) {
+	for (int a = 0; a < 3; a++) {
+		if (point[a] < outer.boundsMin[a] || point[a] > outer.boundsMax[a]) return false;
+	}
+	return true;
+}
+
+bool Contains(const BvhNode& outer, const BvhNode& inner) {
+	return Contains(outer, inner.boundsMin) && Contains(outer, inner.boundsMax);
+}
+
+// Every leaf bounds its triangles and every inner node its children
+bool BoundsHold(const CpuBvh& bvh, const Grid& grid) {
+	const std::vector<BvhNode>& nodes = bvh.GetNodes();
+	for (const BvhNode& node : nodes) {
+		if (node.triangleCount == 0) {
+			if (!Contains(node, nodes[node.leftOrFirst]) || !Contains(node, nodes[node.leftOrFirst + 1])) return false;
+			continue;
+		}
+		for (UINT32 i = node.leftOrFirst; i < node.leftOrFirst + node.triangleCount; i++) {
+			for (int v = 0; v < 3; v++) {
+				UINT32 vertex = grid.indices[3 * bvh.GetTriangles()[i] + v];
+				if (!Contains(node, &grid.positions[3 * vertex])) return false;
+			}
+		}
+	}
+	return true;
+}
+
+// Refit cost against a tree built for the current positions
+double Degradation(const CpuBvh& refit, const Grid& grid) {
+	CpuBvh rebuilt;
+	grid.Build(rebuilt);
+	return refit.GetStats().sahCost / rebuilt.GetStats().sahCost;
+}
+
+}
+
+TEST(CpuBvhBuildCoversEveryTriangleOnce) {
+	Grid grid(32);
+	CpuBvh bvh;
+	grid.Build(bvh);
+
+	std::vector<UINT32> triangles = bvh.GetTriangles();
+	std::sort(triangles.begin(), triangles.end());
+	CHECK(triangles.size() == grid.indices.size() / 3);
+	bool permutation = true;
+	for (size_t i = 0; i < triangles.size(); i++) permutation &= triangles[i] == i;
+	CHECK(permutation);
+	CHECK(bvh.GetStats().maxLeafSize <= CpuBvh::MaxLeafSize);
+	CHECK(BoundsHold(bvh, grid));
+}
+
+TEST(CpuBvhRefitOfUnchangedPositionsKeepsTheTree) {
+	Grid grid(32);
+	CpuBvh bvh;
+	grid.Build(bvh);
+	std::vector<BvhNode> built = bvh.GetNodes();
+	double builtCost = bvh.GetStats().sahCost;
+
+	grid.Refit(bvh);
+	CHECK(bvh.GetNodes().size() == built.size());
+	CHECK(memcmp(bvh.GetNodes().data(), built.data(), built.size() * sizeof(BvhNode)) == 0);
+	CHECK(bvh.GetStats().sahCost == builtCost);
+}
+
+TEST(CpuBvhRefitBoundsFollowTheMesh) {
+	Grid grid(32);
+	CpuBvh bvh;
+	grid.Build(bvh);
+
+	grid.Swirl(0.5f);
+	CHECK(!BoundsHold(bvh, grid));
+	grid.Refit(bvh);
+	CHECK(BoundsHold(bvh, grid));
+
+	// Back at rest the refit tree is the built one again
+	grid.Swirl(0.0f);
+	grid.Refit(bvh);
+	CpuBvh built;
+	grid.Build(built);
+	CHECK(std::fabs(bvh.GetStats().sahCost - built.GetStats().sahCost) < 1e-9);
+}
+
+TEST(CpuBvhRefitDegradesWithTheDeformation) {
+	Grid grid(48);
+	CpuBvh bvh;
+	grid.Build(bvh);
+
+	// The further the mesh moves from the built positions, the worse the refit tree
+	// gets against a rebuild; the curve BlasRefitScheduler rebuilds on
+	double previous = 1.0;
+	bool increasing = true;
+	const float amounts[] = { 0.02f, 0.1f, 0.35f, 1.0f };
+	for (float amount : amounts) {
+		grid.Swirl(amount);
+		grid.Refit(bvh);
+		double degradation = Degradation(bvh, grid);
+		increasing &= degradation >= previous;
+		previous = degradation;
+	}
+	CHECK(increasing);
+	CHECK(previous > 2.0);
+
+	// A small deformation costs little
+	CpuBvh nudged;
+	grid.Swirl(0.0f);
+	grid.Build(nudged);
+	grid.Swirl(0.02f);
+	grid.Refit(nudged);
+	CHECK(Degradation(nudged, grid) < 1.1);
+
+	// A rebuild starts the curve over
+	grid.Swirl(1.0f);
+	grid.Build(bvh);
+	CHECK(Degradation(bvh, grid) == 1.0);
+}
+
+TEST(CpuBvhRefitRejectsAnotherMesh) {
+	Grid grid(8);
+	Grid other(9);
+	CpuBvh bvh;
+	grid.Build(bvh);
+
+	bool threw = false;
+	try {
+		other.Refit(bvh);
+	}
+	catch (const std::logic_error&) {
+		threw = true;
+	}
+	CHECK(threw);
+}
+
+TEST(CpuBvhFileRoundTrip) {
+	Grid grid(16);
+	grid.Swirl(0.3f);
+	CpuBvh bvh;
+	grid.Build(bvh);
+
+	const wchar_t* path = L"CpuBvhFileRoundTrip.bvh";
+	CHECK(bvh.Write(path));
+	CpuBvh read;
+	CHECK(read.Read(path));
+	CHECK(read.GetNodes().size() == bvh.GetNodes().size());
+	CHECK(memcmp(read.GetNodes().data(), bvh.GetNodes().data(), bvh.GetNodes().size() * sizeof(BvhNode)) == 0);
+	CHECK(read.GetTriangles() == bvh.GetTriangles());
+
+	// A flipped byte fails the checksum, a truncated file the block sizes
+	std::fstream file("CpuBvhFileRoundTrip.bvh", std::ios::in | std::ios::out | std::ios::binary);
+	file.seekp(sizeof(BvhFileHeader) + 4);
+	file.put(0x7f);
+	file.close();
+	CHECK(!read.Read(path));
+
+	CHECK(bvh.Write(path));
+	CHECK(truncate("CpuBvhFileRoundTrip.bvh", sizeof(BvhFileHeader) + sizeof(BvhNode)) == 0);
+	CHECK(!read.Read(path));
+	std::remove("CpuBvhFileRoundTrip.bvh");
+}
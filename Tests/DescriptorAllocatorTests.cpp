@@ -0,0 +1,131 @@
+#include "TestHarness.h"
+
+#include "DescriptorAllocator.h"
+
+#include <stdexcept>
+
+namespace {
+
+bool FreeThrows(DescriptorFreeList& list, uint32_t index, uint32_t count) {
+	try {
+		list.Free(index, count);
+	}
+	catch (const std::logic_error&) {
+		return true;
+	}
+	return false;
+}
+
+}
+
+TEST(FreeListAllocatesFirstFit) {
+	DescriptorFreeList list;
+	list.Init(16);
+
+	CHECK(list.Allocate(4) == 0);
+	CHECK(list.Allocate(4) == 4);
+	CHECK(list.Allocate(8) == 8);
+	CHECK(list.Allocate(1) == InvalidDescriptorIndex);
+	CHECK(list.Allocate(0) == InvalidDescriptorIndex);
+	CHECK(list.GetFreeCount() == 0);
+
+	list.Free(0, 4);
+	CHECK(list.Allocate(2) == 0);
+	CHECK(list.Allocate(3) == InvalidDescriptorIndex);
+	CHECK(list.Allocate(2) == 2);
+}
+
+TEST(FreeListMergesNeighbours) {
+	DescriptorFreeList list;
+	list.Init(12);
+	uint32_t a = list.Allocate(4);
+	uint32_t b = list.Allocate(4);
+	uint32_t c = list.Allocate(4);
+
+	list.Free(a, 4);
+	list.Free(c, 4);
+	CHECK(list.GetFreeRangeCount() == 2);
+	CHECK(list.GetLargestFreeRange() == 4);
+
+	// The middle range joins both sides into one
+	list.Free(b, 4);
+	CHECK(list.GetFreeRangeCount() == 1);
+	CHECK(list.GetLargestFreeRange() == 12);
+	CHECK(list.GetFreeCount() == 12);
+	CHECK(list.Allocate(12) == 0);
+}
+
+TEST(FreeListMergesWithTheNextRange) {
+	DescriptorFreeList list;
+	list.Init(8);
+	uint32_t a = list.Allocate(4);
+	list.Allocate(4);
+
+	list.Free(a + 2, 2);
+	list.Free(a, 2);
+	CHECK(list.GetFreeRangeCount() == 1);
+	CHECK(list.GetLargestFreeRange() == 4);
+}
+
+TEST(FreeListRejectsBadFrees) {
+	DescriptorFreeList list;
+	list.Init(8);
+	uint32_t a = list.Allocate(4);
+
+	CHECK(FreeThrows(list, 6, 4));
+	CHECK(FreeThrows(list, 8, 1));
+	CHECK(FreeThrows(list, 4, 1));
+	list.Free(a, 4);
+	CHECK(FreeThrows(list, a, 4));
+	CHECK(FreeThrows(list, a + 1, 2));
+	CHECK(list.GetFreeCount() == 8);
+}
+
+TEST(RingAllocatesContiguousRanges) {
+	DescriptorRing ring;
+	ring.Init(10);
+
+	CHECK(ring.Allocate(4) == 0);
+	CHECK(ring.Allocate(4) == 4);
+	CHECK(ring.GetUsedCount() == 8);
+	// Does not fit before the end and the start is still in use
+	CHECK(ring.Allocate(4) == InvalidDescriptorIndex);
+	CHECK(ring.Allocate(11) == InvalidDescriptorIndex);
+	CHECK(ring.Allocate(2) == 8);
+}
+
+TEST(RingReclaimsOnceTheFencePassed) {
+	DescriptorRing ring;
+	ring.Init(8);
+
+	ring.Allocate(6);
+	ring.Submit(1);
+	ring.Allocate(2);
+	ring.Submit(2);
+	CHECK(ring.Allocate(1) == InvalidDescriptorIndex);
+
+	ring.Retire(0);
+	CHECK(ring.Allocate(1) == InvalidDescriptorIndex);
+
+	// Frame 1 is done, its range comes back and the next table wraps to the start
+	ring.Retire(1);
+	CHECK(ring.GetUsedCount() == 2);
+	CHECK(ring.Allocate(4) == 0);
+	ring.Submit(3);
+
+	ring.Retire(3);
+	CHECK(ring.GetUsedCount() == 0);
+}
+
+TEST(RingSkipsEmptySubmits) {
+	DescriptorRing ring;
+	ring.Init(4);
+
+	ring.Submit(1);
+	ring.Allocate(4);
+	ring.Submit(2);
+	ring.Submit(3);
+	ring.Retire(2);
+	CHECK(ring.GetUsedCount() == 0);
+	CHECK(ring.Allocate(4) == 0);
+}
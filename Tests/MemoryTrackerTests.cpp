@@ -0,0 +1,215 @@
+#include "TestHarness.h"
+
+#include "MemoryTracker.h"
+
+namespace {
+
+class FakeResource : public ID3D12Resource {
+
+public:
+	FakeResource(UINT64 size, D3D12_HEAP_TYPE heapType) : m_heapType(heapType) {
+		m_desc.Dimension = D3D12_RESOURCE_DIMENSION_BUFFER;
+		m_desc.Width = size;
+		m_desc.Height = 1;
+		m_desc.DepthOrArraySize = 1;
+	}
+
+	HRESULT QueryInterface(REFIID, void**) override { return E_NOINTERFACE; }
+	ULONG AddRef() override { return ++m_references; }
+	ULONG Release() override {
+		ULONG references = --m_references;
+		if (!references) delete this;
+		return references;
+	}
+	HRESULT SetName(LPCWSTR) override { return S_OK; }
+	D3D12_RESOURCE_DESC GetDesc() override { return m_desc; }
+	D3D12_GPU_VIRTUAL_ADDRESS GetGPUVirtualAddress() override { return 0; }
+	HRESULT GetHeapProperties(D3D12_HEAP_PROPERTIES* properties, D3D12_HEAP_FLAGS* flags) override {
+		*properties = {};
+		properties->Type = m_heapType;
+		*flags = D3D12_HEAP_FLAG_NONE;
+		return S_OK;
+	}
+
+private:
+	ULONG m_references = 1;
+	D3D12_RESOURCE_DESC m_desc = {};
+	D3D12_HEAP_TYPE m_heapType;
+};
+
+// Records what the tracker asks of the device
+class FakeResidencyDevice : public ResidencyDevice {
+
+public:
+	UINT64 GetAllocationSize(const D3D12_RESOURCE_DESC& desc) override { return desc.Width; }
+	HRESULT MakeResident(UINT count, ID3D12Pageable* const*) override { madeResident += count; return S_OK; }
+	HRESULT Evict(UINT count, ID3D12Pageable* const*) override { evicted += count; return S_OK; }
+	HRESULT SetPriority(UINT count, ID3D12Pageable* const*, D3D12_RESIDENCY_PRIORITY priority) override {
+		if (priority == D3D12_RESIDENCY_PRIORITY_MINIMUM) demoted += count;
+		else promoted += count;
+		return S_OK;
+	}
+	UINT64 QueryLocalBudget() override { queries++; return localBudget; }
+
+	UINT64 localBudget = 0;
+	UINT madeResident = 0;
+	UINT evicted = 0;
+	UINT demoted = 0;
+	UINT promoted = 0;
+	UINT queries = 0;
+};
+
+const UINT64 MB = 1024 * 1024;
+
+// Releases the test's own references once the tracker holds them
+struct Resources {
+	~Resources() { for (ID3D12Resource* resource : list) resource->Release(); }
+	ID3D12Resource* Add(UINT64 size, D3D12_HEAP_TYPE heapType = D3D12_HEAP_TYPE_DEFAULT) {
+		list.push_back(new FakeResource(size, heapType));
+		return list.back();
+	}
+	std::vector<ID3D12Resource*> list;
+};
+
+void Idle(MemoryTracker& tracker) {
+	for (UINT64 i = 0; i < MemoryTracker::IdleFrames; i++) tracker.NextFrame();
+}
+
+}
+
+TEST(MemoryTrackerAccounting) {
+	FakeResidencyDevice device;
+	MemoryTracker tracker;
+	tracker.Init(&device);
+	Resources resources;
+	tracker.Track(resources.Add(4 * MB), L"Vertices", MemoryCategory::Geometry);
+	tracker.Track(resources.Add(2 * MB), L"Indices", MemoryCategory::Geometry);
+	tracker.Track(resources.Add(1 * MB, D3D12_HEAP_TYPE_UPLOAD), L"Upload", MemoryCategory::Upload);
+
+	CHECK(tracker.GetCategoryTotal(MemoryCategory::Geometry) == 6 * MB);
+	CHECK(tracker.GetCategoryTotal(MemoryCategory::Upload) == 1 * MB);
+	CHECK(tracker.GetHeapTotal(D3D12_HEAP_TYPE_DEFAULT) == 6 * MB);
+	CHECK(tracker.GetHeapTotal(D3D12_HEAP_TYPE_UPLOAD) == 1 * MB);
+	CHECK(tracker.GetResidentTotal() == 7 * MB);
+	CHECK(tracker.GetEvictedTotal() == 0);
+}
+
+TEST(MemoryTrackerDropsReleasedResources) {
+	FakeResidencyDevice device;
+	MemoryTracker tracker;
+	tracker.Init(&device);
+	ID3D12Resource* resource = new FakeResource(MB, D3D12_HEAP_TYPE_DEFAULT);
+	tracker.Track(resource, L"Released", MemoryCategory::Geometry);
+	resource->Release();
+	tracker.NextFrame();
+	CHECK(tracker.GetCategoryTotal(MemoryCategory::Geometry) == 0);
+}
+
+TEST(MemoryTrackerDemotesOnlyTheOverage) {
+	FakeResidencyDevice device;
+	MemoryTracker tracker;
+	tracker.Init(&device);
+	Resources resources;
+	for (int i = 0; i < 4; i++) tracker.Track(resources.Add(100 * MB), L"Geometry", MemoryCategory::Geometry);
+	Idle(tracker);
+
+	// 150 MB over: two of the four are enough
+	tracker.SetTotalBudget(250 * MB);
+	CHECK(device.demoted == 2);
+	CHECK(device.evicted == 0);
+
+	// Demoted memory no longer counts, later frames leave the rest alone
+	Idle(tracker);
+	CHECK(device.demoted == 2);
+}
+
+TEST(MemoryTrackerEvictsLowPriorityFirst) {
+	FakeResidencyDevice device;
+	MemoryTracker tracker;
+	tracker.Init(&device);
+	Resources resources;
+	tracker.Track(resources.Add(100 * MB), L"Geometry", MemoryCategory::Geometry);
+	ID3D12Resource* scratch = resources.Add(100 * MB);
+	tracker.Track(scratch, L"Scratch", MemoryCategory::Scratch, ResidencyPriority::Low);
+	Idle(tracker);
+
+	tracker.SetTotalBudget(150 * MB);
+	CHECK(device.evicted == 1);
+	CHECK(device.demoted == 0);
+	CHECK(tracker.GetResidentTotal() == 100 * MB);
+	CHECK(tracker.GetEvictedTotal() == 100 * MB);
+
+	// Using it pages it back in
+	tracker.Use(scratch);
+	CHECK(device.madeResident == 1);
+	CHECK(tracker.GetResidentTotal() == 200 * MB);
+}
+
+TEST(MemoryTrackerKeepsPinnedAndRecentResources) {
+	FakeResidencyDevice device;
+	MemoryTracker tracker;
+	tracker.Init(&device);
+	Resources resources;
+	tracker.Track(resources.Add(100 * MB), L"Pinned", MemoryCategory::AccelerationStructure, ResidencyPriority::Pinned);
+	tracker.Track(resources.Add(100 * MB, D3D12_HEAP_TYPE_UPLOAD), L"Upload", MemoryCategory::Upload, ResidencyPriority::Low);
+	ID3D12Resource* recent = resources.Add(100 * MB);
+	tracker.Track(recent, L"Recent", MemoryCategory::Geometry, ResidencyPriority::Low);
+	Idle(tracker);
+
+	// The GPU may still read what was used within IdleFrames
+	tracker.Use(recent);
+	tracker.SetTotalBudget(MB);
+	CHECK(device.evicted == 0);
+	CHECK(device.demoted == 0);
+
+	Idle(tracker);
+	CHECK(device.evicted == 1);
+}
+
+TEST(MemoryTrackerCategoryBudget) {
+	FakeResidencyDevice device;
+	MemoryTracker tracker;
+	tracker.Init(&device);
+	Resources resources;
+	for (int i = 0; i < 3; i++) tracker.Track(resources.Add(10 * MB), L"Geometry", MemoryCategory::Geometry);
+	for (int i = 0; i < 3; i++) tracker.Track(resources.Add(10 * MB), L"Shader table", MemoryCategory::ShaderTable);
+	Idle(tracker);
+
+	// Only the category over its budget gives way
+	tracker.SetBudget(MemoryCategory::Geometry, 15 * MB);
+	CHECK(device.demoted == 2);
+}
+
+TEST(MemoryTrackerQueriesTheBudgetOncePerPass) {
+	FakeResidencyDevice device;
+	device.localBudget = 50 * MB;
+	MemoryTracker tracker;
+	tracker.Init(&device);
+	Resources resources;
+	for (int i = 0; i < 8; i++) tracker.Track(resources.Add(10 * MB), L"Geometry", MemoryCategory::Geometry);
+	Idle(tracker);
+
+	// The OS budget applies without one of our own
+	CHECK(device.demoted == 3);
+	device.queries = 0;
+	tracker.NextFrame();
+	CHECK(device.queries == 1);
+}
+
+TEST(MemoryTrackerParsesBudgetArguments) {
+	const LPCWSTR argv[] = { L"Sample.exe", L"-budget", L"geometry", L"15", L"-frames", L"3",
+		L"-budget", L"Total", L"512", L"-budget", L"Textures", L"8", L"-budget", L"Scratch" };
+	MemoryBudgets budgets = MemoryTracker::ParseBudgets(_countof(argv), argv);
+	CHECK(budgets.total == 512 * MB);
+	CHECK(budgets.categories[static_cast<UINT>(MemoryCategory::Geometry)] == 15 * MB);
+	CHECK(budgets.categories[static_cast<UINT>(MemoryCategory::Scratch)] == 0);
+
+	FakeResidencyDevice device;
+	MemoryTracker tracker;
+	tracker.Init(&device);
+	Resources resources;
+	for (int i = 0; i < 3; i++) tracker.Track(resources.Add(10 * MB), L"Geometry", MemoryCategory::Geometry);
+	Idle(tracker);
+	tracker.SetBudgets(budgets);
+	CHECK(device.demoted == 2);
+}
@@ -0,0 +1,83 @@
+#include "TestHarness.h"
+
+#include "MeshFile.h"
+
+#include <cstdio>
+#include <fstream>
+#include <limits>
+
+namespace {
+
+const wchar_t* Path = L"MeshFileTests.rmsh";
+const char* NarrowPath = "MeshFileTests.rmsh";
+
+// One quad: four positions and two triangles
+bool WriteQuad() {
+	const float vertices[] = { 0, 0, 0, 1, 0, 0, 0, 0, 1, 1, 0, 1 };
+	const UINT32 indices[] = { 0, 2, 1, 1, 2, 3 };
+	return WriteMeshFile(Path, vertices, 3 * sizeof(float), 4, indices, 6);
+}
+
+MeshFileHeader ReadHeader() {
+	MeshFileHeader header = {};
+	std::ifstream file(NarrowPath, std::ios::binary);
+	file.read(reinterpret_cast<char*>(&header), sizeof(header));
+	return header;
+}
+
+void WriteHeader(const MeshFileHeader& header) {
+	std::fstream file(NarrowPath, std::ios::in | std::ios::out | std::ios::binary);
+	file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+}
+
+}
+
+TEST(MeshFileRoundTrip) {
+	CHECK(WriteQuad());
+	MappedMesh mesh;
+	CHECK(mesh.Open(Path, true));
+	CHECK(mesh.Header().vertexCount == 4);
+	CHECK(mesh.Header().indexCount == 6);
+	CHECK(static_cast<const float*>(mesh.Vertices())[3] == 1.0f);
+	CHECK(static_cast<const UINT32*>(mesh.Indices())[5] == 3);
+	mesh.Close();
+	std::remove(NarrowPath);
+}
+
+TEST(MeshFileRejectsBlocksOutsideTheFile) {
+	CHECK(WriteQuad());
+	const MeshFileHeader good = ReadHeader();
+	const UINT64 max = (std::numeric_limits<UINT64>::max)();
+	MappedMesh mesh;
+
+	// An offset whose end wraps past zero
+	MeshFileHeader header = good;
+	header.vertexOffset = max - (max % header.alignment);
+	WriteHeader(header);
+	CHECK(!mesh.Open(Path));
+
+	// A count whose byte size wraps to the stored one
+	header = good;
+	header.vertexCount = good.vertexCount + (max / header.vertexStride + 1);
+	header.vertexSize = header.vertexCount * header.vertexStride;
+	WriteHeader(header);
+	CHECK(!mesh.Open(Path));
+
+	header = good;
+	header.indexCount = good.indexCount + (max / sizeof(UINT32) + 1);
+	header.indexSize = header.indexCount * sizeof(UINT32);
+	WriteHeader(header);
+	CHECK(!mesh.Open(Path));
+
+	// A block running off the end
+	header = good;
+	header.indexSize += sizeof(UINT32);
+	header.indexCount++;
+	WriteHeader(header);
+	CHECK(!mesh.Open(Path));
+
+	WriteHeader(good);
+	CHECK(mesh.Open(Path));
+	mesh.Close();
+	std::remove(NarrowPath);
+}
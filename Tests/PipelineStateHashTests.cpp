@@ -0,0 +1,196 @@
+#include "TestHarness.h"
+
+#include "PipelineStateHash.h"
+
+#include <vector>
+
+namespace {
+
+const UINT8 VertexShader[] = { 0x44, 0x58, 0x42, 0x43, 1, 2, 3, 4 };
+const UINT8 PixelShader[] = { 0x44, 0x58, 0x42, 0x43, 5, 6, 7, 8 };
+
+// What the samples build: one position and normal stream, one target, depth tested
+struct GraphicsDesc {
+	GraphicsDesc() {
+		elements[0] = { "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 };
+		elements[1] = { "NORMAL", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 12, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 };
+
+		desc = {};
+		desc.VS = { VertexShader, sizeof(VertexShader) };
+		desc.PS = { PixelShader, sizeof(PixelShader) };
+		desc.InputLayout = { elements, 2 };
+		for (auto& target : desc.BlendState.RenderTarget) {
+			target.SrcBlend = D3D12_BLEND_ONE;
+			target.DestBlend = D3D12_BLEND_ZERO;
+			target.BlendOp = D3D12_BLEND_OP_ADD;
+			target.RenderTargetWriteMask = D3D12_COLOR_WRITE_ENABLE_ALL;
+		}
+		desc.SampleMask = D3D12_DEFAULT_SAMPLE_MASK;
+		desc.RasterizerState.FillMode = D3D12_FILL_MODE_SOLID;
+		desc.RasterizerState.CullMode = D3D12_CULL_MODE_BACK;
+		desc.RasterizerState.DepthClipEnable = TRUE;
+		desc.DepthStencilState.DepthEnable = TRUE;
+		desc.DepthStencilState.DepthWriteMask = D3D12_DEPTH_WRITE_MASK_ALL;
+		desc.DepthStencilState.DepthFunc = D3D12_COMPARISON_FUNC_LESS;
+		desc.PrimitiveTopologyType = D3D12_PRIMITIVE_TOPOLOGY_TYPE_TRIANGLE;
+		desc.NumRenderTargets = 1;
+		desc.RTVFormats[0] = DXGI_FORMAT_R8G8B8A8_UNORM;
+		desc.DSVFormat = DXGI_FORMAT_D32_FLOAT;
+		desc.SampleDesc.Count = 1;
+	}
+
+	// The input layout points into the object
+	GraphicsDesc(const GraphicsDesc&) = delete;
+	GraphicsDesc& operator=(const GraphicsDesc&) = delete;
+
+	UINT64 Hash(UINT64 rootSignatureKey = 1) const { return HashGraphicsPipelineDesc(desc, rootSignatureKey); }
+
+	D3D12_INPUT_ELEMENT_DESC elements[2];
+	D3D12_GRAPHICS_PIPELINE_STATE_DESC desc;
+};
+
+}
+
+TEST(PipelineHashIsStableForEqualDescriptions) {
+	GraphicsDesc a;
+	GraphicsDesc b;
+	CHECK(a.Hash() == b.Hash());
+	CHECK(a.Hash(1) != a.Hash(2));
+}
+
+TEST(PipelineHashReadsShadersByContent) {
+	GraphicsDesc a;
+	GraphicsDesc b;
+	std::vector<UINT8> copy(VertexShader, VertexShader + sizeof(VertexShader));
+	b.desc.VS = { copy.data(), copy.size() };
+	CHECK(a.Hash() == b.Hash());
+
+	copy.back() ^= 1;
+	CHECK(a.Hash() != b.Hash());
+
+	// A null shader hashes the same whatever length comes with it
+	GraphicsDesc c;
+	c.desc.GS = { nullptr, 16 };
+	CHECK(a.Hash() == c.Hash());
+}
+
+TEST(PipelineHashIgnoresPointersAndTheCachedBlob) {
+	GraphicsDesc a;
+	GraphicsDesc b;
+	UINT8 blob[4] = {};
+	b.desc.pRootSignature = reinterpret_cast<ID3D12RootSignature*>(&blob);
+	b.desc.CachedPSO = { blob, sizeof(blob) };
+	CHECK(a.Hash() == b.Hash());
+}
+
+TEST(PipelineHashIgnoresSemanticCase) {
+	GraphicsDesc a;
+	GraphicsDesc b;
+	b.elements[0].SemanticName = "Position";
+	b.elements[1].SemanticName = "normal";
+	CHECK(a.Hash() == b.Hash());
+
+	b.elements[1].SemanticName = "TEXCOORD";
+	CHECK(a.Hash() != b.Hash());
+}
+
+TEST(PipelineHashIgnoresStepRateOfVertexData) {
+	GraphicsDesc a;
+	GraphicsDesc b;
+	b.elements[1].InstanceDataStepRate = 3;
+	CHECK(a.Hash() == b.Hash());
+
+	a.elements[1].InputSlotClass = D3D12_INPUT_CLASSIFICATION_PER_INSTANCE_DATA;
+	b.elements[1].InputSlotClass = D3D12_INPUT_CLASSIFICATION_PER_INSTANCE_DATA;
+	a.elements[1].InstanceDataStepRate = 1;
+	CHECK(a.Hash() != b.Hash());
+}
+
+TEST(PipelineHashIgnoresFactorsOfDisabledBlending) {
+	GraphicsDesc a;
+	GraphicsDesc b;
+	b.desc.BlendState.RenderTarget[0].SrcBlend = D3D12_BLEND_SRC_ALPHA;
+	b.desc.BlendState.RenderTarget[0].DestBlend = D3D12_BLEND_INV_SRC_ALPHA;
+	CHECK(a.Hash() == b.Hash());
+
+	a.desc.BlendState.RenderTarget[0].BlendEnable = TRUE;
+	b.desc.BlendState.RenderTarget[0].BlendEnable = TRUE;
+	CHECK(a.Hash() != b.Hash());
+
+	// Any non-zero BOOL enables
+	GraphicsDesc c;
+	c.desc.BlendState.RenderTarget[0].BlendEnable = 2;
+	CHECK(a.Hash() == c.Hash());
+}
+
+TEST(PipelineHashIgnoresUnusedRenderTargets) {
+	GraphicsDesc a;
+	GraphicsDesc b;
+	b.desc.RTVFormats[1] = DXGI_FORMAT_R32G32B32A32_FLOAT;
+	b.desc.BlendState.RenderTarget[1].RenderTargetWriteMask = D3D12_COLOR_WRITE_ENABLE_RED;
+	CHECK(a.Hash() == b.Hash());
+
+	// Without independent blending only the first target's description applies
+	a.desc.NumRenderTargets = 2;
+	b.desc.NumRenderTargets = 2;
+	a.desc.RTVFormats[1] = b.desc.RTVFormats[1];
+	CHECK(a.Hash() == b.Hash());
+
+	a.desc.BlendState.IndependentBlendEnable = TRUE;
+	b.desc.BlendState.IndependentBlendEnable = TRUE;
+	CHECK(a.Hash() != b.Hash());
+}
+
+TEST(PipelineHashIgnoresDisabledDepthAndStencil) {
+	GraphicsDesc a;
+	GraphicsDesc b;
+	b.desc.DepthStencilState.StencilReadMask = 0xff;
+	b.desc.DepthStencilState.FrontFace.StencilFunc = D3D12_COMPARISON_FUNC_ALWAYS;
+	CHECK(a.Hash() == b.Hash());
+
+	a.desc.DepthStencilState.DepthEnable = FALSE;
+	b.desc.DepthStencilState.DepthEnable = FALSE;
+	b.desc.DepthStencilState.DepthFunc = D3D12_COMPARISON_FUNC_ALWAYS;
+	CHECK(a.Hash() == b.Hash());
+
+	a.desc.DepthStencilState.StencilEnable = TRUE;
+	b.desc.DepthStencilState.StencilEnable = TRUE;
+	CHECK(a.Hash() != b.Hash());
+}
+
+TEST(PipelineHashSeparatesStateThatMatters) {
+	GraphicsDesc base;
+	UINT64 hash = base.Hash();
+
+	GraphicsDesc culling;
+	culling.desc.RasterizerState.CullMode = D3D12_CULL_MODE_NONE;
+	CHECK(culling.Hash() != hash);
+
+	GraphicsDesc format;
+	format.desc.RTVFormats[0] = DXGI_FORMAT_R32G32B32A32_FLOAT;
+	CHECK(format.Hash() != hash);
+
+	GraphicsDesc multisampled;
+	multisampled.desc.SampleDesc.Count = 4;
+	CHECK(multisampled.Hash() != hash);
+
+	GraphicsDesc lines;
+	lines.desc.PrimitiveTopologyType = D3D12_PRIMITIVE_TOPOLOGY_TYPE_LINE;
+	CHECK(lines.Hash() != hash);
+}
+
+TEST(PipelineHashSeparatesComputeFromGraphics) {
+	D3D12_COMPUTE_PIPELINE_STATE_DESC compute = {};
+	compute.CS = { VertexShader, sizeof(VertexShader) };
+	D3D12_COMPUTE_PIPELINE_STATE_DESC same = compute;
+	UINT8 blob[4] = {};
+	same.CachedPSO = { blob, sizeof(blob) };
+	CHECK(HashComputePipelineDesc(compute, 1) == HashComputePipelineDesc(same, 1));
+	CHECK(HashComputePipelineDesc(compute, 1) != HashComputePipelineDesc(compute, 2));
+
+	D3D12_GRAPHICS_PIPELINE_STATE_DESC graphics = {};
+	CHECK(HashComputePipelineDesc(D3D12_COMPUTE_PIPELINE_STATE_DESC(), 1) != HashGraphicsPipelineDesc(graphics, 1));
+
+	UINT8 rootSignature[] = { 1, 2, 3 };
+	CHECK(HashRootSignature(rootSignature, sizeof(rootSignature)) != HashRootSignature(rootSignature, 2));
+}
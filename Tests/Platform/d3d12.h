@@ -0,0 +1,308 @@
+#pragma once
+#include <windows.h>
+#include <dxgiformat.h>
+
+typedef UINT64 D3D12_GPU_VIRTUAL_ADDRESS;
+
+enum D3D12_HEAP_TYPE {
+	D3D12_HEAP_TYPE_DEFAULT = 1,
+	D3D12_HEAP_TYPE_UPLOAD = 2,
+	D3D12_HEAP_TYPE_READBACK = 3,
+	D3D12_HEAP_TYPE_CUSTOM = 4,
+};
+
+enum D3D12_HEAP_FLAGS {
+	D3D12_HEAP_FLAG_NONE = 0,
+};
+
+enum D3D12_CPU_PAGE_PROPERTY {
+	D3D12_CPU_PAGE_PROPERTY_UNKNOWN = 0,
+};
+
+enum D3D12_MEMORY_POOL {
+	D3D12_MEMORY_POOL_UNKNOWN = 0,
+};
+
+struct D3D12_HEAP_PROPERTIES {
+	D3D12_HEAP_TYPE Type;
+	D3D12_CPU_PAGE_PROPERTY CPUPageProperty;
+	D3D12_MEMORY_POOL MemoryPoolPreference;
+	UINT CreationNodeMask;
+	UINT VisibleNodeMask;
+};
+
+enum D3D12_RESOURCE_DIMENSION {
+	D3D12_RESOURCE_DIMENSION_UNKNOWN = 0,
+	D3D12_RESOURCE_DIMENSION_BUFFER = 1,
+	D3D12_RESOURCE_DIMENSION_TEXTURE2D = 3,
+};
+
+enum D3D12_TEXTURE_LAYOUT {
+	D3D12_TEXTURE_LAYOUT_UNKNOWN = 0,
+	D3D12_TEXTURE_LAYOUT_ROW_MAJOR = 1,
+};
+
+enum D3D12_RESOURCE_FLAGS {
+	D3D12_RESOURCE_FLAG_NONE = 0,
+	D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS = 0x4,
+};
+
+struct D3D12_RESOURCE_DESC {
+	D3D12_RESOURCE_DIMENSION Dimension;
+	UINT64 Alignment;
+	UINT64 Width;
+	UINT Height;
+	UINT16 DepthOrArraySize;
+	UINT16 MipLevels;
+	DXGI_FORMAT Format;
+	DXGI_SAMPLE_DESC SampleDesc;
+	D3D12_TEXTURE_LAYOUT Layout;
+	D3D12_RESOURCE_FLAGS Flags;
+};
+
+struct D3D12_RESOURCE_ALLOCATION_INFO {
+	UINT64 SizeInBytes;
+	UINT64 Alignment;
+};
+
+enum D3D12_RESIDENCY_PRIORITY {
+	D3D12_RESIDENCY_PRIORITY_MINIMUM = 0x28000000,
+	D3D12_RESIDENCY_PRIORITY_LOW = 0x50000000,
+	D3D12_RESIDENCY_PRIORITY_NORMAL = 0x78000000,
+	D3D12_RESIDENCY_PRIORITY_HIGH = (int)0xa0010000,
+	D3D12_RESIDENCY_PRIORITY_MAXIMUM = (int)0xc8000000,
+};
+
+struct ID3D12Object : IUnknown {
+	virtual HRESULT SetName(LPCWSTR name) = 0;
+};
+
+struct ID3D12DeviceChild : ID3D12Object {};
+struct ID3D12Pageable : ID3D12DeviceChild {};
+
+struct ID3D12Resource : ID3D12Pageable {
+	virtual D3D12_RESOURCE_DESC GetDesc() = 0;
+	virtual D3D12_GPU_VIRTUAL_ADDRESS GetGPUVirtualAddress() = 0;
+	virtual HRESULT GetHeapProperties(D3D12_HEAP_PROPERTIES* properties, D3D12_HEAP_FLAGS* flags) = 0;
+};
+
+struct ID3D12Device : ID3D12Object {
+	virtual D3D12_RESOURCE_ALLOCATION_INFO GetResourceAllocationInfo(UINT visibleMask, UINT count, const D3D12_RESOURCE_DESC* descs) = 0;
+	virtual HRESULT MakeResident(UINT count, ID3D12Pageable* const* objects) = 0;
+	virtual HRESULT Evict(UINT count, ID3D12Pageable* const* objects) = 0;
+	virtual LUID GetAdapterLuid() = 0;
+};
+
+struct ID3D12Device1 : ID3D12Device {
+	virtual HRESULT SetResidencyPriority(UINT count, ID3D12Pageable* const* objects, const D3D12_RESIDENCY_PRIORITY* priorities) = 0;
+};
+
+struct ID3D12RootSignature : ID3D12DeviceChild {};
+
+// Pipeline state descriptions, field for field as in the SDK
+
+#define D3D12_SIMULTANEOUS_RENDER_TARGET_COUNT 8
+#define D3D12_DEFAULT_SAMPLE_MASK 0xffffffff
+
+struct D3D12_SHADER_BYTECODE {
+	const void* pShaderBytecode;
+	SIZE_T BytecodeLength;
+};
+
+struct D3D12_SO_DECLARATION_ENTRY {
+	UINT Stream;
+	LPCSTR SemanticName;
+	UINT SemanticIndex;
+	BYTE StartComponent;
+	BYTE ComponentCount;
+	BYTE OutputSlot;
+};
+
+struct D3D12_STREAM_OUTPUT_DESC {
+	const D3D12_SO_DECLARATION_ENTRY* pSODeclaration;
+	UINT NumEntries;
+	const UINT* pBufferStrides;
+	UINT NumStrides;
+	UINT RasterizedStream;
+};
+
+enum D3D12_BLEND {
+	D3D12_BLEND_ZERO = 1,
+	D3D12_BLEND_ONE = 2,
+	D3D12_BLEND_SRC_ALPHA = 5,
+	D3D12_BLEND_INV_SRC_ALPHA = 6,
+};
+
+enum D3D12_BLEND_OP {
+	D3D12_BLEND_OP_ADD = 1,
+	D3D12_BLEND_OP_SUBTRACT = 2,
+};
+
+enum D3D12_LOGIC_OP {
+	D3D12_LOGIC_OP_CLEAR = 0,
+	D3D12_LOGIC_OP_NOOP = 4,
+};
+
+enum D3D12_COLOR_WRITE_ENABLE {
+	D3D12_COLOR_WRITE_ENABLE_RED = 1,
+	D3D12_COLOR_WRITE_ENABLE_ALL = 15,
+};
+
+struct D3D12_RENDER_TARGET_BLEND_DESC {
+	BOOL BlendEnable;
+	BOOL LogicOpEnable;
+	D3D12_BLEND SrcBlend;
+	D3D12_BLEND DestBlend;
+	D3D12_BLEND_OP BlendOp;
+	D3D12_BLEND SrcBlendAlpha;
+	D3D12_BLEND DestBlendAlpha;
+	D3D12_BLEND_OP BlendOpAlpha;
+	D3D12_LOGIC_OP LogicOp;
+	UINT8 RenderTargetWriteMask;
+};
+
+struct D3D12_BLEND_DESC {
+	BOOL AlphaToCoverageEnable;
+	BOOL IndependentBlendEnable;
+	D3D12_RENDER_TARGET_BLEND_DESC RenderTarget[D3D12_SIMULTANEOUS_RENDER_TARGET_COUNT];
+};
+
+enum D3D12_FILL_MODE {
+	D3D12_FILL_MODE_WIREFRAME = 2,
+	D3D12_FILL_MODE_SOLID = 3,
+};
+
+enum D3D12_CULL_MODE {
+	D3D12_CULL_MODE_NONE = 1,
+	D3D12_CULL_MODE_FRONT = 2,
+	D3D12_CULL_MODE_BACK = 3,
+};
+
+enum D3D12_CONSERVATIVE_RASTERIZATION_MODE {
+	D3D12_CONSERVATIVE_RASTERIZATION_MODE_OFF = 0,
+	D3D12_CONSERVATIVE_RASTERIZATION_MODE_ON = 1,
+};
+
+struct D3D12_RASTERIZER_DESC {
+	D3D12_FILL_MODE FillMode;
+	D3D12_CULL_MODE CullMode;
+	BOOL FrontCounterClockwise;
+	INT DepthBias;
+	FLOAT DepthBiasClamp;
+	FLOAT SlopeScaledDepthBias;
+	BOOL DepthClipEnable;
+	BOOL MultisampleEnable;
+	BOOL AntialiasedLineEnable;
+	UINT ForcedSampleCount;
+	D3D12_CONSERVATIVE_RASTERIZATION_MODE ConservativeRaster;
+};
+
+enum D3D12_DEPTH_WRITE_MASK {
+	D3D12_DEPTH_WRITE_MASK_ZERO = 0,
+	D3D12_DEPTH_WRITE_MASK_ALL = 1,
+};
+
+enum D3D12_COMPARISON_FUNC {
+	D3D12_COMPARISON_FUNC_NEVER = 1,
+	D3D12_COMPARISON_FUNC_LESS = 2,
+	D3D12_COMPARISON_FUNC_LESS_EQUAL = 4,
+	D3D12_COMPARISON_FUNC_ALWAYS = 8,
+};
+
+enum D3D12_STENCIL_OP {
+	D3D12_STENCIL_OP_KEEP = 1,
+	D3D12_STENCIL_OP_REPLACE = 3,
+};
+
+struct D3D12_DEPTH_STENCILOP_DESC {
+	D3D12_STENCIL_OP StencilFailOp;
+	D3D12_STENCIL_OP StencilDepthFailOp;
+	D3D12_STENCIL_OP StencilPassOp;
+	D3D12_COMPARISON_FUNC StencilFunc;
+};
+
+struct D3D12_DEPTH_STENCIL_DESC {
+	BOOL DepthEnable;
+	D3D12_DEPTH_WRITE_MASK DepthWriteMask;
+	D3D12_COMPARISON_FUNC DepthFunc;
+	BOOL StencilEnable;
+	UINT8 StencilReadMask;
+	UINT8 StencilWriteMask;
+	D3D12_DEPTH_STENCILOP_DESC FrontFace;
+	D3D12_DEPTH_STENCILOP_DESC BackFace;
+};
+
+enum D3D12_INPUT_CLASSIFICATION {
+	D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA = 0,
+	D3D12_INPUT_CLASSIFICATION_PER_INSTANCE_DATA = 1,
+};
+
+struct D3D12_INPUT_ELEMENT_DESC {
+	LPCSTR SemanticName;
+	UINT SemanticIndex;
+	DXGI_FORMAT Format;
+	UINT InputSlot;
+	UINT AlignedByteOffset;
+	D3D12_INPUT_CLASSIFICATION InputSlotClass;
+	UINT InstanceDataStepRate;
+};
+
+struct D3D12_INPUT_LAYOUT_DESC {
+	const D3D12_INPUT_ELEMENT_DESC* pInputElementDescs;
+	UINT NumElements;
+};
+
+enum D3D12_INDEX_BUFFER_STRIP_CUT_VALUE {
+	D3D12_INDEX_BUFFER_STRIP_CUT_VALUE_DISABLED = 0,
+	D3D12_INDEX_BUFFER_STRIP_CUT_VALUE_0xFFFF = 1,
+	D3D12_INDEX_BUFFER_STRIP_CUT_VALUE_0xFFFFFFFF = 2,
+};
+
+enum D3D12_PRIMITIVE_TOPOLOGY_TYPE {
+	D3D12_PRIMITIVE_TOPOLOGY_TYPE_UNDEFINED = 0,
+	D3D12_PRIMITIVE_TOPOLOGY_TYPE_POINT = 1,
+	D3D12_PRIMITIVE_TOPOLOGY_TYPE_LINE = 2,
+	D3D12_PRIMITIVE_TOPOLOGY_TYPE_TRIANGLE = 3,
+};
+
+struct D3D12_CACHED_PIPELINE_STATE {
+	const void* pCachedBlob;
+	SIZE_T CachedBlobSizeInBytes;
+};
+
+enum D3D12_PIPELINE_STATE_FLAGS {
+	D3D12_PIPELINE_STATE_FLAG_NONE = 0,
+	D3D12_PIPELINE_STATE_FLAG_TOOL_DEBUG = 1,
+};
+
+struct D3D12_GRAPHICS_PIPELINE_STATE_DESC {
+	ID3D12RootSignature* pRootSignature;
+	D3D12_SHADER_BYTECODE VS;
+	D3D12_SHADER_BYTECODE PS;
+	D3D12_SHADER_BYTECODE DS;
+	D3D12_SHADER_BYTECODE HS;
+	D3D12_SHADER_BYTECODE GS;
+	D3D12_STREAM_OUTPUT_DESC StreamOutput;
+	D3D12_BLEND_DESC BlendState;
+	UINT SampleMask;
+	D3D12_RASTERIZER_DESC RasterizerState;
+	D3D12_DEPTH_STENCIL_DESC DepthStencilState;
+	D3D12_INPUT_LAYOUT_DESC InputLayout;
+	D3D12_INDEX_BUFFER_STRIP_CUT_VALUE IBStripCutValue;
+	D3D12_PRIMITIVE_TOPOLOGY_TYPE PrimitiveTopologyType;
+	UINT NumRenderTargets;
+	DXGI_FORMAT RTVFormats[8];
+	DXGI_FORMAT DSVFormat;
+	DXGI_SAMPLE_DESC SampleDesc;
+	UINT NodeMask;
+	D3D12_CACHED_PIPELINE_STATE CachedPSO;
+	D3D12_PIPELINE_STATE_FLAGS Flags;
+};
+
+struct D3D12_COMPUTE_PIPELINE_STATE_DESC {
+	ID3D12RootSignature* pRootSignature;
+	D3D12_SHADER_BYTECODE CS;
+	UINT NodeMask;
+	D3D12_CACHED_PIPELINE_STATE CachedPSO;
+	D3D12_PIPELINE_STATE_FLAGS Flags;
+};
@@ -0,0 +1,29 @@
+#pragma once
+#include <windows.h>
+#include <dxgiformat.h>
+
+enum DXGI_MEMORY_SEGMENT_GROUP {
+	DXGI_MEMORY_SEGMENT_GROUP_LOCAL = 0,
+	DXGI_MEMORY_SEGMENT_GROUP_NON_LOCAL = 1,
+};
+
+struct DXGI_QUERY_VIDEO_MEMORY_INFO {
+	UINT64 Budget;
+	UINT64 CurrentUsage;
+	UINT64 AvailableForReservation;
+	UINT64 CurrentReservation;
+};
+
+struct IDXGIAdapter3 : IUnknown {
+	virtual HRESULT QueryVideoMemoryInfo(UINT nodeIndex, DXGI_MEMORY_SEGMENT_GROUP group, DXGI_QUERY_VIDEO_MEMORY_INFO* info) = 0;
+};
+
+struct IDXGIFactory4 : IUnknown {
+	virtual HRESULT EnumAdapterByLuid(LUID luid, REFIID riid, void** adapter) = 0;
+};
+
+// There is no adapter to query, budgets come from the tests
+inline HRESULT CreateDXGIFactory1(REFIID, void** factory) {
+	*factory = nullptr;
+	return E_NOINTERFACE;
+}
@@ -0,0 +1,153 @@
+#pragma once
+// Stand-in for the parts of the Windows SDK the tested sources use
+#include <cstddef>
+#include <cstdint>
+#include <cwchar>
+
+typedef int BOOL;
+typedef int INT;
+typedef unsigned int UINT;
+typedef uint8_t BYTE;
+typedef uint8_t UINT8;
+typedef uint16_t UINT16;
+typedef uint32_t UINT32;
+typedef uint64_t UINT64;
+typedef int32_t INT32;
+typedef int64_t INT64;
+typedef float FLOAT;
+typedef uint32_t DWORD;
+typedef uint32_t ULONG;
+typedef int32_t LONG;
+typedef int32_t HRESULT;
+typedef size_t SIZE_T;
+typedef const char* LPCSTR;
+typedef const wchar_t* LPCWSTR;
+typedef wchar_t WCHAR;
+typedef void* HANDLE;
+
+#ifndef TRUE
+#define TRUE 1
+#define FALSE 0
+#endif
+
+#define S_OK ((HRESULT)0)
+#define E_FAIL ((HRESULT)0x80004005)
+#define E_NOINTERFACE ((HRESULT)0x80004002)
+#define SUCCEEDED(hr) (((HRESULT)(hr)) >= 0)
+#define FAILED(hr) (((HRESULT)(hr)) < 0)
+
+#ifndef _countof
+#define _countof(array) (sizeof(array) / sizeof((array)[0]))
+#endif
+
+struct LUID {
+	DWORD LowPart;
+	LONG HighPart;
+};
+
+struct GUID {
+	uint32_t data[4];
+};
+typedef GUID IID;
+typedef const IID& REFIID;
+
+// Interfaces are queried by type here, never by GUID
+#define IID_PPV_ARGS(pp) IID{}, reinterpret_cast<void**>(pp)
+
+struct IUnknown {
+	virtual ~IUnknown() {}
+	virtual HRESULT QueryInterface(REFIID riid, void** object) = 0;
+	virtual ULONG AddRef() = 0;
+	virtual ULONG Release() = 0;
+};
+
+inline void OutputDebugStringW(LPCWSTR) {}
+#define OutputDebugString OutputDebugStringW
+
+// Files, backed by POSIX descriptors and mappings. Only the read-only uses of the
+// samples are covered.
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <map>
+#include <string>
+
+struct LARGE_INTEGER {
+	INT64 QuadPart;
+};
+
+#define INVALID_HANDLE_VALUE (reinterpret_cast<HANDLE>(static_cast<intptr_t>(-1)))
+#define GENERIC_READ 0x80000000
+#define FILE_SHARE_READ 0x1
+#define OPEN_EXISTING 3
+#define FILE_ATTRIBUTE_NORMAL 0x80
+#define FILE_FLAG_SEQUENTIAL_SCAN 0x08000000
+#define PAGE_READONLY 0x2
+#define FILE_MAP_READ 0x4
+
+namespace platform {
+
+struct FileHandle {
+	int fd;
+	bool mapping; // shares the descriptor of its file
+};
+
+// Test paths are plain ASCII
+inline std::string NarrowPath(const std::wstring& path) {
+	return std::string(path.begin(), path.end());
+}
+
+inline std::map<const void*, size_t>& MappedViews() {
+	static std::map<const void*, size_t> views;
+	return views;
+}
+
+inline int Descriptor(HANDLE handle) {
+	return static_cast<FileHandle*>(handle)->fd;
+}
+
+}
+
+inline HANDLE CreateFileW(LPCWSTR fileName, DWORD, DWORD, void*, DWORD, DWORD, HANDLE) {
+	int fd = open(platform::NarrowPath(fileName).c_str(), O_RDONLY);
+	if (fd < 0) return INVALID_HANDLE_VALUE;
+	return new platform::FileHandle{ fd, false };
+}
+
+inline BOOL GetFileSizeEx(HANDLE file, LARGE_INTEGER* size) {
+	struct stat status;
+	if (fstat(platform::Descriptor(file), &status) != 0) return FALSE;
+	size->QuadPart = static_cast<INT64>(status.st_size);
+	return TRUE;
+}
+
+inline HANDLE CreateFileMappingW(HANDLE file, void*, DWORD, DWORD, DWORD, LPCWSTR) {
+	return new platform::FileHandle{ platform::Descriptor(file), true };
+}
+
+inline void* MapViewOfFile(HANDLE mapping, DWORD, DWORD, DWORD, SIZE_T) {
+	struct stat status;
+	if (fstat(platform::Descriptor(mapping), &status) != 0 || status.st_size == 0) return nullptr;
+	size_t size = static_cast<size_t>(status.st_size);
+	void* view = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, platform::Descriptor(mapping), 0);
+	if (view == MAP_FAILED) return nullptr;
+	platform::MappedViews()[view] = size;
+	return view;
+}
+
+inline BOOL UnmapViewOfFile(const void* view) {
+	auto entry = platform::MappedViews().find(view);
+	if (entry == platform::MappedViews().end()) return FALSE;
+	munmap(const_cast<void*>(view), entry->second);
+	platform::MappedViews().erase(entry);
+	return TRUE;
+}
+
+inline BOOL CloseHandle(HANDLE handle) {
+	platform::FileHandle* file = static_cast<platform::FileHandle*>(handle);
+	if (!file->mapping) close(file->fd);
+	delete file;
+	return TRUE;
+}
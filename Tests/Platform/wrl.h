@@ -0,0 +1,46 @@
+#pragma once
+#include <windows.h>
+
+namespace Microsoft {
+namespace WRL {
+
+// Reference counting of COM interfaces, the members the tested sources use
+template <typename T>
+class ComPtr {
+
+public:
+	ComPtr() {}
+	ComPtr(T* pointer) : m_pointer(pointer) { AddRef(); }
+	ComPtr(const ComPtr& other) : m_pointer(other.m_pointer) { AddRef(); }
+	~ComPtr() { Release(); }
+
+	ComPtr& operator=(T* pointer) {
+		if (pointer) pointer->AddRef();
+		Release();
+		m_pointer = pointer;
+		return *this;
+	}
+	ComPtr& operator=(const ComPtr& other) { return *this = other.m_pointer; }
+	ComPtr& operator=(std::nullptr_t) { Release(); return *this; }
+
+	T* Get() const { return m_pointer; }
+	T* operator->() const { return m_pointer; }
+	explicit operator bool() const { return m_pointer != nullptr; }
+	T** GetAddressOf() { return &m_pointer; }
+	T** ReleaseAndGetAddressOf() { Release(); return &m_pointer; }
+	T** operator&() { return ReleaseAndGetAddressOf(); }
+	void Reset() { Release(); }
+
+private:
+	void AddRef() { if (m_pointer) m_pointer->AddRef(); }
+	void Release() {
+		T* pointer = m_pointer;
+		m_pointer = nullptr;
+		if (pointer) pointer->Release();
+	}
+
+	T* m_pointer = nullptr;
+};
+
+}
+}
@@ -0,0 +1,107 @@
+#include "TestHarness.h"
+
+#include "ResolutionController.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+const uint32_t FramesInFlight = 3;
+
+// Records `frames` frames round-robin over the contexts, each traced at the scale
+// the controller picked for it. Returns the largest scale change between frames.
+float Run(ResolutionController& controller, SyntheticTimingSource& source, uint32_t frames, uint32_t* frame) {
+	float largestStep = 0.0f;
+	for (uint32_t i = 0; i < frames; i++, (*frame)++) {
+		uint32_t context = *frame % FramesInFlight;
+		float previous = controller.GetScale();
+		float scale = controller.Update(context);
+		largestStep = (std::max)(largestStep, std::fabs(scale - previous));
+		source.Submit(context, scale);
+	}
+	return largestStep;
+}
+
+}
+
+TEST(ResolutionStaysAtFullScaleUnderBudget) {
+	SyntheticTimingSource source(1.0, 5.0);
+	ResolutionController controller(&source);
+	uint32_t frame = 0;
+
+	Run(controller, source, 60, &frame);
+	CHECK(controller.GetScale() == 1.0f);
+}
+
+TEST(ResolutionConvergesToTheBudget) {
+	// 40 ms at full scale against a 16.7 ms target: the scale settles near sqrt(0.9 * 16.7 / 40)
+	SyntheticTimingSource source(0.0, 40.0);
+	ResolutionController controller(&source);
+	uint32_t frame = 0;
+
+	float largestStep = Run(controller, source, 120, &frame);
+	double expected = std::sqrt(0.9 * controller.GetTargetFrameTime() / 40.0);
+	CHECK(std::fabs(controller.GetScale() - expected) < 0.03);
+	CHECK(controller.GetLastFrameTime() <= controller.GetTargetFrameTime());
+	CHECK(largestStep <= 0.1f + 1e-5f);
+
+	// Settled: no more changes once inside the dead band
+	float settled = controller.GetScale();
+	Run(controller, source, 30, &frame);
+	CHECK(controller.GetScale() == settled);
+}
+
+TEST(ResolutionRecoversAfterASpike) {
+	SyntheticTimingSource source(2.0, 12.0);
+	ResolutionController controller(&source);
+	uint32_t frame = 0;
+
+	Run(controller, source, 30, &frame);
+	CHECK(controller.GetScale() == 1.0f);
+
+	source.SetLoad(2.5);
+	Run(controller, source, 60, &frame);
+	CHECK(controller.GetScale() < 0.8f);
+	CHECK(controller.GetLastFrameTime() <= controller.GetTargetFrameTime());
+
+	source.SetLoad(1.0);
+	Run(controller, source, 60, &frame);
+	CHECK(controller.GetScale() == 1.0f);
+}
+
+TEST(ResolutionClampsToTheScaleRange) {
+	SyntheticTimingSource source(0.0, 400.0);
+	ResolutionController controller(&source);
+	controller.SetScaleRange(0.5f, 0.9f);
+	CHECK(controller.GetScale() == 0.9f);
+	uint32_t frame = 0;
+
+	Run(controller, source, 60, &frame);
+	CHECK(controller.GetScale() == 0.5f);
+
+	// Inverted ranges collapse to the lower bound
+	controller.SetScaleRange(0.7f, 0.6f);
+	CHECK(controller.GetScale() == 0.6f);
+	CHECK(controller.GetMaxScale() == 0.6f);
+}
+
+TEST(ResolutionDispatchSizeKeepsFullTiles) {
+	ResolutionController controller(nullptr);
+	controller.SetScaleRange(0.5f, 1.0f);
+
+	uint32_t width = 0;
+	uint32_t height = 0;
+	controller.GetDispatchSize(1920, 1080, &width, &height);
+	CHECK(width == 1920);
+	CHECK(height == 1080);
+
+	SyntheticTimingSource source(0.0, 200.0);
+	ResolutionController scaled(&source);
+	uint32_t frame = 0;
+	Run(scaled, source, 60, &frame);
+	scaled.GetDispatchSize(1366, 766, &width, &height);
+	CHECK(width % 8 == 0 && height % 8 == 0);
+	CHECK(width < 1366 && height < 766);
+	CHECK(width >= 8 && height >= 8);
+}
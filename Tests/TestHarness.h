@@ -0,0 +1,24 @@
+#pragma once
+#include <vector>
+
+// A test is a function registered with TEST. A failed CHECK reports the expression
+// and the test carries on, so one run lists every failure.
+struct TestCase {
+	const char* name;
+	void (*run)();
+};
+
+std::vector<TestCase>& GetTests();
+void ReportFailure(const char* file, int line, const char* expression);
+
+struct TestRegistration {
+	TestRegistration(const char* name, void (*run)()) { GetTests().push_back({ name, run }); }
+};
+
+#define TEST(name) \
+	static void name(); \
+	static TestRegistration name##Registration(#name, name); \
+	static void name()
+
+#define CHECK(expression) \
+	do { if (!(expression)) ReportFailure(__FILE__, __LINE__, #expression); } while (0)
@@ -0,0 +1,33 @@
+#include "TestHarness.h"
+
+#include <cstdio>
+#include <cstring>
+
+static int g_failures = 0;
+
+std::vector<TestCase>& GetTests() {
+    static std::vector<TestCase> tests;
+    return tests;
+}
+
+void ReportFailure(const char* file, int line, const char* expression) {
+    std::printf("  %s:%d: CHECK(%s) failed\n", file, line, expression);
+    g_failures++;
+}
+
+// Runs every test, or the ones whose name contains the first argument
+int main(int argc, char** argv) {
+    const char* filter = argc > 1 ? argv[1] : nullptr;
+    int run = 0;
+    int failed = 0;
+    for (const TestCase& test : GetTests()) {
+        if (filter && !std::strstr(test.name, filter)) continue;
+        int before = g_failures;
+        std::printf("%s\n", test.name);
+        test.run();
+        run++;
+        if (g_failures != before) failed++;
+    }
+    std::printf("%d tests, %d failed\n", run, failed);
+    return failed ? 1 : 0;
+}
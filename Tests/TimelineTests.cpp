@@ -0,0 +1,115 @@
+#include "TestHarness.h"
+
+#include "Timeline.h"
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+namespace {
+
+// Polls `condition` for up to a second, callbacks run on the timeline worker
+template<typename Condition>
+bool Eventually(Condition condition) {
+	auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+	while (!condition()) {
+		if (std::chrono::steady_clock::now() > deadline) return false;
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+	return true;
+}
+
+}
+
+TEST(TimelineSignalsMonotonicValuesPerQueue) {
+	MockFenceBackend backend(2);
+	Timeline timeline(&backend);
+
+	CHECK(timeline.Signal(0).value == 1);
+	CHECK(timeline.Signal(0).value == 2);
+	CHECK(timeline.Signal(1).value == 1);
+	CHECK(timeline.GetLastSignaled(0).value == 2);
+	CHECK(timeline.GetLastSignaled(1).value == 1);
+	CHECK(backend.GetSignaledValue(0) == 2);
+}
+
+TEST(TimelineIsCompleteFollowsTheBackend) {
+	MockFenceBackend backend(1);
+	Timeline timeline(&backend);
+
+	TimelinePoint first = timeline.Signal(0);
+	TimelinePoint second = timeline.Signal(0);
+	CHECK(!timeline.IsComplete(first));
+
+	backend.Complete(0, first.value);
+	CHECK(timeline.IsComplete(first));
+	CHECK(!timeline.IsComplete(second));
+	CHECK(timeline.GetCompletedValue(0) == first.value);
+}
+
+TEST(TimelineWaitAnyReturnsTheCompletedPoint) {
+	MockFenceBackend backend(2);
+	Timeline timeline(&backend);
+
+	std::vector<TimelinePoint> points = { timeline.Signal(0), timeline.Signal(1) };
+	CHECK(timeline.WaitAny(points, 1) == -1);
+
+	std::thread gpu([&]() { backend.Complete(1, 1); });
+	CHECK(timeline.WaitAny(points) == 1);
+	gpu.join();
+}
+
+TEST(TimelineWaitAllNeedsEveryPoint) {
+	MockFenceBackend backend(2);
+	Timeline timeline(&backend);
+
+	std::vector<TimelinePoint> points = { timeline.Signal(0), timeline.Signal(1) };
+	backend.Complete(0, 1);
+	CHECK(!timeline.WaitAll(points, 1));
+
+	std::thread gpu([&]() { backend.Complete(1, 1); });
+	CHECK(timeline.WaitAll(points));
+	gpu.join();
+	CHECK(timeline.WaitAll({}));
+}
+
+TEST(TimelineCallbacksRunOnceTheirPointCompleted) {
+	MockFenceBackend backend(1);
+	Timeline timeline(&backend);
+
+	TimelinePoint first = timeline.Signal(0);
+	TimelinePoint second = timeline.Signal(0);
+	std::atomic<int> order(0);
+	std::atomic<int> firstRan(0);
+	std::atomic<int> secondRan(0);
+	timeline.OnComplete(second, [&]() { secondRan = ++order; });
+	timeline.OnComplete(first, [&]() { firstRan = ++order; });
+
+	backend.Complete(0, first.value);
+	CHECK(Eventually([&]() { return firstRan != 0; }));
+	CHECK(secondRan == 0);
+
+	backend.Complete(0, second.value);
+	timeline.Flush();
+	CHECK(firstRan == 1);
+	CHECK(secondRan == 2);
+}
+
+TEST(TimelineCallbackOnACompletedPointRuns) {
+	MockFenceBackend backend(1, true);
+	Timeline timeline(&backend);
+
+	std::atomic<bool> ran(false);
+	timeline.OnComplete(timeline.Signal(0), [&]() { ran = true; });
+	timeline.Flush();
+	CHECK(ran);
+}
+
+TEST(TimelineDestructionDoesNotHang) {
+	// Repeated so a wake-up lost between the worker's check and its sleep shows up as a hang
+	MockFenceBackend backend(1);
+	for (int i = 0; i < 2000; i++) {
+		Timeline timeline(&backend);
+	}
+	CHECK(true);
+}